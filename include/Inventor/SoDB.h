@@ -102,6 +102,8 @@ public:
   static void startNotify(void);
   static SbBool isNotifying(void);
   static void endNotify(void);
+  static void enableNotifyBatching(const SbBool on);
+  static SbBool isNotifyBatchingEnabled(void);
 
   typedef SbBool ProgressCallbackType(const SbName & itemid, float fraction,
                                       SbBool interruptible, void * userdata);
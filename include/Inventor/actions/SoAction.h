@@ -94,6 +94,9 @@ public:
   void apply(SoAction * beingApplied);
   virtual void invalidateState(void);
 
+  void setParallelTraversal(const SbBool onoff);
+  SbBool isParallelTraversal(void) const;
+
   static void nullAction(SoAction * action, SoNode * node);
 
   AppliedCode getWhatAppliedTo(void) const;
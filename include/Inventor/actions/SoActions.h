@@ -50,6 +50,8 @@
 #include <Inventor/collision/SoIntersectionDetectionAction.h>
 #include <Inventor/actions/SoSimplifyAction.h>
 #include <Inventor/actions/SoReorganizeAction.h>
+#include <Inventor/actions/SoShapeSimplifyAction.h>
+#include <Inventor/actions/SoGlobalSimplifyAction.h>
 #include <Inventor/actions/SoToVRMLAction.h>
 #include <Inventor/actions/SoToVRML2Action.h>
 
@@ -33,13 +33,10 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 \**************************************************************************/
 
-// FIXME: this class has not yet been implemented in Coin. this is a
-// placeholder / stub / skeleton code, not yet built (nor installed,
-// obviously).  --mortene.
-
 #include <Inventor/actions/SoSimplifyAction.h>
 #include <Inventor/tools/SbLazyPimplPtr.h>
 
+class SoSeparator;
 class SoGlobalSimplifyActionP;
 
 class COIN_DLL_API SoGlobalSimplifyAction : public SoSimplifyAction {
@@ -53,6 +50,12 @@ public:
   SoGlobalSimplifyAction(void);
   virtual ~SoGlobalSimplifyAction(void);
 
+  virtual void apply(SoNode * root);
+  virtual void apply(SoPath * path);
+  virtual void apply(const SoPathList & pathlist, SbBool obeysrules = FALSE);
+
+  SoSeparator * getSimplifiedSceneGraph(void) const;
+
 protected:
   virtual void beginTraversal(SoNode * node);
 
@@ -53,6 +53,9 @@ public:
 
   SoOutput * getOutput(void) const;
 
+  void setSnapshot(const SbBool onoff);
+  SbBool isSnapshot(void) const;
+
   void continueToApply(SoNode * node);
   void continueToApply(SoPath * path);
 
@@ -44,6 +44,7 @@ class SoPrimitiveVertexCacheP;
 class SoPrimitiveVertex;
 class SoPointDetail;
 class SoState;
+class SoTextureCoordinateBundle;
 
 class COIN_DLL_API SoPrimitiveVertexCache : public SoCache {
   typedef SoCache inherited;
@@ -72,6 +73,16 @@ public:
   void addLine(const SoPrimitiveVertex * v0,
                const SoPrimitiveVertex * v1);
   void addPoint(const SoPrimitiveVertex * v);
+  void addIndexedTriangles(const int numindices,
+                           const int32_t * coordindices,
+                           const SbVec3f * coords,
+                           const int numcoords,
+                           const int32_t * normalindices,
+                           const SbVec3f * normals,
+                           const int numnormals,
+                           const int32_t * texcoordindices,
+                           SoTextureCoordinateBundle * texcoordbundle,
+                           const int32_t * materialindices);
 
   int getNumVertices(void) const;
   const SbVec3f * getVertexArray(void) const;
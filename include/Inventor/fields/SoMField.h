@@ -90,6 +90,7 @@ private:
   virtual void write1Value(SoOutput * out, int idx) const = 0;
   virtual SbBool readBinaryValues(SoInput * in, int num);
   virtual void writeBinaryValues(SoOutput * out) const;
+  SbBool readSnapshotValues(SoInput * in, int num, int numbersize);
   virtual int getNumValuesPerLine(void) const;
 
   static SoType classTypeId;
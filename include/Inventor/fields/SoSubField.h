@@ -472,7 +472,7 @@ _class_::allocValues(int newnum) \
         for (i=0; i < SbMin(this->num, newnum); i++) \
           newblock[i] = this->values[i]; \
  \
-        delete[] this->values; /* don't fetch pointer through valuesPtr() (avoids void* cast) */ \
+        if (!this->userDataIsUsed) delete[] this->values; /* don't fetch pointer through valuesPtr() (avoids void* cast) */ \
         this->setValuesPtr(newblock); \
         this->userDataIsUsed = FALSE; \
       } \
@@ -47,6 +47,13 @@
 // ubiquitous within the system.
 //
 //  -mortene
+//
+// SoBase now keeps its auditors in a tree, but SoAuditorList is still
+// embedded in the extended storage of every connected SoField, so
+// the note above still applies. The auditor index used for large
+// lists is kept on the side for this reason.
+
+class SoAuditorListIndex;
 
 
 class COIN_DLL_API SoAuditorList : private SbPList {
@@ -95,6 +102,15 @@ private:
 
   void doNotify(SoNotList * l, const void * auditor, const SoNotRec::Type type);
 
+  SoAuditorListIndex * getIndex(void) const;
+  void buildIndex(void);
+  void dropIndex(void);
+  void compactEntries(SoAuditorListIndex * index);
+  void compact(void);
+  int position(const int index) const;
+  SoNotRec::Type getEntryType(const int pos) const;
+  void removeEntry(const int pos);
+
 };
 
 #endif // !COIN_SOAUDITORLIST_H
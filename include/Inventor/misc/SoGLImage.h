@@ -190,6 +190,11 @@ public:
   static void setDisplayListMaxAge(const uint32_t maxage);
   static void freeAllImages(SoState * state = NULL);
 
+  static void setTextureMemoryBudget(const size_t numbytes);
+  static size_t getTextureMemoryBudget(void);
+  static size_t getResidentTextureMemory(void);
+  size_t getResidentMemory(void) const;
+
   void setEndFrameCallback(void (*cb)(void *), void * closure);
   int getNumFramesSinceUsed(void) const;
 
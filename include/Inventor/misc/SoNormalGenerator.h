@@ -34,7 +34,6 @@
 \**************************************************************************/
 
 #include <Inventor/SbVec3f.h>
-#include <Inventor/SbBSPTree.h>
 #include <Inventor/lists/SbList.h>
 #include <Inventor/system/inttypes.h>
 
@@ -74,8 +73,7 @@ public:
   void setNormal(const int32_t index, const SbVec3f &normal);
 
 private:
-  SbBSPTree bsp;
-  SbList <int> vertexList;
+  SbList <SbVec3f> vertexCoords;
   SbList <int> vertexFace;
   SbList <SbVec3f> faceNormals;
   SbList <SbVec3f> vertexNormals;
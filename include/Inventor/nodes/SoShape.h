@@ -151,11 +151,13 @@ protected:
                          const SbBool colorpervertex);
 private:
   class SoShapeP * pimpl;
-  void validatePVCache(SoGLRenderAction * action);
+  void validatePVCache(SoAction * action);
+  void prebuildPVCache(SoAction * action);
   void getBBox(SoAction * action, SbBox3f & box, SbVec3f & center);
   void rayPickBoundingBox(SoRayPickAction * action);
   friend class soshape_primdata;           // internal class
   friend class so_generate_prim_private;   // a very private class
+  friend class SoGLRenderActionP;          // prebuilds the caches
 };
 
 #endif // !COIN_SOSHAPE_H
@@ -82,6 +82,7 @@ public:
 
   static SbBool readImage(const SbString & fname, int & w, int & h, int & nc,
                           unsigned char *& bytes);
+  static void setAsyncLoading(const SbBool onoff);
 protected:
   virtual ~SoTexture2();
 
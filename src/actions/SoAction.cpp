@@ -344,6 +344,7 @@ SoAction::SoAction(void)
   PRIVATE(this)->applieddata.node = NULL;
   PRIVATE(this)->terminated = FALSE;
   PRIVATE(this)->prevenabledelementscounter = 0;
+  PRIVATE(this)->paralleltraversal = FALSE;
 
   this->currentpath.ref(); // to avoid having a zero refcount instance
 }
@@ -425,6 +426,8 @@ SoAction::initClasses(void)
 
   SoSimplifyAction::initClass();
   SoReorganizeAction::initClass();
+  SoShapeSimplifyAction::initClass();
+  SoGlobalSimplifyAction::initClass();
   SoToVRMLAction::initClass();
 #ifdef HAVE_VRML97
   SoToVRML2Action::initClass();
@@ -825,6 +828,60 @@ SoAction::invalidateState(void)
   this->state = NULL;
 }
 
+/*!
+  Sets whether or not the action should split its traversals into
+  jobs run in parallel on the worker threads. Default value is \c
+  FALSE.
+
+  This is only supported by the actions which just read the scene
+  graph: SoGetBoundingBoxAction, SoRayPickAction, SoSearchAction,
+  SoCallbackAction and SoGetPrimitiveCountAction. Other actions
+  ignore the setting.
+
+  When the action is applied to a node, the children of the group
+  and separator nodes at the top of the scene graph are split into
+  consecutive runs. When it is applied to a path list, the list
+  itself is split. Each run is then traversed as a path list by its
+  own instance of the action, with its own SoState, and the results
+  are combined in traversal order at the end, so that they do not
+  depend on the number of threads. The scene graph must not be
+  changed while the traversal is running.
+
+  As each instance also traverses the nodes leading up to its part
+  of the scene graph, SoCallbackAction will invoke its pre- and
+  post-callbacks for grouping nodes and nodes changing the traversal
+  state more than once. The callbacks are invoked from several
+  threads at the same time, with the worker instance of the action
+  as argument, so they must be thread safe. The bounding box center
+  point found by SoGetBoundingBoxAction is the center of the
+  bounding box. Traversals which can't be split, like applying the
+  action to a single path, are done as usual.
+
+  Parallel traversals are only done when Coin is built with support
+  for thread safe traversals, and there is more than one worker
+  thread (see the COIN_PARALLEL_NUM_THREADS environment variable).
+
+  \since Coin 4.1
+*/
+void
+SoAction::setParallelTraversal(const SbBool onoff)
+{
+  PRIVATE(this)->paralleltraversal = onoff;
+}
+
+/*!
+  Returns whether or not the action splits its traversals into jobs
+  run in parallel.
+
+  \sa setParallelTraversal()
+  \since Coin 4.1
+*/
+SbBool
+SoAction::isParallelTraversal(void) const
+{
+  return PRIVATE(this)->paralleltraversal;
+}
+
 // *************************************************************************
 
 /*!
@@ -1363,3 +1420,123 @@ SoAction::switchToNodeTraversal(SoNode * node)
 // *************************************************************************
 
 #undef PRIVATE
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/SbBox3f.h>
+#include <Inventor/SoPath.h>
+#include <Inventor/SoPickedPoint.h>
+#include <Inventor/actions/SoGetBoundingBoxAction.h>
+#include <Inventor/actions/SoGetPrimitiveCountAction.h>
+#include <Inventor/actions/SoRayPickAction.h>
+#include <Inventor/actions/SoSearchAction.h>
+#include <Inventor/lists/SoPickedPointList.h>
+#include <Inventor/nodes/SoCube.h>
+#include <Inventor/nodes/SoGroup.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoTranslation.h>
+
+// A scene graph with groups changing the traversal state for their
+// siblings, so that the jobs of a parallel traversal depend on the
+// nodes leading up to their part of the scene graph.
+static SoSeparator *
+parallel_scene(void)
+{
+  SoSeparator * root = new SoSeparator;
+  for (int i = 0; i < 20; i++) {
+    SoGroup * group = new SoGroup;
+    SoTranslation * shift = new SoTranslation;
+    shift->translation.setValue(0.05f, 0.0f, 0.0f);
+    group->addChild(shift);
+    root->addChild(group);
+    for (int j = 0; j < 10; j++) {
+      SoSeparator * sep = new SoSeparator;
+      SoTranslation * t = new SoTranslation;
+      t->translation.setValue(0.0f, float(j), -3.0f * float(i));
+      sep->addChild(t);
+      sep->addChild(new SoCube);
+      group->addChild(sep);
+    }
+  }
+  return root;
+}
+
+static SbBool
+parallel_same_paths(const SoPathList & list1, const SoPathList & list2)
+{
+  if (list1.getLength() != list2.getLength()) return FALSE;
+  for (int i = 0; i < list1.getLength(); i++) {
+    if (!(*list1[i] == *list2[i])) return FALSE;
+  }
+  return TRUE;
+}
+
+BOOST_AUTO_TEST_CASE(parallelTraversal)
+{
+  SoSeparator * root = parallel_scene();
+  root->ref();
+  const SbViewportRegion vp(100, 100);
+
+  SoGetBoundingBoxAction bba(vp);
+  bba.apply(root);
+  const SbBox3f box = bba.getBoundingBox();
+  bba.setParallelTraversal(TRUE);
+  bba.apply(root);
+  const SbBox3f parallelbox = bba.getBoundingBox();
+  BOOST_CHECK_MESSAGE((box.getMin() - parallelbox.getMin()).length() < 1e-4f &&
+                      (box.getMax() - parallelbox.getMax()).length() < 1e-4f,
+                      "parallel traversal gave a different bounding box");
+
+  SoGetPrimitiveCountAction pca(vp);
+  pca.apply(root);
+  const int numtris = pca.getTriangleCount();
+  pca.setParallelTraversal(TRUE);
+  pca.apply(root);
+  BOOST_CHECK_EQUAL(pca.getTriangleCount(), numtris);
+  BOOST_CHECK_EQUAL(numtris, 200 * 12);
+
+  const SoType types[] = {
+    SoCube::getClassTypeId(), SoTranslation::getClassTypeId(),
+    SoGroup::getClassTypeId(), SoSeparator::getClassTypeId()
+  };
+  for (int i = 0; i < 4; i++) {
+    SoSearchAction sa;
+    sa.setType(types[i]);
+    sa.setInterest(SoSearchAction::ALL);
+    sa.apply(root);
+    SoPathList paths = sa.getPaths();
+    sa.setParallelTraversal(TRUE);
+    sa.apply(root);
+    BOOST_CHECK_MESSAGE(parallel_same_paths(paths, sa.getPaths()),
+                        "parallel traversal found different paths");
+
+    SoSearchAction::Interest interests[] = { SoSearchAction::FIRST, SoSearchAction::LAST };
+    for (int j = 0; j < 2; j++) {
+      sa.setInterest(interests[j]);
+      sa.apply(root);
+      const SoPath * path = interests[j] == SoSearchAction::FIRST ?
+        paths[0] : paths[paths.getLength() - 1];
+      BOOST_CHECK_MESSAGE(sa.getPath() && (*sa.getPath() == *path),
+                          "parallel traversal found a different path");
+    }
+  }
+
+  SoRayPickAction rpa(vp);
+  rpa.setRay(SbVec3f(0.0f, 0.0f, 10.0f), SbVec3f(0.0f, 0.0f, -1.0f));
+  rpa.setPickAll(TRUE);
+  rpa.apply(root);
+  const int numpicked = rpa.getPickedPointList().getLength();
+  const SbVec3f nearest = rpa.getPickedPoint(0)->getPoint();
+  rpa.setParallelTraversal(TRUE);
+  rpa.apply(root);
+  BOOST_CHECK_EQUAL(rpa.getPickedPointList().getLength(), numpicked);
+  rpa.setPickAll(FALSE);
+  rpa.apply(root);
+  BOOST_CHECK_EQUAL(rpa.getPickedPointList().getLength(), 1);
+  BOOST_CHECK_MESSAGE(rpa.getPickedPoint(0)->getPoint() == nearest,
+                      "parallel traversal picked a different point");
+
+  root->unref();
+}
+
+#endif // COIN_TEST_SUITE
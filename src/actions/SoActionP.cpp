@@ -35,12 +35,20 @@
 
 #include "actions/SoActionP.h"
 
+#include <Inventor/SoFullPath.h>
 #include <Inventor/annex/Profiler/SoProfiler.h>
+#include <Inventor/misc/SoChildList.h>
+#include <Inventor/misc/SoTempPath.h>
+#include <Inventor/nodes/SoGroup.h>
+#include <Inventor/nodes/SoSeparator.h>
 #ifdef HAVE_NODEKITS
 #include <Inventor/annex/Profiler/nodekits/SoProfilerVisualizeKit.h>
 #include <Inventor/annex/Profiler/nodekits/SoProfilerTopKit.h>
 #endif // HAVE_NODEKITS
 
+#include "SbBasicP.h"
+#include "threads/parallelp.h"
+
 // *************************************************************************
 
 SoProfilerStats *
@@ -80,3 +88,188 @@ SoActionP::getProfilerOverlay(void)
 // *************************************************************************
 
 #undef PRIVATE
+
+// *************************************************************************
+
+#ifdef COIN_THREADSAFE
+
+// When splitting the traversal of a node, the scene graph is
+// expanded until there are this many paths per job, so that the
+// work is spread evenly over the jobs.
+static const int SOACTION_PARALLEL_PATHS_PER_JOB = 4;
+
+// Only the children of groups and separators are split between the
+// jobs. Other grouping nodes (switches, LODs, etc) decide during the
+// traversal which of their children to traverse.
+static SbBool
+soaction_parallel_is_expandable(SoNode * node)
+{
+  return
+    ((node->getTypeId() == SoGroup::getClassTypeId()) ||
+     node->isOfType(SoSeparator::getClassTypeId())) &&
+    (node->getChildren()->getLength() > 0);
+}
+
+#endif // COIN_THREADSAFE
+
+SoParallelTraversal::SoParallelTraversal(void)
+  : workers(NULL)
+{
+}
+
+SoParallelTraversal::~SoParallelTraversal()
+{
+  for (int i = 0; i < this->jobs.getLength(); i++) delete this->jobs[i];
+}
+
+//
+// Splits the traversal action is about to do of node into jobs.
+// Returns FALSE if the traversal should be done as usual, which is
+// always the case without support for thread safe traversals.
+//
+SbBool
+SoParallelTraversal::split(SoAction * action, SoNode * node)
+{
+#ifdef COIN_THREADSAFE
+  if (!action->isParallelTraversal()) return FALSE;
+
+  const int numthreads = cc_parallel_get_num_threads();
+  if (numthreads < 2) return FALSE;
+
+  // Several jobs per thread, to even out differences in job size.
+  const int maxjobs = numthreads * 4;
+
+  switch (action->getWhatAppliedTo()) {
+  case SoAction::NODE:
+    {
+      if (!soaction_parallel_is_expandable(node)) return FALSE;
+
+      // Expand one level of the scene graph at a time, so that the
+      // paths stay in traversal order. All the children of an
+      // expanded node get a path, which means that the nodes off the
+      // paths of a job all come before its first path.
+      SoTempPath * head = new SoTempPath(1);
+      head->simpleAppend(node, 0);
+      this->paths.append(head);
+
+      SbBool expanded = TRUE;
+      while (expanded &&
+             (this->paths.getLength() < maxjobs * SOACTION_PARALLEL_PATHS_PER_JOB)) {
+        expanded = FALSE;
+        SoPathList next(this->paths.getLength());
+        for (int i = 0; i < this->paths.getLength(); i++) {
+          SoFullPath * path = reclassify_cast<SoFullPath *>(this->paths[i]);
+          SoNode * tail = path->getTail();
+          if (!soaction_parallel_is_expandable(tail)) {
+            next.append(path);
+            continue;
+          }
+          const int len = path->getLength();
+          const SoChildList * children = tail->getChildren();
+          for (int j = 0; j < children->getLength(); j++) {
+            SoTempPath * child = new SoTempPath(len + 1);
+            for (int k = 0; k < len; k++) {
+              child->simpleAppend(path->getNode(k), path->getIndex(k));
+            }
+            child->simpleAppend((*children)[j], j);
+            next.append(child);
+          }
+          expanded = TRUE;
+        }
+        this->paths = next;
+      }
+    }
+    break;
+  case SoAction::PATH_LIST:
+    this->paths = *action->getPathListAppliedTo();
+    break;
+  default:
+    return FALSE;
+  }
+
+  const int numpaths = this->paths.getLength();
+  const int numjobs = SbMin(maxjobs, numpaths);
+  if (numjobs < 2) return FALSE;
+
+  // Split the paths into consecutive runs of about the same length.
+  // A path list can have paths continuing through the tail of an
+  // earlier path. These are kept in the same job as the earlier
+  // path, as the traversal of the earlier one includes them.
+  const SoPath * top = NULL;
+  for (int i = 0; i < numpaths; i++) {
+    const SoPath * path = this->paths[i];
+    if (top && SoParallelTraversal::isPrefix(top, path)) continue;
+    top = path;
+    const int job = this->firstpath.getLength();
+    if (i >= int((int64_t(numpaths) * job) / numjobs)) {
+      this->firstpath.append(i);
+    }
+  }
+  this->firstpath.append(numpaths);
+  if (this->firstpath.getLength() < 3) return FALSE;
+
+  for (int job = 0; job < this->firstpath.getLength() - 1; job++) {
+    const int start = this->firstpath[job];
+    const int end = this->firstpath[job+1];
+    SoPathList * list = new SoPathList(end - start);
+    for (int i = start; i < end; i++) list->append(this->paths[i]);
+    this->jobs.append(list);
+  }
+  return TRUE;
+#else // !COIN_THREADSAFE
+  return FALSE;
+#endif // !COIN_THREADSAFE
+}
+
+//
+// Applies each of the workers to its job, in parallel.
+//
+void
+SoParallelTraversal::apply(const SbList<SoAction *> & workersarg)
+{
+  assert(workersarg.getLength() == this->jobs.getLength());
+  this->workers = &workersarg;
+  cc_parallel_run(this->jobs.getLength(), SoParallelTraversal::applyJob, this);
+  this->workers = NULL;
+}
+
+void
+SoParallelTraversal::applyJob(void * closure, int job)
+{
+  SoParallelTraversal * thisp = static_cast<SoParallelTraversal *>(closure);
+  (*thisp->workers)[job]->apply(*thisp->jobs[job], TRUE);
+}
+
+//
+// Compares the positions of two paths from the same head node in a
+// depth-first traversal. Returns a negative value if path1 comes
+// first, a positive value if path2 comes first, and 0 if they are
+// equal. A path comes before the paths continuing through its tail.
+//
+int
+SoParallelTraversal::compare(const SoPath * path1, const SoPath * path2)
+{
+  const int len1 = reclassify_cast<const SoFullPath *>(path1)->getLength();
+  const int len2 = reclassify_cast<const SoFullPath *>(path2)->getLength();
+  const int len = SbMin(len1, len2);
+  for (int i = 1; i < len; i++) {
+    const int diff = path1->getIndex(i) - path2->getIndex(i);
+    if (diff != 0) return diff;
+  }
+  return len1 - len2;
+}
+
+//
+// Returns TRUE if path2 continues through the tail of path1, or is
+// equal to it. The paths must have the same head node.
+//
+SbBool
+SoParallelTraversal::isPrefix(const SoPath * path1, const SoPath * path2)
+{
+  const int len = reclassify_cast<const SoFullPath *>(path1)->getLength();
+  if (len > reclassify_cast<const SoFullPath *>(path2)->getLength()) return FALSE;
+  for (int i = 1; i < len; i++) {
+    if (path1->getIndex(i) != path2->getIndex(i)) return FALSE;
+  }
+  return TRUE;
+}
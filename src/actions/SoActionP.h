@@ -45,6 +45,8 @@
 
 #include <Inventor/annex/Profiler/nodes/SoProfilerStats.h>
 #include <Inventor/actions/SoAction.h>
+#include <Inventor/lists/SoPathList.h>
+#include <Inventor/lists/SbList.h>
 
 #ifdef HAVE_NODEKITS
 #include <Inventor/annex/Profiler/nodekits/SoProfilerOverlayKit.h>
@@ -68,9 +70,39 @@ public:
   SbBool terminated;
   SbList <SbList<int> *> pathcodearray;
   int prevenabledelementscounter;
+  SbBool paralleltraversal;
 
   static SoNode * getProfilerOverlay(void);
   static SoProfilerStats * getProfilerStatsNode(void);
 }; // SoActionP
 
+// Splits the traversal of one of the actions which just read the
+// scene graph into jobs, for SoAction::setParallelTraversal(). Each
+// job is a run of consecutive paths from the head node, and is
+// applied to its own instance of the action.
+class SoParallelTraversal {
+public:
+  SoParallelTraversal(void);
+  ~SoParallelTraversal();
+
+  SbBool split(SoAction * action, SoNode * node);
+
+  int getNumJobs(void) const { return this->jobs.getLength(); }
+  const SoPathList & getPaths(void) const { return this->paths; }
+  int getFirstPath(const int job) const { return this->firstpath[job]; }
+
+  void apply(const SbList<SoAction *> & workers);
+
+  static int compare(const SoPath * path1, const SoPath * path2);
+  static SbBool isPrefix(const SoPath * path1, const SoPath * path2);
+
+private:
+  SoPathList paths;
+  SbList<int> firstpath;
+  SbList<SoPathList *> jobs;
+  const SbList<SoAction *> * workers;
+
+  static void applyJob(void * closure, int job);
+}; // SoParallelTraversal
+
 #endif // !COIN_SOACTIONP_H
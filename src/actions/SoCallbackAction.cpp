@@ -219,6 +219,7 @@
 #include <Inventor/nodes/SoShape.h>
 #include <Inventor/SbViewportRegion.h>
 
+#include "actions/SoActionP.h"
 #include "actions/SoSubActionP.h"
 #include "SbBasicP.h"
 
@@ -466,6 +467,27 @@ delete_list_elements(SbList<SoCallbackData *> & cl)
   for (int i = 0; i < n; i++) cl[i]->deleteAll();
 }
 
+static SoCallbackData *
+copy_callback_data(const SoCallbackData * cbdata)
+{
+  SoCallbackData * copy = NULL;
+  while (cbdata) {
+    SoCallbackData * newdata = new SoCallbackData(cbdata->func, cbdata->data);
+    if (copy == NULL) copy = newdata;
+    else copy->append(newdata);
+    cbdata = cbdata->next;
+  }
+  return copy;
+}
+
+static void
+copy_list_elements(const SbList<SoCallbackData *> & cl,
+                   SbList<SoCallbackData *> & copy)
+{
+  int n = cl.getLength();
+  for (int i = 0; i < n; i++) copy.append(copy_callback_data(cl[i]));
+}
+
 /*!
   Destructor.
 */
@@ -1280,6 +1302,33 @@ SoCallbackAction::beginTraversal(SoNode * node)
   // for SoCallbackAction in Inventor, bu we think it should be.
   // It makes it possible to calculate screen space stuff in
   // the callback action callbacks.
+  SoParallelTraversal parallel;
+  if (parallel.split(this, node)) {
+    const int numjobs = parallel.getNumJobs();
+    SbList<SoAction *> workers(numjobs);
+    for (int i = 0; i < numjobs; i++) {
+      SoCallbackAction * worker = new SoCallbackAction;
+      PRIVATE(worker)->viewportset = PRIVATE(this)->viewportset;
+      PRIVATE(worker)->viewport = PRIVATE(this)->viewport;
+      PRIVATE(worker)->callbackall = PRIVATE(this)->callbackall;
+      copy_list_elements(PRIVATE(this)->precallback, PRIVATE(worker)->precallback);
+      copy_list_elements(PRIVATE(this)->postcallback, PRIVATE(worker)->postcallback);
+      copy_list_elements(PRIVATE(this)->trianglecallback, PRIVATE(worker)->trianglecallback);
+      copy_list_elements(PRIVATE(this)->linecallback, PRIVATE(worker)->linecallback);
+      copy_list_elements(PRIVATE(this)->pointcallback, PRIVATE(worker)->pointcallback);
+      // The tails of the paths of the jobs are only the tails of the
+      // paths we were applied to when applied to a path list.
+      if (this->getWhatAppliedTo() == SoAction::PATH_LIST) {
+        PRIVATE(worker)->pretailcallback = copy_callback_data(PRIVATE(this)->pretailcallback);
+        PRIVATE(worker)->posttailcallback = copy_callback_data(PRIVATE(this)->posttailcallback);
+      }
+      workers.append(worker);
+    }
+    parallel.apply(workers);
+    for (int i = 0; i < numjobs; i++) delete workers[i];
+    return;
+  }
+
   if (PRIVATE(this)->viewportset) {
     SoViewportRegionElement::set(this->getState(), PRIVATE(this)->viewport);
   }
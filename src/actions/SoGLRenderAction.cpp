@@ -76,6 +76,7 @@
 #include <Inventor/SbColor.h>
 #include <Inventor/SbPlane.h>
 #include <Inventor/SoFullPath.h>
+#include <Inventor/actions/SoCallbackAction.h>
 #include <Inventor/actions/SoGetBoundingBoxAction.h>
 #include <Inventor/actions/SoSearchAction.h>
 #include <Inventor/caches/SoBoundingBoxCache.h>
@@ -104,13 +105,42 @@
 #include <Inventor/lists/SoCallbackList.h>
 #include <Inventor/lists/SoEnabledElementsList.h>
 #include <Inventor/lists/SoPathList.h>
+#include <Inventor/lists/SoTypeList.h>
+#include <Inventor/misc/SoChildList.h>
 #include <Inventor/misc/SoState.h>
 #include <Inventor/misc/SoGLDriverDatabase.h>
+#include <Inventor/nodes/SoBaseColor.h>
+#include <Inventor/nodes/SoCacheHint.h>
+#include <Inventor/nodes/SoComplexity.h>
+#include <Inventor/nodes/SoCoordinate3.h>
+#include <Inventor/nodes/SoCoordinate4.h>
+#include <Inventor/nodes/SoDrawStyle.h>
 #include <Inventor/nodes/SoGroup.h>
+#include <Inventor/nodes/SoInfo.h>
+#include <Inventor/nodes/SoLabel.h>
+#include <Inventor/nodes/SoLightModel.h>
+#include <Inventor/nodes/SoMaterial.h>
+#include <Inventor/nodes/SoMaterialBinding.h>
+#include <Inventor/nodes/SoMatrixTransform.h>
 #include <Inventor/nodes/SoNode.h>
+#include <Inventor/nodes/SoNormal.h>
+#include <Inventor/nodes/SoNormalBinding.h>
+#include <Inventor/nodes/SoPackedColor.h>
+#include <Inventor/nodes/SoRotation.h>
+#include <Inventor/nodes/SoRotationXYZ.h>
+#include <Inventor/nodes/SoScale.h>
 #include <Inventor/nodes/SoSeparator.h>
 #include <Inventor/nodes/SoShape.h>
 #include <Inventor/nodes/SoShapeHints.h>
+#include <Inventor/nodes/SoTextureCoordinate2.h>
+#include <Inventor/nodes/SoTextureCoordinate3.h>
+#include <Inventor/nodes/SoTextureCoordinateBinding.h>
+#include <Inventor/nodes/SoTransform.h>
+#include <Inventor/nodes/SoTranslation.h>
+#include <Inventor/nodes/SoTransparencyType.h>
+#include <Inventor/nodes/SoUnits.h>
+#include <Inventor/nodes/SoVertexProperty.h>
+#include <Inventor/nodes/SoVertexShape.h>
 #include <Inventor/sensors/SoAlarmSensor.h>
 #include <Inventor/sensors/SoNodeSensor.h>
 #include <Inventor/C/tidbits.h>
@@ -126,6 +156,9 @@
 #include "glue/glp.h"
 #include "glue/simage_wrapper.h"
 #include "rendering/SoGL.h"
+#include "rendering/SoGLTextureMemory.h"
+#include "threads/parallelp.h"
+#include "misc/SbHash.h"
 
 #include <Inventor/annex/Profiler/nodes/SoProfilerStats.h>
 #include "profiler/SoProfilerP.h"
@@ -579,6 +612,24 @@ public:
 
   SoNode * cachedprofilingsg;
 
+#ifdef COIN_THREADSAFE
+  // The scene graph last handled by prebuildCaches(). The sensor
+  // clears it when the node is deleted, so that a new scene graph
+  // allocated at the same address is not mistaken for it.
+  SoNode * prebuildroot;
+  SbUniqueId prebuildnodeid;
+  boost::scoped_ptr<SoNodeSensor> prebuildSensor;
+  static void prebuildDeleteCB(void * userdata, SoSensor * sensor);
+  static SoCallbackAction::Response prebuildPreCB(void * userdata,
+                                                  SoCallbackAction * action,
+                                                  const SoNode * node);
+  static SoCallbackAction::Response prebuildPostCB(void * userdata,
+                                                   SoCallbackAction * action,
+                                                   const SoNode * node);
+  static void prebuildJob(void * closure, int job);
+  void prebuildCaches(SoNode * root);
+#endif // COIN_THREADSAFE
+
   GLuint depthtextureid;
   GLuint hilotextureid;
   boost::scoped_array<GLuint> rgbatextureids;
@@ -633,6 +684,9 @@ public:
 SO_ACTION_SOURCE(SoGLRenderAction);
 
 static int COIN_GLBBOX = 0;
+#ifdef COIN_THREADSAFE
+static int COIN_GLRENDER_PREBUILD_CACHES = 1;
+#endif // COIN_THREADSAFE
 
 // *************************************************************************
 
@@ -663,6 +717,16 @@ SoGLRenderAction::initClass(void)
   else {
     COIN_GLBBOX = 0;
   }
+
+#ifdef COIN_THREADSAFE
+  env = coin_getenv("COIN_GLRENDER_PREBUILD_CACHES");
+  if (env) {
+    COIN_GLRENDER_PREBUILD_CACHES = atoi(env);
+  }
+  else {
+    COIN_GLRENDER_PREBUILD_CACHES = 1;
+  }
+#endif // COIN_THREADSAFE
 }
 
 // *************************************************************************
@@ -732,6 +796,10 @@ SoGLRenderAction::SoGLRenderAction(const SbViewportRegion & viewportregion)
   PRIVATE(this)->sortedlayersblendcounter = 0;
   PRIVATE(this)->usenvidiaregistercombiners = FALSE;
   PRIVATE(this)->cachedprofilingsg = NULL;
+#ifdef COIN_THREADSAFE
+  PRIVATE(this)->prebuildroot = NULL;
+  PRIVATE(this)->prebuildnodeid = 0;
+#endif // COIN_THREADSAFE
   PRIVATE(this)->transpobjdepthwrite = FALSE;
   PRIVATE(this)->transpdelayedrendertype = ONE_PASS;
   PRIVATE(this)->renderingtranspbackfaces = FALSE;
@@ -1066,6 +1134,10 @@ SoGLRenderAction::beginTraversal(SoNode * node)
     return;
   }
 
+  // textures used from now on belong to a new frame, and are kept
+  // resident if the texture memory budget is exceeded
+  SoGLTextureMemory::beginFrame();
+
   // If the environment variable COIN_GLBBOX is set to 1, apply a bbox
   // action before rendering.  This will make sure bounding box caches
   // are updated (needed for view frustum culling). The default
@@ -1074,6 +1146,9 @@ SoGLRenderAction::beginTraversal(SoNode * node)
   if (COIN_GLBBOX) {
     PRIVATE(this)->bboxaction->apply(node);
   }
+#ifdef COIN_THREADSAFE
+  PRIVATE(this)->prebuildCaches(node);
+#endif // COIN_THREADSAFE
   int err_before_init = GL_NO_ERROR;
 
   if (sogl_glerror_debugging()) {
@@ -1684,6 +1759,278 @@ SoGLRenderActionP::isDirectRendering(const SoState * state) const
   return isdirect;
 }
 
+#ifdef COIN_THREADSAFE
+
+// Minimum number of shapes in a scene graph before we bother with
+// building its caches in parallel.
+static const int SOGLRENDER_PREBUILD_MIN_SHAPES = 64;
+
+namespace {
+
+struct soglrender_prebuild_data;
+
+// A prebuild job handles the shapes numbered from start up to end, in
+// traversal order.
+struct soglrender_prebuild_job {
+  const soglrender_prebuild_data * data;
+  int start;
+  int end;
+  int counter;
+  // TRUE when a node was skipped in the current scope, so that the
+  // state no longer matches the one seen while rendering.
+  SbBool tainted;
+  SbList<SbBool> taintstack;
+};
+
+struct soglrender_prebuild_data {
+  SoNode * root;
+  SbViewportRegion viewport;
+  SoGLRenderAction::TransparencyType transparencytype;
+  // The node types traversed besides groups and shapes.
+  SoTypeList properties;
+  // The number of shapes below each separator.
+  SbHash<const SoNode *, int> numshapes;
+};
+
+} // anonymous namespace
+
+static void
+soglrender_prebuild_triangle_cb(void *, SoCallbackAction *,
+                                const SoPrimitiveVertex *,
+                                const SoPrimitiveVertex *,
+                                const SoPrimitiveVertex *)
+{
+}
+
+static void
+soglrender_prebuild_line_cb(void *, SoCallbackAction *,
+                            const SoPrimitiveVertex *,
+                            const SoPrimitiveVertex *)
+{
+}
+
+static void
+soglrender_prebuild_point_cb(void *, SoCallbackAction *,
+                             const SoPrimitiveVertex *)
+{
+}
+
+// Counts the vertex based shapes found below groups and separators,
+// and stores the count of each separator. Other grouping nodes
+// (switches, LODs, etc) are left alone, as we can't tell which of
+// their children will be rendered.
+static int
+soglrender_count_shapes(SoNode * node, soglrender_prebuild_data & data)
+{
+  const SoType type = node->getTypeId();
+  const SbBool isseparator = (type == SoSeparator::getClassTypeId());
+  if (isseparator || (type == SoGroup::getClassTypeId())) {
+    int num = 0;
+    if (isseparator && data.numshapes.get(node, num)) return num;
+    const SoChildList * children = node->getChildren();
+    for (int i = 0; i < children->getLength(); i++) {
+      num += soglrender_count_shapes((*children)[i], data);
+    }
+    if (isseparator) data.numshapes.put(node, num);
+    return num;
+  }
+  return node->isOfType(SoVertexShape::getClassTypeId()) ? 1 : 0;
+}
+
+// Decides which nodes a prebuild job traverses. Only groups,
+// separators, shapes and the property nodes in data->properties are
+// traversed, so that no application callbacks, textures or other
+// nodes with side effects are run on the worker threads. Shapes
+// following a skipped node in the same scope are skipped too, as
+// their caches would not match the render state.
+SoCallbackAction::Response
+SoGLRenderActionP::prebuildPreCB(void * userdata,
+                                 SoCallbackAction * action,
+                                 const SoNode * node)
+{
+  soglrender_prebuild_job * job = static_cast<soglrender_prebuild_job *>(userdata);
+  const soglrender_prebuild_data * data = job->data;
+  SoState * state = action->getState();
+
+  if (node == data->root) {
+    SoShapeStyleElement::setTransparencyType(state, data->transparencytype);
+  }
+
+  const SoType type = node->getTypeId();
+  if (type == SoSeparator::getClassTypeId()) {
+    job->taintstack.push(job->tainted);
+    int num = 0;
+    (void) data->numshapes.get(node, num);
+    if ((job->counter + num <= job->start) || (job->counter >= job->end)) {
+      job->counter += num;
+      return SoCallbackAction::PRUNE;
+    }
+    return SoCallbackAction::CONTINUE;
+  }
+  if (type == SoGroup::getClassTypeId()) return SoCallbackAction::CONTINUE;
+
+  if (node->isOfType(SoVertexShape::getClassTypeId())) {
+    const int idx = job->counter++;
+    if ((idx < job->start) || (idx >= job->end) || job->tainted) {
+      return SoCallbackAction::PRUNE;
+    }
+    const unsigned int flags = SoShapeStyleElement::get(state)->getFlags();
+    if (flags & (SoShapeStyleElement::INVISIBLE|SoShapeStyleElement::BBOXCMPLX)) {
+      return SoCallbackAction::PRUNE;
+    }
+    // Build the primitive vertex cache for the shapes that will be
+    // rendered from it. Generating the primitives of the other shapes
+    // builds the same normal and texture coordinate caches as
+    // rendering them does.
+    const SbBool transparent =
+      (flags & (SoShapeStyleElement::TRANSP_TEXTURE|
+                SoShapeStyleElement::TRANSP_MATERIAL)) != 0;
+    if ((flags & SoShapeStyleElement::VERTEXARRAY) ||
+        (transparent && (flags & SoShapeStyleElement::TRANSP_SORTED_TRIANGLES))) {
+      SoShape * shape = coin_assert_cast<SoShape *>(const_cast<SoNode *>(node));
+      shape->prebuildPVCache(action);
+      return SoCallbackAction::PRUNE;
+    }
+    return SoCallbackAction::CONTINUE;
+  }
+
+  if (data->properties.find(type) >= 0) return SoCallbackAction::CONTINUE;
+
+  // separator subclasses restore the state they change
+  if (!node->isOfType(SoSeparator::getClassTypeId())) job->tainted = TRUE;
+  return SoCallbackAction::PRUNE;
+}
+
+// Restores the taint flag of the scope a separator closes.
+SoCallbackAction::Response
+SoGLRenderActionP::prebuildPostCB(void * userdata,
+                                  SoCallbackAction * COIN_UNUSED_ARG(action),
+                                  const SoNode * node)
+{
+  soglrender_prebuild_job * job = static_cast<soglrender_prebuild_job *>(userdata);
+  if (node->getTypeId() == SoSeparator::getClassTypeId()) {
+    job->tainted = job->taintstack.pop();
+  }
+  return SoCallbackAction::CONTINUE;
+}
+
+void
+SoGLRenderActionP::prebuildJob(void * closure, int job)
+{
+  soglrender_prebuild_job * jobs =
+    static_cast<soglrender_prebuild_job *>(closure);
+  soglrender_prebuild_job * thisjob = &jobs[job];
+
+  SoCallbackAction cba(thisjob->data->viewport);
+  cba.addPreCallback(SoNode::getClassTypeId(),
+                     SoGLRenderActionP::prebuildPreCB, thisjob);
+  cba.addPostCallback(SoSeparator::getClassTypeId(),
+                      SoGLRenderActionP::prebuildPostCB, thisjob);
+  cba.addTriangleCallback(SoVertexShape::getClassTypeId(),
+                          soglrender_prebuild_triangle_cb, NULL);
+  cba.addLineSegmentCallback(SoVertexShape::getClassTypeId(),
+                             soglrender_prebuild_line_cb, NULL);
+  cba.addPointCallback(SoVertexShape::getClassTypeId(),
+                       soglrender_prebuild_point_cb, NULL);
+  cba.apply(thisjob->data->root);
+}
+
+//
+// Builds the caches of the shapes in a new scene graph (or, with
+// COIN_GLRENDER_PREBUILD_CACHES=2, a changed scene graph) in parallel
+// before it is rendered: the primitive vertex caches of shapes
+// rendered with vertex arrays or sorted transparent triangles, and
+// the normal and texture coordinate caches of the other shapes. The
+// shapes are numbered in traversal order and split into consecutive
+// runs, each traversed from the root by its own SoCallbackAction on
+// the worker pool, pruning the separators outside of its run.
+//
+// Set COIN_GLRENDER_PREBUILD_CACHES=0 to disable the pass.
+//
+void
+SoGLRenderActionP::prebuildCaches(SoNode * root)
+{
+  if (COIN_GLRENDER_PREBUILD_CACHES <= 0) return;
+  if (this->action->getWhatAppliedTo() != SoAction::NODE) return;
+  if ((root == this->prebuildroot) &&
+      ((COIN_GLRENDER_PREBUILD_CACHES < 2) ||
+       (root->getNodeId() == this->prebuildnodeid))) return;
+
+  const int numthreads = cc_parallel_get_num_threads();
+  if (numthreads < 2) return;
+
+  if (root != this->prebuildroot) {
+    if (this->prebuildSensor.get() == NULL) {
+      this->prebuildSensor.reset(new SoNodeSensor);
+      this->prebuildSensor->setDeleteCallback(SoGLRenderActionP::prebuildDeleteCB, this);
+    }
+    this->prebuildSensor->detach();
+    this->prebuildSensor->attach(root);
+  }
+  this->prebuildroot = root;
+  this->prebuildnodeid = root->getNodeId();
+
+  soglrender_prebuild_data data;
+  data.root = root;
+  data.viewport = this->viewport;
+  data.transparencytype = this->transparencytype;
+  const int numshapes = soglrender_count_shapes(root, data);
+  if (numshapes < SOGLRENDER_PREBUILD_MIN_SHAPES) return;
+
+  data.properties.append(SoBaseColor::getClassTypeId());
+  data.properties.append(SoCacheHint::getClassTypeId());
+  data.properties.append(SoComplexity::getClassTypeId());
+  data.properties.append(SoCoordinate3::getClassTypeId());
+  data.properties.append(SoCoordinate4::getClassTypeId());
+  data.properties.append(SoDrawStyle::getClassTypeId());
+  data.properties.append(SoInfo::getClassTypeId());
+  data.properties.append(SoLabel::getClassTypeId());
+  data.properties.append(SoLightModel::getClassTypeId());
+  data.properties.append(SoMaterial::getClassTypeId());
+  data.properties.append(SoMaterialBinding::getClassTypeId());
+  data.properties.append(SoMatrixTransform::getClassTypeId());
+  data.properties.append(SoNormal::getClassTypeId());
+  data.properties.append(SoNormalBinding::getClassTypeId());
+  data.properties.append(SoPackedColor::getClassTypeId());
+  data.properties.append(SoRotation::getClassTypeId());
+  data.properties.append(SoRotationXYZ::getClassTypeId());
+  data.properties.append(SoScale::getClassTypeId());
+  data.properties.append(SoShapeHints::getClassTypeId());
+  data.properties.append(SoTextureCoordinate2::getClassTypeId());
+  data.properties.append(SoTextureCoordinate3::getClassTypeId());
+  data.properties.append(SoTextureCoordinateBinding::getClassTypeId());
+  data.properties.append(SoTransform::getClassTypeId());
+  data.properties.append(SoTranslation::getClassTypeId());
+  data.properties.append(SoTransparencyType::getClassTypeId());
+  data.properties.append(SoUnits::getClassTypeId());
+  data.properties.append(SoVertexProperty::getClassTypeId());
+
+  // Several jobs per thread, to even out differences in shape size.
+  const int numjobs = SbMin(numthreads * 4,
+                            numshapes / SOGLRENDER_PREBUILD_MIN_SHAPES + 1);
+  boost::scoped_array<soglrender_prebuild_job> jobs(new soglrender_prebuild_job[numjobs]);
+  for (int i = 0; i < numjobs; i++) {
+    jobs[i].data = &data;
+    jobs[i].start = int((int64_t(numshapes) * i) / numjobs);
+    jobs[i].end = int((int64_t(numshapes) * (i+1)) / numjobs);
+    jobs[i].counter = 0;
+    jobs[i].tainted = FALSE;
+  }
+
+  cc_parallel_run(numjobs, SoGLRenderActionP::prebuildJob, jobs.get());
+}
+
+// Forgets the scene graph handled by prebuildCaches() when it is
+// deleted.
+void
+SoGLRenderActionP::prebuildDeleteCB(void * userdata, SoSensor * COIN_UNUSED_ARG(sensor))
+{
+  SoGLRenderActionP * thisp = static_cast<SoGLRenderActionP *>(userdata);
+  thisp->prebuildroot = NULL;
+  thisp->prebuildnodeid = 0;
+}
+
+#endif // COIN_THREADSAFE
 
 //
 // render the scene. Called from beginTraversal()
@@ -93,6 +93,7 @@
 #include <Inventor/errors/SoDebugError.h>
 #endif // COIN_DEBUG
 
+#include "actions/SoActionP.h"
 #include "actions/SoSubActionP.h"
 #include "SbBasicP.h"
 
@@ -598,6 +599,29 @@ SoGetBoundingBoxAction::beginTraversal(SoNode * node)
   this->resetCenter();
   this->bbox.makeEmpty();
 
+  // Resetting the box at the reset path needs the box of the whole
+  // traversal up to that point, so we can't split that traversal.
+  SoParallelTraversal parallel;
+  if (!this->isResetPath() && parallel.split(this, node)) {
+    const int numjobs = parallel.getNumJobs();
+    SbList<SoAction *> workers(numjobs);
+    for (int i = 0; i < numjobs; i++) {
+      SoGetBoundingBoxAction * worker = new SoGetBoundingBoxAction(this->vpregion);
+      worker->setInCameraSpace(this->isInCameraSpace());
+      workers.append(worker);
+    }
+    parallel.apply(workers);
+
+    for (int i = 0; i < numjobs; i++) {
+      SoGetBoundingBoxAction * worker =
+        static_cast<SoGetBoundingBoxAction *>(workers[i]);
+      if (!worker->bbox.isEmpty()) this->bbox.extendBy(worker->bbox);
+      delete worker;
+    }
+    if (!this->bbox.isEmpty()) this->setCenter(this->bbox.getCenter(), FALSE);
+    return;
+  }
+
   SoViewportRegionElement::set(this->getState(), this->vpregion);
   inherited::beginTraversal(node);
 }
@@ -60,6 +60,7 @@
 #include <Inventor/elements/SoDecimationTypeElement.h>
 #include <Inventor/elements/SoViewportRegionElement.h>
 
+#include "actions/SoActionP.h"
 #include "actions/SoSubActionP.h"
 
 class SoGetPrimitiveCountActionP {
@@ -391,5 +392,33 @@ SoGetPrimitiveCountAction::beginTraversal(SoNode * node)
 //  SoDecimationTypeElement::set(this->getState(), this->decimationtype);
 //  SoDecimationPercentageElement::set(this->getState(), this->decimationpercentage);
 
+  SoParallelTraversal parallel;
+  if (parallel.split(this, node)) {
+    const int numjobs = parallel.getNumJobs();
+    SbList<SoAction *> workers(numjobs);
+    for (int i = 0; i < numjobs; i++) {
+      SoGetPrimitiveCountAction * worker =
+        new SoGetPrimitiveCountAction(this->pimpl->viewport);
+      worker->textastris = this->textastris;
+      worker->approx = this->approx;
+      worker->nonvertexastris = this->nonvertexastris;
+      worker->decimationtype = this->decimationtype;
+      worker->decimationpercentage = this->decimationpercentage;
+      workers.append(worker);
+    }
+    parallel.apply(workers);
+    for (int i = 0; i < numjobs; i++) {
+      SoGetPrimitiveCountAction * worker =
+        static_cast<SoGetPrimitiveCountAction *>(workers[i]);
+      this->numtris += worker->numtris;
+      this->numlines += worker->numlines;
+      this->numpoints += worker->numpoints;
+      this->numtexts += worker->numtexts;
+      this->numimages += worker->numimages;
+      delete worker;
+    }
+    return;
+  }
+
   this->traverse(node);
 }
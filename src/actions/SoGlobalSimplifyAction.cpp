@@ -30,20 +30,106 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 \**************************************************************************/
 
-// FIXME: this class has not yet been implemented in Coin. this is a
-// placeholder / stub / skeleton code, not yet built (nor installed,
-// obviously).  --mortene.
-
 /*!
   \class SoGlobalSimplifyAction SoGlobalSimplifyAction.h Inventor/actions/SoGlobalSimplifyAction.h
   \brief The SoGlobalSimplifyAction class is for globally simplifying the
   geometry of a scene graph, globally.
+
+  The triangles of all shapes in the scene graph are collected in
+  world space and merged into one mesh per material, which is then
+  decimated to each simplification level. The result, available
+  from getSimplifiedSceneGraph(), is a separator with an
+  SoLevelOfDetail node (or an SoLOD node, if ranges have been set)
+  with one child per level. Levels of 1.0 use the original scene
+  graph when the action was applied to a node. Each simplified level
+  contains an SoMaterial and an SoIndexedFaceSet with an
+  SoVertexProperty per material.
+
+  Since the geometry is merged across shapes, textures are not kept
+  in the simplified levels. Materials are grouped on diffuse color
+  and transparency.
+
+  The scene graph the action is applied to is not modified.
+
+  \sa SoShapeSimplifyAction, SoReorganizeAction
 */
 
-#include <Inventor/SbName.h>
 #include <Inventor/actions/SoGlobalSimplifyAction.h>
-#include <coindefs.h> // COIN_STUB()
 
+#include <Inventor/SbName.h>
+#include <Inventor/SbBox3f.h>
+#include <Inventor/SbColor4f.h>
+#include <Inventor/SbMatrix.h>
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/SoPrimitiveVertex.h>
+#include <Inventor/actions/SoCallbackAction.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/nodes/SoGroup.h>
+#include <Inventor/nodes/SoImage.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/nodes/SoMaterial.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoShape.h>
+#include <Inventor/nodes/SoShapeHints.h>
+#include <Inventor/nodes/SoText2.h>
+
+#include "actions/SoSubActionP.h"
+#include "actions/SoMeshDecimator.h"
+#include "misc/SbHash.h"
+
+class SoGlobalSimplifyActionP {
+public:
+  SoGlobalSimplifyActionP(void)
+    : master(NULL),
+      cbaction(SbViewportRegion(640, 480)),
+      result(NULL)
+  {
+    this->cbaction.addPreCallback(SoShape::getClassTypeId(),
+                                  pre_shape_cb, this);
+    this->cbaction.addTriangleCallback(SoShape::getClassTypeId(),
+                                       triangle_cb, this);
+  }
+  ~SoGlobalSimplifyActionP()
+  {
+    this->reset();
+  }
+
+  class Group {
+  public:
+    Group(void) : decimator(FALSE, FALSE) { }
+    SoMeshDecimator decimator;
+    SoMaterial * material;
+    float creaseangle;
+  };
+
+  SoGlobalSimplifyAction * master;
+  SoCallbackAction cbaction;
+  SoSeparator * result;
+
+  SbList <Group *> groups;
+  SbHash<uint32_t, Group *> groupdict;
+  SbBox3f box;
+
+  // per shape
+  SbBool swapvertices;
+  int lastmaterialindex;
+  Group * lastgroup;
+
+  static SoCallbackAction::Response pre_shape_cb(void * userdata,
+                                                 SoCallbackAction * action,
+                                                 const SoNode * node);
+  static void triangle_cb(void * userdata, SoCallbackAction * action,
+                          const SoPrimitiveVertex * v1,
+                          const SoPrimitiveVertex * v2,
+                          const SoPrimitiveVertex * v3);
+
+  Group * findGroup(SoCallbackAction * action, const int materialindex);
+  void createResult(SoNode * original);
+  void clearGroups(void);
+  void reset(void);
+};
+
+#define PRIVATE(obj) obj->pimpl
 
 SO_ACTION_SOURCE(SoGlobalSimplifyAction);
 
@@ -63,7 +149,8 @@ SoGlobalSimplifyAction::initClass(void)
 
 SoGlobalSimplifyAction::SoGlobalSimplifyAction(void)
 {
-  COIN_STUB();
+  PRIVATE(this)->master = this;
+  SO_ACTION_CONSTRUCTOR(SoGlobalSimplifyAction);
 }
 
 /*!
@@ -72,12 +159,310 @@ SoGlobalSimplifyAction::SoGlobalSimplifyAction(void)
 
 SoGlobalSimplifyAction::~SoGlobalSimplifyAction(void)
 {
-  COIN_STUB();
+}
+
+/*!
+  Simplifies the scene graph under \a root.
+*/
+void
+SoGlobalSimplifyAction::apply(SoNode * root)
+{
+  PRIVATE(this)->reset();
+  PRIVATE(this)->cbaction.apply(root);
+  PRIVATE(this)->createResult(root);
+}
+
+/*!
+  Simplifies the geometry under the tail of \a path. Since the
+  geometry is transformed by the nodes along the path, levels of 1.0
+  will contain the merged, but not decimated, geometry.
+*/
+void
+SoGlobalSimplifyAction::apply(SoPath * path)
+{
+  PRIVATE(this)->reset();
+  PRIVATE(this)->cbaction.apply(path);
+  PRIVATE(this)->createResult(NULL);
+}
+
+/*!
+  Simplifies the geometry under the tails of the paths in \a
+  pathlist.
+
+  \sa apply(SoPath *)
+*/
+void
+SoGlobalSimplifyAction::apply(const SoPathList & pathlist, SbBool obeysrules)
+{
+  PRIVATE(this)->reset();
+  PRIVATE(this)->cbaction.apply(pathlist, obeysrules);
+  PRIVATE(this)->createResult(NULL);
+}
+
+/*!
+  Returns the result of the last apply(), or NULL if the action has
+  not been applied. The returned scene graph is unref'ed when the
+  action is applied again or destructed, so ref it to keep it.
+*/
+SoSeparator *
+SoGlobalSimplifyAction::getSimplifiedSceneGraph(void) const
+{
+  return PRIVATE(this)->result;
 }
 
 // Documented in superclass.
 void
 SoGlobalSimplifyAction::beginTraversal(SoNode * /* node */)
 {
-  COIN_STUB();
+  assert(0 && "should never get here");
 }
+
+#undef PRIVATE
+
+// *************************************************************************
+
+SoCallbackAction::Response
+SoGlobalSimplifyActionP::pre_shape_cb(void * userdata,
+                                      SoCallbackAction * action,
+                                      const SoNode * node)
+{
+  // screen aligned shapes can't be merged into world space geometry
+  if (node->isOfType(SoText2::getClassTypeId()) ||
+      node->isOfType(SoImage::getClassTypeId())) {
+    return SoCallbackAction::PRUNE;
+  }
+  SoGlobalSimplifyActionP * thisp = static_cast<SoGlobalSimplifyActionP *>(userdata);
+  // the merged geometry is counterclockwise in world space
+  const SbBool mirrored = action->getModelMatrix().det3() < 0.0f;
+  const SbBool clockwise = action->getVertexOrdering() == SoShapeHints::CLOCKWISE;
+  thisp->swapvertices = mirrored != clockwise;
+  thisp->lastmaterialindex = -1;
+  thisp->lastgroup = NULL;
+  return SoCallbackAction::CONTINUE;
+}
+
+void
+SoGlobalSimplifyActionP::triangle_cb(void * userdata, SoCallbackAction * action,
+                                     const SoPrimitiveVertex * v1,
+                                     const SoPrimitiveVertex * v2,
+                                     const SoPrimitiveVertex * v3)
+{
+  SoGlobalSimplifyActionP * thisp = static_cast<SoGlobalSimplifyActionP *>(userdata);
+
+  const int materialindex = v1->getMaterialIndex();
+  if (materialindex != thisp->lastmaterialindex || thisp->lastgroup == NULL) {
+    thisp->lastgroup = thisp->findGroup(action, materialindex);
+    thisp->lastmaterialindex = materialindex;
+  }
+
+  const SbMatrix & m = action->getModelMatrix();
+  SbVec3f p1, p2, p3;
+  m.multVecMatrix(v1->getPoint(), p1);
+  m.multVecMatrix(v2->getPoint(), p2);
+  m.multVecMatrix(v3->getPoint(), p3);
+  thisp->box.extendBy(p1);
+  thisp->box.extendBy(p2);
+  thisp->box.extendBy(p3);
+
+  if (thisp->swapvertices) {
+    thisp->lastgroup->decimator.addTriangle(p1, p3, p2);
+  }
+  else {
+    thisp->lastgroup->decimator.addTriangle(p1, p2, p3);
+  }
+}
+
+// Returns the group for the material at materialindex, creating it
+// if needed.
+SoGlobalSimplifyActionP::Group *
+SoGlobalSimplifyActionP::findGroup(SoCallbackAction * action, const int materialindex)
+{
+  SbColor ambient, diffuse, specular, emission;
+  float shininess, transparency;
+  action->getMaterial(ambient, diffuse, specular, emission,
+                      shininess, transparency, materialindex);
+
+  const uint32_t key = SbColor4f(diffuse, 1.0f - transparency).getPackedValue();
+  Group * group;
+  if (!this->groupdict.get(key, group)) {
+    group = new Group;
+    group->material = new SoMaterial;
+    group->material->ref();
+    group->material->ambientColor = ambient;
+    group->material->diffuseColor = diffuse;
+    group->material->specularColor = specular;
+    group->material->emissiveColor = emission;
+    group->material->shininess = shininess;
+    group->material->transparency = transparency;
+    group->creaseangle = action->getCreaseAngle();
+    this->groupdict.put(key, group);
+    this->groups.append(group);
+  }
+  return group;
+}
+
+// Decimates the collected geometry and builds the result scene
+// graph. original is used for levels of 1.0, if not NULL.
+void
+SoGlobalSimplifyActionP::createResult(SoNode * original)
+{
+  this->result = new SoSeparator;
+  this->result->ref();
+
+  // the levels are extracted one after the other from the same mesh,
+  // so keep the original triangle counts
+  SbList <int> groupcounts;
+  int numtriangles = 0;
+  int i;
+  for (i = 0; i < this->groups.getLength(); i++) {
+    groupcounts.append(this->groups[i]->decimator.getNumTriangles());
+    numtriangles += groupcounts[i];
+  }
+  if (numtriangles == 0) {
+    this->clearGroups();
+    return;
+  }
+
+  SoNode * full = original;
+  if (original && !original->isOfType(SoSeparator::getClassTypeId())) {
+    SoSeparator * sep = new SoSeparator;
+    sep->addChild(original);
+    full = sep;
+  }
+
+  const int numlevels = this->master->getNumSimplificationLevels();
+  const float * levels = this->master->getSimplificationLevels();
+  const int mintriangles = this->master->getMinTriangles();
+
+  if (numlevels == 0 || (full && numtriangles < mintriangles)) {
+    if (full) this->result->addChild(full);
+    this->clearGroups();
+    return;
+  }
+
+  SoShapeHints * hints = NULL;
+
+  SbList <SoNode *> children;
+  SbList <int> counts;
+  for (int l = 0; l < numlevels; l++) {
+    if (levels[l] >= 1.0f && full) {
+      children.append(full);
+      counts.append(numtriangles);
+      continue;
+    }
+    float fraction = 1.0f;
+    if (levels[l] < 1.0f) {
+      const int target = SbMax(static_cast<int>(levels[l] * numtriangles + 0.5f), mintriangles);
+      fraction = SbMin(float(target) / float(numtriangles), 1.0f);
+    }
+    if (hints == NULL) {
+      hints = new SoShapeHints;
+      hints->vertexOrdering = SoShapeHints::COUNTERCLOCKWISE;
+      hints->shapeType = SoShapeHints::UNKNOWN_SHAPE_TYPE;
+    }
+    SoSeparator * sep = new SoSeparator;
+    sep->addChild(hints);
+    int count = 0;
+    for (i = 0; i < this->groups.getLength(); i++) {
+      Group * group = this->groups[i];
+      group->decimator.decimate(SbMax(static_cast<int>(fraction * groupcounts[i] + 0.5f), 1));
+      sep->addChild(group->material);
+      sep->addChild(group->decimator.createFaceSet(group->creaseangle, TRUE));
+      count += group->decimator.getNumTriangles();
+    }
+    children.append(sep);
+    counts.append(count);
+  }
+
+  SoGroup * lod = SoMeshDecimator::createLevelGroup(this->master, this->box,
+                                                    counts.getArrayPtr(),
+                                                    numlevels);
+  for (i = 0; i < children.getLength(); i++) {
+    lod->addChild(children[i]);
+  }
+  this->result->addChild(lod);
+  this->clearGroups();
+}
+
+void
+SoGlobalSimplifyActionP::reset(void)
+{
+  if (this->result) {
+    this->result->unref();
+    this->result = NULL;
+  }
+  this->clearGroups();
+}
+
+// The materials are kept alive by the result.
+void
+SoGlobalSimplifyActionP::clearGroups(void)
+{
+  for (int i = 0; i < this->groups.getLength(); i++) {
+    this->groups[i]->material->unref();
+    delete this->groups[i];
+  }
+  this->groups.truncate(0);
+  this->groupdict.clear();
+  this->box.makeEmpty();
+}
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/actions/SoGetPrimitiveCountAction.h>
+#include <Inventor/nodes/SoComplexity.h>
+#include <Inventor/nodes/SoMaterial.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoSphere.h>
+#include <Inventor/nodes/SoTranslation.h>
+
+BOOST_AUTO_TEST_CASE(simplifyglobal)
+{
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  SoComplexity * complexity = new SoComplexity;
+  complexity->value = 1.0f;
+  root->addChild(complexity);
+  SoMaterial * red = new SoMaterial;
+  red->diffuseColor.setValue(1.0f, 0.0f, 0.0f);
+  root->addChild(red);
+  root->addChild(new SoSphere);
+  SoTranslation * trans = new SoTranslation;
+  trans->translation.setValue(3.0f, 0.0f, 0.0f);
+  root->addChild(trans);
+  SoMaterial * green = new SoMaterial;
+  green->diffuseColor.setValue(0.0f, 1.0f, 0.0f);
+  root->addChild(green);
+  root->addChild(new SoSphere);
+  const int numchildren = root->getNumChildren();
+
+  SoGetPrimitiveCountAction pca;
+  pca.apply(root);
+  const int numtriangles = pca.getTriangleCount();
+
+  SoGlobalSimplifyAction simplify;
+  const float levels[] = { 1.0f, 0.25f };
+  simplify.setSimplificationLevels(2, levels);
+  simplify.setMinTriangles(10);
+  simplify.apply(root);
+
+  BOOST_CHECK_MESSAGE(root->getNumChildren() == numchildren,
+                      "should not modify the scene graph");
+
+  SoSeparator * result = simplify.getSimplifiedSceneGraph();
+  BOOST_REQUIRE(result != NULL && result->getNumChildren() == 1);
+  SoGroup * lod = static_cast<SoGroup *>(result->getChild(0));
+  BOOST_REQUIRE(lod->getNumChildren() == 2);
+  BOOST_CHECK(lod->getChild(0) == root);
+
+  // shape hints, and a material and face set per color
+  SoGroup * level = static_cast<SoGroup *>(lod->getChild(1));
+  BOOST_CHECK(level->getNumChildren() == 5);
+  pca.apply(level);
+  BOOST_CHECK_MESSAGE(pca.getTriangleCount() < numtriangles / 2,
+                      "should reduce the number of triangles");
+
+  root->unref();
+}
+
+#endif // COIN_TEST_SUITE
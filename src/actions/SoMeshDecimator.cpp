@@ -0,0 +1,664 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#include "actions/SoMeshDecimator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include <Inventor/SbBox3f.h>
+#include <Inventor/SbColor4f.h>
+#include <Inventor/actions/SoSimplifyAction.h>
+#include <Inventor/misc/SoNormalGenerator.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/nodes/SoLOD.h>
+#include <Inventor/nodes/SoLevelOfDetail.h>
+#include <Inventor/nodes/SoVertexProperty.h>
+
+// Border edges get an extra quadric for a plane through the edge,
+// perpendicular to the triangle. The weight (relative to the squared
+// edge length) keeps open borders and attribute seams from eroding.
+static const double SOMESHDECIMATOR_BORDER_WEIGHT = 100.0;
+
+// A collapse is rejected if it would rotate a remaining triangle's
+// normal by more than ~85 degrees.
+static const double SOMESHDECIMATOR_MIN_NORMAL_COS = 0.1;
+
+namespace {
+
+struct somesh_edge {
+  int v0, v1, tri;
+  bool operator < (const somesh_edge & e) const {
+    return (this->v0 < e.v0) || (this->v0 == e.v0 && this->v1 < e.v1);
+  }
+};
+
+inline SbVec3f
+somesh_normal(const SbVec3f & p0, const SbVec3f & p1, const SbVec3f & p2)
+{
+  return (p1 - p0).cross(p2 - p0);
+}
+
+} // anonymous namespace
+
+// *************************************************************************
+
+void
+SoMeshDecimator::Quadric::clear(void)
+{
+  this->a2 = this->ab = this->ac = this->ad = 0.0;
+  this->b2 = this->bc = this->bd = 0.0;
+  this->c2 = this->cd = this->d2 = 0.0;
+}
+
+void
+SoMeshDecimator::Quadric::addPlane(const double a, const double b,
+                                   const double c, const double d,
+                                   const double w)
+{
+  this->a2 += w*a*a; this->ab += w*a*b; this->ac += w*a*c; this->ad += w*a*d;
+  this->b2 += w*b*b; this->bc += w*b*c; this->bd += w*b*d;
+  this->c2 += w*c*c; this->cd += w*c*d;
+  this->d2 += w*d*d;
+}
+
+void
+SoMeshDecimator::Quadric::add(const Quadric & q)
+{
+  this->a2 += q.a2; this->ab += q.ab; this->ac += q.ac; this->ad += q.ad;
+  this->b2 += q.b2; this->bc += q.bc; this->bd += q.bd;
+  this->c2 += q.c2; this->cd += q.cd;
+  this->d2 += q.d2;
+}
+
+double
+SoMeshDecimator::Quadric::evaluate(const SbVec3f & v) const
+{
+  const double x = v[0], y = v[1], z = v[2];
+  return
+    x*(this->a2*x + 2.0*(this->ab*y + this->ac*z + this->ad)) +
+    y*(this->b2*y + 2.0*(this->bc*z + this->bd)) +
+    z*(this->c2*z + 2.0*this->cd) +
+    this->d2;
+}
+
+// Finds the position minimizing the error. Returns FALSE if the
+// system is (close to) singular, e.g. for flat or straight regions.
+SbBool
+SoMeshDecimator::Quadric::optimize(SbVec3f & v) const
+{
+  const double c00 = this->b2*this->c2 - this->bc*this->bc;
+  const double c01 = this->ac*this->bc - this->ab*this->c2;
+  const double c02 = this->ab*this->bc - this->ac*this->b2;
+  const double det = this->a2*c00 + this->ab*c01 + this->ac*c02;
+  const double trace = this->a2 + this->b2 + this->c2;
+  if (fabs(det) <= 1e-8 * trace * trace * trace) return FALSE;
+
+  const double c11 = this->a2*this->c2 - this->ac*this->ac;
+  const double c12 = this->ab*this->ac - this->a2*this->bc;
+  const double c22 = this->a2*this->b2 - this->ab*this->ab;
+  const double inv = -1.0 / det;
+  v.setValue(float(inv * (c00*this->ad + c01*this->bd + c02*this->cd)),
+             float(inv * (c01*this->ad + c11*this->bd + c12*this->cd)),
+             float(inv * (c02*this->ad + c12*this->bd + c22*this->cd)));
+  return TRUE;
+}
+
+// *************************************************************************
+
+SoMeshDecimator::SoMeshDecimator(const SbBool texcoordsarg, const SbBool colorsarg)
+  : texcoords(texcoordsarg),
+    colors(colorsarg),
+    numattr((texcoordsarg ? 2 : 0) + (colorsarg ? 4 : 0)),
+    numlive(0),
+    prepared(FALSE),
+    markid(0)
+{
+}
+
+SoMeshDecimator::~SoMeshDecimator()
+{
+}
+
+// Vertices are welded through an open addressing hash table of
+// vertex indices, hashed on the bit patterns of the position and
+// attribute values.
+unsigned int
+SoMeshDecimator::hashVertex(const int idx) const
+{
+  const int n = this->numattr;
+  unsigned int h = 0;
+  for (int i = 0; i < 3 + n; i++) {
+    const float f = i < 3 ? this->pos[idx][i] : this->attr[idx*n+i-3];
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    h = (h ^ bits) * 0x9e3779b1u;
+  }
+  return h ^ (h >> 16);
+}
+
+SbBool
+SoMeshDecimator::sameVertex(const int idx, const SbVec3f & v, const float * attrib) const
+{
+  if (this->pos[idx] != v) return FALSE;
+  const int n = this->numattr;
+  for (int i = 0; i < n; i++) {
+    if (this->attr[idx*n+i] != attrib[i]) return FALSE;
+  }
+  return TRUE;
+}
+
+void
+SoMeshDecimator::growWeldTable(void)
+{
+  const size_t size = SbMax(this->weldtable.size() * 2, static_cast<size_t>(1024));
+  this->weldtable.assign(size, -1);
+  const unsigned int mask = static_cast<unsigned int>(size - 1);
+  const int numv = static_cast<int>(this->pos.size());
+  for (int i = 0; i < numv; i++) {
+    unsigned int slot = this->hashVertex(i) & mask;
+    while (this->weldtable[slot] >= 0) slot = (slot + 1) & mask;
+    this->weldtable[slot] = i;
+  }
+}
+
+// Returns the index of the vertex at position v with attributes
+// attrib, adding a new vertex if there is none.
+int
+SoMeshDecimator::addVertex(const SbVec3f & vin, const float * attrib)
+{
+  // adding zero turns -0.0 into 0.0, which compares equal anyway
+  const SbVec3f v(vin[0] + 0.0f, vin[1] + 0.0f, vin[2] + 0.0f);
+  const int n = this->numattr;
+  const int newidx = static_cast<int>(this->pos.size());
+  if (static_cast<size_t>(newidx) * 2 >= this->weldtable.size()) {
+    this->growWeldTable();
+  }
+  // hash the candidate as if it was already added
+  this->pos.push_back(v);
+  for (int j = 0; j < n; j++) this->attr.push_back(attrib[j] + 0.0f);
+
+  const unsigned int mask = static_cast<unsigned int>(this->weldtable.size() - 1);
+  unsigned int slot = this->hashVertex(newidx) & mask;
+  while (this->weldtable[slot] >= 0) {
+    const int idx = this->weldtable[slot];
+    if (this->sameVertex(idx, v, n ? &this->attr[newidx*n] : NULL)) {
+      this->pos.pop_back();
+      this->attr.resize(newidx * n);
+      return idx;
+    }
+    slot = (slot + 1) & mask;
+  }
+  this->weldtable[slot] = newidx;
+  return newidx;
+}
+
+/*!
+  Adds a triangle to the mesh. The attribute pointers must point to
+  the vertex' texture coordinates (two floats) followed by its color
+  (four floats), for the attributes enabled in the constructor.
+*/
+void
+SoMeshDecimator::addTriangle(const SbVec3f & v0, const SbVec3f & v1, const SbVec3f & v2,
+                             const float * a0, const float * a1, const float * a2)
+{
+  assert(!this->prepared && "triangles must be added before decimating");
+  assert((this->numattr == 0 || (a0 && a1 && a2)) && "missing attributes");
+
+  const int i0 = this->addVertex(v0, a0);
+  const int i1 = this->addVertex(v1, a1);
+  const int i2 = this->addVertex(v2, a2);
+  if (i0 == i1 || i1 == i2 || i0 == i2) return;
+
+  this->tris.push_back(i0);
+  this->tris.push_back(i1);
+  this->tris.push_back(i2);
+  this->tdead.push_back(0);
+  this->numlive++;
+}
+
+int
+SoMeshDecimator::getNumTriangles(void) const
+{
+  return this->numlive;
+}
+
+int
+SoMeshDecimator::getNumAttributes(void) const
+{
+  return this->numattr;
+}
+
+// Sets up vertex quadrics, vertex to triangle adjacency and the
+// initial collapse candidates (one per edge).
+void
+SoMeshDecimator::prepare(void)
+{
+  this->prepared = TRUE;
+
+  // the welding table is not needed anymore
+  std::vector<int>().swap(this->weldtable);
+
+  const int numv = static_cast<int>(this->pos.size());
+  const int numt = static_cast<int>(this->tdead.size());
+
+  Quadric zero;
+  zero.clear();
+  this->quadric.assign(numv, zero);
+  this->stamp.assign(numv, 0);
+  this->alive.assign(numv, 1);
+  this->mark.assign(numv, 0);
+  this->vtris.resize(numv);
+
+  std::vector<somesh_edge> edges;
+  edges.reserve(numt * 3);
+
+  int i;
+  for (i = 0; i < numt; i++) {
+    const int * t = &this->tris[i*3];
+    SbVec3f n = somesh_normal(this->pos[t[0]], this->pos[t[1]], this->pos[t[2]]);
+    const double area2 = n.length();
+    if (area2 > 0.0) {
+      n /= float(area2);
+      const double d = -n.dot(this->pos[t[0]]);
+      for (int k = 0; k < 3; k++) {
+        this->quadric[t[k]].addPlane(n[0], n[1], n[2], d, area2 * 0.5);
+      }
+    }
+    for (int k = 0; k < 3; k++) {
+      this->vtris[t[k]].push_back(i);
+      somesh_edge e;
+      e.v0 = SbMin(t[k], t[(k+1)%3]);
+      e.v1 = SbMax(t[k], t[(k+1)%3]);
+      e.tri = i;
+      edges.push_back(e);
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+
+  // border edges (used by a single triangle) get a constraint plane
+  const int numedges = static_cast<int>(edges.size());
+  for (i = 0; i < numedges; ) {
+    int j = i + 1;
+    while (j < numedges && edges[j].v0 == edges[i].v0 && edges[j].v1 == edges[i].v1) j++;
+    if (j == i + 1) {
+      const int * t = &this->tris[edges[i].tri*3];
+      const SbVec3f n = somesh_normal(this->pos[t[0]], this->pos[t[1]], this->pos[t[2]]);
+      const SbVec3f & p0 = this->pos[edges[i].v0];
+      const SbVec3f e = this->pos[edges[i].v1] - p0;
+      SbVec3f bn = e.cross(n);
+      const double len = bn.length();
+      if (len > 0.0) {
+        bn /= float(len);
+        const double d = -bn.dot(p0);
+        const double w = SOMESHDECIMATOR_BORDER_WEIGHT * e.sqrLength();
+        this->quadric[edges[i].v0].addPlane(bn[0], bn[1], bn[2], d, w);
+        this->quadric[edges[i].v1].addPlane(bn[0], bn[1], bn[2], d, w);
+      }
+    }
+    i = j;
+  }
+
+  for (i = 0; i < numedges; ) {
+    this->pushCandidate(edges[i].v0, edges[i].v1);
+    int j = i + 1;
+    while (j < numedges && edges[j].v0 == edges[i].v0 && edges[j].v1 == edges[i].v1) j++;
+    i = j;
+  }
+}
+
+// Calculates the cost and target position for collapsing the edge
+// between v0 and v1. t is the attribute interpolation parameter.
+double
+SoMeshDecimator::evaluateCollapse(const int v0, const int v1,
+                                  SbVec3f & target, float & t) const
+{
+  Quadric q = this->quadric[v0];
+  q.add(this->quadric[v1]);
+
+  const SbVec3f & p0 = this->pos[v0];
+  const SbVec3f & p1 = this->pos[v1];
+  const SbVec3f mid = (p0 + p1) * 0.5f;
+  const float edgelen2 = (p1 - p0).sqrLength();
+
+  double cost;
+  if (q.optimize(target) && (target - mid).sqrLength() <= edgelen2) {
+    cost = q.evaluate(target);
+  }
+  else {
+    // fall back to the best of the end and mid points
+    const double e0 = q.evaluate(p0);
+    const double e1 = q.evaluate(p1);
+    const double em = q.evaluate(mid);
+    cost = e0; target = p0;
+    if (e1 < cost) { cost = e1; target = p1; }
+    if (em < cost) { cost = em; target = mid; }
+  }
+
+  t = 0.0f;
+  if (this->numattr && edgelen2 > 0.0f) {
+    t = SbClamp((target - p0).dot(p1 - p0) / edgelen2, 0.0f, 1.0f);
+  }
+  return SbMax(cost, 0.0);
+}
+
+// Adds the edge between v0 and v1 to the candidate heap.
+void
+SoMeshDecimator::pushCandidate(const int v0, const int v1)
+{
+  SbVec3f target;
+  float t;
+  Candidate c;
+  c.cost = static_cast<float>(this->evaluateCollapse(v0, v1, target, t));
+  c.v0 = v0;
+  c.v1 = v1;
+  c.stamp0 = this->stamp[v0];
+  c.stamp1 = this->stamp[v1];
+
+  this->heap.push_back(c);
+  std::push_heap(this->heap.begin(), this->heap.end());
+}
+
+// Checks that the collapse keeps the mesh manifold and doesn't fold
+// any of the surrounding triangles over.
+SbBool
+SoMeshDecimator::canCollapse(const int u, const int v, const SbVec3f & target)
+{
+  this->markid++;
+  size_t i;
+  int numshared = 0;
+  const std::vector<int> & utris = this->vtris[u];
+  for (i = 0; i < utris.size(); i++) {
+    if (this->tdead[utris[i]]) continue;
+    const int * t = &this->tris[utris[i]*3];
+    if (t[0] == v || t[1] == v || t[2] == v) numshared++;
+    for (int k = 0; k < 3; k++) this->mark[t[k]] = this->markid;
+  }
+  if (numshared == 0) return FALSE;
+
+  // link condition: the end points must not share more neighbours
+  // than the triangles on the edge
+  int numcommon = 0;
+  const std::vector<int> & vtrisv = this->vtris[v];
+  for (i = 0; i < vtrisv.size(); i++) {
+    if (this->tdead[vtrisv[i]]) continue;
+    const int * t = &this->tris[vtrisv[i]*3];
+    for (int k = 0; k < 3; k++) {
+      const int w = t[k];
+      if (w != u && w != v && this->mark[w] == this->markid) {
+        this->mark[w] = 0;
+        numcommon++;
+      }
+    }
+  }
+  if (numcommon > numshared) return FALSE;
+
+  for (int end = 0; end < 2; end++) {
+    const int w = end ? v : u;
+    const std::vector<int> & wtris = this->vtris[w];
+    for (i = 0; i < wtris.size(); i++) {
+      if (this->tdead[wtris[i]]) continue;
+      const int * t = &this->tris[wtris[i]*3];
+      SbVec3f p[3];
+      SbBool onedge = FALSE;
+      for (int k = 0; k < 3; k++) {
+        p[k] = this->pos[t[k]];
+        if (t[k] == (end ? u : v)) onedge = TRUE;
+      }
+      if (onedge) continue; // removed by the collapse
+
+      const SbVec3f n0 = somesh_normal(p[0], p[1], p[2]);
+      for (int k = 0; k < 3; k++) {
+        if (t[k] == w) p[k] = target;
+      }
+      const SbVec3f n1 = somesh_normal(p[0], p[1], p[2]);
+      const double dot = n0.dot(n1);
+      if (dot <= SOMESHDECIMATOR_MIN_NORMAL_COS * n0.length() * n1.length()) {
+        return FALSE;
+      }
+    }
+  }
+  return TRUE;
+}
+
+// Collapses v1 into v0, moves v0 to the target position and updates
+// the candidates around it.
+void
+SoMeshDecimator::collapse(const int u, const int v, const SbVec3f & target, const float t)
+{
+  const int n = this->numattr;
+  for (int k = 0; k < n; k++) {
+    float & a = this->attr[u*n+k];
+    a += t * (this->attr[v*n+k] - a);
+  }
+  this->pos[u] = target;
+  this->quadric[u].add(this->quadric[v]);
+  this->alive[v] = 0;
+  this->stamp[u]++;
+
+  std::vector<int> & utris = this->vtris[u];
+  const std::vector<int> & vtrisv = this->vtris[v];
+  size_t i;
+  for (i = 0; i < vtrisv.size(); i++) {
+    const int ti = vtrisv[i];
+    if (this->tdead[ti]) continue;
+    int * t = &this->tris[ti*3];
+    if (t[0] == u || t[1] == u || t[2] == u) {
+      this->tdead[ti] = 1;
+      this->numlive--;
+    }
+    else {
+      for (int k = 0; k < 3; k++) {
+        if (t[k] == v) t[k] = u;
+      }
+      utris.push_back(ti);
+    }
+  }
+  std::vector<int>().swap(this->vtris[v]);
+
+  size_t numkept = 0;
+  for (i = 0; i < utris.size(); i++) {
+    if (!this->tdead[utris[i]]) utris[numkept++] = utris[i];
+  }
+  utris.resize(numkept);
+
+  this->markid++;
+  this->mark[u] = this->markid;
+  for (i = 0; i < utris.size(); i++) {
+    const int * t = &this->tris[utris[i]*3];
+    for (int k = 0; k < 3; k++) {
+      if (this->mark[t[k]] != this->markid) {
+        this->mark[t[k]] = this->markid;
+        this->pushCandidate(u, t[k]);
+      }
+    }
+  }
+}
+
+/*!
+  Collapses edges until the mesh has at most \a targettriangles
+  triangles, or until no more edges can be collapsed without
+  breaking the mesh.
+*/
+void
+SoMeshDecimator::decimate(const int targettriangles)
+{
+  if (!this->prepared) this->prepare();
+
+  while (this->numlive > targettriangles && !this->heap.empty()) {
+    std::pop_heap(this->heap.begin(), this->heap.end());
+    const Candidate c = this->heap.back();
+    this->heap.pop_back();
+
+    if (!this->alive[c.v0] || !this->alive[c.v1] ||
+        this->stamp[c.v0] != c.stamp0 || this->stamp[c.v1] != c.stamp1) {
+      continue; // stale
+    }
+    SbVec3f target;
+    float t;
+    this->evaluateCollapse(c.v0, c.v1, target, t);
+    if (this->canCollapse(c.v0, c.v1, target)) {
+      this->collapse(c.v0, c.v1, target, t);
+    }
+  }
+}
+
+/*!
+  Returns the current mesh, with unused vertices removed. \a
+  attributes gets getNumAttributes() values per vertex, and \a
+  triangles three indices per triangle.
+*/
+void
+SoMeshDecimator::getMesh(SbList <SbVec3f> & vertices,
+                         SbList <float> & attributes,
+                         SbList <int32_t> & triangles) const
+{
+  vertices.truncate(0);
+  attributes.truncate(0);
+  triangles.truncate(0);
+
+  const int n = this->numattr;
+  std::vector<int> remap(this->pos.size(), -1);
+  const int numt = static_cast<int>(this->tdead.size());
+  for (int i = 0; i < numt; i++) {
+    if (this->tdead[i]) continue;
+    for (int k = 0; k < 3; k++) {
+      const int idx = this->tris[i*3+k];
+      if (remap[idx] < 0) {
+        remap[idx] = vertices.getLength();
+        vertices.append(this->pos[idx]);
+        for (int j = 0; j < n; j++) attributes.append(this->attr[idx*n+j]);
+      }
+      triangles.append(remap[idx]);
+    }
+  }
+}
+
+/*!
+  Returns an SoIndexedFaceSet with an SoVertexProperty for the
+  current mesh. Normals are generated per vertex using \a
+  creaseangle. The returned node has a zero reference count.
+*/
+SoIndexedFaceSet *
+SoMeshDecimator::createFaceSet(const float creaseangle, const SbBool ccw) const
+{
+  SbList <SbVec3f> vertices;
+  SbList <float> attributes;
+  SbList <int32_t> triangles;
+  this->getMesh(vertices, attributes, triangles);
+
+  const int numv = vertices.getLength();
+  const int numt = triangles.getLength() / 3;
+  const SbVec3f * v = vertices.getArrayPtr();
+  const int32_t * t = triangles.getArrayPtr();
+
+  SoNormalGenerator ng(ccw, numv);
+  int i;
+  for (i = 0; i < numt; i++) {
+    ng.triangle(v[t[i*3]], v[t[i*3+1]], v[t[i*3+2]]);
+  }
+  ng.generate(creaseangle);
+
+  SoVertexProperty * vp = new SoVertexProperty;
+  vp->vertex.setValues(0, numv, v);
+  vp->normal.setValues(0, ng.getNumNormals(), ng.getNormals());
+  vp->normalBinding = SoVertexProperty::PER_VERTEX;
+
+  const int n = this->numattr;
+  const float * a = attributes.getArrayPtr();
+  if (this->texcoords) {
+    vp->texCoord.setNum(numv);
+    SbVec2f * dst = vp->texCoord.startEditing();
+    for (i = 0; i < numv; i++) dst[i].setValue(a[i*n], a[i*n+1]);
+    vp->texCoord.finishEditing();
+  }
+  if (this->colors) {
+    const int offset = this->texcoords ? 2 : 0;
+    vp->orderedRGBA.setNum(numv);
+    uint32_t * dst = vp->orderedRGBA.startEditing();
+    for (i = 0; i < numv; i++) {
+      const float * c = a + i*n + offset;
+      dst[i] = SbColor4f(SbClamp(c[0], 0.0f, 1.0f), SbClamp(c[1], 0.0f, 1.0f),
+                         SbClamp(c[2], 0.0f, 1.0f), SbClamp(c[3], 0.0f, 1.0f)).getPackedValue();
+    }
+    vp->orderedRGBA.finishEditing();
+    vp->materialBinding = SoVertexProperty::PER_VERTEX_INDEXED;
+  }
+
+  SoIndexedFaceSet * ifs = new SoIndexedFaceSet;
+  ifs->vertexProperty = vp;
+  ifs->normalIndex.setNum(0);
+  ifs->materialIndex.setNum(0);
+  ifs->textureCoordIndex.setNum(0);
+  ifs->coordIndex.setNum(numt * 4);
+  int32_t * ptr = ifs->coordIndex.startEditing();
+  for (i = 0; i < numt; i++) {
+    *ptr++ = t[i*3];
+    *ptr++ = t[i*3+1];
+    *ptr++ = t[i*3+2];
+    *ptr++ = -1;
+  }
+  ifs->coordIndex.finishEditing();
+  return ifs;
+}
+
+/*!
+  Creates the node that switches between the simplification levels
+  of \a action. An SoLOD node is used if the action has ranges set,
+  otherwise an SoLevelOfDetail node where a level is kept until its
+  triangles would cover less than SoSimplifyAction::getSizeFactor()
+  pixels each on average. \a box is the bounding box of the original
+  geometry. The children must be added by the caller.
+*/
+SoGroup *
+SoMeshDecimator::createLevelGroup(const SoSimplifyAction * action,
+                                  const SbBox3f & box,
+                                  const int * numtriangles,
+                                  const int numlevels)
+{
+  const int numranges = SbMin(action->getNumRanges(), numlevels - 1);
+  if (numranges > 0) {
+    SoLOD * lod = new SoLOD;
+    lod->center = box.getCenter();
+    lod->range.setValues(0, numranges, action->getRanges());
+    lod->range.setNum(numranges);
+    return lod;
+  }
+  SoLevelOfDetail * lod = new SoLevelOfDetail;
+  lod->screenArea.setNum(SbMax(numlevels - 1, 0));
+  for (int i = 0; i < numlevels - 1; i++) {
+    lod->screenArea.set1Value(i, action->getSizeFactor() * float(numtriangles[i]));
+  }
+  return lod;
+}
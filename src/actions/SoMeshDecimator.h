@@ -0,0 +1,138 @@
+#ifndef COIN_SOMESHDECIMATOR_H
+#define COIN_SOMESHDECIMATOR_H
+
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#ifndef COIN_INTERNAL
+#error this is a private header file
+#endif /* !COIN_INTERNAL */
+
+#include <vector>
+
+#include <Inventor/SbVec3f.h>
+#include <Inventor/lists/SbList.h>
+
+class SoIndexedFaceSet;
+class SoGroup;
+class SoSimplifyAction;
+class SbBox3f;
+
+// Quadric error metric triangle mesh decimation (Garland & Heckbert),
+// shared by the simplify actions. Triangles are added one at a time,
+// and vertices are welded on position (and attribute values, so that
+// texture and color seams end up as mesh boundaries). Edges are then
+// collapsed in order of increasing error until the requested number
+// of triangles is reached. decimate() can be called repeatedly with
+// decreasing targets to extract several levels of detail from the
+// same mesh.
+
+class SoMeshDecimator {
+public:
+  SoMeshDecimator(const SbBool texcoords, const SbBool colors);
+  ~SoMeshDecimator();
+
+  void addTriangle(const SbVec3f & v0, const SbVec3f & v1, const SbVec3f & v2,
+                   const float * a0 = NULL, const float * a1 = NULL,
+                   const float * a2 = NULL);
+
+  int getNumTriangles(void) const;
+  int getNumAttributes(void) const;
+
+  void decimate(const int targettriangles);
+
+  void getMesh(SbList <SbVec3f> & vertices,
+               SbList <float> & attributes,
+               SbList <int32_t> & triangles) const;
+  SoIndexedFaceSet * createFaceSet(const float creaseangle,
+                                   const SbBool ccw) const;
+
+  static SoGroup * createLevelGroup(const SoSimplifyAction * action,
+                                    const SbBox3f & box,
+                                    const int * numtriangles,
+                                    const int numlevels);
+
+private:
+  struct Quadric {
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+    void clear(void);
+    void addPlane(const double a, const double b, const double c,
+                  const double d, const double w);
+    void add(const Quadric & q);
+    double evaluate(const SbVec3f & v) const;
+    SbBool optimize(SbVec3f & v) const;
+  };
+  // the target position is recalculated when the candidate is used,
+  // to keep the heap entries small
+  struct Candidate {
+    float cost;
+    int v0, v1;
+    unsigned int stamp0, stamp1;
+    bool operator < (const Candidate & c) const { return this->cost > c.cost; }
+  };
+
+  unsigned int hashVertex(const int idx) const;
+  SbBool sameVertex(const int idx, const SbVec3f & v, const float * attrib) const;
+  void growWeldTable(void);
+  int addVertex(const SbVec3f & v, const float * attrib);
+  void prepare(void);
+  double evaluateCollapse(const int v0, const int v1,
+                          SbVec3f & target, float & t) const;
+  void pushCandidate(const int v0, const int v1);
+  SbBool canCollapse(const int u, const int v, const SbVec3f & target);
+  void collapse(const int u, const int v, const SbVec3f & target, const float t);
+
+  SbBool texcoords;
+  SbBool colors;
+  int numattr;
+  int numlive;
+  SbBool prepared;
+
+  std::vector<int> weldtable;
+
+  std::vector<SbVec3f> pos;
+  std::vector<float> attr;
+  std::vector<Quadric> quadric;
+  std::vector<unsigned int> stamp;
+  std::vector<unsigned char> alive;
+  std::vector<std::vector<int> > vtris;
+  std::vector<int> mark;
+  int markid;
+
+  std::vector<int> tris;
+  std::vector<unsigned char> tdead;
+
+  std::vector<Candidate> heap;
+};
+
+#endif // !COIN_SOMESHDECIMATOR_H
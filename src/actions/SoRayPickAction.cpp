@@ -159,6 +159,7 @@
 #include <Inventor/errors/SoDebugError.h>
 #endif // COIN_DEBUG
 
+#include "actions/SoActionP.h"
 #include "actions/SoSubActionP.h"
 
 
@@ -182,6 +183,7 @@ public:
   void calcObjectSpaceData(SoState * ownerstate);
   void calcMatrices(SoState * ownerstate);
   void setPickStyleFlags(SoState * ownerstate);
+  void copySettings(const SoRayPickActionP & other);
 
   // Hidden private variables.
 
@@ -1052,6 +1054,47 @@ void
 SoRayPickAction::beginTraversal(SoNode * node)
 {
   PRIVATE(this)->cleanupPickedPoints();
+
+  SoParallelTraversal parallel;
+  if (parallel.split(this, node)) {
+    const int numjobs = parallel.getNumJobs();
+    SbList<SoAction *> workers(numjobs);
+    for (int i = 0; i < numjobs; i++) {
+      SoRayPickAction * worker = new SoRayPickAction(this->vpRegion);
+      worker->enableCulling(this->isCullingEnabled());
+      PRIVATE(worker)->copySettings(PRIVATE(this).get());
+      workers.append(worker);
+    }
+    parallel.apply(workers);
+
+    // Keep the ray as computed by the traversal, like a serial
+    // traversal does.
+    PRIVATE(this)->copySettings(PRIVATE(static_cast<SoRayPickAction *>(workers[0])).get());
+
+    // Go through the picked points in traversal order, so that the
+    // first of several points at the same distance is kept.
+    const SbBool pickall = PRIVATE(this)->isFlagSet(SoRayPickActionP::PICK_ALL);
+    SoPickedPointList & pplist = PRIVATE(this)->pickedpointlist;
+    SbList<double> & ppdistance = PRIVATE(this)->ppdistance;
+    for (int i = 0; i < numjobs; i++) {
+      SoRayPickAction * worker = static_cast<SoRayPickAction *>(workers[i]);
+      const SoPickedPointList & workerpplist = PRIVATE(worker)->pickedpointlist;
+      for (int j = 0; j < workerpplist.getLength(); j++) {
+        const double dist = PRIVATE(worker)->ppdistance[j];
+        if (!pickall && pplist.getLength()) {
+          if (dist >= ppdistance[0]) continue;
+          pplist.truncate(0);
+          ppdistance.truncate(0);
+        }
+        pplist.append(workerpplist[j]->copy());
+        ppdistance.append(dist);
+      }
+      delete worker;
+    }
+    PRIVATE(this)->clearFlag(SoRayPickActionP::PPLIST_IS_SORTED);
+    return;
+  }
+
   this->getState()->push();
   SoViewportRegionElement::set(this->getState(), this->vpRegion);
 
@@ -1094,6 +1137,32 @@ SoRayPickActionP::cleanupPickedPoints(void)
   this->clearFlag(PPLIST_IS_SORTED);
 }
 
+// Copies everything but the picked points from other.
+void
+SoRayPickActionP::copySettings(const SoRayPickActionP & other)
+{
+  this->osvolume = other.osvolume;
+  this->wsvolume = other.wsvolume;
+  this->osline_sp = other.osline_sp;
+  this->osline = other.osline;
+  this->nearplane = other.nearplane;
+  this->vppoint = other.vppoint;
+  this->normvppoint = other.normvppoint;
+  this->raystart = other.raystart;
+  this->raydirection = other.raydirection;
+  this->rayradiusstart = other.rayradiusstart;
+  this->rayradiusdelta = other.rayradiusdelta;
+  this->raynear = other.raynear;
+  this->rayfar = other.rayfar;
+  this->radiusinpixels = other.radiusinpixels;
+  this->wsline = other.wsline;
+  this->obj2world = other.obj2world;
+  this->world2obj = other.world2obj;
+  this->extramatrix = other.extramatrix;
+  this->flags = (this->flags & PPLIST_IS_SORTED) | (other.flags & ~PPLIST_IS_SORTED);
+  this->objectspacevalid = other.objectspacevalid;
+}
+
 void
 SoRayPickActionP::setFlag(const unsigned int flag)
 {
@@ -75,6 +75,9 @@
 
 #include <Inventor/nodes/SoNode.h>
 
+#include <Inventor/SoPath.h>
+
+#include "actions/SoActionP.h"
 #include "actions/SoSubActionP.h"
 
 // *************************************************************************
@@ -471,6 +474,71 @@ SoSearchAction::beginTraversal(SoNode * nodeptr)
   // now obsoleted 'duringSearchAll' flag.
   SoSearchAction::duringSearchAll = this->isSearchingAll();
 
+  // When applied to a path list, nodes off the paths are searched
+  // too, which we can't tell apart from the nodes leading up to the
+  // part of the scene graph each job traverses. Only split
+  // traversals of a node.
+  SoParallelTraversal parallel;
+  if ((this->getWhatAppliedTo() == SoAction::NODE) &&
+      parallel.split(this, nodeptr)) {
+    const int numjobs = parallel.getNumJobs();
+    SbList<SoAction *> workers(numjobs);
+    for (int i = 0; i < numjobs; i++) {
+      // The jobs find all matches, and we pick the first or last
+      // one afterwards.
+      SoSearchAction * worker = new SoSearchAction;
+      worker->lookfor = this->lookfor;
+      worker->interest = SoSearchAction::ALL;
+      worker->searchall = this->searchall;
+      worker->chkderived = this->chkderived;
+      worker->node = this->node;
+      worker->type = this->type;
+      worker->name = this->name;
+      workers.append(worker);
+    }
+    parallel.apply(workers);
+
+    // Each job also searches the nodes leading up to its paths. Keep
+    // the paths found at or below the paths of the job, and the paths
+    // to a node leading up to them only in the job which has the
+    // first path below that node.
+    const SoPathList & jobpaths = parallel.getPaths();
+    SoPathList found;
+    for (int i = 0; i < numjobs; i++) {
+      SoSearchAction * worker = static_cast<SoSearchAction *>(workers[i]);
+      int j = parallel.getFirstPath(i);
+      const int end = parallel.getFirstPath(i+1);
+      for (int k = 0; k < worker->paths.getLength(); k++) {
+        SoPath * p = worker->paths[k];
+        while ((j < end - 1) &&
+               (SoParallelTraversal::compare(jobpaths[j], p) < 0) &&
+               !SoParallelTraversal::isPrefix(jobpaths[j], p)) j++;
+        if (SoParallelTraversal::isPrefix(jobpaths[j], p) ||
+            (SoParallelTraversal::isPrefix(p, jobpaths[j]) &&
+             ((j == 0) || !SoParallelTraversal::isPrefix(p, jobpaths[j-1])))) {
+          found.append(p);
+        }
+      }
+      delete worker;
+    }
+
+    if (found.getLength() > 0) {
+      switch (this->interest) {
+      case FIRST:
+        this->addPath(found[0]);
+        break;
+      case LAST:
+        this->addPath(found[found.getLength() - 1]);
+        break;
+      default:
+        for (int i = 0; i < found.getLength(); i++) this->addPath(found[i]);
+        break;
+      }
+    }
+    SoSearchAction::duringSearchAll = FALSE;
+    return;
+  }
+
   this->traverse(nodeptr); // begin traversal at root node
 
   SoSearchAction::duringSearchAll = FALSE;
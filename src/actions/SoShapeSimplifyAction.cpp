@@ -30,20 +30,106 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 \**************************************************************************/
 
-// FIXME: this class has not yet been implemented in Coin. this is a
-// placeholder / stub / skeleton code, not yet built (nor installed,
-// obviously).  --mortene.
-
 /*!
   \class SoShapeSimplifyAction SoShapeSimplifyAction.h Inventor/actions/SoShapeSimplifyAction.h
   \brief The SoShapeSimplifyAction class replaces complex primitives
   with simplified polygon representations.
+
+  Each SoVertexShape in the scene graph with at least
+  SoSimplifyAction::getMinTriangles() triangles is replaced by an
+  SoLevelOfDetail node (or an SoLOD node, if ranges have been set),
+  with one child per simplification level. Levels of 1.0 use the
+  original shape, the other levels are SoIndexedFaceSet nodes with an
+  SoVertexProperty holding the decimated geometry in the shape's
+  coordinate system.
+
+  The shapes are decimated by collapsing edges in order of increasing
+  quadric error. Texture coordinates and per vertex colors are
+  interpolated for the remaining vertices, and normals are generated
+  using the crease angle in effect for the shape.
+
+  Shapes with a non-group parent, such as the geometry of a VRML2
+  Shape node, are left untouched.
+
+  \code
+  SoShapeSimplifyAction simplify;
+  const float levels[] = { 1.0f, 0.25f, 0.05f };
+  simplify.setSimplificationLevels(3, levels);
+  simplify.apply(root);
+  \endcode
+
+  \sa SoGlobalSimplifyAction, SoReorganizeAction
 */
 
-#include <Inventor/SbName.h>
 #include <Inventor/actions/SoShapeSimplifyAction.h>
-#include <coindefs.h> // COIN_STUB()
 
+#include <Inventor/SbName.h>
+#include <Inventor/SbBox3f.h>
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/SoPrimitiveVertex.h>
+#include <Inventor/actions/SoCallbackAction.h>
+#include <Inventor/actions/SoSearchAction.h>
+#include <Inventor/elements/SoLazyElement.h>
+#include <Inventor/elements/SoMultiTextureCoordinateElement.h>
+#include <Inventor/elements/SoMultiTextureEnabledElement.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/nodes/SoGroup.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/nodes/SoVertexShape.h>
+
+#include "actions/SoSubActionP.h"
+#include "actions/SoMeshDecimator.h"
+#include "misc/SbHash.h"
+#include "SbBasicP.h"
+
+class SoShapeSimplifyActionP {
+public:
+  SoShapeSimplifyActionP(void)
+    : master(NULL),
+      cbaction(SbViewportRegion(640, 480)),
+      shape(NULL),
+      decimator(NULL)
+  {
+    this->cbaction.addPreCallback(SoVertexShape::getClassTypeId(),
+                                  pre_shape_cb, this);
+    this->cbaction.addTriangleCallback(SoVertexShape::getClassTypeId(),
+                                       triangle_cb, this);
+  }
+  ~SoShapeSimplifyActionP()
+  {
+    delete this->decimator;
+  }
+
+  SoShapeSimplifyAction * master;
+  SoCallbackAction cbaction;
+  SoSearchAction sa;
+  SbHash<const SoNode *, SoNode *> replaced;
+
+  const SoNode * shape;
+  SbBool collecting;
+  SbBool didinit;
+  SoMeshDecimator * decimator;
+  float creaseangle;
+  SbBool ccw;
+  SbBox3f box;
+
+  static SoCallbackAction::Response pre_shape_cb(void * userdata,
+                                                 SoCallbackAction * action,
+                                                 const SoNode * node);
+  static void triangle_cb(void * userdata, SoCallbackAction * action,
+                          const SoPrimitiveVertex * v1,
+                          const SoPrimitiveVertex * v2,
+                          const SoPrimitiveVertex * v3);
+
+  void initShape(SoCallbackAction * action);
+  void getAttributes(SoState * state, const SoPrimitiveVertex * v, float * attr) const;
+  SoNode * createLevels(SoFullPath * path);
+  void simplifyShape(SoFullPath * path);
+  void simplifyPaths(const SoPathList & pl);
+  void releaseReplaced(void);
+};
+
+#define PRIVATE(obj) obj->pimpl
 
 SO_ACTION_SOURCE(SoShapeSimplifyAction);
 
@@ -63,7 +149,8 @@ SoShapeSimplifyAction::initClass(void)
 
 SoShapeSimplifyAction::SoShapeSimplifyAction(void)
 {
-  COIN_STUB();
+  PRIVATE(this)->master = this;
+  SO_ACTION_CONSTRUCTOR(SoShapeSimplifyAction);
 }
 
 /*!
@@ -72,12 +159,331 @@ SoShapeSimplifyAction::SoShapeSimplifyAction(void)
 
 SoShapeSimplifyAction::~SoShapeSimplifyAction(void)
 {
-  COIN_STUB();
+}
+
+/*!
+  Replaces all shapes under \a root with level of detail nodes.
+*/
+void
+SoShapeSimplifyAction::apply(SoNode * root)
+{
+  PRIVATE(this)->sa.setType(SoVertexShape::getClassTypeId());
+  PRIVATE(this)->sa.setSearchingAll(TRUE);
+  PRIVATE(this)->sa.setInterest(SoSearchAction::ALL);
+  PRIVATE(this)->sa.apply(root);
+  PRIVATE(this)->simplifyPaths(PRIVATE(this)->sa.getPaths());
+  PRIVATE(this)->sa.reset();
+}
+
+/*!
+  Replaces the shapes under the tail of \a path with level of detail
+  nodes.
+*/
+void
+SoShapeSimplifyAction::apply(SoPath * path)
+{
+  PRIVATE(this)->sa.setType(SoVertexShape::getClassTypeId());
+  PRIVATE(this)->sa.setSearchingAll(TRUE);
+  PRIVATE(this)->sa.setInterest(SoSearchAction::ALL);
+  PRIVATE(this)->sa.apply(path);
+  PRIVATE(this)->simplifyPaths(PRIVATE(this)->sa.getPaths());
+  PRIVATE(this)->sa.reset();
+}
+
+/*!
+  Replaces the shapes under the tails of the paths in \a pathlist
+  with level of detail nodes.
+*/
+void
+SoShapeSimplifyAction::apply(const SoPathList & pathlist, SbBool COIN_UNUSED_ARG(obeysrules))
+{
+  for (int i = 0; i < pathlist.getLength(); i++) {
+    this->apply(pathlist[i]);
+  }
 }
 
 // Documented in superclass.
 void
 SoShapeSimplifyAction::beginTraversal(SoNode * /* node */)
 {
-  COIN_STUB();
+  assert(0 && "should never get here");
 }
+
+#undef PRIVATE
+
+// *************************************************************************
+
+SoCallbackAction::Response
+SoShapeSimplifyActionP::pre_shape_cb(void * userdata,
+                                     SoCallbackAction * COIN_UNUSED_ARG(action),
+                                     const SoNode * node)
+{
+  SoShapeSimplifyActionP * thisp = static_cast<SoShapeSimplifyActionP *>(userdata);
+  // applying to a path also traverses shapes in groups to the left
+  // of it, only the path tail should be collected
+  thisp->collecting = (node == thisp->shape);
+  return SoCallbackAction::CONTINUE;
+}
+
+void
+SoShapeSimplifyActionP::triangle_cb(void * userdata, SoCallbackAction * action,
+                                    const SoPrimitiveVertex * v1,
+                                    const SoPrimitiveVertex * v2,
+                                    const SoPrimitiveVertex * v3)
+{
+  SoShapeSimplifyActionP * thisp = static_cast<SoShapeSimplifyActionP *>(userdata);
+  if (!thisp->collecting) return;
+  if (!thisp->didinit) thisp->initShape(action);
+
+  const SbVec3f & p1 = v1->getPoint();
+  const SbVec3f & p2 = v2->getPoint();
+  const SbVec3f & p3 = v3->getPoint();
+  thisp->box.extendBy(p1);
+  thisp->box.extendBy(p2);
+  thisp->box.extendBy(p3);
+
+  if (thisp->decimator->getNumAttributes()) {
+    float a1[6], a2[6], a3[6];
+    SoState * state = action->getState();
+    thisp->getAttributes(state, v1, a1);
+    thisp->getAttributes(state, v2, a2);
+    thisp->getAttributes(state, v3, a3);
+    thisp->decimator->addTriangle(p1, p2, p3, a1, a2, a3);
+  }
+  else {
+    thisp->decimator->addTriangle(p1, p2, p3);
+  }
+}
+
+// Decides which vertex attributes to keep, from the state at the
+// first triangle (after the shape has pushed its vertex property).
+void
+SoShapeSimplifyActionP::initShape(SoCallbackAction * action)
+{
+  this->didinit = TRUE;
+  SoState * state = action->getState();
+
+  SbBool texcoords = FALSE;
+  if (SoMultiTextureEnabledElement::get(state, 0)) {
+    const SoMultiTextureCoordinateElement * celem =
+      SoMultiTextureCoordinateElement::getInstance(state);
+    texcoords = celem->getType() != SoMultiTextureCoordinateElement::TEXGEN;
+  }
+  const SbBool colors =
+    action->getMaterialBinding() != SoMaterialBinding::OVERALL;
+
+  this->decimator = new SoMeshDecimator(texcoords, colors);
+  this->creaseangle = action->getCreaseAngle();
+  this->ccw = action->getVertexOrdering() != SoShapeHints::CLOCKWISE;
+}
+
+void
+SoShapeSimplifyActionP::getAttributes(SoState * state,
+                                      const SoPrimitiveVertex * v,
+                                      float * attr) const
+{
+  if (this->decimator->getNumAttributes() != 4) {
+    SbVec4f tc = v->getTextureCoords();
+    if (tc[3] != 0.0f) {
+      tc[0] /= tc[3];
+      tc[1] /= tc[3];
+    }
+    *attr++ = tc[0];
+    *attr++ = tc[1];
+  }
+  if (this->decimator->getNumAttributes() != 2) {
+    const int idx = v->getMaterialIndex();
+    const SbColor & c = SoLazyElement::getDiffuse(state, idx);
+    *attr++ = c[0];
+    *attr++ = c[1];
+    *attr++ = c[2];
+    *attr++ = 1.0f - SoLazyElement::getTransparency(state, idx);
+  }
+}
+
+// Collects the triangles of the shape at the tail of path and creates
+// the level of detail node replacing it. Returns NULL if the shape
+// should be left as is.
+SoNode *
+SoShapeSimplifyActionP::createLevels(SoFullPath * path)
+{
+  this->shape = path->getTail();
+  this->collecting = FALSE;
+  this->didinit = FALSE;
+  this->box.makeEmpty();
+  this->cbaction.apply(path);
+  this->shape = NULL;
+
+  SoMeshDecimator * decimator = this->decimator;
+  this->decimator = NULL;
+  if (decimator == NULL) return NULL;
+
+  const int numlevels = this->master->getNumSimplificationLevels();
+  const float * levels = this->master->getSimplificationLevels();
+  const int mintriangles = this->master->getMinTriangles();
+  const int numtriangles = decimator->getNumTriangles();
+  if (numlevels == 0 || numtriangles < mintriangles) {
+    delete decimator;
+    return NULL;
+  }
+
+  SbList <SoNode *> children;
+  SbList <int> counts;
+  for (int i = 0; i < numlevels; i++) {
+    if (levels[i] >= 1.0f) {
+      children.append(path->getTail());
+      counts.append(numtriangles);
+      continue;
+    }
+    const int target = static_cast<int>(levels[i] * numtriangles + 0.5f);
+    decimator->decimate(SbMax(target, mintriangles));
+    children.append(decimator->createFaceSet(this->creaseangle, this->ccw));
+    counts.append(decimator->getNumTriangles());
+  }
+  delete decimator;
+
+  SoGroup * lod = SoMeshDecimator::createLevelGroup(this->master, this->box,
+                                                    counts.getArrayPtr(),
+                                                    numlevels);
+  for (int j = 0; j < children.getLength(); j++) {
+    lod->addChild(children[j]);
+  }
+  return lod;
+}
+
+void
+SoShapeSimplifyActionP::simplifyShape(SoFullPath * path)
+{
+  if (path->getLength() < 2) return;
+  SoNode * shape = path->getTail();
+  SoNode * parent = path->getNodeFromTail(1);
+  if (!parent->isOfType(SoGroup::getClassTypeId())) return;
+
+  SoGroup * g = coin_assert_cast<SoGroup *>(parent);
+  const int idx = path->getIndexFromTail(0);
+  // an earlier replacement may have changed the group
+  if (idx >= g->getNumChildren() || g->getChild(idx) != shape) return;
+
+  // instances are replaced by the same node
+  SoNode * lod;
+  if (!this->replaced.get(shape, lod)) {
+    lod = this->createLevels(path);
+    if (lod) lod->ref();
+    this->replaced.put(shape, lod);
+  }
+  if (lod == NULL) return;
+
+  path->pop();
+  g->replaceChild(idx, lod);
+  path->push(idx);
+}
+
+void
+SoShapeSimplifyActionP::simplifyPaths(const SoPathList & pl)
+{
+  for (int i = 0; i < pl.getLength(); i++) {
+    this->simplifyShape(reclassify_cast<SoFullPath *>(pl[i]));
+  }
+  this->releaseReplaced();
+}
+
+void
+SoShapeSimplifyActionP::releaseReplaced(void)
+{
+  for (SbHash<const SoNode *, SoNode *>::const_iterator iter =
+         this->replaced.const_begin();
+       iter != this->replaced.const_end();
+       ++iter) {
+    if (iter->obj) iter->obj->unref();
+  }
+  this->replaced.clear();
+}
+
+#ifdef COIN_TEST_SUITE
+
+#include <cmath>
+#include <Inventor/actions/SoGetPrimitiveCountAction.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/nodes/SoLevelOfDetail.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoVertexProperty.h>
+
+// unit sphere made of n*2n quads
+static SoIndexedFaceSet *
+soshapesimplify_create_sphere(const int n)
+{
+  SoVertexProperty * vp = new SoVertexProperty;
+  for (int i = 0; i <= n; i++) {
+    for (int j = 0; j < 2*n; j++) {
+      const float theta = float(M_PI) * i / n;
+      const float phi = float(M_PI) * j / n;
+      vp->vertex.set1Value(i*2*n + j, SbVec3f(sin(theta) * cos(phi),
+                                              sin(theta) * sin(phi),
+                                              cos(theta)));
+    }
+  }
+  SoIndexedFaceSet * ifs = new SoIndexedFaceSet;
+  ifs->vertexProperty = vp;
+  ifs->coordIndex.setNum(n * 2*n * 5);
+  int32_t * idx = ifs->coordIndex.startEditing();
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < 2*n; j++) {
+      const int a = i*2*n + j;
+      const int b = i*2*n + (j+1) % (2*n);
+      *idx++ = a; *idx++ = b; *idx++ = b + 2*n; *idx++ = a + 2*n; *idx++ = -1;
+    }
+  }
+  ifs->coordIndex.finishEditing();
+  return ifs;
+}
+
+BOOST_AUTO_TEST_CASE(simplifysphere)
+{
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  SoIndexedFaceSet * sphere = soshapesimplify_create_sphere(30);
+  root->addChild(sphere);
+  root->addChild(sphere);
+
+  SoGetPrimitiveCountAction pca;
+  pca.apply(sphere);
+  const int numtriangles = pca.getTriangleCount();
+
+  SoShapeSimplifyAction simplify;
+  const float levels[] = { 1.0f, 0.3f, 0.1f };
+  simplify.setSimplificationLevels(3, levels);
+  simplify.apply(root);
+
+  BOOST_REQUIRE(root->getChild(0)->isOfType(SoLevelOfDetail::getClassTypeId()));
+  BOOST_CHECK_MESSAGE(root->getChild(1) == root->getChild(0),
+                      "instances should share the level of detail node");
+
+  SoLevelOfDetail * lod = static_cast<SoLevelOfDetail *>(root->getChild(0));
+  BOOST_REQUIRE(lod->getNumChildren() == 3);
+  BOOST_CHECK(lod->getChild(0) == sphere);
+  BOOST_CHECK(lod->screenArea.getNum() == 2);
+
+  int prev = numtriangles;
+  for (int i = 1; i < 3; i++) {
+    BOOST_REQUIRE(lod->getChild(i)->isOfType(SoIndexedFaceSet::getClassTypeId()));
+    SoIndexedFaceSet * ifs = static_cast<SoIndexedFaceSet *>(lod->getChild(i));
+    pca.apply(ifs);
+    const int count = pca.getTriangleCount();
+    BOOST_CHECK_MESSAGE(count < prev && count <= int(levels[i] * numtriangles) + 1,
+                        "should reduce the number of triangles");
+    BOOST_CHECK_MESSAGE(count > int(levels[i] * numtriangles * 0.9f),
+                        "should not reduce more than asked for");
+    prev = count;
+
+    const SoVertexProperty * vp =
+      static_cast<const SoVertexProperty *>(ifs->vertexProperty.getValue());
+    float maxerr = 0.0f;
+    for (int j = 0; j < vp->vertex.getNum(); j++) {
+      maxerr = SbMax(maxerr, float(fabs(vp->vertex[j].length() - 1.0f)));
+    }
+    BOOST_CHECK_MESSAGE(maxerr < 0.05f, "simplified vertices should stay on the surface");
+  }
+  root->unref();
+}
+
+#endif // COIN_TEST_SUITE
@@ -34,19 +34,40 @@
   \class SoSimplifyAction SoSimplifyAction.h Inventor/actions/SoSimplifyAction.h
   \brief The SoSimplifyAction class is the base class for the simplify
   action classes.
+
+  The settings in this class control the levels of detail created by
+  SoShapeSimplifyAction and SoGlobalSimplifyAction. Each level is a
+  fraction of the original number of triangles to keep, and the
+  levels are put under an SoLevelOfDetail node, or under an SoLOD
+  node if ranges have been set.
 */
 
 #include <Inventor/actions/SoSimplifyAction.h>
 
 #include <Inventor/SbName.h>
+#include <Inventor/lists/SbList.h>
 
 #include "coindefs.h" // COIN_STUB()
 #include "actions/SoSubActionP.h"
 
 class SoSimplifyActionP {
 public:
+  SoSimplifyActionP(void)
+    : sizefactor(1.0f),
+      mintriangles(100)
+  {
+    this->levels.append(1.0f);
+    this->levels.append(0.3f);
+    this->levels.append(0.1f);
+  }
+  SbList <float> levels;
+  SbList <float> ranges;
+  float sizefactor;
+  int mintriangles;
 };
 
+#define PRIVATE(obj) obj->pimpl
+
 SO_ACTION_SOURCE(SoSimplifyAction);
 
 /*!
@@ -99,3 +120,122 @@ SoSimplifyAction::apply(const SoPathList & pathlist, SbBool obeysrules)
 {
   inherited::apply(pathlist, obeysrules);
 }
+
+/*!
+  Sets the simplification levels, as fractions of the original number
+  of triangles, in decreasing order. A level of 1.0 or more uses the
+  original geometry. The default levels are 1.0, 0.3 and 0.1.
+*/
+void
+SoSimplifyAction::setSimplificationLevels(const int num, const float levels[])
+{
+  PRIVATE(this)->levels.truncate(0);
+  for (int i = 0; i < num; i++) {
+    PRIVATE(this)->levels.append(SbClamp(levels[i], 0.0f, 1.0f));
+  }
+}
+
+/*!
+  Returns the simplification levels.
+
+  \sa setSimplificationLevels()
+*/
+const float *
+SoSimplifyAction::getSimplificationLevels(void) const
+{
+  return PRIVATE(this)->levels.getArrayPtr();
+}
+
+/*!
+  Returns the number of simplification levels.
+*/
+int
+SoSimplifyAction::getNumSimplificationLevels(void) const
+{
+  return PRIVATE(this)->levels.getLength();
+}
+
+/*!
+  Sets the distances used for switching between the simplification
+  levels. When ranges are set, SoLOD nodes are created instead of
+  SoLevelOfDetail nodes. There should be one range less than there
+  are simplification levels. Set \a num to 0 to go back to using
+  SoLevelOfDetail.
+
+  \sa SoLOD::range
+*/
+void
+SoSimplifyAction::setRanges(const int num, const float newranges[])
+{
+  PRIVATE(this)->ranges.truncate(0);
+  for (int i = 0; i < num; i++) {
+    PRIVATE(this)->ranges.append(newranges[i]);
+  }
+}
+
+/*!
+  Returns the ranges.
+
+  \sa setRanges()
+*/
+const float *
+SoSimplifyAction::getRanges(void) const
+{
+  return PRIVATE(this)->ranges.getArrayPtr();
+}
+
+/*!
+  Returns the number of ranges.
+*/
+int
+SoSimplifyAction::getNumRanges(void) const
+{
+  return PRIVATE(this)->ranges.getLength();
+}
+
+/*!
+  Sets the number of pixels each triangle should cover on average
+  before switching to the next, coarser, level. This is used to
+  calculate the SoLevelOfDetail::screenArea values. Default value is
+  1.0.
+*/
+void
+SoSimplifyAction::setSizeFactor(const float size)
+{
+  PRIVATE(this)->sizefactor = size;
+}
+
+/*!
+  Returns the size factor.
+
+  \sa setSizeFactor()
+*/
+float
+SoSimplifyAction::getSizeFactor(void) const
+{
+  return PRIVATE(this)->sizefactor;
+}
+
+/*!
+  Sets the minimum number of triangles in a simplified level. Geometry
+  with fewer triangles than this is not simplified. Default value is
+  100.
+*/
+void
+SoSimplifyAction::setMinTriangles(const int mintri)
+{
+  PRIVATE(this)->mintriangles = mintri;
+}
+
+/*!
+  Returns the minimum number of triangles.
+
+  \sa setMinTriangles()
+*/
+int
+SoSimplifyAction::getMinTriangles(void) const
+{
+  return PRIVATE(this)->mintriangles;
+}
+
+#undef PRIVATE
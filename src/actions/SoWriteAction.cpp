@@ -104,6 +104,10 @@
   }
   \endcode
 
+  Scenes which are read often, for instance on every start of an
+  application, can be written as snapshots instead, see
+  setSnapshot().
+
   \sa SoOutput
 */
 
@@ -117,11 +121,17 @@
 #include "coindefs.h"
 #include "actions/SoSubActionP.h"
 #include "io/SoWriterefCounter.h"
+#include "misc/SoDBP.h"
 
 class SoWriteActionP {
 public:
+  SoWriteActionP(void) : snapshot(FALSE) { }
+
+  SbBool snapshot;
 };
 
+#define PRIVATE(obj) ((obj)->pimpl)
+
 SO_ACTION_SOURCE(SoWriteAction);
 
 
@@ -180,6 +190,55 @@ SoWriteAction::getOutput(void) const
   return this->outobj;
 }
 
+/*!
+  Sets whether the scene should be written as a snapshot.
+
+  Snapshots are binary Inventor files in which the arrays of numbers
+  in multi-value fields, like the coordinates in SoCoordinate3 or the
+  indices in SoIndexedFaceSet, are stored just as they are laid out
+  in memory, in the byte order of the writing host. They can be read
+  back with SoDB::readAll() and the other import methods of SoDB,
+  like any other Inventor file.
+
+  When a snapshot file is read on a host with the same byte order,
+  and SoInput can map the file into memory, large arrays are not
+  copied, but used straight from the mapping, as if set with
+  SoMField::setValuesPointer(). Only the pages of the file which are
+  actually accessed are then read from disk, which makes loading of
+  large scenes almost instant. The mapping is private, so changing the
+  field values leaves the file untouched, and only the changed pages
+  are copied. It is released when the last field using it is
+  destructed. Note that for such fields,
+  SoMField::isDeleteValuesEnabled() returns \c FALSE, and
+  SoMField::enableDeleteValues() must not be called.
+
+  Unlike regular binary import, invalid floating point numbers are
+  not replaced while reading snapshots, as they are trusted to have
+  been written by this method.
+
+  Snapshot mode sets the SoOutput instance to binary format and
+  changes its header string when the action is applied, so it must be
+  set before anything has been written.
+
+  \sa isSnapshot()
+*/
+void
+SoWriteAction::setSnapshot(const SbBool onoff)
+{
+  PRIVATE(this)->snapshot = onoff;
+}
+
+/*!
+  Returns whether the scene is written as a snapshot.
+
+  \sa setSnapshot()
+*/
+SbBool
+SoWriteAction::isSnapshot(void) const
+{
+  return PRIVATE(this)->snapshot;
+}
+
 /*!
   Applies the write method to the subgraph starting at \a node with
   the current SoOutput instance, without resetting any of the internal
@@ -235,6 +294,11 @@ SoWriteAction::beginTraversal(SoNode * node)
   SoNodeSensor *sensor = NULL;
 #endif
   if (this->continuing == FALSE) { // Run through both stages.
+    if (PRIVATE(this)->snapshot) {
+      this->outobj->setBinary(TRUE);
+      this->outobj->setHeaderString(SoDBP::getSnapshotHeader());
+    }
+
     // call SoWriterefCounter::instance() before traversing to set the
     // "current" pointer in SoWriterefCounter. This is needed to be
     // backwards compatible with old code that uses the writeref
@@ -282,6 +346,8 @@ SoWriteAction::shouldCompactPathLists(void) const
   return FALSE;
 }
 
+#undef PRIVATE
+
 #ifdef COIN_TEST_SUITE
 
 // check that the realTime GlobalField is written if it has any
@@ -359,4 +425,130 @@ BOOST_AUTO_TEST_CASE(GlobalField)
 
 }
 
+#include <Inventor/nodes/SoCoordinate3.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+
+static SoSeparator *
+snapshot_scene(const int numpoints)
+{
+  SoSeparator * root = new SoSeparator;
+  SoCoordinate3 * coords = new SoCoordinate3;
+  coords->point.setNum(numpoints);
+  SbVec3f * p = coords->point.startEditing();
+  for (int i = 0; i < numpoints; i++) {
+    p[i].setValue(float(i), float(i) * 0.5f, -float(i));
+  }
+  coords->point.finishEditing();
+  root->addChild(coords);
+  SoIndexedFaceSet * faceset = new SoIndexedFaceSet;
+  const int32_t indices[] = { 0, 1, 2, -1, 2, 1, 3, -1 };
+  faceset->coordIndex.setValues(0, 8, indices);
+  root->addChild(faceset);
+  return root;
+}
+
+static SbBool
+snapshot_check_scene(SoSeparator * root, const int numpoints)
+{
+  if (root->getNumChildren() != 2) return FALSE;
+  SoCoordinate3 * coords = (SoCoordinate3 *) root->getChild(0);
+  SoIndexedFaceSet * faceset = (SoIndexedFaceSet *) root->getChild(1);
+  if (coords->point.getNum() != numpoints) return FALSE;
+  for (int i = 0; i < numpoints; i++) {
+    if (coords->point[i] != SbVec3f(float(i), float(i) * 0.5f, -float(i))) {
+      return FALSE;
+    }
+  }
+  return (faceset->coordIndex.getNum() == 8) &&
+    (faceset->coordIndex[2] == 2) && (faceset->coordIndex[7] == -1);
+}
+
+BOOST_AUTO_TEST_CASE(snapshotFile)
+{
+  const int numpoints = 10000;
+  SoSeparator * scene = snapshot_scene(numpoints);
+  scene->ref();
+
+  FILE * fp = tmpfile();
+  BOOST_REQUIRE(fp);
+  SoOutput out;
+  out.setFilePointer(fp);
+  SoWriteAction wa(&out);
+  wa.setSnapshot(TRUE);
+  wa.apply(scene);
+  scene->unref();
+  fflush(fp);
+
+  rewind(fp);
+  SoSeparator * root;
+  {
+    SoInput in;
+    in.setFilePointer(fp);
+    BOOST_CHECK(in.isBinary());
+    root = SoDB::readAll(&in);
+  }
+  BOOST_REQUIRE(root);
+  root->ref();
+  // the values must stay valid after the input is gone
+  BOOST_CHECK(snapshot_check_scene(root, numpoints));
+
+  SoCoordinate3 * coords = (SoCoordinate3 *) root->getChild(0);
+  if (coin_getenv("COIN_SOINPUT_NO_MMAP") == NULL) {
+    // large arrays are used in place from the mapping, small copied
+    BOOST_CHECK(!coords->point.isDeleteValuesEnabled());
+    BOOST_CHECK(((SoIndexedFaceSet *) root->getChild(1))->coordIndex.isDeleteValuesEnabled());
+  }
+
+  // changes are private to the field
+  coords->point.set1Value(1, SbVec3f(-1.0f, -1.0f, -1.0f));
+  coords->point.set1Value(numpoints, SbVec3f(1.0f, 1.0f, 1.0f));
+  BOOST_CHECK_EQUAL(coords->point.getNum(), numpoints + 1);
+  BOOST_CHECK(coords->point[1] == SbVec3f(-1.0f, -1.0f, -1.0f));
+  BOOST_CHECK(coords->point[2] == SbVec3f(2.0f, 1.0f, -2.0f));
+
+  rewind(fp);
+  SoInput in;
+  in.setFilePointer(fp);
+  SoSeparator * again = SoDB::readAll(&in);
+  BOOST_REQUIRE(again);
+  again->ref();
+  BOOST_CHECK(snapshot_check_scene(again, numpoints));
+  again->unref();
+  in.closeFile();
+
+  root->unref();
+  fclose(fp);
+}
+
+BOOST_AUTO_TEST_CASE(snapshotBuffer)
+{
+  // arrays in memory buffers are always copied
+  const int numpoints = 2000;
+  SoSeparator * scene = snapshot_scene(numpoints);
+  scene->ref();
+
+  SoOutput out;
+  const int buffer_size = 1024;
+  char * buffer = (char *)malloc(buffer_size);
+  out.setBuffer(buffer, buffer_size, realloc);
+  SoWriteAction wa(&out);
+  wa.setSnapshot(TRUE);
+  BOOST_CHECK(wa.isSnapshot());
+  wa.apply(scene);
+  scene->unref();
+
+  void * data;
+  size_t size;
+  out.getBuffer(data, size);
+  SoInput in;
+  in.setBuffer(data, size);
+  SoSeparator * root = SoDB::readAll(&in);
+  BOOST_REQUIRE(root);
+  root->ref();
+  BOOST_CHECK(snapshot_check_scene(root, numpoints));
+  BOOST_CHECK(((SoCoordinate3 *) root->getChild(0))->point.isDeleteValuesEnabled());
+  root->unref();
+  free(data);
+}
+
 #endif // COIN_TEST_SUITE
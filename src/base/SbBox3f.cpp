@@ -437,17 +437,18 @@ SbBox3f::transform(const SbMatrix & matrix)
   }
 #endif // COIN_DEBUG
 
-  SbVec3f dst;
   SbVec3f points[2] = {this->minpt, this->maxpt};
-  SbVec3f corner;
+  SbVec3f corners[8];
   SbBox3f newbox;
 
-  //transform all the corners and include them into the new box.
+  //Find all corners the "binary" way :-)
   for (int i=0;i<8;i++) {
-    //Find all corners the "binary" way :-)
-    corner.setValue(points[(i&4)>>2][0], points[(i&2)>>1][1], points[i&1][2]);
-    matrix.multVecMatrix(corner, dst);
-    newbox.extendBy(dst);
+    corners[i].setValue(points[(i&4)>>2][0], points[(i&2)>>1][1], points[i&1][2]);
+  }
+  //transform all the corners and include them into the new box.
+  matrix.multVecMatrix(corners, corners, 8);
+  for (int j=0;j<8;j++) {
+    newbox.extendBy(corners[j]);
   }
   this->setBounds(newbox.minpt, newbox.maxpt);
 }
@@ -134,6 +134,11 @@
 
 #include "coindefs.h" // COIN_STUB()
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SBMATRIX_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
 #ifndef COIN_WORKAROUND_NO_USING_STD_FUNCS
 using std::memmove;
 using std::memcmp;
@@ -1525,6 +1530,189 @@ SbMatrix::multDirMatrix(const SbVec3f & src, SbVec3f & dst) const
   dst[2] = s[0]*t0[2] + s[1]*t1[2] + s[2]*t2[2];
 }
 
+#ifdef SBMATRIX_HAVE_SSE2
+
+namespace {
+
+enum SbMatrixTransformMode {
+  SBMATRIX_AFFINE_POINTS,
+  SBMATRIX_POINTS,
+  SBMATRIX_DIRECTIONS
+};
+
+// Loads the four packed points at p (x0 y0 z0 x1, y1 z1 x2 y2,
+// z2 x3 y3 z3) into one vector per coordinate.
+inline void
+sbmatrix_load4(const float * p, __m128 & x, __m128 & y, __m128 & z)
+{
+  const __m128 a = _mm_loadu_ps(p);
+  const __m128 b = _mm_loadu_ps(p + 4);
+  const __m128 c = _mm_loadu_ps(p + 8);
+  x = _mm_shuffle_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3,3,0,0)),
+                     _mm_shuffle_ps(b, c, _MM_SHUFFLE(1,1,2,2)),
+                     _MM_SHUFFLE(2,0,2,0));
+  y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0,0,1,1)),
+                     _mm_shuffle_ps(b, c, _MM_SHUFFLE(2,2,3,3)),
+                     _MM_SHUFFLE(2,0,2,0));
+  z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1,1,2,2)),
+                     _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,3,0,0)),
+                     _MM_SHUFFLE(2,0,2,0));
+}
+
+// The reverse of sbmatrix_load4().
+inline void
+sbmatrix_store4(float * p, const __m128 x, const __m128 y, const __m128 z)
+{
+  const __m128 a = _mm_shuffle_ps(_mm_unpacklo_ps(x, y),
+                                  _mm_shuffle_ps(z, x, _MM_SHUFFLE(1,1,0,0)),
+                                  _MM_SHUFFLE(2,0,1,0));
+  const __m128 b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1,1,1,1)),
+                                  _mm_unpackhi_ps(x, y),
+                                  _MM_SHUFFLE(1,0,2,0));
+  const __m128 c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3,3,2,2)),
+                                  _mm_shuffle_ps(y, z, _MM_SHUFFLE(3,3,3,3)),
+                                  _MM_SHUFFLE(2,0,2,0));
+  _mm_storeu_ps(p, a);
+  _mm_storeu_ps(p + 4, b);
+  _mm_storeu_ps(p + 8, c);
+}
+
+// Computes x*m0 + y*m1 + z*m2 in the same order as the scalar code,
+// so the results are bit-identical.
+inline __m128
+sbmatrix_dot3(const __m128 x, const __m128 y, const __m128 z,
+              const float m0, const float m1, const float m2)
+{
+  return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m0)),
+                               _mm_mul_ps(y, _mm_set1_ps(m1))),
+                    _mm_mul_ps(z, _mm_set1_ps(m2)));
+}
+
+// Transforms the vectors in src four at a time, and returns the
+// number of vectors transformed. All four vectors are loaded before
+// any result is stored, so src and dst can be the same array.
+int
+sbmatrix_transform_sse2(const float (*t)[4], const SbVec3f * src, SbVec3f * dst,
+                        const int num, const SbMatrixTransformMode mode)
+{
+  const float * s = reinterpret_cast<const float *>(src);
+  float * d = reinterpret_cast<float *>(dst);
+  const int num4 = num & ~3;
+  for (int i = 0; i < num4; i += 4, s += 12, d += 12) {
+    __m128 x, y, z;
+    sbmatrix_load4(s, x, y, z);
+    __m128 rx = sbmatrix_dot3(x, y, z, t[0][0], t[1][0], t[2][0]);
+    __m128 ry = sbmatrix_dot3(x, y, z, t[0][1], t[1][1], t[2][1]);
+    __m128 rz = sbmatrix_dot3(x, y, z, t[0][2], t[1][2], t[2][2]);
+    if (mode != SBMATRIX_DIRECTIONS) {
+      rx = _mm_add_ps(rx, _mm_set1_ps(t[3][0]));
+      ry = _mm_add_ps(ry, _mm_set1_ps(t[3][1]));
+      rz = _mm_add_ps(rz, _mm_set1_ps(t[3][2]));
+    }
+    if (mode == SBMATRIX_POINTS) {
+      const __m128 w = _mm_add_ps(sbmatrix_dot3(x, y, z, t[0][3], t[1][3], t[2][3]),
+                                  _mm_set1_ps(t[3][3]));
+      rx = _mm_div_ps(rx, w);
+      ry = _mm_div_ps(ry, w);
+      rz = _mm_div_ps(rz, w);
+    }
+    sbmatrix_store4(d, rx, ry, rz);
+  }
+  return num4;
+}
+
+} // anonymous namespace
+
+#endif // SBMATRIX_HAVE_SSE2
+
+/*!
+  \overload
+
+  Multiplies the \a num points in \a src with this matrix, and
+  returns the results in \a dst. This gives the same results as
+  calling multVecMatrix() for each point, but is faster for large
+  arrays, as the matrix is inspected only once.
+
+  \a src and \a dst can be the same array, but must otherwise not
+  overlap.
+
+  \since Coin 4.1
+*/
+void
+SbMatrix::multVecMatrix(const SbVec3f * src, SbVec3f * dst, const int num) const
+{
+  if (SbMatrixP::isIdentity(this->matrix)) {
+    if (src != dst) { memcpy(dst, src, num * sizeof(SbVec3f)); }
+    return;
+  }
+
+  const float (*t)[4] = this->matrix;
+  const float m00 = t[0][0], m01 = t[0][1], m02 = t[0][2], m03 = t[0][3];
+  const float m10 = t[1][0], m11 = t[1][1], m12 = t[1][2], m13 = t[1][3];
+  const float m20 = t[2][0], m21 = t[2][1], m22 = t[2][2], m23 = t[2][3];
+  const float m30 = t[3][0], m31 = t[3][1], m32 = t[3][2], m33 = t[3][3];
+
+  // W is 1 for affine matrices (the common case), so skip the
+  // division then.
+  const SbBool affine = m03 == 0.0f && m13 == 0.0f && m23 == 0.0f && m33 == 1.0f;
+  int start = 0;
+#ifdef SBMATRIX_HAVE_SSE2
+  start = sbmatrix_transform_sse2(t, src, dst, num,
+                                  affine ? SBMATRIX_AFFINE_POINTS : SBMATRIX_POINTS);
+#endif // SBMATRIX_HAVE_SSE2
+  if (affine) {
+    for (int i = start; i < num; i++) {
+      const float x = src[i][0], y = src[i][1], z = src[i][2];
+      dst[i].setValue(x*m00 + y*m10 + z*m20 + m30,
+                      x*m01 + y*m11 + z*m21 + m31,
+                      x*m02 + y*m12 + z*m22 + m32);
+    }
+  }
+  else {
+    for (int i = start; i < num; i++) {
+      const float x = src[i][0], y = src[i][1], z = src[i][2];
+      const float W = x*m03 + y*m13 + z*m23 + m33;
+      dst[i].setValue((x*m00 + y*m10 + z*m20 + m30)/W,
+                      (x*m01 + y*m11 + z*m21 + m31)/W,
+                      (x*m02 + y*m12 + z*m22 + m32)/W);
+    }
+  }
+}
+
+/*!
+  \overload
+
+  Multiplies the \a num direction vectors in \a src with this matrix,
+  and returns the results in \a dst. See multVecMatrix() for the
+  array version of point transformations.
+
+  \since Coin 4.1
+*/
+void
+SbMatrix::multDirMatrix(const SbVec3f * src, SbVec3f * dst, const int num) const
+{
+  if (SbMatrixP::isIdentity(this->matrix)) {
+    if (src != dst) { memcpy(dst, src, num * sizeof(SbVec3f)); }
+    return;
+  }
+
+  const float (*t)[4] = this->matrix;
+  const float m00 = t[0][0], m01 = t[0][1], m02 = t[0][2];
+  const float m10 = t[1][0], m11 = t[1][1], m12 = t[1][2];
+  const float m20 = t[2][0], m21 = t[2][1], m22 = t[2][2];
+
+  int start = 0;
+#ifdef SBMATRIX_HAVE_SSE2
+  start = sbmatrix_transform_sse2(t, src, dst, num, SBMATRIX_DIRECTIONS);
+#endif // SBMATRIX_HAVE_SSE2
+  for (int i = start; i < num; i++) {
+    const float x = src[i][0], y = src[i][1], z = src[i][2];
+    dst[i].setValue(x*m00 + y*m10 + z*m20,
+                    x*m01 + y*m11 + z*m21,
+                    x*m02 + y*m12 + z*m22);
+  }
+}
+
 /*!
   Multiplies line point with the full matrix and multiplies the
   line direction with the matrix without the translation components.
@@ -2053,6 +2241,7 @@ SbMatrixP::decomp_affine(SbMatrixP::HMatrix A, SbMatrixP::AffineParts * parts)
 
 #ifdef COIN_TEST_SUITE
 #include <Inventor/SbDPMatrix.h>
+#include <Inventor/SbVec3f.h>
 
 BOOST_AUTO_TEST_CASE(constructFromSbDPMatrix) {
   SbMatrixd a(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
@@ -2063,4 +2252,48 @@ BOOST_AUTO_TEST_CASE(constructFromSbDPMatrix) {
   BOOST_CHECK_MESSAGE(b == d,
                       "Equality comparrison failed!");
 }
+
+BOOST_AUTO_TEST_CASE(multVecArray) {
+  SbMatrix m(1,2,3,0.1f, 4,5,6,0.2f, 7,8,9,0.3f, 10,11,12,1.5f);
+  SbMatrix affine(1,2,3,0, 4,5,6,0, 7,8,9,0, 10,11,12,1);
+  SbMatrix identity = SbMatrix::identity();
+  const SbMatrix * matrices[] = { &m, &affine, &identity };
+
+  // not a multiple of four, to also cover the vectors left over by
+  // the SIMD code
+  const int num = 19;
+  SbVec3f src[num], dst[num], tmp[num];
+  for (int i = 0; i < num; i++) { src[i].setValue(float(i), float(i*i) - 20.0f, 0.5f * i + 0.1f); }
+
+  for (int k = 0; k < 3; k++) {
+    const SbMatrix & mat = *matrices[k];
+    mat.multVecMatrix(src, dst, num);
+    for (int i = 0; i < num; i++) {
+      SbVec3f v;
+      mat.multVecMatrix(src[i], v);
+      BOOST_CHECK_MESSAGE(v == dst[i], "array multVecMatrix() differs from single vector version");
+    }
+    mat.multDirMatrix(src, dst, num);
+    for (int i = 0; i < num; i++) {
+      SbVec3f v;
+      mat.multDirMatrix(src[i], v);
+      BOOST_CHECK_MESSAGE(v == dst[i], "array multDirMatrix() differs from single vector version");
+    }
+    // transforming in place
+    for (int i = 0; i < num; i++) { tmp[i] = src[i]; }
+    mat.multVecMatrix(tmp, tmp, num);
+    for (int i = 0; i < num; i++) {
+      SbVec3f v;
+      mat.multVecMatrix(src[i], v);
+      BOOST_CHECK_MESSAGE(v == tmp[i], "in place multVecMatrix() failed");
+    }
+    for (int i = 0; i < num; i++) { tmp[i] = src[i]; }
+    mat.multDirMatrix(tmp, tmp, num);
+    for (int i = 0; i < num; i++) {
+      SbVec3f v;
+      mat.multDirMatrix(src[i], v);
+      BOOST_CHECK_MESSAGE(v == tmp[i], "in place multDirMatrix() failed");
+    }
+  }
+}
 #endif //COIN_TEST_SUITE
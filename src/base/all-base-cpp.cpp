@@ -99,9 +99,11 @@
 #include "dynarray.cpp"
 #include "hash.cpp"
 #include "heap.cpp"
+#include "imageresize.cpp"
 #include "list.cpp"
 #include "memalloc.cpp"
 #include "namemap.cpp"
+#include "radixsort.cpp"
 #include "rbptree.cpp"
 #include "string.cpp"
 #include "time.cpp"
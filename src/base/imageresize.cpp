@@ -0,0 +1,673 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+/*
+  Separable image resampling and mipmap level halving for 8-bit
+  images with 1 to 4 components, used for texture images.
+
+  cc_image_resize() first computes the source pixels and weights
+  contributing to each destination column and row, for the chosen
+  filter kernel. When downscaling, the kernel is widened by the
+  scale factor, so that all source pixels contribute. The image is
+  then resampled in bands of destination rows: each band filters the
+  source rows it needs horizontally into a small float buffer, and
+  combines these vertically into the destination rows. The bands are
+  independent of each other and are spread over the available CPUs,
+  and the band buffers are small enough to stay in the cache.
+
+  Pixels outside the image are clamped to the edge.
+*/
+
+#include "base/imageresize.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include <Inventor/SbBasic.h>
+
+#include "threads/parallelp.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGERESIZE_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+/* ************************************************************************* */
+
+/* the number of destination rows filtered by each job */
+#define IMAGERESIZE_BAND_ROWS 32
+
+typedef struct {
+  int first; /* first source pixel */
+  int num; /* number of source pixels */
+} imageresize_span;
+
+/* The source pixels and weights contributing to each destination
+   pixel along one axis. */
+typedef struct {
+  imageresize_span * spans;
+  float * weights; /* maxtaps weights for each destination pixel */
+  int maxtaps;
+} imageresize_kernel;
+
+static float
+imageresize_sinc(const float x)
+{
+  if (x == 0.0f) return 1.0f;
+  const float px = float(M_PI) * x;
+  return float(sin(px)) / px;
+}
+
+static float
+imageresize_filter(const enum cc_image_resize_filter filter, const float x)
+{
+  switch (filter) {
+  case CC_IMAGE_RESIZE_BOX:
+    return (x >= -0.5f && x < 0.5f) ? 1.0f : 0.0f;
+  case CC_IMAGE_RESIZE_BILINEAR:
+    return (x > -1.0f && x < 1.0f) ? 1.0f - float(fabs(x)) : 0.0f;
+  case CC_IMAGE_RESIZE_LANCZOS:
+    return (x > -3.0f && x < 3.0f) ? imageresize_sinc(x) * imageresize_sinc(x / 3.0f) : 0.0f;
+  default:
+    assert(0 && "unknown filter");
+    break;
+  }
+  return 0.0f;
+}
+
+static float
+imageresize_support(const enum cc_image_resize_filter filter)
+{
+  switch (filter) {
+  case CC_IMAGE_RESIZE_BOX: return 0.5f;
+  case CC_IMAGE_RESIZE_BILINEAR: return 1.0f;
+  default: break;
+  }
+  return 3.0f;
+}
+
+static void
+imageresize_make_kernel(imageresize_kernel * kernel, const int srcsize,
+                        const int dstsize, const enum cc_image_resize_filter filter)
+{
+  const float scale = float(dstsize) / float(srcsize);
+  const float fscale = SbMin(scale, 1.0f);
+  const float width = imageresize_support(filter) / fscale;
+
+  kernel->maxtaps = int(ceil(width * 2.0f)) + 2;
+  kernel->spans = new imageresize_span[dstsize];
+  kernel->weights = new float[dstsize * kernel->maxtaps];
+
+  for (int i = 0; i < dstsize; i++) {
+    float * w = kernel->weights + i * kernel->maxtaps;
+    for (int k = 0; k < kernel->maxtaps; k++) w[k] = 0.0f;
+
+    /* in source pixel coordinates, with pixel centers at j + 0.5 */
+    const float center = (float(i) + 0.5f) / scale;
+    const int start = int(floor(center - width));
+    const int end = int(ceil(center + width));
+    const int first = SbClamp(start, 0, srcsize - 1);
+    float sum = 0.0f;
+    for (int j = start; j <= end; j++) {
+      const float f = imageresize_filter(filter, (float(j) + 0.5f - center) * fscale);
+      if (f == 0.0f) continue;
+      const int k = SbClamp(j, 0, srcsize - 1) - first;
+      assert(k < kernel->maxtaps);
+      w[k] += f;
+      sum += f;
+    }
+
+    /* normalize, and strip taps without weight at the ends */
+    int num = kernel->maxtaps;
+    while (num > 1 && w[num-1] == 0.0f) num--;
+    int skip = 0;
+    while (skip < num - 1 && w[skip] == 0.0f) skip++;
+    for (int k = 0; k < num - skip; k++) {
+      w[k] = (sum != 0.0f) ? w[k + skip] / sum : 0.0f;
+    }
+    kernel->spans[i].first = first + skip;
+    kernel->spans[i].num = num - skip;
+  }
+}
+
+typedef struct {
+  const unsigned char * src;
+  unsigned char * dst;
+  int width, height, nc;
+  int newwidth, newheight;
+  imageresize_kernel xkernel;
+  imageresize_kernel ykernel;
+  SbBool nearest; /* a single source pixel for each destination pixel */
+} imageresize_data;
+
+// Filters one source row horizontally, from destination pixel \a
+// start. The number of components is a template parameter, so that
+// the inner loops can be unrolled.
+template <int NC>
+static void
+imageresize_row(const unsigned char * srcrow, float * out, const int newwidth,
+                const imageresize_kernel & kernel, const int start = 0)
+{
+  for (int x = start; x < newwidth; x++) {
+    const float * w = kernel.weights + x * kernel.maxtaps;
+    const unsigned char * s = srcrow + kernel.spans[x].first * NC;
+    const int num = kernel.spans[x].num;
+    float sum[NC];
+    int c;
+    for (c = 0; c < NC; c++) sum[c] = 0.0f;
+    for (int k = 0; k < num; k++) {
+      for (c = 0; c < NC; c++) sum[c] += w[k] * float(s[k * NC + c]);
+    }
+    for (c = 0; c < NC; c++) out[x * NC + c] = sum[c];
+  }
+}
+
+#ifdef IMAGERESIZE_HAVE_SSE2
+
+// Filters one source row of 3 or 4 components horizontally, with all
+// components of a pixel in one register. The sums are done in the same
+// order as in imageresize_row(), so the results are identical. For 3
+// components, 4 bytes are read and 4 floats are written for each
+// pixel, so the pixels touching the end of the source or destination
+// row are left for imageresize_row().
+template <int NC>
+static int
+imageresize_row_sse2(const unsigned char * srcrow, const int width,
+                     float * out, const int newwidth,
+                     const imageresize_kernel & kernel)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int x;
+  for (x = 0; x < newwidth; x++) {
+    const int first = kernel.spans[x].first;
+    const int num = kernel.spans[x].num;
+    if (NC == 3 && (x == newwidth - 1 || first + num >= width)) break;
+    const float * w = kernel.weights + x * kernel.maxtaps;
+    const unsigned char * s = srcrow + first * NC;
+    __m128 sum = _mm_setzero_ps();
+    for (int k = 0; k < num; k++) {
+      int32_t pixel;
+      memcpy(&pixel, s + k * NC, sizeof(pixel));
+      __m128i v = _mm_cvtsi32_si128(pixel);
+      v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+      sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_cvtepi32_ps(v)));
+    }
+    _mm_storeu_ps(out + x * NC, sum);
+  }
+  return x;
+}
+
+#endif // IMAGERESIZE_HAVE_SSE2
+
+// Filters the source rows in \a in vertically with the \a num
+// weights in \a w, and rounds the results into \a dst. \a acc is a
+// scratch row.
+static void
+imageresize_column(const float * in, const int rowsize, const float * w,
+                   const int num, unsigned char * dst, float * acc)
+{
+  int i = 0;
+#ifdef IMAGERESIZE_HAVE_SSE2
+  // 16 values at a time, with the sums kept in registers. Each value
+  // is summed in the same order as below, so the results are identical.
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 max = _mm_set1_ps(255.0f);
+  for (; i + 16 <= rowsize; i += 16) {
+    __m128 a0 = zero, a1 = zero, a2 = zero, a3 = zero;
+    const float * inrow = in + i;
+    for (int k = 0; k < num; k++) {
+      const __m128 wk = _mm_set1_ps(w[k]);
+      a0 = _mm_add_ps(a0, _mm_mul_ps(wk, _mm_loadu_ps(inrow)));
+      a1 = _mm_add_ps(a1, _mm_mul_ps(wk, _mm_loadu_ps(inrow + 4)));
+      a2 = _mm_add_ps(a2, _mm_mul_ps(wk, _mm_loadu_ps(inrow + 8)));
+      a3 = _mm_add_ps(a3, _mm_mul_ps(wk, _mm_loadu_ps(inrow + 12)));
+      inrow += rowsize;
+    }
+#define IMAGERESIZE_ROUND(a) \
+    _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(a, half), zero), max))
+    const __m128i lo = _mm_packs_epi32(IMAGERESIZE_ROUND(a0), IMAGERESIZE_ROUND(a1));
+    const __m128i hi = _mm_packs_epi32(IMAGERESIZE_ROUND(a2), IMAGERESIZE_ROUND(a3));
+#undef IMAGERESIZE_ROUND
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(lo, hi));
+  }
+#endif // IMAGERESIZE_HAVE_SSE2
+
+  const int start = i;
+  for (i = start; i < rowsize; i++) acc[i] = 0.0f;
+  for (int k = 0; k < num; k++) {
+    const float wk = w[k];
+    const float * inrow = in + k * rowsize;
+    for (i = start; i < rowsize; i++) acc[i] += wk * inrow[i];
+  }
+  for (i = start; i < rowsize; i++) {
+    const float v = acc[i] + 0.5f;
+    dst[i] = (unsigned char) (v <= 0.0f ? 0 : (v >= 255.0f ? 255 : int(v)));
+  }
+}
+
+static void
+imageresize_band_job(void * closure, int job)
+{
+  const imageresize_data * data = static_cast<const imageresize_data *>(closure);
+  const int nc = data->nc;
+  const int dstrowsize = data->newwidth * nc;
+  const int srcrowsize = data->width * nc;
+  const int y0 = job * IMAGERESIZE_BAND_ROWS;
+  const int y1 = SbMin(y0 + IMAGERESIZE_BAND_ROWS, data->newheight);
+
+  const imageresize_span * yspans = data->ykernel.spans;
+  if (data->nearest) {
+    const imageresize_span * xspans = data->xkernel.spans;
+    for (int y = y0; y < y1; y++) {
+      const unsigned char * srcrow = data->src + yspans[y].first * srcrowsize;
+      unsigned char * dst = data->dst + y * dstrowsize;
+      for (int x = 0; x < data->newwidth; x++) {
+        const unsigned char * s = srcrow + xspans[x].first * nc;
+        for (int c = 0; c < nc; c++) *dst++ = s[c];
+      }
+    }
+    return;
+  }
+
+  const int firstrow = yspans[y0].first;
+  int endrow = firstrow;
+  for (int y = y0; y < y1; y++) {
+    endrow = SbMax(endrow, yspans[y].first + yspans[y].num);
+  }
+
+  /* filter the source rows of this band horizontally */
+  float * rows = new float[(endrow - firstrow) * dstrowsize + dstrowsize];
+  float * acc = rows + (endrow - firstrow) * dstrowsize;
+  for (int r = firstrow; r < endrow; r++) {
+    const unsigned char * srcrow = data->src + r * srcrowsize;
+    float * out = rows + (r - firstrow) * dstrowsize;
+    int start = 0;
+#ifdef IMAGERESIZE_HAVE_SSE2
+    if (nc == 3) {
+      start = imageresize_row_sse2<3>(srcrow, data->width, out,
+                                      data->newwidth, data->xkernel);
+    }
+    else if (nc == 4) {
+      start = imageresize_row_sse2<4>(srcrow, data->width, out,
+                                      data->newwidth, data->xkernel);
+    }
+#endif // IMAGERESIZE_HAVE_SSE2
+    switch (nc) {
+    case 1: imageresize_row<1>(srcrow, out, data->newwidth, data->xkernel, start); break;
+    case 2: imageresize_row<2>(srcrow, out, data->newwidth, data->xkernel, start); break;
+    case 3: imageresize_row<3>(srcrow, out, data->newwidth, data->xkernel, start); break;
+    default: imageresize_row<4>(srcrow, out, data->newwidth, data->xkernel, start); break;
+    }
+  }
+
+  /* and combine them vertically into the destination rows */
+  const int ytaps = data->ykernel.maxtaps;
+  for (int y = y0; y < y1; y++) {
+    const float * w = data->ykernel.weights + y * ytaps;
+    const float * in = rows + (yspans[y].first - firstrow) * dstrowsize;
+    imageresize_column(in, dstrowsize, w, yspans[y].num,
+                       data->dst + y * dstrowsize, acc);
+  }
+  delete [] rows;
+}
+
+/*!
+  Resamples the \a width x \a height image in \a src, with \a nc
+  bytes per pixel, to \a newwidth x \a newheight, and stores the
+  result in \a dst, using \a filter.
+
+  CC_IMAGE_RESIZE_BOX averages the source pixels covered by each
+  destination pixel when downscaling, and picks the nearest source
+  pixel when upscaling. CC_IMAGE_RESIZE_BILINEAR and
+  CC_IMAGE_RESIZE_LANCZOS use a tent and a three lobe Lanczos kernel.
+*/
+void
+cc_image_resize(const unsigned char * src, const int width, const int height,
+                const int nc, unsigned char * dst,
+                const int newwidth, const int newheight,
+                const enum cc_image_resize_filter filter)
+{
+  assert(width > 0 && height > 0 && newwidth > 0 && newheight > 0);
+  assert(nc >= 1 && nc <= 4);
+
+  imageresize_data data;
+  data.src = src;
+  data.dst = dst;
+  data.width = width;
+  data.height = height;
+  data.nc = nc;
+  data.newwidth = newwidth;
+  data.newheight = newheight;
+  imageresize_make_kernel(&data.xkernel, width, newwidth, filter);
+  imageresize_make_kernel(&data.ykernel, height, newheight, filter);
+
+  /* upscaling with a box filter just picks the nearest pixel */
+  int i;
+  data.nearest = TRUE;
+  for (i = 0; data.nearest && i < newwidth; i++) data.nearest = (data.xkernel.spans[i].num == 1);
+  for (i = 0; data.nearest && i < newheight; i++) data.nearest = (data.ykernel.spans[i].num == 1);
+
+  const int numbands = (newheight + IMAGERESIZE_BAND_ROWS - 1) / IMAGERESIZE_BAND_ROWS;
+  cc_parallel_run(numbands, imageresize_band_job, &data);
+
+  delete [] data.xkernel.spans;
+  delete [] data.xkernel.weights;
+  delete [] data.ykernel.spans;
+  delete [] data.ykernel.weights;
+}
+
+/* ************************************************************************* */
+
+typedef struct {
+  const unsigned char * src;
+  unsigned char * dst;
+  int width, nc;
+  int newheight;
+  int numjobs;
+} imagehalve_data;
+
+template <int NC>
+static void
+imagehalve_row(const unsigned char * src, const int nextrow,
+               unsigned char * dst, const int newwidth)
+{
+  for (int j = 0; j < newwidth; j++) {
+    for (int c = 0; c < NC; c++) {
+      dst[c] = (src[c] + src[c+NC] + src[c+nextrow] + src[c+nextrow+NC] + 2) >> 2;
+    }
+    dst += NC;
+    src += 2 * NC;
+  }
+}
+
+static void
+imagehalve_job(void * closure, int job)
+{
+  const imagehalve_data * data = static_cast<const imagehalve_data *>(closure);
+  const int nc = data->nc;
+  const int nextrow = data->width * nc;
+  const int newwidth = data->width >> 1;
+  const int y0 = int((int64_t(data->newheight) * job) / data->numjobs);
+  const int y1 = int((int64_t(data->newheight) * (job + 1)) / data->numjobs);
+
+  /* step rows exactly like the old SoGLImage halve_image() did: for
+     odd widths each row pair starts one pixel earlier than 2*i rows
+     in, so mipmaps stay bit-identical to those from earlier versions */
+  const int srcstep = 2 * newwidth * nc + nextrow;
+  for (int i = y0; i < y1; i++) {
+    const unsigned char * src = data->src + i * srcstep;
+    unsigned char * dst = data->dst + i * newwidth * nc;
+    switch (nc) {
+    case 1: imagehalve_row<1>(src, nextrow, dst, newwidth); break;
+    case 2: imagehalve_row<2>(src, nextrow, dst, newwidth); break;
+    case 3: imagehalve_row<3>(src, nextrow, dst, newwidth); break;
+    default: imagehalve_row<4>(src, nextrow, dst, newwidth); break;
+    }
+  }
+}
+
+/*!
+  Creates the next mipmap level of the \a width x \a height image in
+  \a src, with \a nc bytes per pixel, by averaging each 2x2 pixel
+  block (or pixel pair for 1D images), and stores it in \a dst. If a
+  dimension is odd, the last row or column is skipped (for odd widths,
+  the source rows are stepped as in earlier versions of Coin). For large
+  images, \a src and \a dst must not overlap.
+*/
+void
+cc_image_halve(const unsigned char * src, const int width, const int height,
+               const int nc, unsigned char * dst)
+{
+  assert(width > 1 || height > 1);
+  assert(nc >= 1 && nc <= 4);
+
+  /* check for 1D images */
+  if (width == 1 || height == 1) {
+    const int n = SbMax(width >> 1, height >> 1);
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j < nc; j++) {
+        *dst = (src[0] + src[nc]) >> 1;
+        dst++; src++;
+      }
+      src += nc; /* skip to next pixel */
+    }
+    return;
+  }
+
+  imagehalve_data data;
+  data.src = src;
+  data.dst = dst;
+  data.width = width;
+  data.nc = nc;
+  data.newheight = height >> 1;
+
+  /* the jobs are quite cheap, so only split up large images */
+  const int numthreads = cc_parallel_get_num_threads();
+  const int maxjobs = (numthreads > 1) ? numthreads * 4 : 1;
+  data.numjobs = SbMax(1, SbMin(maxjobs, (width >> 1) * data.newheight / 65536));
+  if (data.numjobs == 1) {
+    imagehalve_job(&data, 0);
+  }
+  else {
+    assert((src + width * height * nc <= dst || dst + (width >> 1) * data.newheight * nc <= src) &&
+           "source and destination must not overlap");
+    cc_parallel_run(data.numjobs, imagehalve_job, &data);
+  }
+}
+
+#undef IMAGERESIZE_BAND_ROWS
+#undef IMAGERESIZE_HAVE_SSE2
+
+/* ************************************************************************* */
+
+#ifdef COIN_TEST_SUITE
+#ifdef COIN_TEST_INTERNALS
+
+#include <vector>
+#include <cstring>
+#include <Inventor/SbBasic.h>
+
+#include "base/imageresize.h"
+
+// cc_image_resize() filters the destination rows in bands of this
+// many rows (IMAGERESIZE_BAND_ROWS)
+static const int imageresize_test_bandrows = 32;
+
+static const cc_image_resize_filter imageresize_test_filters[] = {
+  CC_IMAGE_RESIZE_BOX, CC_IMAGE_RESIZE_BILINEAR, CC_IMAGE_RESIZE_LANCZOS
+};
+
+static std::vector<unsigned char>
+imageresize_test_image(const int width, const int height, const int nc)
+{
+  std::vector<unsigned char> image(width * height * nc);
+  unsigned int seed = 12345u + width * 31u + height * 17u + nc;
+  for (size_t i = 0; i < image.size(); i++) {
+    seed = seed * 1103515245u + 12345u;
+    image[i] = (unsigned char) (seed >> 16);
+  }
+  return image;
+}
+
+// The mipmap halving from earlier versions of SoGLImage, which
+// cc_image_halve() must match exactly.
+static void
+imageresize_test_halve_reference(const int width, const int height, const int nc,
+                                 const unsigned char * datain, unsigned char * dataout)
+{
+  int i, j, c;
+  int nextrow = width * nc;
+  int newwidth = width >> 1;
+  int newheight = height >> 1;
+  unsigned char * dst = dataout;
+  const unsigned char * src = datain;
+
+  if (width == 1 || height == 1) {
+    int n = SbMax(newwidth, newheight);
+    for (i = 0; i < n; i++) {
+      for (j = 0; j < nc; j++) {
+        *dst = (src[0] + src[nc]) >> 1;
+        dst++; src++;
+      }
+      src += nc;
+    }
+  }
+  else {
+    for (i = 0; i < newheight; i++) {
+      for (j = 0; j < newwidth; j++) {
+        for (c = 0; c < nc; c++) {
+          *dst = (src[0] + src[nc] + src[nextrow] + src[nextrow+nc] + 2) >> 2;
+          dst++; src++;
+        }
+        src += nc;
+      }
+      src += nextrow;
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(resizeIdentity)
+{
+  const int heights[] = { 1, 5, 32, 33, 65, 100 };
+  for (int f = 0; f < 3; f++) {
+    for (int h = 0; h < int(sizeof(heights) / sizeof(heights[0])); h++) {
+      for (int nc = 1; nc <= 4; nc++) {
+        const int width = 7, height = heights[h];
+        std::vector<unsigned char> src = imageresize_test_image(width, height, nc);
+        std::vector<unsigned char> dst(src.size(), 0);
+        cc_image_resize(&src[0], width, height, nc, &dst[0], width, height,
+                        imageresize_test_filters[f]);
+        BOOST_CHECK_MESSAGE(dst == src,
+                            "resizing to the same size must not change the image "
+                            "(filter " << f << ", height " << height << ", nc " << nc << ")");
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(resizeConstant)
+{
+  const int sizes[][4] = {
+    { 16, 16, 4, 4 }, { 10, 70, 3, 33 }, { 5, 40, 17, 100 }, { 64, 64, 30, 65 }
+  };
+  for (int f = 0; f < 3; f++) {
+    for (int s = 0; s < int(sizeof(sizes) / sizeof(sizes[0])); s++) {
+      const int nc = 3;
+      const unsigned char value[nc] = { 0, 137, 255 };
+      std::vector<unsigned char> src(sizes[s][0] * sizes[s][1] * nc);
+      for (size_t i = 0; i < src.size(); i++) src[i] = value[i % nc];
+      std::vector<unsigned char> dst(sizes[s][2] * sizes[s][3] * nc);
+      cc_image_resize(&src[0], sizes[s][0], sizes[s][1], nc, &dst[0],
+                      sizes[s][2], sizes[s][3], imageresize_test_filters[f]);
+      size_t wrong = 0;
+      for (size_t i = 0; i < dst.size(); i++) {
+        if (dst[i] != value[i % nc]) wrong++;
+      }
+      BOOST_CHECK_MESSAGE(wrong == 0,
+                          "a constant image must stay constant (filter " << f <<
+                          ", " << sizes[s][2] << "x" << sizes[s][3] << ")");
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(resizeBoxHalf)
+{
+  // destination heights on both sides of the band boundaries
+  const int newheights[] = { 1, imageresize_test_bandrows - 1, imageresize_test_bandrows,
+                             imageresize_test_bandrows + 1, 2 * imageresize_test_bandrows + 1 };
+  for (int h = 0; h < int(sizeof(newheights) / sizeof(newheights[0])); h++) {
+    for (int nc = 1; nc <= 4; nc++) {
+      const int newwidth = 9, newheight = newheights[h];
+      const int width = newwidth * 2, height = newheight * 2;
+      std::vector<unsigned char> src = imageresize_test_image(width, height, nc);
+      std::vector<unsigned char> dst(newwidth * newheight * nc);
+      cc_image_resize(&src[0], width, height, nc, &dst[0], newwidth, newheight,
+                      CC_IMAGE_RESIZE_BOX);
+      size_t wrong = 0;
+      for (int y = 0; y < newheight; y++) {
+        for (int x = 0; x < newwidth; x++) {
+          for (int c = 0; c < nc; c++) {
+            const unsigned char * s = &src[((2 * y) * width + 2 * x) * nc + c];
+            const int expected = (s[0] + s[nc] + s[width * nc] + s[width * nc + nc] + 2) >> 2;
+            if (dst[(y * newwidth + x) * nc + c] != expected) wrong++;
+          }
+        }
+      }
+      BOOST_CHECK_MESSAGE(wrong == 0,
+                          "box downscaling by two must average 2x2 blocks "
+                          "(height " << newheight << ", nc " << nc << ")");
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(resizeBands)
+{
+  // upscaling with the box filter picks the nearest source row, so
+  // every row must come out right no matter which band it is in
+  const int width = 3, height = 41, newheight = 4 * imageresize_test_bandrows + 5;
+  std::vector<unsigned char> src = imageresize_test_image(width, height, 1);
+  std::vector<unsigned char> dst(width * newheight);
+  cc_image_resize(&src[0], width, height, 1, &dst[0], width, newheight,
+                  CC_IMAGE_RESIZE_BOX);
+  int wrongrows = 0;
+  for (int y = 0; y < newheight; y++) {
+    const int sy = int((float(y) + 0.5f) * float(height) / float(newheight));
+    if (memcmp(&dst[y * width], &src[sy * width], width) != 0) wrongrows++;
+  }
+  BOOST_CHECK_MESSAGE(wrongrows == 0, "upscaled rows must match their nearest source row");
+}
+
+BOOST_AUTO_TEST_CASE(halveMatchesReference)
+{
+  const int sizes[][2] = {
+    { 2, 2 }, { 8, 8 }, { 7, 5 }, { 9, 4 }, { 4, 9 }, { 33, 67 },
+    { 1030, 515 }, { 1, 8 }, { 1, 7 }, { 8, 1 }, { 7, 1 }, { 2, 1 }, { 1, 2 }
+  };
+  for (int s = 0; s < int(sizeof(sizes) / sizeof(sizes[0])); s++) {
+    for (int nc = 1; nc <= 4; nc++) {
+      const int width = sizes[s][0], height = sizes[s][1];
+      const int num = SbMax(width >> 1, 1) * SbMax(height >> 1, 1) * nc;
+      std::vector<unsigned char> src = imageresize_test_image(width, height, nc);
+      std::vector<unsigned char> expected(num), dst(num);
+      imageresize_test_halve_reference(width, height, nc, &src[0], &expected[0]);
+      cc_image_halve(&src[0], width, height, nc, &dst[0]);
+      BOOST_CHECK_MESSAGE(dst == expected,
+                          "cc_image_halve() must match the old mipmap code "
+                          "(" << width << "x" << height << ", nc " << nc << ")");
+    }
+  }
+}
+
+#endif // COIN_TEST_INTERNALS
+#endif // COIN_TEST_SUITE
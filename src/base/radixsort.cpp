@@ -0,0 +1,155 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+/*
+  Stable LSD radix sort on 32-bit float keys.
+
+  The keys are mapped to unsigned integers which sort in the same
+  order as the floats (the sign bit is flipped for positive values,
+  all bits for negative ones), and are then sorted in three passes on
+  11-bit digits. The histograms for all passes are built in a single
+  run over the keys, and passes where all keys have the same digit
+  are skipped, which is common for depth values within a limited
+  range.
+
+  The sort is stable, so elements with equal keys keep their
+  relative order. Callers who pass in keys in the order of the
+  previous sort get consistent results for ties from frame to frame,
+  and the function returns early when the keys are still sorted.
+*/
+
+#include "base/radixsort.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#ifndef COIN_WORKAROUND_NO_USING_STD_FUNCS
+using std::malloc;
+using std::free;
+using std::memset;
+using std::memcpy;
+#endif // !COIN_WORKAROUND_NO_USING_STD_FUNCS
+
+/* ************************************************************************* */
+
+#define RADIXSORT_BITS 11
+#define RADIXSORT_SIZE (1 << RADIXSORT_BITS)
+#define RADIXSORT_MASK (RADIXSORT_SIZE - 1)
+#define RADIXSORT_PASSES 3
+
+static uint32_t
+radixsort_float_key(const float f)
+{
+  uint32_t u;
+  /* adding 0 turns -0 into 0, which compares equal as a float */
+  const float tmp = f + 0.0f;
+  memcpy(&u, &tmp, sizeof(u));
+  return u ^ ((u & 0x80000000) ? 0xffffffff : 0x80000000);
+}
+
+/* ************************************************************************* */
+
+/*!
+  Sorts the \a num elements in \a keys in ascending order, and
+  returns the sorted order in \a order, i.e. keys[order[0]] will be
+  the smallest key. Equal keys keep their relative order.
+
+  Returns \c FALSE if \a keys were already sorted, in which case \a
+  order is set to the identity order.
+*/
+SbBool
+cc_radixsort_float(const float * keys, const int num, int * order)
+{
+  int i, pass;
+
+  for (i = 1; i < num; i++) {
+    if (keys[i] < keys[i-1]) break;
+  }
+  if (i >= num) {
+    for (i = 0; i < num; i++) { order[i] = i; }
+    return FALSE;
+  }
+
+  uint32_t * ukeys = static_cast<uint32_t *>(malloc(sizeof(uint32_t) * num * 2));
+  uint32_t * ukeys2 = ukeys + num;
+  int * order2 = static_cast<int *>(malloc(sizeof(int) * num));
+  int * hist = static_cast<int *>(malloc(sizeof(int) * RADIXSORT_SIZE * RADIXSORT_PASSES));
+  memset(hist, 0, sizeof(int) * RADIXSORT_SIZE * RADIXSORT_PASSES);
+
+  for (i = 0; i < num; i++) {
+    const uint32_t key = radixsort_float_key(keys[i]);
+    ukeys[i] = key;
+    order[i] = i;
+    hist[key & RADIXSORT_MASK]++;
+    hist[RADIXSORT_SIZE + ((key >> RADIXSORT_BITS) & RADIXSORT_MASK)]++;
+    hist[2 * RADIXSORT_SIZE + (key >> (2 * RADIXSORT_BITS))]++;
+  }
+
+  uint32_t * srckeys = ukeys;
+  uint32_t * dstkeys = ukeys2;
+  int * srcorder = order;
+  int * dstorder = order2;
+
+  for (pass = 0; pass < RADIXSORT_PASSES; pass++) {
+    int * h = hist + pass * RADIXSORT_SIZE;
+    const int shift = pass * RADIXSORT_BITS;
+    if (h[(srckeys[0] >> shift) & RADIXSORT_MASK] == num) continue;
+
+    int sum = 0;
+    for (i = 0; i < RADIXSORT_SIZE; i++) {
+      const int cnt = h[i];
+      h[i] = sum;
+      sum += cnt;
+    }
+    for (i = 0; i < num; i++) {
+      const uint32_t key = srckeys[i];
+      const int pos = h[(key >> shift) & RADIXSORT_MASK]++;
+      dstkeys[pos] = key;
+      dstorder[pos] = srcorder[i];
+    }
+    uint32_t * tmpkeys = srckeys; srckeys = dstkeys; dstkeys = tmpkeys;
+    int * tmporder = srcorder; srcorder = dstorder; dstorder = tmporder;
+  }
+
+  if (srcorder != order) {
+    memcpy(order, srcorder, sizeof(int) * num);
+  }
+  free(hist);
+  free(order2);
+  free(ukeys);
+  return TRUE;
+}
+
+#undef RADIXSORT_BITS
+#undef RADIXSORT_SIZE
+#undef RADIXSORT_MASK
+#undef RADIXSORT_PASSES
@@ -48,6 +48,8 @@
 #include <Inventor/lists/SbList.h>
 #include <Inventor/C/tidbits.h> // coin_getenv()
 
+#include "rendering/SoGLTextureMemory.h"
+
 // *************************************************************************
 
 class SoGLRenderCacheP {
@@ -135,6 +137,17 @@ SoGLRenderCache::call(SoState * state)
     else COIN_NESTED_CACHING = 0;
   }
   
+  // The textures bound by the display list are not bound through
+  // their SoGLImage, so mark them as used in this frame here, to keep
+  // them from being evicted by the texture memory budget.
+  const int numnested = PRIVATE(this)->nestedcachelist.getLength();
+  for (int i = 0; i < numnested; i++) {
+    SoGLDisplayList * nested = PRIVATE(this)->nestedcachelist[i];
+    if (nested->getType() == SoGLDisplayList::TEXTURE_OBJECT) {
+      SoGLTextureMemory::touch(nested);
+    }
+  }
+
   if (COIN_NESTED_CACHING) {
     if (state->isCacheOpen()) {
       SoCacheElement::addCacheDependency(state, this);  
@@ -148,6 +161,13 @@ SoGLRenderCache::call(SoState * state)
         SoCacheElement::getCurrentCache(state)
        );
       parentCache->addNestedCache(PRIVATE(this)->displaylist);
+      // the parent's display list binds our textures as well
+      for (int i = 0; i < numnested; i++) {
+        SoGLDisplayList * nested = PRIVATE(this)->nestedcachelist[i];
+        if (nested->getType() == SoGLDisplayList::TEXTURE_OBJECT) {
+          parentCache->addNestedCache(nested);
+        }
+      }
     }
     else {
       PRIVATE(this)->displaylist->call(state);
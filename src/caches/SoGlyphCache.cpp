@@ -40,7 +40,9 @@
 #include "caches/SoGlyphCache.h"
 
 #include <cassert>
+#include <vector>
 
+#include <Inventor/C/base/string.h>
 #include <Inventor/lists/SbList.h>
 #include <Inventor/elements/SoFontNameElement.h>
 #include <Inventor/elements/SoFontSizeElement.h>
@@ -54,8 +56,24 @@ public:
   SbList <cc_glyph2d*> glyphlist2d;
   SbList <cc_glyph3d*> glyphlist3d;
   cc_font_specification * fontspec;
+
+  static int decodeString(const char * utf8string, std::vector<uint32_t> & characters);
 };
 
+// Decodes a UTF-8 string into the characters to fetch glyphs for.
+int
+SoGlyphCacheP::decodeString(const char * utf8string, std::vector<uint32_t> & characters)
+{
+  const int length = (int) cc_string_utf8_validate_length(utf8string);
+  characters.resize(length);
+  const char * p = utf8string;
+  for (int i = 0; i < length; i++) {
+    characters[i] = cc_string_utf8_get_char(p);
+    p = cc_string_utf8_next_char(p);
+  }
+  return length;
+}
+
 #define PRIVATE(obj) ((obj)->pimpl)
 
 SoGlyphCache::SoGlyphCache(SoState * state)
@@ -115,6 +133,68 @@ SoGlyphCache::addGlyph(cc_glyph3d * glyph)
   PRIVATE(this)->glyphlist3d.append(glyph);
 }
 
+/*
+  Fetches the glyphs for all the characters of a UTF-8 string, using
+  the cached font specification, and adds them to the cache in
+  order. The glyphs are looked up in one batch, which is faster than
+  calling cc_glyph2d_ref() for each character. Returns the index of
+  the first glyph added, for getGlyph2D().
+*/
+int
+SoGlyphCache::addGlyphs2D(const char * utf8string, const float angle)
+{
+  std::vector<uint32_t> characters;
+  const int first = PRIVATE(this)->glyphlist2d.getLength();
+  const int num = SoGlyphCacheP::decodeString(utf8string, characters);
+  if (num > 0) {
+    std::vector<cc_glyph2d *> glyphs(num);
+    cc_glyph2d_ref_string(&characters[0], num, this->getCachedFontspec(),
+                          angle, &glyphs[0]);
+    for (int i = 0; i < num; i++) PRIVATE(this)->glyphlist2d.append(glyphs[i]);
+  }
+  return first;
+}
+
+/*
+  Fetches the glyphs for all the characters of a UTF-8 string, like
+  addGlyphs2D(). Returns the index of the first glyph added, for
+  getGlyph3D().
+*/
+int
+SoGlyphCache::addGlyphs3D(const char * utf8string)
+{
+  std::vector<uint32_t> characters;
+  const int first = PRIVATE(this)->glyphlist3d.getLength();
+  const int num = SoGlyphCacheP::decodeString(utf8string, characters);
+  if (num > 0) {
+    std::vector<cc_glyph3d *> glyphs(num);
+    cc_glyph3d_ref_string(&characters[0], num, this->getCachedFontspec(),
+                          &glyphs[0]);
+    for (int i = 0; i < num; i++) PRIVATE(this)->glyphlist3d.append(glyphs[i]);
+  }
+  return first;
+}
+
+/*
+  Returns the 2D glyph at index \a idx, in the order the glyphs were
+  added. The cache keeps the reference.
+*/
+cc_glyph2d *
+SoGlyphCache::getGlyph2D(const int idx) const
+{
+  return PRIVATE(this)->glyphlist2d[idx];
+}
+
+/*
+  Returns the 3D glyph at index \a idx, in the order the glyphs were
+  added. The cache keeps the reference.
+*/
+cc_glyph3d *
+SoGlyphCache::getGlyph3D(const int idx) const
+{
+  return PRIVATE(this)->glyphlist3d[idx];
+}
+
 /*!
   Read and store current font specification. Will create cache dependencies
   since some elements are read. We can't read the font specification in the
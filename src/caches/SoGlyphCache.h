@@ -65,6 +65,11 @@ public:
   void addGlyph(cc_glyph2d * glyph);
   void addGlyph(cc_glyph3d * glyph);
 
+  int addGlyphs2D(const char * utf8string, const float angle);
+  int addGlyphs3D(const char * utf8string);
+  cc_glyph2d * getGlyph2D(const int idx) const;
+  cc_glyph3d * getGlyph3D(const int idx) const;
+
 private:
   friend class SoGlyphCacheP;
   SoGlyphCacheP * pimpl;
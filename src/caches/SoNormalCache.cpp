@@ -57,6 +57,7 @@
 #include <Inventor/errors/SoDebugError.h>
 
 #include "tidbitsp.h"
+#include "threads/parallelp.h"
 
 // *************************************************************************
 
@@ -195,18 +196,19 @@ SoNormalCache::getIndices(void) const
 
 //
 // calculates the normal vector for a vertex, based on the
-// normal vectors of all incident faces
+// normal vectors of all incident faces. Returns FALSE if some of the
+// incident faces have no face normal.
 //
-static void
+static SbBool
 calc_normal_vec(const SbVec3f * facenormals, const int facenum, 
-                const int numfacenorm, SbList <int32_t> & faceArray, 
-                const float threshold, SbVec3f & vertnormal)
+                const int numfacenorm, const int32_t * faceArray, 
+                const int n, const float threshold, SbVec3f & vertnormal)
 {
   // start with face normal vector
   const SbVec3f * facenormal = & facenormals[facenum];
   vertnormal = *facenormal;
 
-  int n = faceArray.getLength();
+  SbBool ok = TRUE;
   int currface;
 
   for (int i = 0; i < n; i++) {
@@ -220,18 +222,51 @@ calc_normal_vec(const SbVec3f * facenormals, const int facenum,
         }
       }
       else {
-        static int calc_norm_error = 0;
-        if (calc_norm_error < 1) {
-          SoDebugError::postWarning("SoNormalCache::calc_normal_vec", "Normals "
-                                    "have not been specified for all faces. "
-                                    "this warning will only be shown once, "
-                                    "but there might be more errors");
-        }
-
-        calc_norm_error++;
+        ok = FALSE;
       }
     }
   }
+  return ok;
+}
+
+// Data for the jobs calculating vertex normals in generatePerVertex().
+typedef struct {
+  const SbVec3f * facenormals;
+  int numfacenorm;
+  const int32_t * vindex;
+  const int32_t * cornerface;
+  const int * facestart;
+  const int32_t * faces;
+  float threshold;
+  SbVec3f * result;
+  SbBool * ok;
+  int num;
+  int numjobs;
+} sonormalcache_vertex_data;
+
+static void
+sonormalcache_vertex_job(void * closure, int job)
+{
+  const sonormalcache_vertex_data * data =
+    static_cast<const sonormalcache_vertex_data *>(closure);
+  const int start = int((int64_t(data->num) * job) / data->numjobs);
+  const int end = int((int64_t(data->num) * (job + 1)) / data->numjobs);
+
+  SbBool ok = TRUE;
+  for (int i = start; i < end; i++) {
+    const int facenum = data->cornerface[i];
+    if (facenum < 0) continue; // not a valid vertex
+    const int v = data->vindex[i];
+    const int first = data->facestart[v];
+    SbVec3f & tmpvec = data->result[i];
+    if (!calc_normal_vec(data->facenormals, facenum, data->numfacenorm,
+                         data->faces + first, data->facestart[v+1] - first,
+                         data->threshold, tmpvec)) {
+      ok = FALSE;
+    }
+    (void) tmpvec.normalize();
+  }
+  data->ok[job] = ok;
 }
 
 /*!
@@ -296,97 +331,174 @@ SoNormalCache::generatePerVertex(const SbVec3f * const coords,
     if (temp > maxi) maxi = temp;
   }
 
-  // for each vertex, store all faceindices the vertex is a part of
-  SbList<int32_t> * vertexFaceArray = new SbList<int32_t>[maxi+1]; // [0, maxi]
+  // for each vertex, store all faceindices the vertex is a part
+  // of. The face indices are stored in a single array, in the order
+  // they are found, with facestart[v] as the first index for vertex
+  // v. The first pass counts, the second pass fills in.
+  int * facestart = new int[maxi+2]; // [0, maxi+1]
+  int * pos = new int[maxi+1];
+  for (i = 0; i <= maxi+1; i++) facestart[i] = 0;
+  int32_t * faces = NULL;
+  int numfaces = 0;
 
-  // for each vertex, store all normals that have been calculated
-  SbList <int32_t>* vertexNormalArray = new SbList<int32_t>[maxi+1]; // [0, maxi]
+  for (int pass = 0; pass < 2; pass++) {
+    numfaces = 0;
+    if (pass == 1) {
+      for (i = 0; i <= maxi; i++) facestart[i+1] += facestart[i];
+      for (i = 0; i <= maxi; i++) pos[i] = facestart[i];
+      faces = new int32_t[SbMax(facestart[maxi+1], 1)];
+    }
 
-  int numfaces = 0;
+#define ADD_FACE(vidx) \
+    if (pass == 0) facestart[(vidx)+1]++; \
+    else faces[pos[(vidx)]++] = numfaces
 
-  if (tristrip) {
-    // Find and save the faces belonging to the different vertices
-    i = 0;
-    while (i + 2 < numvi) {
-      temp = vindex[i];
-      if (temp >= 0 && static_cast<unsigned int>(temp) < numcoords) {
-        vertexFaceArray[temp].append(numfaces);
-      }
-      else {
-        i = i+1;
-        numfaces++;
-        continue;
-      }
+    if (tristrip) {
+      // Find and save the faces belonging to the different vertices
+      i = 0;
+      while (i + 2 < numvi) {
+        temp = vindex[i];
+        if (temp >= 0 && static_cast<unsigned int>(temp) < numcoords) {
+          ADD_FACE(temp);
+        }
+        else {
+          i = i+1;
+          numfaces++;
+          continue;
+        }
 
-      temp = vindex[i+1];
-      if (temp >= 0 && static_cast<unsigned int>(temp) < numcoords) {
-        vertexFaceArray[temp].append(numfaces);
-      }
-      else {
-        i = i+2;
-        numfaces++;
-        continue;
-      }
+        temp = vindex[i+1];
+        if (temp >= 0 && static_cast<unsigned int>(temp) < numcoords) {
+          ADD_FACE(temp);
+        }
+        else {
+          i = i+2;
+          numfaces++;
+          continue;
+        }
 
-      temp = vindex[i+2];
-      if (temp >= 0 && static_cast<unsigned int>(temp) < numcoords) {
-        vertexFaceArray[temp].append(numfaces);
-      }
-      else {
-        i = i+3;
-        numfaces++;
-        continue;
-      }
+        temp = vindex[i+2];
+        if (temp >= 0 && static_cast<unsigned int>(temp) < numcoords) {
+          ADD_FACE(temp);
+        }
+        else {
+          i = i+3;
+          numfaces++;
+          continue;
+        }
 
-      temp = i+3 < numvi ? vindex[i+3] : -1;
-      if (temp < 0 || static_cast<unsigned int>(temp) >= numcoords) {
-        i = i + 4; // Jump to next possible face
+        temp = i+3 < numvi ? vindex[i+3] : -1;
+        if (temp < 0 || static_cast<unsigned int>(temp) >= numcoords) {
+          i = i + 4; // Jump to next possible face
+          numfaces++;
+          continue;
+        }
+
+        i++;
         numfaces++;
-        continue;
       }
-
-      i++;
-      numfaces++;
     }
+    else { // !tristrip
+      for (i = 0; i < numvi; i++) {
+        temp = vindex[i];
+        if (temp >= 0 && static_cast<unsigned int>(temp) < numcoords) {
+          ADD_FACE(temp);
+        }
+        else {
+          numfaces++;
+        }
+      }
+    }
+#undef ADD_FACE
   }
-  else { // !tristrip
-    for (i = 0; i < numvi; i++) {
-      temp = vindex[i];
-      if (temp >= 0 && static_cast<unsigned int>(temp) < numcoords) {
-        vertexFaceArray[temp].append(numfaces);
+
+  // find the face of each valid vertex, and count the vertices
+  // referring to each coordinate
+  int32_t * cornerface = new int32_t[SbMax(numvi, 1)];
+  int * normalstart = new int[maxi+2]; // [0, maxi+1]
+  for (i = 0; i <= maxi+1; i++) normalstart[i] = 0;
+  int facenum = 0;
+  int stripcnt = 0;
+  for (i = 0; i < numvi; i++) {
+    temp = vindex[i];
+    if (temp >= 0 && static_cast<unsigned int>(temp) < numcoords) {
+      if (tristrip) {
+        if (++stripcnt > 3) facenum++; // next face
       }
-      else {
-        numfaces++;
+      cornerface[i] = facenum;
+      normalstart[temp+1]++;
+    }
+    else { // new face
+      cornerface[i] = -1;
+      facenum++;
+      stripcnt = 0;
+    }
+  }
+  for (i = 0; i <= maxi; i++) normalstart[i+1] += normalstart[i];
+
+  // calculate the normal of each vertex. The normals are
+  // independent of each other, so spread them over the available
+  // CPUs for large meshes
+  SbVec3f * result = new SbVec3f[SbMax(numvi, 1)];
+
+  sonormalcache_vertex_data data;
+  data.facenormals = facenorm;
+  data.numfacenorm = numfacenorm;
+  data.vindex = vindex;
+  data.cornerface = cornerface;
+  data.facestart = facestart;
+  data.faces = faces;
+  data.threshold = static_cast<float>(cos(SbClamp(crease_angle, 0.0f, static_cast<float>(M_PI))));
+  data.result = result;
+  data.num = numvi;
+
+  const int numthreads = cc_parallel_get_num_threads();
+  const int maxjobs = (numthreads > 1) ? numthreads * 4 : 1;
+  data.numjobs = SbMax(1, SbMin(maxjobs, numvi / 4096));
+  SbBool * ok = new SbBool[data.numjobs];
+  data.ok = ok;
+  cc_parallel_run(data.numjobs, sonormalcache_vertex_job, &data);
+
+  for (i = 0; i < data.numjobs; i++) {
+    if (!ok[i]) {
+      static int calc_norm_error = 0;
+      if (calc_norm_error < 1) {
+        SoDebugError::postWarning("SoNormalCache::calc_normal_vec", "Normals "
+                                  "have not been specified for all faces. "
+                                  "this warning will only be shown once, "
+                                  "but there might be more errors");
       }
+      calc_norm_error++;
+      break;
     }
   }
+  delete [] ok;
 
-  float threshold = static_cast<float>(cos(SbClamp(crease_angle, 0.0f, static_cast<float>(M_PI))));
+  // for each vertex, store all normals that have been calculated,
+  // with normalstart[v] as the first index for vertex v, and
+  // numvertexnormals[v] as the number of normals stored
+  int32_t * vertexnormals = new int32_t[SbMax(normalstart[maxi+1], 1)];
+  int * numvertexnormals = new int[maxi+1];
+  for (i = 0; i <= maxi; i++) numvertexnormals[i] = 0;
+
+  PRIVATE(this)->indices.ensureCapacity(numvi);
   SbBool found;
   int currindex = 0; // current normal index
   int nindex = 0;
   int j, n ;
-  int facenum = 0;
-  int stripcnt = 0;
 
   for (i = 0; i < numvi; i++) {
     currindex = vindex[i];
-    if (currindex >= 0 && static_cast<unsigned int>(currindex) < numcoords) {
-      if (tristrip) {
-        if (++stripcnt > 3) facenum++; // next face
-      }
-      // calc normal for this vertex
-      SbVec3f tmpvec;
-      calc_normal_vec(facenorm, facenum, numfacenorm, vertexFaceArray[currindex], 
-                      threshold, tmpvec);
+    if (cornerface[i] >= 0) {
+      const SbVec3f & tmpvec = result[i];
 
       // Be robust when it comes to erroneously specified triangles.
-      if ((tmpvec.normalize() == 0.0f) && coin_debug_extra()) {
+      if ((tmpvec == SbVec3f(0.0f, 0.0f, 0.0f)) && coin_debug_extra()) {
 #if COIN_DEBUG
         static uint32_t normgenerrors_vertex = 0;
         if (normgenerrors_vertex < 1) {
           SoDebugError::postWarning("SoNormalCache::generatePerVertex","Unable to "
-                                    "generate valid normal for face %d", facenum);
+                                    "generate valid normal for face %d", cornerface[i]);
         }
         normgenerrors_vertex++;
 #endif // COIN_DEBUG
@@ -397,38 +509,32 @@ SoNormalCache::generatePerVertex(const SbVec3f * const coords,
       // considered when generating vertex normals.  
       // pederb, 2005-12-21
 
-      if (PRIVATE(this)->normalArray.getLength() <= nindex)
-        PRIVATE(this)->normalArray.append(tmpvec);
-      else
-        PRIVATE(this)->normalArray[nindex] = tmpvec;
-
       // try to find equal normal (total smoothing)
-      SbList <int32_t> & array = vertexNormalArray[currindex];
+      const int32_t * array = vertexnormals + normalstart[currindex];
       found = FALSE;
-      n = array.getLength();
+      n = numvertexnormals[currindex];
       int same_normal = -1;
       for (j = 0; j < n && !found; j++) {
         same_normal = array[j];
-        found = PRIVATE(this)->normalArray[same_normal].equals(PRIVATE(this)->normalArray[nindex],
+        found = PRIVATE(this)->normalArray[same_normal].equals(tmpvec,
                                                       NORMAL_EPSILON);
       }
       if (found)
         PRIVATE(this)->indices.append(same_normal);
       // might be equal to the previous normal (when all normals for a face are equal)
       else if ((nindex > 0) &&
-               PRIVATE(this)->normalArray[nindex].equals(PRIVATE(this)->normalArray[nindex-1],
+               PRIVATE(this)->normalArray[nindex-1].equals(tmpvec,
                                                 NORMAL_EPSILON)) {
         PRIVATE(this)->indices.append(nindex-1);
       }
       else {
+        PRIVATE(this)->normalArray.append(tmpvec);
         PRIVATE(this)->indices.append(nindex);
-        array.append(nindex);
+        vertexnormals[normalstart[currindex] + numvertexnormals[currindex]++] = nindex;
         nindex++;
       }
     }
     else { // new face
-      facenum++;
-      stripcnt = 0;
       PRIVATE(this)->indices.append(-1); // add a -1 for PER_VERTEX_INDEXED binding
     }
   }
@@ -441,8 +547,14 @@ SoNormalCache::generatePerVertex(const SbVec3f * const coords,
                          "generated normals per vertex: %p %d %d\n",
                          PRIVATE(this)->normalData.normals, PRIVATE(this)->numNormals, PRIVATE(this)->indices.getLength());
 #endif
-  delete [] vertexFaceArray;
-  delete [] vertexNormalArray;
+  delete [] numvertexnormals;
+  delete [] vertexnormals;
+  delete [] result;
+  delete [] normalstart;
+  delete [] cornerface;
+  delete [] faces;
+  delete [] pos;
+  delete [] facestart;
 }
 
 /*!
@@ -1140,3 +1252,62 @@ SoNormalCache::clearGenerator(void)
 #undef NORMAL_EPSILON
 #undef NORMALCACHE_DEBUG
 #undef PRIVATE
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/lists/SbList.h>
+
+BOOST_AUTO_TEST_CASE(perVertexCreaseAngle)
+{
+  // a strip of quads in the xy plane folded 90 degrees along the
+  // y axis, in a grid large enough to be split into several jobs
+  const int numx = 4, numy = 3000;
+  SbList <SbVec3f> coords;
+  for (int y = 0; y < numy; y++) {
+    for (int x = 0; x < numx; x++) {
+      const float fx = float(x - numx / 2);
+      coords.append(fx <= 0.0f ?
+                    SbVec3f(fx, float(y), 0.0f) :
+                    SbVec3f(0.0f, float(y), -fx));
+    }
+  }
+  SbList <int32_t> cind;
+  for (int y = 0; y < numy - 1; y++) {
+    for (int x = 0; x < numx - 1; x++) {
+      const int32_t v = y * numx + x;
+      cind.append(v); cind.append(v + 1);
+      cind.append(v + numx + 1); cind.append(v + numx);
+      cind.append(-1);
+    }
+  }
+
+  const SbVec3f n0(0.0f, 0.0f, 1.0f), n1(1.0f, 0.0f, 0.0f);
+  SbVec3f avg = n0 + n1;
+  (void) avg.normalize();
+
+  for (int smooth = 0; smooth < 2; smooth++) {
+    SoNormalCache cache(NULL);
+    cache.generatePerVertex(coords.getArrayPtr(), coords.getLength(),
+                            cind.getArrayPtr(), cind.getLength(),
+                            smooth ? float(M_PI) * 0.75f : float(M_PI) * 0.25f);
+    BOOST_REQUIRE_EQUAL(cache.getNumIndices(), cind.getLength());
+
+    const SbVec3f * normals = cache.getNormals();
+    const int32_t * nind = cache.getIndices();
+    int numwrong = 0;
+    for (int i = 0; i < cind.getLength(); i++) {
+      if (cind[i] < 0) {
+        if (nind[i] != -1) numwrong++;
+        continue;
+      }
+      const int x = cind[i] % numx;
+      const int face = (i / 5) % (numx - 1);
+      SbVec3f expected = (face < numx / 2) ? n0 : n1;
+      if (smooth && x == numx / 2) expected = avg;
+      if (!normals[nind[i]].equals(expected, 1e-6f)) numwrong++;
+    }
+    BOOST_CHECK_MESSAGE(numwrong == 0, "unexpected vertex normals");
+  }
+}
+
+#endif // COIN_TEST_SUITE
@@ -56,6 +56,7 @@
 #include <Inventor/C/tidbits.h>
 #include <Inventor/SbVec3f.h>
 #include <Inventor/SoPrimitiveVertex.h>
+#include <Inventor/bundles/SoTextureCoordinateBundle.h>
 #include <Inventor/details/SoFaceDetail.h>
 #include <Inventor/details/SoLineDetail.h>
 #include <Inventor/details/SoPointDetail.h>
@@ -77,10 +78,12 @@
 #include <Inventor/misc/SoGLDriverDatabase.h>
 
 #include "tidbitsp.h"
+#include "base/radixsort.h"
 #include "misc/SbHash.h"
 #include "rendering/SoGL.h"
 #include "rendering/SoVBO.h"
 #include "rendering/SoVertexArrayIndexer.h"
+#include "threads/parallelp.h"
 #include "SbBasicP.h"
 
 // *************************************************************************
@@ -168,7 +171,19 @@ public:
   SoGLLazyElement::GLState prestate;
   SoGLLazyElement::GLState poststate;
 
+  // The normal, texture coordinate and material indices of a vertex
+  // added by addIndexedTriangles(), and the next vertex with the same
+  // coordinate index.
+  struct IndexedVertex {
+    int32_t normalidx;
+    int32_t texcoordidx;
+    int32_t materialidx;
+    int32_t next;
+  };
+
   void addVertex(const Vertex & v);
+  void setColor(Vertex & v, const int midx);
+  void addMultiTexCoords(const Vertex & v);
 
   void renderImmediate(const cc_glglue * glue,
                        const GLint * indices,
@@ -290,6 +305,12 @@ SoPrimitiveVertexCache::SoPrimitiveVertexCache(SoState * state)
   if (SoGLLazyElement_enabled(state)) {
     SoGLLazyElement::beginCaching(state, &PRIVATE(this)->prestate, &PRIVATE(this)->poststate);
   }
+  else {
+    // built ahead of rendering (see SoGLRenderAction), without any
+    // lazy OpenGL state to depend on
+    PRIVATE(this)->prestate.cachebitmask = 0;
+    PRIVATE(this)->poststate.cachebitmask = 0;
+  }
 }
 
 /*!
@@ -506,22 +527,7 @@ SoPrimitiveVertexCache::addTriangle(const SoPrimitiveVertex * v0,
     v.texcoord0 = tmp;
     v.texcoordidx = -1;
 
-    int midx = vp[i]->getMaterialIndex();
-    uint32_t col;
-    if (PRIVATE(this)->packedptr) {
-      col = PRIVATE(this)->packedptr[SbClamp(midx, 0, PRIVATE(this)->numdiffuse-1)];
-    }
-    else {
-      SbColor tmpc = PRIVATE(this)->diffuseptr[SbClamp(midx,0,PRIVATE(this)->numdiffuse-1)];
-      float tmpt = PRIVATE(this)->transpptr[SbClamp(midx,0,PRIVATE(this)->numtransp-1)];
-      col = tmpc.getPackedValue(tmpt);
-    }
-    if (col != PRIVATE(this)->firstcolor) PRIVATE(this)->colorpervertex = TRUE;
-
-    v.rgba[0] = col>>24;
-    v.rgba[1] = (col>>16)&0xff;
-    v.rgba[2] = (col>>8)&0xff;
-    v.rgba[3] = col&0xff;
+    PRIVATE(this)->setColor(v, vp[i]->getMaterialIndex());
 
     const SoDetail * d = coin_safe_cast<const SoDetail *>(vp[i]->getDetail());
 
@@ -545,19 +551,7 @@ SoPrimitiveVertexCache::addTriangle(const SoPrimitiveVertex * v0,
       PRIVATE(this)->addVertex(v);
       triangleindices[i] = idx;
 
-      // update texture coordinates for unit 1-n
-      for (int j = 1; j <= PRIVATE(this)->lastenabled; j++) {
-        if (v.texcoordidx >= 0 &&
-            (PRIVATE(this)->multielem->getType(j) == SoMultiTextureCoordinateElement::EXPLICIT)) {
-          PRIVATE(this)->multitexcoords[j].append(PRIVATE(this)->multielem->get4(j, v.texcoordidx));
-        }
-        else if (PRIVATE(this)->multielem->getType(j) == SoMultiTextureCoordinateElement::FUNCTION) {
-          PRIVATE(this)->multitexcoords[j].append(PRIVATE(this)->multielem->get(j, v.vertex, v.normal));
-        }
-        else {
-          PRIVATE(this)->multitexcoords[j].append(v.texcoord0);
-        }
-      }
+      PRIVATE(this)->addMultiTexCoords(v);
     }
     else {
       triangleindices[i] = idx;
@@ -592,22 +586,7 @@ SoPrimitiveVertexCache::addLine(const SoPrimitiveVertex * v0,
     v.texcoord0 = tmp;
     v.texcoordidx = -1;
 
-    int midx = vp[i]->getMaterialIndex();
-    uint32_t col;
-    if (PRIVATE(this)->packedptr) {
-      col = PRIVATE(this)->packedptr[SbClamp(midx, 0, PRIVATE(this)->numdiffuse-1)];
-    }
-    else {
-      SbColor tmpc = PRIVATE(this)->diffuseptr[SbClamp(midx,0,PRIVATE(this)->numdiffuse-1)];
-      float tmpt = PRIVATE(this)->transpptr[SbClamp(midx,0,PRIVATE(this)->numtransp-1)];
-      col = tmpc.getPackedValue(tmpt);
-    }
-    if (col != PRIVATE(this)->firstcolor) PRIVATE(this)->colorpervertex = TRUE;
-
-    v.rgba[0] = col>>24;
-    v.rgba[1] = (col>>16)&0xff;
-    v.rgba[2] = (col>>8)&0xff;
-    v.rgba[3] = col&0xff;
+    PRIVATE(this)->setColor(v, vp[i]->getMaterialIndex());
 
     const SoDetail * d = coin_assert_cast<const SoDetail *>(vp[i]->getDetail());
 
@@ -629,19 +608,7 @@ SoPrimitiveVertexCache::addLine(const SoPrimitiveVertex * v0,
       PRIVATE(this)->addVertex(v);
       lineindices[i] = idx;
 
-      // update texture coordinates for unit 1-n
-      for (int j = 1; j <= PRIVATE(this)->lastenabled; j++) {
-        if (v.texcoordidx >= 0 &&
-            (PRIVATE(this)->multielem->getType(j) == SoMultiTextureCoordinateElement::EXPLICIT)) {
-          PRIVATE(this)->multitexcoords[j].append(PRIVATE(this)->multielem->get4(j, v.texcoordidx));
-        }
-        else if (PRIVATE(this)->multielem->getType(j) == SoMultiTextureCoordinateElement::FUNCTION) {
-          PRIVATE(this)->multitexcoords[j].append(PRIVATE(this)->multielem->get(j, v.vertex, v.normal));
-        }
-        else {
-          PRIVATE(this)->multitexcoords[j].append(v.texcoord0);
-        }
-      }
+      PRIVATE(this)->addMultiTexCoords(v);
     }
     else {
       lineindices[i] = idx;
@@ -668,22 +635,7 @@ SoPrimitiveVertexCache::addPoint(const SoPrimitiveVertex * v0)
   v.texcoord0 = tmp;
   v.texcoordidx = -1;
 
-  int midx = v0->getMaterialIndex();
-  uint32_t col;
-  if (PRIVATE(this)->packedptr) {
-    col = PRIVATE(this)->packedptr[SbClamp(midx, 0, PRIVATE(this)->numdiffuse-1)];
-  }
-  else {
-    SbColor tmpc = PRIVATE(this)->diffuseptr[SbClamp(midx,0,PRIVATE(this)->numdiffuse-1)];
-    float tmpt = PRIVATE(this)->transpptr[SbClamp(midx,0,PRIVATE(this)->numtransp-1)];
-    col = tmpc.getPackedValue(tmpt);
-  }
-  if (col != PRIVATE(this)->firstcolor) PRIVATE(this)->colorpervertex = TRUE;
-
-  v.rgba[0] = col>>24;
-  v.rgba[1] = (col>>16)&0xff;
-  v.rgba[2] = (col>>8)&0xff;
-  v.rgba[3] = col&0xff;
+  PRIVATE(this)->setColor(v, v0->getMaterialIndex());
 
   const SoDetail * d = coin_assert_cast<const SoDetail *>(v0->getDetail());
 
@@ -706,25 +658,134 @@ SoPrimitiveVertexCache::addPoint(const SoPrimitiveVertex * v0)
     PRIVATE(this)->addVertex(v);
     PRIVATE(this)->pointindexer->addPoint(idx);
 
-    // update texture coordinates for unit 1-n
-    for (int j = 1; j <= PRIVATE(this)->lastenabled; j++) {
-      if (v.texcoordidx >= 0 &&
-          (PRIVATE(this)->multielem->getType(j) == SoMultiTextureCoordinateElement::EXPLICIT)) {
-        PRIVATE(this)->multitexcoords[j].append(PRIVATE(this)->multielem->get4(j, v.texcoordidx));
-      }
-      else if (PRIVATE(this)->multielem->getType(j) == SoMultiTextureCoordinateElement::FUNCTION) {
-        PRIVATE(this)->multitexcoords[j].append(PRIVATE(this)->multielem->get(j, v.vertex, v.normal));
-      }
-      else {
-        PRIVATE(this)->multitexcoords[j].append(v.texcoord0);
-      }
-    }
+    PRIVATE(this)->addMultiTexCoords(v);
   }
   else {
     PRIVATE(this)->pointindexer->addPoint(idx);
   }
 }
 
+/*!
+  Adds a set of triangles to the cache directly from index arrays, in
+  the same format as the coordIndex field of SoIndexedFaceSet. Each
+  triangle is three indices into \a coords, followed by -1 (which may
+  be omitted for the last triangle). Only triangles are allowed.
+
+  \a normalindices, \a texcoordindices and \a materialindices are
+  indexed in parallel with \a coordindices. The normal indices must
+  be less than \a numnormals. If \a normalindices is NULL, all
+  vertices get the first normal in \a normals, or (0, 0, 1) if there
+  are no normals. If \a texcoordbundle is not NULL, it computes the
+  texture coordinates from the coordinate and normal of each vertex,
+  for texture coordinate functions and default texture coordinates.
+  Otherwise, if \a texcoordindices is not NULL, the texture
+  coordinates are fetched from unit 0 of
+  SoMultiTextureCoordinateElement, which must contain explicit texture
+  coordinates. If both are NULL, all vertices get the texture
+  coordinate (0, 0, 0, 1). If \a materialindices is NULL, all
+  vertices get material 0.
+
+  This is a faster alternative to calling addTriangle() for shapes
+  that are already indexed, since vertices are merged on their index
+  tuples instead of through a hash table on the vertex data. Vertices
+  with different indices but equal data are therefore not merged.
+
+  \since Coin 4.1
+*/
+void
+SoPrimitiveVertexCache::addIndexedTriangles(const int numindices,
+                                            const int32_t * coordindices,
+                                            const SbVec3f * coords,
+                                            const int numcoords,
+                                            const int32_t * normalindices,
+                                            const SbVec3f * normals,
+                                            const int numnormals,
+                                            const int32_t * texcoordindices,
+                                            SoTextureCoordinateBundle * texcoordbundle,
+                                            const int32_t * materialindices)
+{
+  if (PRIVATE(this)->lastenabled >= 1 && PRIVATE(this)->multielem == NULL) {
+    // fetch SoMultiTextureCoordinateElement the first time we get here
+    PRIVATE(this)->multielem = SoMultiTextureCoordinateElement::getInstance(PRIVATE(this)->state);
+  }
+  const SoMultiTextureCoordinateElement * texcoordelem =
+    (texcoordindices && !texcoordbundle) ?
+    SoMultiTextureCoordinateElement::getInstance(PRIVATE(this)->state) : NULL;
+
+  if (PRIVATE(this)->triangleindexer == NULL) {
+    PRIVATE(this)->triangleindexer = new SoVertexArrayIndexer;
+  }
+
+  const SbVec3f dummynormal(0.0f, 0.0f, 1.0f);
+  const SbVec4f dummytexcoord(0.0f, 0.0f, 0.0f, 1.0f);
+
+  // The first vertex added for each coordinate index. Vertices with
+  // the same coordinate index, but other normal, texture coordinate
+  // or material indices, are chained through IndexedVertex::next.
+  int32_t * firstvertex = new int32_t[numcoords];
+  for (int i = 0; i < numcoords; i++) firstvertex[i] = -1;
+  SbList <SoPrimitiveVertexCacheP::IndexedVertex> indexedvertices(numcoords);
+  const int32_t startidx = PRIVATE(this)->vertexlist.getLength();
+
+  int i = 0;
+  while (i + 2 < numindices) {
+    int32_t triangleindices[3];
+    for (int j = 0; j < 3; j++, i++) {
+      const int32_t cidx = coordindices[i];
+      assert(cidx >= 0 && cidx < numcoords);
+      SoPrimitiveVertexCacheP::IndexedVertex iv;
+      iv.normalidx = normalindices ? normalindices[i] : 0;
+      iv.texcoordidx = texcoordelem ? texcoordindices[i] : 0;
+      iv.materialidx = materialindices ? materialindices[i] : 0;
+
+      int32_t idx = firstvertex[cidx];
+      while (idx >= 0) {
+        const SoPrimitiveVertexCacheP::IndexedVertex & other = indexedvertices[idx];
+        if (other.normalidx == iv.normalidx &&
+            other.texcoordidx == iv.texcoordidx &&
+            other.materialidx == iv.materialidx) break;
+        idx = other.next;
+      }
+      if (idx < 0) {
+        idx = indexedvertices.getLength();
+        iv.next = firstvertex[cidx];
+        firstvertex[cidx] = idx;
+        indexedvertices.append(iv);
+
+        SoPrimitiveVertexCacheP::Vertex v;
+        v.vertex = coords[cidx];
+        if (normalindices) {
+          assert(iv.normalidx >= 0 && iv.normalidx < numnormals);
+          v.normal = normals[iv.normalidx];
+        }
+        else v.normal = (normals && numnormals > 0) ? normals[0] : dummynormal;
+        if (texcoordbundle) v.texcoord0 = texcoordbundle->get(v.vertex, v.normal);
+        else v.texcoord0 = texcoordelem ? texcoordelem->get4(iv.texcoordidx) : dummytexcoord;
+        v.texcoordidx = iv.texcoordidx;
+        if (PRIVATE(this)->numbumpcoords) {
+          v.bumpcoord = PRIVATE(this)->bumpcoords[SbClamp(iv.texcoordidx, 0, PRIVATE(this)->numbumpcoords-1)];
+        }
+        else {
+          v.bumpcoord = SbVec2f(v.texcoord0[0], v.texcoord0[1]);
+        }
+        PRIVATE(this)->setColor(v, iv.materialidx);
+        PRIVATE(this)->addVertex(v);
+        PRIVATE(this)->addMultiTexCoords(v);
+      }
+      triangleindices[j] = startidx + idx;
+    }
+    PRIVATE(this)->triangleindexer->addTriangle(triangleindices[0],
+                                                triangleindices[1],
+                                                triangleindices[2]);
+    if (i < numindices) {
+      // only triangles are allowed
+      assert(coordindices[i] < 0);
+      i++;
+    }
+  }
+  delete[] firstvertex;
+}
+
 int
 SoPrimitiveVertexCache::getNumVertices(void) const
 {
@@ -836,6 +897,46 @@ SoPrimitiveVertexCache::fit(void)
   if (PRIVATE(this)->pointindexer) PRIVATE(this)->pointindexer->close();
 }
 
+// Data for the jobs computing vertex and triangle depths in
+// depthSortTriangles().
+typedef struct {
+  const SbPlane * plane;
+  const SbVec3f * vertices;
+  const GLint * indices;
+  float * vdist;
+  float * tdist;
+  int numvertices;
+  int numtriangles;
+  int numjobs;
+} sopvcache_depth_data;
+
+static void
+sopvcache_vertex_depth_job(void * closure, int job)
+{
+  const sopvcache_depth_data * data = static_cast<const sopvcache_depth_data *>(closure);
+  const int start = int((int64_t(data->numvertices) * job) / data->numjobs);
+  const int end = int((int64_t(data->numvertices) * (job + 1)) / data->numjobs);
+  for (int i = start; i < end; i++) {
+    data->vdist[i] = data->plane->getDistance(data->vertices[i]);
+  }
+}
+
+static void
+sopvcache_triangle_depth_job(void * closure, int job)
+{
+  const sopvcache_depth_data * data = static_cast<const sopvcache_depth_data *>(closure);
+  const int start = int((int64_t(data->numtriangles) * job) / data->numjobs);
+  const int end = int((int64_t(data->numtriangles) * (job + 1)) / data->numjobs);
+  const GLint * iptr = data->indices;
+  for (int i = start; i < end; i++) {
+    float acc = 0.0;
+    for (int j = 0; j < 3; j++) {
+      acc += data->vdist[iptr[i*3+j]];
+    }
+    data->tdist[i] = acc / 3.0f;
+  }
+}
+
 void
 SoPrimitiveVertexCache::depthSortTriangles(SoState * state)
 {
@@ -854,42 +955,49 @@ SoPrimitiveVertexCache::depthSortTriangles(SoState * state)
     }
     PRIVATE(this)->prevsortplane = sortplane;
     float * darray = PRIVATE(this)->deptharray;
-    const SbVec3f * vptr = PRIVATE(this)->vertexlist.getArrayPtr();
     GLint * iptr = PRIVATE(this)->triangleindexer->getWriteableIndices();
-    int i,j;
-    for (i = 0; i < numtri; i++) {
-      float acc = 0.0;
-      for (j = 0; j < 3; j++) {
-        acc += sortplane.getDistance(vptr[iptr[i*3+j]]);
-      }
-      darray[i] = acc / 3.0f;
-    }
-    int distance;
-    float dtmp;
-    int itmp[3];
-
-    // shell sort algorithm (O(nlog(n))
-    for (distance = 1; distance <= numtri/9; distance = 3*distance + 1) ;
-    for (; distance > 0; distance /= 3) {
-      for (i = distance; i < numtri; i++) {
-        dtmp = darray[i];
-        itmp[0] = iptr[i*3];
-        itmp[1] = iptr[i*3+1];
-        itmp[2] = iptr[i*3+2];
-        j = i;
-        while (j >= distance && darray[j-distance] > dtmp) {
-          darray[j] = darray[j-distance];
-          iptr[j*3] = iptr[(j-distance)*3];
-          iptr[j*3+1] = iptr[(j-distance)*3+1];
-          iptr[j*3+2] = iptr[(j-distance)*3+2];
-          j -= distance;
-        }
-        darray[j] = dtmp;
-        iptr[j*3] = itmp[0];
-        iptr[j*3+1] = itmp[1];
-        iptr[j*3+2] = itmp[2];
+
+    // Vertices are shared between triangles, so find the distance of
+    // each vertex once, and then average them for the triangles. Both
+    // steps are spread over the available CPUs for large caches.
+    sopvcache_depth_data data;
+    data.plane = &sortplane;
+    data.vertices = PRIVATE(this)->vertexlist.getArrayPtr();
+    data.indices = iptr;
+    data.vdist = new float[numv];
+    data.tdist = darray;
+    data.numvertices = numv;
+    data.numtriangles = numtri;
+
+    const int numthreads = cc_parallel_get_num_threads();
+    const int maxjobs = (numthreads > 1) ? numthreads * 4 : 1;
+    data.numjobs = SbMax(1, SbMin(maxjobs, numv / 16384));
+    cc_parallel_run(data.numjobs, sopvcache_vertex_depth_job, &data);
+    data.numjobs = SbMax(1, SbMin(maxjobs, numtri / 16384));
+    cc_parallel_run(data.numjobs, sopvcache_triangle_depth_job, &data);
+    delete[] data.vdist;
+
+    // The indices are stored in the order of the previous sort, which
+    // often is still valid, or close to it. cc_radixsort_float()
+    // returns early in the first case, and is stable, so triangles at
+    // the same depth will not swap places between frames.
+    int * order = new int[numtri];
+    if (cc_radixsort_float(darray, numtri, order)) {
+      GLint * itmp = new GLint[numtri*3];
+      float * dtmp = new float[numtri];
+      memcpy(itmp, iptr, numtri*3*sizeof(GLint));
+      memcpy(dtmp, darray, numtri*sizeof(float));
+      for (int i = 0; i < numtri; i++) {
+        const int src = order[i];
+        darray[i] = dtmp[src];
+        iptr[i*3] = itmp[src*3];
+        iptr[i*3+1] = itmp[src*3+1];
+        iptr[i*3+2] = itmp[src*3+2];
       }
+      delete[] itmp;
+      delete[] dtmp;
     }
+    delete[] order;
   }
 }
 
@@ -937,6 +1045,44 @@ SoPrimitiveVertexCacheP::addVertex(const Vertex & v)
   }
 }
 
+void
+SoPrimitiveVertexCacheP::setColor(Vertex & v, const int midx)
+{
+  uint32_t col;
+  if (this->packedptr) {
+    col = this->packedptr[SbClamp(midx, 0, this->numdiffuse-1)];
+  }
+  else {
+    SbColor tmpc = this->diffuseptr[SbClamp(midx,0,this->numdiffuse-1)];
+    float tmpt = this->transpptr[SbClamp(midx,0,this->numtransp-1)];
+    col = tmpc.getPackedValue(tmpt);
+  }
+  if (col != this->firstcolor) this->colorpervertex = TRUE;
+
+  v.rgba[0] = col>>24;
+  v.rgba[1] = (col>>16)&0xff;
+  v.rgba[2] = (col>>8)&0xff;
+  v.rgba[3] = col&0xff;
+}
+
+// update texture coordinates for unit 1-n
+void
+SoPrimitiveVertexCacheP::addMultiTexCoords(const Vertex & v)
+{
+  for (int j = 1; j <= this->lastenabled; j++) {
+    if (v.texcoordidx >= 0 &&
+        (this->multielem->getType(j) == SoMultiTextureCoordinateElement::EXPLICIT)) {
+      this->multitexcoords[j].append(this->multielem->get4(j, v.texcoordidx));
+    }
+    else if (this->multielem->getType(j) == SoMultiTextureCoordinateElement::FUNCTION) {
+      this->multitexcoords[j].append(this->multielem->get(j, v.vertex, v.normal));
+    }
+    else {
+      this->multitexcoords[j].append(v.texcoord0);
+    }
+  }
+}
+
 void
 SoPrimitiveVertexCacheP::enableArrays(const cc_glglue * glue,
                                       const SbBool color, const SbBool normal,
@@ -1131,3 +1277,270 @@ SoPrimitiveVertexCacheP::renderImmediate(const cc_glglue * glue,
 }
 
 #undef PRIVATE
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/SbBox2f.h>
+#include <Inventor/actions/SoCallbackAction.h>
+#include <Inventor/bundles/SoTextureCoordinateBundle.h>
+#include <Inventor/elements/SoCoordinateElement.h>
+#include <Inventor/elements/SoNormalElement.h>
+#include <Inventor/nodes/SoCoordinate3.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/nodes/SoMaterial.h>
+#include <Inventor/nodes/SoMaterialBinding.h>
+#include <Inventor/nodes/SoNormal.h>
+#include <Inventor/nodes/SoNormalBinding.h>
+#include <Inventor/nodes/SoOrthographicCamera.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoTexture2.h>
+
+// One cache filled through addTriangle() and one through
+// addIndexedTriangles(), from the same shape.
+typedef struct {
+  SoPrimitiveVertexCache * hashed;
+  SoPrimitiveVertexCache * indexed;
+} sopvcache_testdata;
+
+static SoCallbackAction::Response
+sopvcache_pre_cb(void * closure, SoCallbackAction * action, const SoNode * node)
+{
+  sopvcache_testdata * data = static_cast<sopvcache_testdata *>(closure);
+  const SoIndexedFaceSet * ifs = static_cast<const SoIndexedFaceSet *>(node);
+  SoState * state = action->getState();
+
+  data->hashed = new SoPrimitiveVertexCache(state);
+  data->hashed->ref();
+  data->indexed = new SoPrimitiveVertexCache(state);
+  data->indexed->ref();
+
+  // default texture coordinates are set up as SoIndexedFaceSet does
+  SoTextureCoordinateBundle tb(action, FALSE, FALSE);
+  const SoCoordinateElement * coords = SoCoordinateElement::getInstance(state);
+  data->indexed->addIndexedTriangles(ifs->coordIndex.getNum(),
+                                     ifs->coordIndex.getValues(0),
+                                     coords->getArrayPtr3(), coords->getNum(),
+                                     ifs->normalIndex.getValues(0),
+                                     SoNormalElement::getInstance(state)->getArrayPtr(),
+                                     SoNormalElement::getInstance(state)->getNum(),
+                                     NULL,
+                                     tb.needCoordinates() ? &tb : NULL,
+                                     ifs->materialIndex.getValues(0));
+  return SoCallbackAction::CONTINUE;
+}
+
+static void
+sopvcache_triangle_cb(void * closure, SoCallbackAction *,
+                      const SoPrimitiveVertex * v1,
+                      const SoPrimitiveVertex * v2,
+                      const SoPrimitiveVertex * v3)
+{
+  sopvcache_testdata * data = static_cast<sopvcache_testdata *>(closure);
+  data->hashed->addTriangle(v1, v2, v3);
+}
+
+// Builds a grid of n*n quads split in two triangles each, where the
+// normal and material indices alternate between the triangles, so
+// that most coordinates are used with several index tuples. Returns
+// the number of triangles.
+static int
+sopvcache_build_grid(SoSeparator * root, const int n, const SbBool textured)
+{
+  if (textured) {
+    // no texture coordinates, so that the default ones are used
+    static const unsigned char texels[] = { 0, 255, 255, 0 };
+    SoTexture2 * texture = new SoTexture2;
+    texture->image.setValue(SbVec2s(2, 2), 1, texels);
+    root->addChild(texture);
+  }
+
+  SoMaterial * mat = new SoMaterial;
+  mat->diffuseColor.set1Value(0, SbColor(1.0f, 0.0f, 0.0f));
+  mat->diffuseColor.set1Value(1, SbColor(0.0f, 1.0f, 0.0f));
+  mat->diffuseColor.set1Value(2, SbColor(0.0f, 0.0f, 1.0f));
+  root->addChild(mat);
+  SoMaterialBinding * mb = new SoMaterialBinding;
+  mb->value = SoMaterialBinding::PER_VERTEX_INDEXED;
+  root->addChild(mb);
+
+  SoNormal * normal = new SoNormal;
+  normal->vector.set1Value(0, SbVec3f(0.0f, 0.0f, 1.0f));
+  normal->vector.set1Value(1, SbVec3f(0.0f, 1.0f, 0.0f));
+  root->addChild(normal);
+  SoNormalBinding * nb = new SoNormalBinding;
+  nb->value = SoNormalBinding::PER_VERTEX_INDEXED;
+  root->addChild(nb);
+
+  SoCoordinate3 * coord = new SoCoordinate3;
+  for (int j = 0; j <= n; j++) {
+    for (int i = 0; i <= n; i++) {
+      coord->point.set1Value(j*(n+1)+i, SbVec3f(float(i), float(j), float((i*j) % 3)));
+    }
+  }
+  root->addChild(coord);
+
+  SoIndexedFaceSet * ifs = new SoIndexedFaceSet;
+  int numtriangles = 0;
+  for (int j = 0; j < n; j++) {
+    for (int i = 0; i < n; i++) {
+      const int a = j*(n+1) + i;
+      const int32_t tri[2][3] = { { a, a+1, a+n+2 }, { a, a+n+2, a+n+1 } };
+      for (int t = 0; t < 2; t++) {
+        for (int k = 0; k < 4; k++) {
+          const int idx = numtriangles*4 + k;
+          ifs->coordIndex.set1Value(idx, k < 3 ? tri[t][k] : -1);
+          ifs->normalIndex.set1Value(idx, k < 3 ? t : -1);
+          ifs->materialIndex.set1Value(idx, k < 3 ? (numtriangles % 3) : -1);
+        }
+        numtriangles++;
+      }
+    }
+  }
+  root->addChild(ifs);
+  return numtriangles;
+}
+
+BOOST_AUTO_TEST_CASE(indexedTriangles)
+{
+  const int n = 20;
+  for (int textured = 0; textured < 2; textured++) {
+    SoSeparator * root = new SoSeparator;
+    root->ref();
+    const int numtriangles = sopvcache_build_grid(root, n, textured);
+
+    sopvcache_testdata data;
+    data.hashed = data.indexed = NULL;
+    SoCallbackAction cba;
+    cba.addPreCallback(SoIndexedFaceSet::getClassTypeId(), sopvcache_pre_cb, &data);
+    cba.addTriangleCallback(SoIndexedFaceSet::getClassTypeId(), sopvcache_triangle_cb, &data);
+    cba.apply(root);
+    BOOST_REQUIRE(data.hashed != NULL && data.indexed != NULL);
+    data.hashed->fit();
+    data.indexed->fit();
+
+    // All coordinates, normals and colors are distinct, so merging on
+    // index tuples must give the same vertices as merging on values.
+    const int numv = data.hashed->getNumVertices();
+    BOOST_CHECK_MESSAGE(numv > (n+1)*(n+1), "coordinates should be shared between vertices");
+    BOOST_CHECK_EQUAL(data.indexed->getNumVertices(), numv);
+    BOOST_CHECK_EQUAL(data.indexed->colorPerVertex(), data.hashed->colorPerVertex());
+    BOOST_REQUIRE_EQUAL(data.hashed->getNumTriangleIndices(), numtriangles * 3);
+    BOOST_REQUIRE_EQUAL(data.indexed->getNumTriangleIndices(), numtriangles * 3);
+
+    SbBool same = (data.indexed->getNumVertices() == numv);
+    for (int i = 0; same && i < numv; i++) {
+      same =
+        data.indexed->getVertexArray()[i] == data.hashed->getVertexArray()[i] &&
+        data.indexed->getNormalArray()[i] == data.hashed->getNormalArray()[i] &&
+        data.indexed->getTexCoordArray()[i] == data.hashed->getTexCoordArray()[i] &&
+        data.indexed->getBumpCoordArray()[i] == data.hashed->getBumpCoordArray()[i] &&
+        memcmp(data.indexed->getColorArray() + i*4, data.hashed->getColorArray() + i*4, 4) == 0;
+    }
+    for (int i = 0; same && i < numtriangles * 3; i++) {
+      same = data.indexed->getTriangleIndex(i) == data.hashed->getTriangleIndex(i);
+    }
+    BOOST_CHECK_MESSAGE(same, "indexed triangles differ from hashed triangles");
+
+    // the default texture coordinates span the grid
+    if (textured && data.indexed->getNumVertices() > 0) {
+      SbBox2f texbox;
+      for (int i = 0; i < data.indexed->getNumVertices(); i++) {
+        const SbVec4f & tc = data.indexed->getTexCoordArray()[i];
+        texbox.extendBy(SbVec2f(tc[0], tc[1]));
+      }
+      BOOST_CHECK_MESSAGE(texbox.getMin() == SbVec2f(0.0f, 0.0f) &&
+                          texbox.getMax() == SbVec2f(1.0f, 1.0f),
+                          "default texture coordinates should span the unit square");
+    }
+
+    data.hashed->unref();
+    data.indexed->unref();
+    root->unref();
+  }
+}
+
+// Sorts the triangles of the face set on depth while the state is
+// still set up for it, and returns the z value sum of each triangle
+// in the sorted order.
+static SoCallbackAction::Response
+sopvcache_sort_cb(void * closure, SoCallbackAction * action, const SoNode * node)
+{
+  const SoIndexedFaceSet * ifs = static_cast<const SoIndexedFaceSet *>(node);
+  SoState * state = action->getState();
+  SbList <float> * sums = static_cast<SbList <float> *>(closure);
+
+  SoPrimitiveVertexCache * cache = new SoPrimitiveVertexCache(state);
+  cache->ref();
+  const SoCoordinateElement * coords = SoCoordinateElement::getInstance(state);
+  cache->addIndexedTriangles(ifs->coordIndex.getNum(), ifs->coordIndex.getValues(0),
+                             coords->getArrayPtr3(), coords->getNum(),
+                             NULL, NULL, 0, NULL, NULL, NULL);
+  cache->fit();
+  cache->depthSortTriangles(state);
+
+  const SbVec3f * v = cache->getVertexArray();
+  for (int i = 0; i < cache->getNumTriangleIndices(); i += 3) {
+    sums->append(v[cache->getTriangleIndex(i)][2] +
+                 v[cache->getTriangleIndex(i+1)][2] +
+                 v[cache->getTriangleIndex(i+2)][2]);
+  }
+  cache->unref();
+  return SoCallbackAction::CONTINUE;
+}
+
+BOOST_AUTO_TEST_CASE(depthSortTriangles)
+{
+  const int n = 30;
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  SoOrthographicCamera * camera = new SoOrthographicCamera;
+  camera->position = SbVec3f(0.0f, 0.0f, 100.0f);
+  root->addChild(camera);
+
+  SoCoordinate3 * coord = new SoCoordinate3;
+  for (int j = 0; j <= n; j++) {
+    for (int i = 0; i <= n; i++) {
+      coord->point.set1Value(j*(n+1)+i, SbVec3f(float(i), float(j), float((i*7 + j*13) % 11)));
+    }
+  }
+  root->addChild(coord);
+  SoIndexedFaceSet * ifs = new SoIndexedFaceSet;
+  int numtriangles = 0;
+  for (int j = 0; j < n; j++) {
+    for (int i = 0; i < n; i++) {
+      const int a = j*(n+1) + i;
+      const int32_t tri[2][3] = { { a, a+1, a+n+2 }, { a, a+n+2, a+n+1 } };
+      for (int t = 0; t < 2; t++) {
+        for (int k = 0; k < 4; k++) {
+          ifs->coordIndex.set1Value(numtriangles*4 + k, k < 3 ? tri[t][k] : -1);
+        }
+        numtriangles++;
+      }
+    }
+  }
+  root->addChild(ifs);
+
+  // triangles are sorted back to front, so view the shape from both
+  // sides and check that the order is reversed
+  for (int side = 0; side < 2; side++) {
+    if (side == 1) {
+      camera->position = SbVec3f(0.0f, 0.0f, -100.0f);
+      camera->orientation = SbRotation(SbVec3f(0.0f, 1.0f, 0.0f), float(M_PI));
+    }
+    SbList <float> sums;
+    SoCallbackAction cba;
+    cba.addPostCallback(SoIndexedFaceSet::getClassTypeId(), sopvcache_sort_cb, &sums);
+    cba.apply(root);
+    BOOST_REQUIRE_EQUAL(sums.getLength(), numtriangles);
+    BOOST_CHECK_MESSAGE(sums[0] != sums[numtriangles-1], "all triangles at the same depth");
+
+    SbBool sorted = TRUE;
+    for (int i = 1; sorted && i < numtriangles; i++) {
+      sorted = (side == 0) ? (sums[i] >= sums[i-1]) : (sums[i] <= sums[i-1]);
+    }
+    BOOST_CHECK_MESSAGE(sorted, "triangles are not sorted on depth");
+  }
+  root->unref();
+}
+
+#endif // COIN_TEST_SUITE
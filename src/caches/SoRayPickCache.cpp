@@ -0,0 +1,807 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+/*!
+  \class SoRayPickCache SoRayPickCache.h caches/SoRayPickCache.h
+  \brief The SoRayPickCache class stores the triangles of a shape in a bounding volume hierarchy.
+
+  \ingroup caches
+
+  SoShape::rayPick() normally calls generatePrimitives() and tests
+  every single triangle against the pick ray. This is very slow for
+  large meshes, so shapes that are picked repeatedly store their
+  triangles in this cache instead, together with the data needed to
+  recreate the picked point and its detail. A pick then only has to
+  test the triangles in the leaf nodes hit by the ray.
+
+  The cache is invalidated through the usual element dependency
+  mechanism, just like the other shape caches.
+*/
+
+// *************************************************************************
+
+#include "caches/SoRayPickCache.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <Inventor/SbBox3f.h>
+#include <Inventor/SbLine.h>
+#include <Inventor/SoPrimitiveVertex.h>
+#include <Inventor/details/SoFaceDetail.h>
+#include <Inventor/details/SoPointDetail.h>
+#include <Inventor/errors/SoDebugError.h>
+
+#include "tidbitsp.h"
+
+// *************************************************************************
+
+// max number of triangles in a leaf node
+#define SORAYPICKCACHE_LEAFSIZE 4
+
+struct soraypickcache_corner {
+  SbVec3f point;
+  SbVec3f normal;
+  SbVec4f texcoords;
+  int32_t materialindex;
+};
+
+struct soraypickcache_triangle {
+  int32_t corner[3];
+  int32_t face;
+};
+
+struct soraypickcache_face {
+  int32_t faceindex;
+  int32_t partindex;
+  int32_t first;     // first point detail in the facepoints array
+  int32_t numpoints; // -1 if the shape didn't supply a detail
+};
+
+// a leaf node stores its triangles at [index, index+count> in the
+// order array. For internal nodes count is 0, the left child
+// immediately follows its parent and index is the right child.
+struct soraypickcache_node {
+  float bmin[3];
+  float bmax[3];
+  int32_t index;
+  int32_t count;
+};
+
+struct soraypickcache_hashentry {
+  uint32_t hash;
+  int32_t index;
+};
+
+// used while building the hierarchy
+struct soraypickcache_prim {
+  float centroid[3];
+  int32_t triangle;
+};
+
+class soraypickcache_prim_less {
+public:
+  soraypickcache_prim_less(const int axis) : axis(axis) { }
+  bool operator()(const soraypickcache_prim & a, const soraypickcache_prim & b) const {
+    return a.centroid[this->axis] < b.centroid[this->axis];
+  }
+private:
+  int axis;
+};
+
+// hash the raw bytes of a record. All records are made up of 32-bit
+// words.
+static uint32_t
+soraypickcache_hash(const void * record, const size_t size)
+{
+  const unsigned char * ptr = static_cast<const unsigned char *>(record);
+  uint32_t h = 0;
+  for (size_t i = 0; i < size; i += 4) {
+    uint32_t w;
+    memcpy(&w, ptr + i, 4);
+    h = (h ^ w) * 0x9e3779b1;
+    h ^= h >> 15;
+  }
+  // final avalanche, from MurmurHash3
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+// size of the direct mapped table of recently used corners
+#define SORAYPICKCACHE_RECENTSIZE 4096
+
+// Searches the open addressing hash table for a record equal to
+// key. Returns the index of the existing record, or numrecords if
+// the key was added to the table. The caller must then append key
+// to the record array. Neighbouring triangles usually share
+// vertices, so the small recent table is tested first to avoid
+// cache misses in the large table.
+static int
+soraypickcache_find(std::vector<soraypickcache_hashentry> & table,
+                    int32_t * recent,
+                    const unsigned char * records, const int numrecords,
+                    const void * key, const size_t size)
+{
+  const uint32_t hash = soraypickcache_hash(key, size);
+  int32_t & r = recent[hash & (SORAYPICKCACHE_RECENTSIZE - 1)];
+  if (r >= 0 && memcmp(records + r * size, key, size) == 0) return r;
+
+  soraypickcache_hashentry empty;
+  empty.hash = 0;
+  empty.index = -1;
+  if (size_t(numrecords + 1) * 2 > table.size()) {
+    std::vector<soraypickcache_hashentry> old;
+    old.swap(table);
+    table.assign(old.size() ? old.size() * 2 : 1024, empty);
+    const size_t mask = table.size() - 1;
+    for (size_t i = 0; i < old.size(); i++) {
+      if (old[i].index < 0) continue;
+      size_t h = old[i].hash & mask;
+      while (table[h].index >= 0) h = (h + 1) & mask;
+      table[h] = old[i];
+    }
+  }
+  const size_t mask = table.size() - 1;
+  size_t h = hash & mask;
+  while (table[h].index >= 0) {
+    if (table[h].hash == hash &&
+        memcmp(records + table[h].index * size, key, size) == 0) {
+      r = table[h].index;
+      return r;
+    }
+    h = (h + 1) & mask;
+  }
+  table[h].hash = hash;
+  table[h].index = numrecords;
+  r = numrecords;
+  return numrecords;
+}
+
+// tests if the line intersects the box expanded by pad
+static SbBool
+soraypickcache_hit(const soraypickcache_node & node,
+                   const double * pos, const double * dir, const double pad)
+{
+  double tmin = -DBL_MAX;
+  double tmax = DBL_MAX;
+  for (int i = 0; i < 3; i++) {
+    const double lo = double(node.bmin[i]) - pad;
+    const double hi = double(node.bmax[i]) + pad;
+    if (dir[i] == 0.0) {
+      if (pos[i] < lo || pos[i] > hi) return FALSE;
+    }
+    else {
+      double t0 = (lo - pos[i]) / dir[i];
+      double t1 = (hi - pos[i]) / dir[i];
+      if (t0 > t1) std::swap(t0, t1);
+      if (t0 > tmin) tmin = t0;
+      if (t1 < tmax) tmax = t1;
+      if (tmin > tmax) return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// *************************************************************************
+
+class SoRayPickCacheP {
+public:
+  SoRayPickCacheP(void) : usable(TRUE), pad(0.0) {
+    for (int i = 0; i < SORAYPICKCACHE_RECENTSIZE; i++) {
+      this->recentcorners[i] = -1;
+    }
+  }
+
+  int addCorner(const SoPrimitiveVertex * v);
+  int addFace(const SoDetail * detail);
+  void build(const int first, const int count);
+
+  std::vector<soraypickcache_corner> corners;
+  std::vector<soraypickcache_triangle> triangles;
+  std::vector<soraypickcache_face> faces;
+  std::vector<int32_t> facepoints; // four indices per point detail
+  std::vector<soraypickcache_node> nodes;
+  std::vector<int32_t> order;
+
+  // only used while the cache is being created
+  std::vector<soraypickcache_hashentry> cornertable;
+  int32_t recentcorners[SORAYPICKCACHE_RECENTSIZE];
+  std::vector<soraypickcache_prim> prims;
+
+  SbBool usable;
+  double pad;
+};
+
+#define PRIVATE(obj) ((obj)->pimpl)
+
+int
+SoRayPickCacheP::addCorner(const SoPrimitiveVertex * v)
+{
+  soraypickcache_corner c;
+  c.point = v->getPoint();
+  c.normal = v->getNormal();
+  c.texcoords = v->getTextureCoords();
+  c.materialindex = v->getMaterialIndex();
+
+  const int num = int(this->corners.size());
+  const int idx = soraypickcache_find(this->cornertable, this->recentcorners,
+                                      num ? reinterpret_cast<const unsigned char *>(&this->corners[0]) : NULL,
+                                      num, &c, sizeof(c));
+  if (idx == num) this->corners.push_back(c);
+  return idx;
+}
+
+// Stores the face detail of a triangle. Returns -1 if the detail
+// can't be stored in the cache.
+int
+SoRayPickCacheP::addFace(const SoDetail * detail)
+{
+  soraypickcache_face f;
+  f.faceindex = 0;
+  f.partindex = 0;
+  f.first = int32_t(this->facepoints.size() / 4);
+  f.numpoints = -1;
+
+  const SoFaceDetail * fd = NULL;
+  if (detail) {
+    if (detail->getTypeId() != SoFaceDetail::getClassTypeId()) return -1;
+    fd = static_cast<const SoFaceDetail *>(detail);
+    f.faceindex = fd->getFaceIndex();
+    f.partindex = fd->getPartIndex();
+    f.numpoints = fd->getNumPoints();
+  }
+
+  // polygons are split into several triangles sharing the same
+  // detail, so test against the previous face before adding a new one
+  if (!this->faces.empty()) {
+    const soraypickcache_face & last = this->faces.back();
+    SbBool equal =
+      last.faceindex == f.faceindex && last.partindex == f.partindex &&
+      last.numpoints == f.numpoints;
+    for (int i = 0; equal && i < f.numpoints; i++) {
+      const SoPointDetail * pd = fd->getPoint(i);
+      const int32_t * p = &this->facepoints[(last.first + i) * 4];
+      equal =
+        p[0] == pd->getCoordinateIndex() && p[1] == pd->getMaterialIndex() &&
+        p[2] == pd->getNormalIndex() && p[3] == pd->getTextureCoordIndex();
+    }
+    if (equal) return int(this->faces.size()) - 1;
+  }
+
+  for (int i = 0; i < f.numpoints; i++) {
+    const SoPointDetail * pd = fd->getPoint(i);
+    this->facepoints.push_back(pd->getCoordinateIndex());
+    this->facepoints.push_back(pd->getMaterialIndex());
+    this->facepoints.push_back(pd->getNormalIndex());
+    this->facepoints.push_back(pd->getTextureCoordIndex());
+  }
+  this->faces.push_back(f);
+  return int(this->faces.size()) - 1;
+}
+
+// Builds the subtree for prims [first, first+count> by splitting
+// at the median centroid along the axis with the largest centroid
+// extent.
+void
+SoRayPickCacheP::build(const int first, const int count)
+{
+  const int nodeidx = int(this->nodes.size());
+  this->nodes.push_back(soraypickcache_node());
+
+  int i, j;
+  float cmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+  float cmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+  for (i = first; i < first + count; i++) {
+    const float * c = this->prims[i].centroid;
+    for (j = 0; j < 3; j++) {
+      if (c[j] < cmin[j]) cmin[j] = c[j];
+      if (c[j] > cmax[j]) cmax[j] = c[j];
+    }
+  }
+  int axis = 0;
+  for (j = 1; j < 3; j++) {
+    if (cmax[j] - cmin[j] > cmax[axis] - cmin[axis]) axis = j;
+  }
+
+  if (count <= SORAYPICKCACHE_LEAFSIZE || cmax[axis] <= cmin[axis]) {
+    soraypickcache_node & node = this->nodes[nodeidx];
+    for (j = 0; j < 3; j++) {
+      node.bmin[j] = FLT_MAX;
+      node.bmax[j] = -FLT_MAX;
+    }
+    for (i = first; i < first + count; i++) {
+      const int32_t t = this->prims[i].triangle;
+      this->order[i] = t;
+      for (int k = 0; k < 3; k++) {
+        const SbVec3f & p = this->corners[this->triangles[t].corner[k]].point;
+        for (j = 0; j < 3; j++) {
+          if (p[j] < node.bmin[j]) node.bmin[j] = p[j];
+          if (p[j] > node.bmax[j]) node.bmax[j] = p[j];
+        }
+      }
+    }
+    node.index = first;
+    node.count = count;
+    return;
+  }
+
+  const int mid = first + count / 2;
+  std::nth_element(this->prims.begin() + first,
+                   this->prims.begin() + mid,
+                   this->prims.begin() + first + count,
+                   soraypickcache_prim_less(axis));
+  this->build(first, mid - first);
+  const int right = int(this->nodes.size());
+  this->build(mid, first + count - mid);
+
+  const soraypickcache_node & l = this->nodes[nodeidx + 1];
+  const soraypickcache_node & r = this->nodes[right];
+  soraypickcache_node & node = this->nodes[nodeidx];
+  for (j = 0; j < 3; j++) {
+    node.bmin[j] = SbMin(l.bmin[j], r.bmin[j]);
+    node.bmax[j] = SbMax(l.bmax[j], r.bmax[j]);
+  }
+  node.index = right;
+  node.count = 0;
+}
+
+// *************************************************************************
+
+/*!
+  Constructor with \a state being the current state.
+*/
+SoRayPickCache::SoRayPickCache(SoState * state)
+  : SoCache(state)
+{
+  PRIVATE(this) = new SoRayPickCacheP;
+
+#if COIN_DEBUG
+  if (coin_debug_caching_level() > 0) {
+    SoDebugError::postInfo("SoRayPickCache::SoRayPickCache",
+                           "Cache created: %p", this);
+
+  }
+#endif // debug
+}
+
+/*!
+  Destructor.
+*/
+SoRayPickCache::~SoRayPickCache()
+{
+#if COIN_DEBUG
+  if (coin_debug_caching_level() > 0) {
+    SoDebugError::postInfo("SoRayPickCache::~SoRayPickCache",
+                           "Cache destructed: %p", this);
+  }
+#endif // debug
+
+  delete PRIVATE(this);
+}
+
+/*!
+  Adds a triangle to the cache. \a detail is the detail the shape
+  would have set in the picked point for this triangle, and it is
+  copied by the cache. If the detail is not a face detail, the cache
+  is marked as unusable.
+*/
+void
+SoRayPickCache::addTriangle(const SoPrimitiveVertex * v0,
+                            const SoPrimitiveVertex * v1,
+                            const SoPrimitiveVertex * v2,
+                            const SoDetail * detail)
+{
+  if (!PRIVATE(this)->usable) return;
+
+  soraypickcache_triangle t;
+  t.face = PRIVATE(this)->addFace(detail);
+  if (t.face < 0) {
+    // just give up. The shape will be picked the old fashioned way.
+    PRIVATE(this)->usable = FALSE;
+    return;
+  }
+  t.corner[0] = PRIVATE(this)->addCorner(v0);
+  t.corner[1] = PRIVATE(this)->addCorner(v1);
+  t.corner[2] = PRIVATE(this)->addCorner(v2);
+  PRIVATE(this)->triangles.push_back(t);
+}
+
+/*!
+  Should be called after all triangles have been added. Builds the
+  bounding volume hierarchy.
+*/
+void
+SoRayPickCache::close(void)
+{
+  std::vector<soraypickcache_hashentry>().swap(PRIVATE(this)->cornertable);
+
+  if (!PRIVATE(this)->usable) {
+    std::vector<soraypickcache_corner>().swap(PRIVATE(this)->corners);
+    std::vector<soraypickcache_triangle>().swap(PRIVATE(this)->triangles);
+    std::vector<soraypickcache_face>().swap(PRIVATE(this)->faces);
+    std::vector<int32_t>().swap(PRIVATE(this)->facepoints);
+    return;
+  }
+
+  const int num = int(PRIVATE(this)->triangles.size());
+  if (num == 0) return;
+
+  std::vector<soraypickcache_prim> & prims = PRIVATE(this)->prims;
+  prims.resize(num);
+  for (int i = 0; i < num; i++) {
+    const soraypickcache_triangle & t = PRIVATE(this)->triangles[i];
+    const SbVec3f & p0 = PRIVATE(this)->corners[t.corner[0]].point;
+    const SbVec3f & p1 = PRIVATE(this)->corners[t.corner[1]].point;
+    const SbVec3f & p2 = PRIVATE(this)->corners[t.corner[2]].point;
+    for (int j = 0; j < 3; j++) {
+      prims[i].centroid[j] = (p0[j] + p1[j] + p2[j]) / 3.0f;
+    }
+    prims[i].triangle = i;
+  }
+  PRIVATE(this)->order.resize(num);
+  PRIVATE(this)->nodes.reserve(4 * num / SORAYPICKCACHE_LEAFSIZE + 1);
+  PRIVATE(this)->build(0, num);
+  std::vector<soraypickcache_prim>().swap(prims);
+
+  // Boxes are stored with single precision, while the triangle test
+  // is done with double precision. Expand the boxes slightly during
+  // traversal so that no triangles are missed.
+  const soraypickcache_node & root = PRIVATE(this)->nodes[0];
+  double size = 0.0;
+  for (int j = 0; j < 3; j++) {
+    size = SbMax(size, double(root.bmax[j]) - double(root.bmin[j]));
+    size = SbMax(size, fabs(double(root.bmin[j])));
+    size = SbMax(size, fabs(double(root.bmax[j])));
+  }
+  PRIVATE(this)->pad = size * 1.0e-5;
+}
+
+/*!
+  Returns \c FALSE if the shape generated triangles that couldn't be
+  stored in the cache. The cache should not be used for picking in
+  that case.
+*/
+SbBool
+SoRayPickCache::isUsable(void) const
+{
+  return PRIVATE(this)->usable;
+}
+
+/*!
+  Returns the number of triangles in the cache.
+*/
+int
+SoRayPickCache::getNumTriangles(void) const
+{
+  return int(PRIVATE(this)->triangles.size());
+}
+
+/*!
+  Appends the triangles that might intersect the object space \a
+  line to \a triangles. The triangles are returned in the order
+  they were added to the cache.
+*/
+void
+SoRayPickCache::findTriangles(const SbLine & line, SbList<int> & triangles) const
+{
+  const std::vector<soraypickcache_node> & nodes = PRIVATE(this)->nodes;
+  if (nodes.empty()) return;
+
+  double pos[3], dir[3];
+  double pad = PRIVATE(this)->pad;
+  for (int i = 0; i < 3; i++) {
+    pos[i] = line.getPosition()[i];
+    dir[i] = line.getDirection()[i];
+    pad = SbMax(pad, fabs(pos[i]) * 1.0e-6);
+  }
+
+  const int first = triangles.getLength();
+  // the tree is balanced, so the stack will never grow very large
+  SbList<int> stack(64);
+  stack.push(0);
+  while (stack.getLength()) {
+    const soraypickcache_node & node = nodes[stack.pop()];
+    if (!soraypickcache_hit(node, pos, dir, pad)) continue;
+    if (node.count) {
+      for (int i = 0; i < node.count; i++) {
+        triangles.append(PRIVATE(this)->order[node.index + i]);
+      }
+    }
+    else {
+      stack.push(node.index);
+      stack.push(int(&node - &nodes[0]) + 1);
+    }
+  }
+  const int num = triangles.getLength() - first;
+  if (num > 1) {
+    int * ptr = &triangles[first];
+    std::sort(ptr, ptr + num);
+  }
+}
+
+/*!
+  Returns the vertices of triangle \a idx. The vertices will have no
+  detail set.
+*/
+void
+SoRayPickCache::getTriangle(const int idx,
+                            SoPrimitiveVertex & v0,
+                            SoPrimitiveVertex & v1,
+                            SoPrimitiveVertex & v2) const
+{
+  const soraypickcache_triangle & t = PRIVATE(this)->triangles[idx];
+  SoPrimitiveVertex * v[3] = { &v0, &v1, &v2 };
+  for (int i = 0; i < 3; i++) {
+    const soraypickcache_corner & c = PRIVATE(this)->corners[t.corner[i]];
+    v[i]->setPoint(c.point);
+    v[i]->setNormal(c.normal);
+    v[i]->setTextureCoords(c.texcoords);
+    v[i]->setMaterialIndex(c.materialindex);
+    v[i]->setDetail(NULL);
+  }
+}
+
+/*!
+  Returns a new instance of the detail for triangle \a idx, or
+  \c NULL if no detail was supplied for the triangle. It is the
+  caller's responsibility to delete the detail.
+*/
+SoDetail *
+SoRayPickCache::createDetail(const int idx) const
+{
+  const soraypickcache_face & f =
+    PRIVATE(this)->faces[PRIVATE(this)->triangles[idx].face];
+  if (f.numpoints < 0) return NULL;
+
+  SoFaceDetail * fd = new SoFaceDetail;
+  fd->setFaceIndex(f.faceindex);
+  fd->setPartIndex(f.partindex);
+  fd->setNumPoints(f.numpoints);
+  SoPointDetail pd;
+  for (int i = 0; i < f.numpoints; i++) {
+    const int32_t * p = &PRIVATE(this)->facepoints[(f.first + i) * 4];
+    pd.setCoordinateIndex(p[0]);
+    pd.setMaterialIndex(p[1]);
+    pd.setNormalIndex(p[2]);
+    pd.setTextureCoordIndex(p[3]);
+    fd->setPoint(i, &pd);
+  }
+  return fd;
+}
+
+#undef PRIVATE
+#undef SORAYPICKCACHE_LEAFSIZE
+#undef SORAYPICKCACHE_RECENTSIZE
+
+#ifdef COIN_TEST_SUITE
+
+#include <cmath>
+#include <Inventor/SoPickedPoint.h>
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/actions/SoRayPickAction.h>
+#include <Inventor/details/SoFaceDetail.h>
+#include <Inventor/details/SoPointDetail.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoVertexProperty.h>
+#include "threads/parallelp.h"
+
+// wavy grid of n*n quads with one color per quad, large enough to
+// get a pick cache
+static SoSeparator *
+soraypickcache_create_grid(const int n)
+{
+  SoVertexProperty * vp = new SoVertexProperty;
+  vp->vertex.setNum((n+1)*(n+1));
+  SbVec3f * v = vp->vertex.startEditing();
+  for (int j = 0; j <= n; j++) {
+    for (int i = 0; i <= n; i++) {
+      v[j*(n+1)+i].setValue(float(i) / n, float(j) / n,
+                            0.1f * float(sin(i * 0.7) * cos(j * 0.5)));
+    }
+  }
+  vp->vertex.finishEditing();
+  for (int i = 0; i < n*n; i++) {
+    vp->orderedRGBA.set1Value(i, 0xff000000 | ((i * 2654435761u) & 0xffff00));
+  }
+  vp->materialBinding = SoVertexProperty::PER_FACE;
+
+  SoIndexedFaceSet * ifs = new SoIndexedFaceSet;
+  ifs->vertexProperty = vp;
+  ifs->coordIndex.setNum(n*n*5);
+  int32_t * idx = ifs->coordIndex.startEditing();
+  for (int j = 0; j < n; j++) {
+    for (int i = 0; i < n; i++) {
+      const int a = j*(n+1) + i;
+      *idx++ = a; *idx++ = a+1; *idx++ = a+n+2; *idx++ = a+n+1; *idx++ = -1;
+    }
+  }
+  ifs->coordIndex.finishEditing();
+
+  SoSeparator * root = new SoSeparator;
+  root->addChild(ifs);
+  return root;
+}
+
+static SbBool
+soraypickcache_same_points(const SoPickedPointList & l1,
+                           const SoPickedPointList & l2)
+{
+  if (l1.getLength() != l2.getLength()) return FALSE;
+  for (int i = 0; i < l1.getLength(); i++) {
+    if (l1[i]->getPoint() != l2[i]->getPoint() ||
+        l1[i]->getNormal() != l2[i]->getNormal() ||
+        l1[i]->getTextureCoords() != l2[i]->getTextureCoords() ||
+        l1[i]->getMaterialIndex() != l2[i]->getMaterialIndex() ||
+        l1[i]->isOnGeometry() != l2[i]->isOnGeometry()) return FALSE;
+    const SoFaceDetail * d1 = static_cast<const SoFaceDetail *>(l1[i]->getDetail());
+    const SoFaceDetail * d2 = static_cast<const SoFaceDetail *>(l2[i]->getDetail());
+    if (!d1 || !d2) return FALSE;
+    if (d1->getFaceIndex() != d2->getFaceIndex() ||
+        d1->getPartIndex() != d2->getPartIndex() ||
+        d1->getNumPoints() != d2->getNumPoints()) return FALSE;
+    for (int j = 0; j < d1->getNumPoints(); j++) {
+      const SoPointDetail * p1 = d1->getPoint(j);
+      const SoPointDetail * p2 = d2->getPoint(j);
+      if (p1->getCoordinateIndex() != p2->getCoordinateIndex() ||
+          p1->getMaterialIndex() != p2->getMaterialIndex() ||
+          p1->getNormalIndex() != p2->getNormalIndex() ||
+          p1->getTextureCoordIndex() != p2->getTextureCoordIndex()) return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+BOOST_AUTO_TEST_CASE(cachedpicks)
+{
+  const int n = 60;
+  SoSeparator * cached = soraypickcache_create_grid(n);
+  cached->ref();
+
+  SoRayPickAction ra(SbViewportRegion(100, 100));
+  SoRayPickAction ref(SbViewportRegion(100, 100));
+  ra.setPickAll(TRUE);
+  ref.setPickAll(TRUE);
+  int numhits = 0;
+
+  for (int i = 0; i < 20; i++) {
+    // the rays go through vertices and edges as well as faces
+    const SbVec3f start(float(i % 5) / 4.0f, float(i / 5) / 3.0f, 1.0f);
+    const SbVec3f dir(0.01f * (i % 3), -0.02f * (i % 2), -1.0f);
+    ra.setRay(start, dir);
+    ref.setRay(start, dir);
+
+    // picking the same shape repeatedly will create the cache
+    ra.apply(cached);
+    ra.apply(cached);
+    ra.apply(cached);
+
+    SoSeparator * fresh = soraypickcache_create_grid(n);
+    fresh->ref();
+    ref.apply(fresh);
+    numhits += ref.getPickedPointList().getLength();
+    BOOST_CHECK_MESSAGE(soraypickcache_same_points(ra.getPickedPointList(),
+                                                   ref.getPickedPointList()),
+                        "cached pick differs from regular pick");
+    fresh->unref();
+  }
+  BOOST_CHECK_MESSAGE(numhits >= 10, "rays should hit the grid");
+
+  // changing the shape must invalidate the cache
+  SoIndexedFaceSet * ifs = static_cast<SoIndexedFaceSet *>(cached->getChild(0));
+  SoVertexProperty * vp = static_cast<SoVertexProperty *>(ifs->vertexProperty.getValue());
+  SbVec3f * v = vp->vertex.startEditing();
+  for (int i = 0; i < vp->vertex.getNum(); i++) v[i][2] = -0.5f;
+  vp->vertex.finishEditing();
+  ra.setRay(SbVec3f(0.31f, 0.32f, 1.0f), SbVec3f(0.0f, 0.0f, -1.0f));
+  ra.apply(cached);
+  BOOST_CHECK_MESSAGE(ra.getPickedPointList().getLength() == 1 &&
+                      fabs(ra.getPickedPointList()[0]->getPoint()[2] + 0.5f) < 1.0e-5f,
+                      "cache not invalidated");
+
+  cached->unref();
+}
+
+typedef struct {
+  SoSeparator * root;
+  SoPickedPointList * const * reference;
+  int * numfailed;
+} soraypickcache_test_data;
+
+static void
+soraypickcache_test_ray(SoRayPickAction & ra, const int i)
+{
+  ra.setRay(SbVec3f(float(i % 5) / 4.0f, float(i / 5) / 3.0f, 1.0f),
+            SbVec3f(0.01f * (i % 3), -0.02f * (i % 2), -1.0f));
+}
+
+static void
+soraypickcache_test_job(void * closure, int job)
+{
+  const soraypickcache_test_data * data =
+    static_cast<const soraypickcache_test_data *>(closure);
+  SoRayPickAction ra(SbViewportRegion(100, 100));
+  ra.setPickAll(TRUE);
+  for (int i = 0; i < 20; i++) {
+    soraypickcache_test_ray(ra, (i + job) % 20);
+    ra.apply(data->root);
+    if (!soraypickcache_same_points(ra.getPickedPointList(),
+                                    *data->reference[(i + job) % 20])) {
+      data->numfailed[job]++;
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(concurrentpicks)
+{
+  const int n = 60;
+  SoSeparator * root = soraypickcache_create_grid(n);
+  root->ref();
+
+  SoPickedPointList * reference[20];
+  SoRayPickAction ra(SbViewportRegion(100, 100));
+  ra.setPickAll(TRUE);
+  for (int i = 0; i < 20; i++) {
+    soraypickcache_test_ray(ra, i);
+    ra.apply(root);
+    reference[i] = new SoPickedPointList(ra.getPickedPointList());
+  }
+
+  // the threads race to build, replace and release the shared cache
+  const int numjobs = 16;
+  int numfailed[numjobs];
+  for (int i = 0; i < numjobs; i++) numfailed[i] = 0;
+  soraypickcache_test_data data;
+  data.root = root;
+  data.reference = reference;
+  data.numfailed = numfailed;
+  cc_parallel_run(numjobs, soraypickcache_test_job, &data);
+
+  int total = 0;
+  for (int i = 0; i < numjobs; i++) total += numfailed[i];
+  BOOST_CHECK_MESSAGE(total == 0, "concurrent picks differ from regular picks");
+
+  for (int i = 0; i < 20; i++) {
+    reference[i]->truncate(0);
+    delete reference[i];
+  }
+  root->unref();
+}
+
+#endif // COIN_TEST_SUITE
@@ -38,6 +38,7 @@
 #include "SoNormalCache.cpp"
 #include "SoTextureCoordinateCache.cpp"
 #include "SoPrimitiveVertexCache.cpp"
+#include "SoRayPickCache.cpp"
 #include "SoGlyphCache.cpp"
 #include "SoShaderProgramCache.cpp"
 #include "SoVBOCache.cpp"
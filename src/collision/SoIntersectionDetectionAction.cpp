@@ -43,6 +43,23 @@
   high-performance component in Coin.  Using it in a continuous manner
   over complex scene graphs is doomed to be a performance killer.
 
+  To make repeated invocations on the same scene graph less
+  expensive, the action keeps its per-shape data between calls to
+  apply(), keyed on the path to each shape. The triangles of a shape
+  and the search tree built over them are only regenerated when the
+  shape or the state it depends on changes, so moving a shape by
+  changing a transformation above it is cheap. Shapes found to
+  overlap are tested against each other on several threads when
+  Coin is built with thread support, but the filter and
+  intersection callbacks are always invoked from the thread calling
+  apply(). Note that the filter callback may then be invoked for a
+  few shape pairs ahead of the intersection callbacks for the
+  previous pairs.
+
+  The action holds references to the paths of the shapes found
+  during the last apply() until the next apply() or until the action
+  is destructed.
+
   Below is a simple usage example for this class.  It was written as a
   standalone framework set up for profiling and optimization of the
   SoIntersectionDetectionAction.  It tests intersection of all shapes
@@ -120,11 +137,6 @@
 // intersection testing code in SoExtSelection. Check if that could be
 // used.
 
-// FIXME: I just noticed that there's an O(n^2) algorithm for removing
-// duplicates from SbOctTree::findItems() results in SbOctTree.cpp
-// (see the add_to_array() helper function). This may very well be a
-// serious bottleneck, should investigate. 20050512 mortene.
-
 // *************************************************************************
 
 /*! \file SoIntersectionDetectionAction.h */
@@ -135,19 +147,18 @@
 #endif // HAVE_CONFIG_H
 
 #include <Inventor/C/tidbits.h>
-#include <Inventor/SbOctTree.h>
-#include <Inventor/SbRotation.h>
 #include <Inventor/SbTime.h>
-#include <Inventor/SbViewportRegion.h>
 #include <Inventor/SbXfBox3f.h>
+#include <Inventor/SoFullPath.h>
 #include <Inventor/SoPath.h>
 #include <Inventor/SoPrimitiveVertex.h>
 #include <Inventor/actions/SoCallbackAction.h>
-#include <Inventor/actions/SoGetBoundingBoxAction.h>
 #include <Inventor/actions/SoGetPrimitiveCountAction.h>
 #include <Inventor/actions/SoWriteAction.h>
 #include <Inventor/caches/SoBoundingBoxCache.h>
+#include <Inventor/elements/SoCacheElement.h>
 #include <Inventor/errors/SoDebugError.h>
+#include <Inventor/misc/SoState.h>
 #include <Inventor/lists/SbPList.h>
 #include <Inventor/nodes/SoBaseColor.h>
 #include <Inventor/nodes/SoCoordinate3.h>
@@ -172,6 +183,8 @@
 
 #include "actions/SoSubActionP.h"
 #include "collision/SbTri3f.h"
+#include "misc/SbHash.h"
+#include "threads/parallelp.h"
 #include "coindefs.h"
 
 #if BOOST_WORKAROUND(COIN_MSVC, <= COIN_MSVC_6_0_VERSION)
@@ -181,6 +194,7 @@
 
 #include "SbBasicP.h"
 
+#include <algorithm>
 #include <list>
 #include <vector>
 
@@ -214,6 +228,7 @@
 
 class ShapeData;
 class PrimitiveData;
+struct ida_task;
 
 class SoIntersectionDetectionAction :: PImpl {
 public:
@@ -246,9 +261,21 @@ public:
   static SoCallbackAction::Response pruneCB(void * closure, SoCallbackAction * action, const SoNode * node);
 
   void reset(void);
+  void deleteShapes(void);
+  void removeUnusedShapes(void);
+  void findCandidatePairs(std::vector<std::pair<int, int> > & pairs);
   void doIntersectionTesting(void);
-  void doPrimitiveIntersectionTesting(PrimitiveData * primitives1, PrimitiveData * primitives2, SbBool & cont);
-  void doInternalPrimitiveIntersectionTesting(PrimitiveData * primitives, SbBool & cont);
+  SbBool invokeIntersectionCallbacks(ida_task * task, int tri1, int tri2, SbBool & cont);
+
+  struct NarrowPhaseData {
+    ida_task * tasks;
+    float epsilon;
+    // When set, the intersection callbacks are invoked as soon as a
+    // hit is found, instead of being collected for later invocation.
+    PImpl * invoker;
+    SbBool cont;
+  };
+  static void narrowPhaseJob(void * closure, int jobidx);
 
   SoTypeList * prunetypes;
 
@@ -257,8 +284,16 @@ public:
   typedef std::pair<SoIntersectionVisitationCB *, void *> SoIntersectionVisitationCallback;
   std::vector<SoIntersectionVisitationCallback> traversalcallbacks;
 
+  // The shapes found in the last apply(), in traversal order.
   SbList<ShapeData*> shapedata;
-  SbXfBox3f fullxfbbox;
+  // All shapes kept between applies, sorted on the minimum x value
+  // of their bounding boxes for the sweep-and-prune broad phase.
+  std::vector<ShapeData*> sweeplist;
+  // Lookup of kept shapes from a hash of their paths.
+  SbHash<unsigned int, ShapeData *> shapedict;
+  int applycount;
+  int numnewshapes;
+  int sweepaxis;
 };
 
 float SoIntersectionDetectionAction::PImpl::staticepsilon = 0.0f;
@@ -275,11 +310,14 @@ SoIntersectionDetectionAction::PImpl::PImpl(void)
   this->traverser = NULL;
   this->prunetypes = new SoTypeList;
   this->traversaltypes = new SoTypeList;
+  this->applycount = 0;
+  this->numnewshapes = 0;
+  this->sweepaxis = 0;
 }
 
 SoIntersectionDetectionAction::PImpl::~PImpl(void)
 {
-  this->reset();
+  this->deleteShapes();
   delete this->traverser;
   delete this->prunetypes;
   delete this->traversaltypes;
@@ -671,13 +709,6 @@ SoIntersectionDetectionAction::apply(SoNode * node)
 
   PRIVATE(this)->reset();
 
-  // Needs a bounding box for the full scene, for later initialization
-  // of the SbOctTree of shape bounding boxes.
-  SbViewportRegion vp;
-  SoGetBoundingBoxAction bboxaction(vp);
-  bboxaction.apply(node);
-  PRIVATE(this)->fullxfbbox = bboxaction.getXfBoundingBox();
-
   if (ida_debug()) { // debug
     SoGetPrimitiveCountAction counter;
     counter.apply(node);
@@ -708,14 +739,6 @@ void
 SoIntersectionDetectionAction::apply(SoPath * path)
 {
   PRIVATE(this)->reset();
-
-  // Needs a bounding box for the full scene, for later initialization
-  // of the SbOctTree of shape bounding boxes.
-  SbViewportRegion vp;
-  SoGetBoundingBoxAction bboxaction(vp);
-  bboxaction.apply(path);
-  PRIVATE(this)->fullxfbbox = bboxaction.getXfBoundingBox();
-
   PRIVATE(this)->traverser->apply(path);
   PRIVATE(this)->doIntersectionTesting();
 }
@@ -724,107 +747,262 @@ void
 SoIntersectionDetectionAction::apply(const SoPathList & paths, SbBool obeysRules)
 {
   PRIVATE(this)->reset();
-
-  // Needs a bounding box for the full scene, for later initialization
-  // of the SbOctTree of shape bounding boxes.
-  SbViewportRegion vp;
-  SoGetBoundingBoxAction bboxaction(vp);
-  bboxaction.apply(paths, obeysRules);
-  PRIVATE(this)->fullxfbbox = bboxaction.getXfBoundingBox();
-
   PRIVATE(this)->traverser->apply(paths, obeysRules);
   PRIVATE(this)->doIntersectionTesting();
 }
 
 // *************************************************************************
 
+// Node in the bounding volume hierarchy built over the object space
+// triangles of a shape. For leaf nodes, count is the number of
+// triangles and index is the position of the first of them in
+// PrimitiveData::order. For internal nodes, count is 0, the left
+// child is the next node in the array and index is the position of
+// the right child.
+struct ida_bvhnode {
+  float bmin[3];
+  float bmax[3];
+  int index;
+  int count;
+};
+
+#define IDA_BVH_LEAFSIZE 4
+
+struct ida_center_less {
+  const SbVec3f * centers;
+  int axis;
+  bool operator()(const int a, const int b) const {
+    return this->centers[a][this->axis] < this->centers[b][this->axis];
+  }
+};
+
 class PrimitiveData {
 public:
   PrimitiveData(void)
   {
     this->path = NULL;
-    this->octtree = NULL;
+    this->transformset = FALSE;
   }
 
   ~PrimitiveData()
   {
-    delete this->octtree;
-    for (unsigned int i = 0; i < this->numTriangles(); i++) { delete this->getTriangle(i); }
+    for (size_t i = 0; i < this->triangles.size(); i++) { delete this->triangles[i]; }
   }
 
-
-  const SbOctTree * getOctTree(void) {
-    if (this->octtree == NULL) {
-      const SbOctTreeFuncs funcs = {
-        NULL /* ptinsidefunc */,
-        PrimitiveData::insideboxfunc,
-        NULL /* insidespherefunc */,
-        NULL /* insideplanesfunc */
-      };
-
-      SbBox3f b = this->getBoundingBox();
-      // Add a 1% slack to the bounding box, to avoid problems in
-      // SbOctTree due to floating point inaccuracies (see assert() in
-      // SbOctTree::addItem()).
-      //
-      // This may be just a temporary hack -- see the FIXME at the
-      // same place as mentioned above.
-      SbMatrix m;
-      m.setTransform(SbVec3f(0, 0, 0), // translation
-                     SbRotation::identity(), // rotation
-                     SbVec3f(1.01f, 1.01f, 1.01f), // scalefactor
-                     SbRotation::identity(), // scaleorientation
-                     SbVec3f(b.getCenter())); // center
-      b.transform(m);
-
-      this->octtree = new SbOctTree(b, funcs);
-
-      if (ida_debug()) {
-        SoDebugError::postInfo("PrimitiveData::getOctTree",
-                               "made new octtree for PrimitiveData %p", this);
-      }
-
-      for (unsigned int k = 0; k < this->numTriangles(); k++) {
-        SbTri3f * t = this->getTriangle(k);
-        this->octtree->addItem(t);
-      }
-    }
-    return this->octtree;
-  }
-
-
   void setPath(SoPath * p) { this->path = p; }
   SoPath * getPath(void) const { return this->path; }
 
-  void addTriangle(SbTri3f * t)
+  // Triangles are kept in object space, so that the tree does not
+  // have to be rebuilt when the shape is moved. setTransform() moves
+  // them to world space.
+  void addTriangle(const SbVec3f & a, const SbVec3f & b, const SbVec3f & c)
   {
-    assert(this->octtree == NULL && "all triangles must be added before making octtree");
-    this->triangles.append(t);
-    this->bbox.extendBy(t->getBoundingBox());
+    assert(this->nodes.empty() && "all triangles must be added before building the tree");
+    this->vertices.push_back(a);
+    this->vertices.push_back(b);
+    this->vertices.push_back(c);
   }
 
-  unsigned int numTriangles(void) const { return this->triangles.getLength(); }
-  SbTri3f * getTriangle(const int idx) const { return this->triangles[idx]; }
+  void setTransform(const SbMatrix & m);
+  void buildTree(void);
+  void findTriangles(const SbBox3f & box, std::vector<int> & result) const;
 
-  const SbBox3f & getBoundingBox(void) const { return this->bbox; }
+  unsigned int numTriangles(void) const { return static_cast<unsigned int>(this->vertices.size() / 3); }
+  SbTri3f * getTriangle(const int idx) const { return this->triangles[idx]; }
+  // Empty for triangles which are degenerate in world space.
+  const SbBox3f & getTriangleBox(const int idx) const { return this->triboxes[idx]; }
+  void getObjectTriangle(const int idx, SbVec3f & a, SbVec3f & b, SbVec3f & c) const
+  {
+    a = this->vertices[idx*3];
+    b = this->vertices[idx*3+1];
+    c = this->vertices[idx*3+2];
+  }
 
   SbMatrix transform;
   SbMatrix invtransform;
 
 private:
-  static SbBool insideboxfunc(void * const item, const SbBox3f & box);
+  void buildNode(const int first, const int count, const std::vector<SbVec3f> & centers);
 
   SoPath * path;
-  SbList<SbTri3f*> triangles;
-  SbBox3f bbox;
-  SbOctTree * octtree;
+  std::vector<SbVec3f> vertices;
+  // world space triangles and their bounding boxes
+  std::vector<SbTri3f*> triangles;
+  std::vector<SbBox3f> triboxes;
+  SbBool transformset;
+  std::vector<ida_bvhnode> nodes;
+  std::vector<int> order;
 };
 
-SbBool
-PrimitiveData::insideboxfunc(void * const item, const SbBox3f & box)
+void
+PrimitiveData::setTransform(const SbMatrix & m)
 {
-  SbTri3f * tri = static_cast<SbTri3f *>(item);
-  return box.intersect(tri->getBoundingBox());
+  if (this->transformset && (m == this->transform)) { return; }
+  this->transformset = TRUE;
+  this->transform = m;
+  this->invtransform = m.inverse();
+
+  const int numtris = static_cast<int>(this->numTriangles());
+  if (numtris == 0) { return; }
+
+  std::vector<SbVec3f> world(this->vertices.size());
+  m.multVecMatrix(&this->vertices[0], &world[0], numtris * 3);
+
+  this->triboxes.resize(numtris);
+  for (int i = 0; i < numtris; i++) {
+    const SbVec3f & oa = this->vertices[i*3];
+    const SbVec3f & ob = this->vertices[i*3+1];
+    const SbVec3f & oc = this->vertices[i*3+2];
+    const SbVec3f & wa = world[i*3];
+    const SbVec3f & wb = world[i*3+1];
+    const SbVec3f & wc = world[i*3+2];
+
+    if (i < static_cast<int>(this->triangles.size())) { this->triangles[i]->setValue(wa, wb, wc); }
+    else { this->triangles.push_back(new SbTri3f(wa, wb, wc)); }
+
+    SbBox3f & box = this->triboxes[i];
+    box.makeEmpty();
+    // Only valid triangles are tested, the empty bounding box makes
+    // sure the others are never hit.
+    const SbVec3f normal = (wa - wb).cross(wa - wc);
+    if (normal.length() > 0.0f) {
+      box.extendBy(wa);
+      box.extendBy(wb);
+      box.extendBy(wc);
+    }
+    else {
+      static SbBool warn = TRUE;
+      if (warn) {
+        warn = FALSE;
+        SoDebugError::postWarning("PrimitiveData::setTransform",
+                                  "Found an invalid triangle while souping up "
+                                  "triangle primitives from a shape for "
+                                  "intersection testing. Transformed=="
+                                  "<<%f, %f, %f>, <%f, %f, %f>, <%f, %f, %f>>. "
+                                  "Untransformed=="
+                                  "<<%f, %f, %f>, <%f, %f, %f>, <%f, %f, %f>>. "
+                                  "Will only warn once, there could be more "
+                                  "cases.",
+                                  wa[0], wa[1], wa[2],
+                                  wb[0], wb[1], wb[2],
+                                  wc[0], wc[1], wc[2],
+                                  oa[0], oa[1], oa[2],
+                                  ob[0], ob[1], ob[2],
+                                  oc[0], oc[1], oc[2]);
+      }
+    }
+  }
+}
+
+void
+PrimitiveData::buildTree(void)
+{
+  const int numtris = static_cast<int>(this->numTriangles());
+  if (!this->nodes.empty() || (numtris == 0)) { return; }
+
+  std::vector<SbVec3f> centers(numtris);
+  this->order.resize(numtris);
+  for (int i = 0; i < numtris; i++) {
+    centers[i] = (this->vertices[i*3] + this->vertices[i*3+1] + this->vertices[i*3+2]) / 3.0f;
+    this->order[i] = i;
+  }
+  // a median split tree has less than 2*numtris/LEAFSIZE nodes
+  this->nodes.reserve(2 * (numtris / IDA_BVH_LEAFSIZE + 1));
+  this->buildNode(0, numtris, centers);
+
+  if (ida_debug()) {
+    SoDebugError::postInfo("PrimitiveData::buildTree",
+                           "made tree with %d nodes for PrimitiveData %p",
+                           static_cast<int>(this->nodes.size()), this);
+  }
+}
+
+void
+PrimitiveData::buildNode(const int first, const int count, const std::vector<SbVec3f> & centers)
+{
+  SbBox3f box, centerbox;
+  for (int i = first; i < first + count; i++) {
+    const int t = this->order[i];
+    box.extendBy(this->vertices[t*3]);
+    box.extendBy(this->vertices[t*3+1]);
+    box.extendBy(this->vertices[t*3+2]);
+    centerbox.extendBy(centers[t]);
+  }
+
+  const int nodeidx = static_cast<int>(this->nodes.size());
+  ida_bvhnode node;
+  for (int k = 0; k < 3; k++) {
+    node.bmin[k] = box.getMin()[k];
+    node.bmax[k] = box.getMax()[k];
+  }
+  node.index = first;
+  node.count = count;
+  this->nodes.push_back(node);
+  if (count <= IDA_BVH_LEAFSIZE) { return; }
+
+  // split at the median of the triangle centers, along the axis
+  // where they are spread the most
+  SbVec3f size = centerbox.getMax() - centerbox.getMin();
+  ida_center_less less;
+  less.centers = &centers[0];
+  less.axis = 0;
+  if (size[1] > size[less.axis]) { less.axis = 1; }
+  if (size[2] > size[less.axis]) { less.axis = 2; }
+
+  const int half = count / 2;
+  std::vector<int>::iterator start = this->order.begin() + first;
+  std::nth_element(start, start + half, start + count, less);
+
+  this->buildNode(first, half, centers);
+  this->nodes[nodeidx].index = static_cast<int>(this->nodes.size());
+  this->nodes[nodeidx].count = 0;
+  this->buildNode(first + half, count - half, centers);
+}
+
+// Finds the triangles with world space bounding boxes intersecting
+// box. The indices are returned in ascending order.
+void
+PrimitiveData::findTriangles(const SbBox3f & box, std::vector<int> & result) const
+{
+  result.clear();
+  if (this->nodes.empty() || box.isEmpty()) { return; }
+
+  // The tree is searched with the box moved to object space, padded
+  // to make up for rounding errors in the transformation. The world
+  // space test on each triangle is exact.
+  SbBox3f objbox(box);
+  objbox.transform(this->invtransform);
+  SbVec3f pad = objbox.getMax() - objbox.getMin();
+  for (int k = 0; k < 3; k++) {
+    pad[k] = pad[k] * 1e-4f +
+      SbMax(SbAbs(objbox.getMin()[k]), SbAbs(objbox.getMax()[k])) * 1e-5f;
+  }
+  const SbVec3f qmin = objbox.getMin() - pad;
+  const SbVec3f qmax = objbox.getMax() + pad;
+
+  // the depth of a median split tree is log2 of the number of nodes
+  int stack[64];
+  int stacksize = 0;
+  stack[stacksize++] = 0;
+  while (stacksize > 0) {
+    const int nodeidx = stack[--stacksize];
+    const ida_bvhnode & node = this->nodes[nodeidx];
+    if (qmin[0] > node.bmax[0] || qmax[0] < node.bmin[0] ||
+        qmin[1] > node.bmax[1] || qmax[1] < node.bmin[1] ||
+        qmin[2] > node.bmax[2] || qmax[2] < node.bmin[2]) { continue; }
+
+    if (node.count > 0) {
+      for (int i = node.index; i < node.index + node.count; i++) {
+        const int t = this->order[i];
+        if (this->triboxes[t].intersect(box)) { result.push_back(t); }
+      }
+    }
+    else {
+      stack[stacksize++] = node.index;
+      stack[stacksize++] = nodeidx + 1;
+    }
+  }
+  std::sort(result.begin(), result.end());
 }
 
 // *************************************************************************
@@ -833,28 +1011,100 @@ class ShapeData {
 public:
   ShapeData(void)
   {
+    this->path = NULL;
+    this->index = -1;
+    this->applycount = 0;
+    this->hash = 0;
+    this->next = NULL;
+    this->nodeid = 0;
     this->primitives = NULL;
+    this->cache = NULL;
+    this->storedinvalid = FALSE;
   }
 
   ~ShapeData()
   {
-    delete this->primitives;
+    this->invalidate();
+    if (this->path) { this->path->unref(); }
   }
 
   PrimitiveData * getPrimitives(void);
 
+  // The primitives are kept as long as the shape node and the
+  // elements used while generating them are unchanged.
+  SbBool isValid(SoState * state, const SbUniqueId id) const
+  {
+    if (this->primitives == NULL) { return TRUE; }
+    return (id == this->nodeid) && this->cache->isValid(state);
+  }
+
+  void invalidate(void)
+  {
+    delete this->primitives;
+    this->primitives = NULL;
+    if (this->cache) { this->cache->unref(); }
+    this->cache = NULL;
+  }
+
   SoPath * path;
   SbXfBox3f xfbbox;
+  // The projected bounding box, extended with the epsilon value.
+  SbBox3f sweepbox;
+  // The position in PImpl::shapedata, and the apply() the shape was
+  // last found in.
+  int index;
+  int applycount;
+  // For the PImpl::shapedict hash chain.
+  unsigned int hash;
+  ShapeData * next;
+  SbUniqueId nodeid;
 
 private:
+  static SoCallbackAction::Response preShapeCB(void * closure, SoCallbackAction * action, const SoNode * node);
+  static SoCallbackAction::Response postShapeCB(void * closure, SoCallbackAction * action, const SoNode * node);
   static void triangleCB(void * closure, SoCallbackAction *,
                          const SoPrimitiveVertex * v1,
                          const SoPrimitiveVertex * v2,
                          const SoPrimitiveVertex * v3);
 
   PrimitiveData * primitives;
+  SoCache * cache;
+  SbBool storedinvalid;
 };
 
+// Opens a cache before the shape generates its primitives, to record
+// which elements they depend on.
+SoCallbackAction::Response
+ShapeData::preShapeCB(void * closure, SoCallbackAction * action, const SoNode * node)
+{
+  ShapeData * thisp = static_cast<ShapeData *>(closure);
+  if (node != reclassify_cast<SoFullPath *>(thisp->path)->getTail()) {
+    return SoCallbackAction::CONTINUE;
+  }
+  assert(thisp->cache == NULL);
+
+  SoState * state = action->getState();
+  // must push state to make cache dependencies work
+  state->push();
+  thisp->storedinvalid = SoCacheElement::setInvalid(FALSE);
+  thisp->cache = new SoCache(state);
+  thisp->cache->ref();
+  SoCacheElement::set(state, thisp->cache);
+  return SoCallbackAction::CONTINUE;
+}
+
+SoCallbackAction::Response
+ShapeData::postShapeCB(void * closure, SoCallbackAction * action, const SoNode * node)
+{
+  ShapeData * thisp = static_cast<ShapeData *>(closure);
+  if (node != reclassify_cast<SoFullPath *>(thisp->path)->getTail()) {
+    return SoCallbackAction::CONTINUE;
+  }
+  action->getState()->pop();
+  SoCacheElement::setInvalid(thisp->storedinvalid);
+  return SoCallbackAction::CONTINUE;
+}
+
 void
 ShapeData::triangleCB(void * closure, SoCallbackAction *,
                       const SoPrimitiveVertex * v1,
@@ -862,65 +1112,114 @@ ShapeData::triangleCB(void * closure, SoCallbackAction *,
                       const SoPrimitiveVertex * v3)
 {
   PrimitiveData * primitives = static_cast<PrimitiveData *>(closure);
-  const SbVec3f & oa = v1->getPoint();
-  const SbVec3f & ob = v2->getPoint();
-  const SbVec3f & oc = v3->getPoint();
-  SbVec3f wa, wb, wc;
-  primitives->transform.multVecMatrix(oa, wa);
-  primitives->transform.multVecMatrix(ob, wb);
-  primitives->transform.multVecMatrix(oc, wc);
-
-  // Only add valid triangles.
-  const SbVec3f normal = (wa - wb).cross(wa - wc);
-  if (normal.length() > 0.0f) {
-    SbTri3f * triangle = new SbTri3f(wa, wb, wc);
-    primitives->addTriangle(triangle);
-  }
-  else {
-    static SbBool warn = TRUE;
-    if (warn) {
-      warn = FALSE;
-      SoDebugError::postWarning("ShapeData::triangleCB",
-                                "Found an invalid triangle while souping up "
-                                "triangle primitives from a shape for "
-                                "intersection testing. Transformed=="
-                                "<<%f, %f, %f>, <%f, %f, %f>, <%f, %f, %f>>. "
-                                "Untransformed=="
-                                "<<%f, %f, %f>, <%f, %f, %f>, <%f, %f, %f>>. "
-                                "Will only warn once, there could be more "
-                                "cases.",
-                                wa[0], wa[1], wa[2],
-                                wb[0], wb[1], wb[2],
-                                wc[0], wc[1], wc[2],
-                                oa[0], oa[1], oa[2],
-                                ob[0], ob[1], ob[2],
-                                oc[0], oc[1], oc[2]);
-    }
-  }
+  primitives->addTriangle(v1->getPoint(), v2->getPoint(), v3->getPoint());
 }
 
+// Generates the primitives if needed, and makes sure they are in
+// world space. This traverses the scene graph, so it must only be
+// called from the thread applying the action.
 PrimitiveData *
 ShapeData::getPrimitives(void)
 {
-  if (this->primitives) { return this->primitives; }
-
-  this->primitives = new PrimitiveData;
-  this->primitives->setPath(this->path);
-  this->primitives->transform = this->xfbbox.getTransform();
-  this->primitives->invtransform = primitives->transform.inverse();
-  SoCallbackAction generator;
-  generator.addTriangleCallback(SoShape::getClassTypeId(),
-                                ShapeData::triangleCB,
-                                this->primitives);
-  generator.apply(this->path);
+  if (this->primitives == NULL) {
+    this->primitives = new PrimitiveData;
+    this->primitives->setPath(this->path);
+    SoCallbackAction generator;
+    generator.addPreCallback(SoShape::getClassTypeId(),
+                             ShapeData::preShapeCB, this);
+    generator.addPostCallback(SoShape::getClassTypeId(),
+                              ShapeData::postShapeCB, this);
+    generator.addTriangleCallback(SoShape::getClassTypeId(),
+                                  ShapeData::triangleCB,
+                                  this->primitives);
+    generator.apply(this->path);
+    if (this->cache == NULL) {
+      // the shape was never reached, make sure this is tried again
+      // the next time
+      this->cache = new SoCache(generator.getState());
+      this->cache->ref();
+      this->cache->invalidate();
+    }
+    this->primitives->buildTree();
+  }
+  this->primitives->setTransform(this->xfbbox.getTransform());
   return this->primitives;
 }
 
 // *************************************************************************
 
+// Hash value for the head, the child indices and the tail of a path.
+static unsigned int
+ida_path_hash(const SoFullPath * path)
+{
+  unsigned int h = SbHashFunc(static_cast<const SoBase *>(path->getHead()));
+  const int len = path->getLength();
+  for (int i = 1; i < len; i++) {
+    h = h * 31 + static_cast<unsigned int>(path->getIndex(i));
+  }
+  h = h * 31 + SbHashFunc(static_cast<const SoBase *>(path->getTail()));
+  // finalizer from MurmurHash3, SbHash uses the key as is
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+// Compares every node and index of two paths. SoPath::operator==()
+// only compares the head and the indices, which is not enough after
+// an intermediate node has been replaced.
+static SbBool
+ida_path_equal(const SoFullPath * path1, const SoFullPath * path2)
+{
+  const int len = path1->getLength();
+  if (len != path2->getLength()) return FALSE;
+  for (int i = len - 1; i >= 0; i--) {
+    if (path1->getNode(i) != path2->getNode(i)) return FALSE;
+    if (i > 0 && path1->getIndex(i) != path2->getIndex(i)) return FALSE;
+  }
+  return TRUE;
+}
+
 SoCallbackAction::Response
 SoIntersectionDetectionAction::PImpl::shape(SoCallbackAction * action, SoShape * shape)
 {
+  const SoFullPath * curpath = reclassify_cast<const SoFullPath *>(action->getCurPath());
+  const unsigned int hash = ida_path_hash(curpath);
+
+  ShapeData * data = NULL;
+  if (this->shapedict.get(hash, data)) {
+    while (data && !ida_path_equal(reclassify_cast<SoFullPath *>(data->path), curpath)) {
+      data = data->next;
+    }
+  }
+
+  if (data == NULL) {
+    data = new ShapeData;
+    data->path = new SoPath(*curpath);
+    data->path->ref();
+    data->hash = hash;
+    ShapeData * first = NULL;
+    (void)this->shapedict.get(hash, first);
+    data->next = first;
+    (void)this->shapedict.put(hash, data);
+    this->sweeplist.push_back(data);
+    this->numnewshapes++;
+  }
+  // the same path can be found more than once when applying on a
+  // path list, the shape is only tested once
+  else if (data->applycount == this->applycount) {
+    return SoCallbackAction::CONTINUE;
+  }
+  else if (!data->isValid(action->getState(), shape->getNodeId())) {
+    data->invalidate();
+  }
+  data->applycount = this->applycount;
+  data->nodeid = shape->getNodeId();
+  data->index = this->shapedata.getLength();
+  this->shapedata.append(data);
+
   SbBox3f bbox;
   SbVec3f center;
 
@@ -933,12 +1232,8 @@ SoIntersectionDetectionAction::PImpl::shape(SoCallbackAction * action, SoShape *
   else {
     shape->computeBBox(action, bbox, center);
   }
-  ShapeData * data = new ShapeData;
-  data->path = new SoPath(*(action->getCurPath()));
-  data->path->ref();
   data->xfbbox = bbox;
   data->xfbbox.setTransform(action->getModelMatrix());
-  this->shapedata.append(data);
   return SoCallbackAction::CONTINUE;
 }
 
@@ -1009,12 +1304,11 @@ void
 SoIntersectionDetectionAction::PImpl::reset(void)
 {
   int i;
-  for (i = 0; i < this->shapedata.getLength(); i++) {
-    ShapeData * data = this->shapedata[i];
-    data->path->unref();
-    delete data;
-  }
+  // The shape data is kept, unused shapes are removed by
+  // removeUnusedShapes() after the traversal.
   this->shapedata.truncate(0);
+  this->applycount++;
+  this->numnewshapes = 0;
   delete this->traverser;
   this->traverser = new SoCallbackAction;
 #ifdef HAVE_DRAGGERS
@@ -1030,6 +1324,41 @@ SoIntersectionDetectionAction::PImpl::reset(void)
                                   shapeCB, this);
 }
 
+void
+SoIntersectionDetectionAction::PImpl::deleteShapes(void)
+{
+  for (size_t i = 0; i < this->sweeplist.size(); i++) {
+    delete this->sweeplist[i];
+  }
+  this->sweeplist.clear();
+  this->shapedict.clear();
+  this->shapedata.truncate(0);
+}
+
+// Deletes the data for shapes which were not found in the last
+// traversal.
+void
+SoIntersectionDetectionAction::PImpl::removeUnusedShapes(void)
+{
+  size_t numkept = 0;
+  for (size_t i = 0; i < this->sweeplist.size(); i++) {
+    ShapeData * data = this->sweeplist[i];
+    if (data->applycount == this->applycount) { this->sweeplist[numkept++] = data; }
+    else { delete data; }
+  }
+  if (numkept == this->sweeplist.size()) { return; }
+
+  this->sweeplist.resize(numkept);
+  this->shapedict.clear();
+  for (size_t i = 0; i < numkept; i++) {
+    ShapeData * data = this->sweeplist[i];
+    ShapeData * first = NULL;
+    (void)this->shapedict.get(data->hash, first);
+    data->next = first;
+    (void)this->shapedict.put(data->hash, data);
+  }
+}
+
 #if 0 //Do not compile debug functions normally
 
 // This is a helper function for debugging purposes: it sets up an
@@ -1154,19 +1483,260 @@ expand_SbXfBox3f(const SbXfBox3f & box, float epsilon)
   return extbox;
 }
 
-// The callback test function for the SbOctTree.
-static SbBool
-shapeinsideboxfunc(void * const item, const SbBox3f & box)
+struct ida_sweep_less {
+  int axis;
+  bool operator()(const ShapeData * a, const ShapeData * b) const {
+    return a->sweepbox.getMin()[this->axis] < b->sweepbox.getMin()[this->axis];
+  }
+};
+
+// Finds the pairs of shapes with intersecting bounding boxes, as
+// pairs of indices into the shapedata list, the lower index first. The
+// pairs are sorted.
+//
+// The shapes are kept sorted on the lower end of their bounding boxes
+// along one axis between applies. As shapes in a scene that is tested
+// repeatedly rarely move much, an insertion sort will usually only
+// need to make a few swaps.
+void
+SoIntersectionDetectionAction::PImpl::findCandidatePairs(std::vector<std::pair<int, int> > & pairs)
+{
+  const float theepsilon = this->getEpsilon();
+  const SbVec3f e(theepsilon, theepsilon, theepsilon);
+
+  // sweep along the axis where the shapes are spread out the most
+  SbVec3f sum(0.0f, 0.0f, 0.0f), sumsqr(0.0f, 0.0f, 0.0f);
+  int numboxes = 0;
+  for (int i = 0; i < this->shapedata.getLength(); i++) {
+    ShapeData * shape = this->shapedata[i];
+    shape->sweepbox.makeEmpty();
+    if (shape->xfbbox.isEmpty()) { continue; }
+    shape->sweepbox = shape->xfbbox.project();
+    if (theepsilon > 0.0f) {
+      shape->sweepbox.getMin() -= e;
+      shape->sweepbox.getMax() += e;
+    }
+    const SbVec3f center = shape->sweepbox.getCenter();
+    for (int k = 0; k < 3; k++) {
+      sum[k] += center[k];
+      sumsqr[k] += center[k] * center[k];
+    }
+    numboxes++;
+  }
+  int axis = this->sweepaxis;
+  if (numboxes > 0) {
+    float maxvariance = -1.0f;
+    for (int k = 0; k < 3; k++) {
+      const float mean = sum[k] / numboxes;
+      const float variance = sumsqr[k] / numboxes - mean * mean;
+      if (variance > maxvariance) {
+        maxvariance = variance;
+        axis = k;
+      }
+    }
+  }
+
+  ida_sweep_less less;
+  less.axis = axis;
+  const int numshapes = static_cast<int>(this->sweeplist.size());
+  if ((axis != this->sweepaxis) || (this->numnewshapes > numshapes / 8)) {
+    std::sort(this->sweeplist.begin(), this->sweeplist.end(), less);
+  }
+  else {
+    for (int i = 1; i < numshapes; i++) {
+      ShapeData * shape = this->sweeplist[i];
+      int j = i;
+      while ((j > 0) && less(shape, this->sweeplist[j-1])) {
+        this->sweeplist[j] = this->sweeplist[j-1];
+        j--;
+      }
+      this->sweeplist[j] = shape;
+    }
+  }
+  this->sweepaxis = axis;
+  const int axis1 = (axis + 1) % 3;
+  const int axis2 = (axis + 2) % 3;
+
+  for (int i = 0; i < numshapes; i++) {
+    ShapeData * shape1 = this->sweeplist[i];
+    const SbBox3f & box1 = shape1->sweepbox;
+    // empty boxes are sorted last
+    if (box1.isEmpty()) { break; }
+
+    for (int j = i + 1; j < numshapes; j++) {
+      ShapeData * shape2 = this->sweeplist[j];
+      const SbBox3f & box2 = shape2->sweepbox;
+      if (box2.getMin()[axis] > box1.getMax()[axis]) { break; }
+      if ((box2.getMin()[axis1] > box1.getMax()[axis1]) ||
+          (box2.getMax()[axis1] < box1.getMin()[axis1]) ||
+          (box2.getMin()[axis2] > box1.getMax()[axis2]) ||
+          (box2.getMax()[axis2] < box1.getMin()[axis2])) { continue; }
+
+      // The sweep boxes of both shapes are extended with the epsilon
+      // value. Do the actual test with only the first one extended,
+      // and then the more accurate test on the non-projected boxes.
+      ShapeData * first = shape1;
+      ShapeData * second = shape2;
+      if (first->index > second->index) { std::swap(first, second); }
+
+      if (!second->xfbbox.intersect(first->sweepbox)) { continue; }
+
+      SbXfBox3f xfboxchk;
+      if (theepsilon > 0.0f) { xfboxchk = expand_SbXfBox3f(first->xfbbox, theepsilon); }
+      else { xfboxchk = first->xfbbox; }
+
+      if (!xfboxchk.intersect(second->xfbbox)) {
+        if (ida_debug()) {
+          SoDebugError::postInfo("SoIntersectionDetectionAction::PImpl::findCandidatePairs",
+                                 "shape %d intersecting %d is a miss when tried with SbXfBox3f::intersect(SbXfBox3f)",
+                                 first->index, second->index);
+        }
+        continue;
+      }
+      pairs.push_back(std::pair<int, int>(first->index, second->index));
+    }
+  }
+  std::sort(pairs.begin(), pairs.end());
+}
+
+// *************************************************************************
+
+// A pair of shapes, or a single shape to be tested for
+// self-intersections, to be tested on the primitive level.
+struct ida_task {
+  ShapeData * shape1;
+  ShapeData * shape2;
+  // The triangles of iterationprims are looked up in the tree of
+  // treeprims, which is the larger of the two shapes.
+  PrimitiveData * iterationprims;
+  PrimitiveData * treeprims;
+  // Intersecting triangles, as pairs of indices into iterationprims
+  // and treeprims.
+  std::vector<int> hits;
+  unsigned int nrisectchks;
+};
+
+void
+SoIntersectionDetectionAction::PImpl::narrowPhaseJob(void * closure, int jobidx)
 {
-  ShapeData * shape = static_cast<ShapeData *>(item);
-  return shape->xfbbox.intersect(box);
+  NarrowPhaseData * data = static_cast<NarrowPhaseData *>(closure);
+  ida_task * task = &data->tasks[jobidx];
+  PrimitiveData * iterationprims = task->iterationprims;
+  PrimitiveData * treeprims = task->treeprims;
+
+  // Self-intersection testing can ignore the epsilon setting, as that
+  // only indicates a distance between distinct shapes. Triangles are
+  // not tested against themselves.
+  const SbBool self = (iterationprims == treeprims);
+  const float theepsilon = self ? 0.0f : data->epsilon;
+  const SbVec3f e(theepsilon, theepsilon, theepsilon);
+
+  task->hits.clear();
+  task->nrisectchks = 0;
+
+  std::vector<int> candidatetris;
+  const int numtris = static_cast<int>(iterationprims->numTriangles());
+  for (int i = 0; i < numtris; i++) {
+    SbBox3f tribbox = iterationprims->getTriangleBox(i);
+    if (tribbox.isEmpty()) { continue; }
+    if (theepsilon > 0.0f) {
+      // Extend bbox in all 6 directions with the epsilon value.
+      tribbox.getMin() -= e;
+      tribbox.getMax() += e;
+    }
+    else if (self) {
+      // SbTri3f::intersect() reports neighbouring triangles which only
+      // share vertices that differ by a rounding error as
+      // intersecting, and all triangles of a shape used to be tested
+      // against each other. Make sure such neighbours are found.
+      SbVec3f pad = tribbox.getMax() - tribbox.getMin();
+      for (int k = 0; k < 3; k++) {
+        pad[k] = pad[k] * 1e-3f +
+          SbMax(SbAbs(tribbox.getMin()[k]), SbAbs(tribbox.getMax()[k])) * 1e-5f;
+      }
+      tribbox.getMin() -= pad;
+      tribbox.getMax() += pad;
+    }
+    treeprims->findTriangles(tribbox, candidatetris);
+
+    const SbTri3f * t1 = iterationprims->getTriangle(i);
+    for (size_t j = 0; j < candidatetris.size(); j++) {
+      const int idx = candidatetris[j];
+      if (self && (idx <= i)) { continue; }
+      task->nrisectchks++;
+      if (t1->intersect(*treeprims->getTriangle(idx), theepsilon)) {
+        if (data->invoker) {
+          SbBool cont;
+          if (!data->invoker->invokeIntersectionCallbacks(task, i, idx, cont)) {
+            data->cont = cont;
+            return;
+          }
+        }
+        else {
+          task->hits.push_back(i);
+          task->hits.push_back(idx);
+        }
+      }
+    }
+  }
+}
+
+// Invokes the intersection callbacks for a pair of intersecting
+// triangles. Returns FALSE if no more triangles should be tested for
+// the shapes of the task, and sets cont to FALSE if the intersection
+// testing should be aborted.
+SbBool
+SoIntersectionDetectionAction::PImpl::invokeIntersectionCallbacks(ida_task * task, int tri1, int tri2, SbBool & cont)
+{
+  cont = TRUE;
+
+  SoIntersectingPrimitive p1;
+  p1.path = task->iterationprims->getPath();
+  p1.type = SoIntersectingPrimitive::TRIANGLE;
+  task->iterationprims->getTriangle(tri1)->getValue(p1.xf_vertex[0], p1.xf_vertex[1], p1.xf_vertex[2]);
+  task->iterationprims->getObjectTriangle(tri1, p1.vertex[0], p1.vertex[1], p1.vertex[2]);
+
+  SoIntersectingPrimitive p2;
+  p2.path = task->treeprims->getPath();
+  p2.type = SoIntersectingPrimitive::TRIANGLE;
+  task->treeprims->getTriangle(tri2)->getValue(p2.xf_vertex[0], p2.xf_vertex[1], p2.xf_vertex[2]);
+  task->treeprims->getObjectTriangle(tri2, p2.vertex[0], p2.vertex[1], p2.vertex[2]);
+
+  std::vector<SoIntersectionCallback>::iterator it = this->callbacks.begin();
+  while (it != this->callbacks.end()) {
+    switch ( (*it).first((*it).second, &p1, &p2) ) {
+    case SoIntersectionDetectionAction::NEXT_PRIMITIVE:
+      // Break out of the switch, invoke next callback.
+      break;
+    case SoIntersectionDetectionAction::NEXT_SHAPE:
+      // FIXME: remaining callbacks won't be invoked -- should they? 20030328 mortene.
+      return FALSE;
+    case SoIntersectionDetectionAction::ABORT:
+      // FIXME: remaining callbacks won't be invoked -- should they? 20030328 mortene.
+      cont = FALSE;
+      return FALSE;
+    default:
+      assert(0);
+    }
+    ++it;
+  }
+  return TRUE;
 }
 
 // Execute full set of intersection detection operations on all the
 // primitives that have been souped up from the scene graph.
+//
+// The shape pairs are tested in batches. The filter callback is
+// invoked and the primitives are generated for a batch on this
+// thread, before the triangles are tested on all threads. The
+// intersection callbacks are then invoked on this thread. Without
+// multithreading, each batch holds a single task and the intersection
+// callbacks are invoked as soon as a hit is found.
 void
 SoIntersectionDetectionAction::PImpl::doIntersectionTesting(void)
 {
+  this->removeUnusedShapes();
+
   if (this->callbacks.empty()) {
     SoDebugError::postWarning("SoIntersectionDetectionAction::PImpl::doIntersectionTesting",
                               "intersection testing invoked, but no callbacks set up");
@@ -1183,318 +1753,225 @@ SoIntersectionDetectionAction::PImpl::doIntersectionTesting(void)
 
   }
 
-  const SbOctTreeFuncs funcs = {
-    NULL /* ptinsidefunc */,
-    shapeinsideboxfunc,
-    NULL /* insidespherefunc */,
-    NULL /* insideplanesfunc */
-  };
+  std::vector<std::pair<int, int> > pairs;
+  this->findCandidatePairs(pairs);
 
-  SbBox3f b = this->fullxfbbox.project();
-  // Add a 1% slack to the bounding box, to avoid problems in
-  // SbOctTree due to floating point inaccuracies (see assert() in
-  // SbOctTree::addItem()).
-  //
-  // This may be just a temporary hack -- see the FIXME at the
-  // same place.
-  SbMatrix m;
-  m.setTransform(SbVec3f(0, 0, 0), // translation
-                 SbRotation::identity(), // rotation
-                 SbVec3f(1.01f, 1.01f, 1.01f), // scalefactor
-                 SbRotation::identity(), // scaleorientation
-                 SbVec3f(b.getCenter())); // center
-  b.transform(m);
-
-  SbOctTree shapetree(b, funcs);
-  for (int k = 0; k < this->shapedata.getLength(); k++) {
-    ShapeData * shape = this->shapedata[k];
-    if (shape->xfbbox.isEmpty()) { continue; }
-    shapetree.addItem(shape);
+  // Each shape is tested against itself first, if enabled, and then
+  // against the shapes after it in traversal order. A pair with equal
+  // indices is a self-intersection test.
+  std::vector<std::pair<int, int> > tests;
+  tests.reserve(pairs.size());
+  size_t pairidx = 0;
+  for (int i = 0; i < this->shapedata.getLength(); i++) {
+    if (this->internalsenabled && !this->shapedata[i]->xfbbox.isEmpty()) {
+      tests.push_back(std::pair<int, int>(i, i));
+    }
+    while ((pairidx < pairs.size()) && (pairs[pairidx].first == i)) {
+      tests.push_back(pairs[pairidx++]);
+    }
   }
 
-  if (ida_debug()) { shapetree.debugTree(stderr); }
-
   // For debugging.
   unsigned int nrshapeshapeisects = 0;
   unsigned int nrselfisects = 0;
+  unsigned int nrisectchks = 0;
 
-  const float theepsilon = this->getEpsilon();
-
-  for (int i = 0; i < this->shapedata.getLength(); i++) {
-    ShapeData * shape1 = this->shapedata[i];
-
-    // If the shape has no geometry, immediately skip to next
-    // iteration of for-loop.
-    if (shape1->xfbbox.isEmpty()) { continue; }
-
-    // Remove shapes from octtree as we iterate over the full set, to
-    // avoid self-intersection and to avoid checks against other
-    // shapes happening both ways.
-    shapetree.removeItem(shape1);
-
-    // FIXME: shouldn't we also invoke the filter-callback here? 20030403 mortene.
-    if (this->internalsenabled) {
-      nrselfisects++;
-      SbBool cont;
-      this->doInternalPrimitiveIntersectionTesting(shape1->getPrimitives(), cont);
-      if (!cont) { goto done; }
-    }
+  const int numthreads = cc_parallel_get_num_threads();
+  const size_t batchsize = (numthreads > 1) ? size_t(numthreads) * 4 : 1;
+
+  std::vector<ida_task> batch;
+  NarrowPhaseData data;
+  data.epsilon = this->getEpsilon();
+  data.invoker = (batchsize == 1) ? this : NULL;
+  data.cont = TRUE;
+
+  size_t testidx = 0;
+  while (data.cont && (testidx < tests.size())) {
+    batch.clear();
+    while ((batch.size() < batchsize) && (testidx < tests.size())) {
+      ShapeData * shape1 = this->shapedata[tests[testidx].first];
+      ShapeData * shape2 = this->shapedata[tests[testidx].second];
+      testidx++;
+
+      // FIXME: shouldn't we also invoke the filter-callback for
+      // self-intersections? 20030403 mortene.
+      if (shape1 == shape2) { nrselfisects++; }
+      else if (!this->filtercb ||
+               this->filtercb(this->filterclosure, shape1->path, shape2->path)) {
+        nrshapeshapeisects++;
+      }
+      else { continue; }
 
-    SbBox3f shapebbox = shape1->xfbbox.project();
-    if (theepsilon > 0.0f) {
-      const SbVec3f e(theepsilon, theepsilon, theepsilon);
-      // Extend bbox in all 6 directions with the epsilon value.
-      shapebbox.getMin() -= e;
-      shapebbox.getMax() += e;
+      ida_task task = ida_task();
+      task.shape1 = shape1;
+      task.shape2 = shape2;
+      batch.push_back(task);
     }
-    SbList<void*> candidateshapes;
-    shapetree.findItems(shapebbox, candidateshapes);
-
-    if (ida_debug()) {
-      SoDebugError::postInfo("SoIntersectionDetectionAction::PImpl::doIntersectionTesting",
-                             "shape %d intersects %d other shapes",
-                             i, candidateshapes.getLength());
-
-      // debug, dump to .iv-file the "master" shape bbox given by i,
-      // plus ditto for all intersected shapes
-#if 0
-      if (i == 4) {
-        SoSeparator * root = new SoSeparator;
-        root->ref();
-
-        root->addChild(make_scene_graph(shape1->xfbbox, "mastershape"));
-
-        for (int j = 0; j < candidateshapes.getLength(); j++) {
-          ShapeData * s = (ShapeData * )candidateshapes[j];
-          SbString str;
-          str.sprintf("%d", j);
-          root->addChild(make_scene_graph(s->xfbbox, str.getString()));
-        }
 
-        SoOutput out;
-        SbBool ok = out.openFile("/tmp/shapechk.iv");
-        assert(ok);
-        SoWriteAction wa(&out);
-        wa.apply(root);
+    for (size_t i = 0; i < batch.size(); i++) {
+      ida_task & task = batch[i];
+      PrimitiveData * primitives1 = task.shape1->getPrimitives();
+      PrimitiveData * primitives2 = task.shape2->getPrimitives();
 
-        root->unref();
+      // Use the majority size shape for the tree.
+      //
+      // (Some initial investigation indicates that this isn't a clear-cut
+      // choice, by the way -- should investigate further. mortene.)
+      task.treeprims = primitives1;
+      task.iterationprims = primitives2;
+      if (primitives1->numTriangles() < primitives2->numTriangles()) {
+        task.treeprims = primitives2;
+        task.iterationprims = primitives1;
       }
-#endif // debug
     }
+    if (batch.empty()) { continue; }
 
-    SbXfBox3f xfboxchk;
-    if (theepsilon > 0.0f) { xfboxchk = expand_SbXfBox3f(shape1->xfbbox, theepsilon); }
-    else { xfboxchk = shape1->xfbbox; }
-
-    for (int j = 0; j < candidateshapes.getLength(); j++) {
-      ShapeData * shape2 = static_cast<ShapeData *>(candidateshapes[j]);
+    data.tasks = &batch[0];
+    cc_parallel_run(static_cast<int>(batch.size()), PImpl::narrowPhaseJob, &data);
 
-      if (!xfboxchk.intersect(shape2->xfbbox)) {
-        if (ida_debug()) {
-          SoDebugError::postInfo("SoIntersectionDetectionAction::PImpl::doIntersectionTesting",
-                                 "shape %d intersecting %d is a miss when tried with SbXfBox3f::intersect(SbXfBox3f)",
-                                 i, j);
-        }
-        continue;
-      }
-
-      if (!this->filtercb ||
-          this->filtercb(this->filterclosure, shape1->path, shape2->path)) {
-        nrshapeshapeisects++;
-        SbBool cont;
-        this->doPrimitiveIntersectionTesting(shape1->getPrimitives(), shape2->getPrimitives(), cont);
-        if (!cont) { goto done; }
+    for (size_t i = 0; i < batch.size(); i++) {
+      const ida_task & task = batch[i];
+      nrisectchks += task.nrisectchks;
+      for (size_t j = 0; data.cont && (j < task.hits.size()); j += 2) {
+        if (!this->invokeIntersectionCallbacks(&batch[i], task.hits[j], task.hits[j+1], data.cont)) { break; }
       }
+      if (!data.cont) { break; }
     }
   }
 
- done:
   if (ida_debug()) {
     SoDebugError::postInfo("SoIntersectionDetectionAction::PImpl::doIntersectionTesting",
-                           "shape-shape intersections: %d, shape self-intersections: %d",
-                           nrshapeshapeisects, nrselfisects);
+                           "shape-shape intersections: %d, shape self-intersections: %d, "
+                           "triangle intersection checks: %d",
+                           nrshapeshapeisects, nrselfisects, nrisectchks);
   }
 }
 
-// Intersection testing between primitives of different shapes.
-void
-SoIntersectionDetectionAction::PImpl::doPrimitiveIntersectionTesting(PrimitiveData * primitives1,
-                                                             PrimitiveData * primitives2,
-                                                             SbBool & cont)
-{
-  cont = TRUE;
-
-  // for debugging
-  if (ida_debug()) {
-    SoDebugError::postInfo("SoIntersectionDetectionAction::PImpl::doPrimitiveIntersectionTesting",
-                           "primitives1 (%p) = %d tris, primitives2 (%p) = %d tris",
-                           primitives1, primitives1->numTriangles(),
-                           primitives2, primitives2->numTriangles());
-  }
-  unsigned int nrisectchks = 0;
-  unsigned int nrhits = 0;
-
-  // Use the majority size shape from an octtree.
-  //
-  // (Some initial investigation indicates that this isn't a clear-cut
-  // choice, by the way -- should investigate further. mortene.)
-  PrimitiveData * octtreeprims = primitives1;
-  PrimitiveData * iterationprims = primitives2;
-  if (primitives1->numTriangles() < primitives2->numTriangles()) {
-    octtreeprims = primitives2;
-    iterationprims = primitives1;
-  }
+#undef PRIVATE
 
-  const SbOctTree * octtree = octtreeprims->getOctTree();
+#ifdef COIN_TEST_SUITE
 
-  const float theepsilon = this->getEpsilon();
-  const SbVec3f e(theepsilon, theepsilon, theepsilon);
+#include <Inventor/nodes/SoCoordinate3.h>
+#include <Inventor/nodes/SoCube.h>
+#include <Inventor/nodes/SoFaceSet.h>
+#include <Inventor/nodes/SoGroup.h>
+#include <Inventor/nodes/SoSeparator.h>
+#include <Inventor/nodes/SoTranslation.h>
 
-  for (unsigned int i = 0; i < iterationprims->numTriangles(); i++) {
-    SbTri3f * t1 = static_cast<SbTri3f *>(iterationprims->getTriangle(i));
+static SoIntersectionDetectionAction::Resp
+intersectionCB(void * closure,
+               const SoIntersectingPrimitive *,
+               const SoIntersectingPrimitive *)
+{
+  int * count = static_cast<int *>(closure);
+  (*count)++;
+  return SoIntersectionDetectionAction::NEXT_PRIMITIVE;
+}
 
-    SbBox3f tribbox = t1->getBoundingBox();
-    if (theepsilon > 0.0f) {
-      // Extend bbox in all 6 directions with the epsilon value.
-      tribbox.getMin() -= e;
-      tribbox.getMax() += e;
-    }
+BOOST_AUTO_TEST_CASE(repeatedApply)
+{
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  SoCube * cube1 = new SoCube;
+  root->addChild(cube1);
+  SoTranslation * translation = new SoTranslation;
+  translation->translation.setValue(1.5f, 0.5f, 0.5f);
+  root->addChild(translation);
+  SoCube * cube2 = new SoCube;
+  root->addChild(cube2);
+
+  int count = 0;
+  SoIntersectionDetectionAction ida;
+  ida.addIntersectionCallback(intersectionCB, &count);
+
+  ida.apply(root);
+  const int overlapping = count;
+  BOOST_CHECK_MESSAGE(overlapping > 0, "overlapping cubes should intersect");
+
+  count = 0;
+  ida.apply(root);
+  BOOST_CHECK_MESSAGE(count == overlapping, "second apply should give the same result");
+
+  // the cached triangles must follow the shape when moved
+  translation->translation.setValue(2.5f, 0.5f, 0.5f);
+  count = 0;
+  ida.apply(root);
+  BOOST_CHECK_MESSAGE(count == 0, "separated cubes should not intersect");
+
+  translation->translation.setValue(1.5f, 0.5f, 0.5f);
+  count = 0;
+  ida.apply(root);
+  BOOST_CHECK_MESSAGE(count == overlapping, "cubes moved back should intersect again");
+
+  // and be regenerated when the shape changes
+  cube2->width = 0.5f;
+  count = 0;
+  ida.apply(root);
+  BOOST_CHECK_MESSAGE(count == 0, "shrunk cube should not intersect");
+
+  root->unref();
+}
 
-    SbList<void*> candidatetris;
-    octtree->findItems(tribbox, candidatetris);
-
-    for (int j = 0; j < candidatetris.getLength(); j++) {
-      SbTri3f * t2 = static_cast<SbTri3f *>(candidatetris[j]);
-
-      nrisectchks++;
-
-      if (t1->intersect(*t2, theepsilon)) {
-        nrhits++;
-
-        SoIntersectingPrimitive p1;
-        p1.path = iterationprims->getPath();
-        p1.type = SoIntersectingPrimitive::TRIANGLE;
-        t1->getValue(p1.xf_vertex[0], p1.xf_vertex[1], p1.xf_vertex[2]);
-        iterationprims->invtransform.multVecMatrix(p1.xf_vertex[0], p1.vertex[0]);
-        iterationprims->invtransform.multVecMatrix(p1.xf_vertex[1], p1.vertex[1]);
-        iterationprims->invtransform.multVecMatrix(p1.xf_vertex[2], p1.vertex[2]);
-
-        SoIntersectingPrimitive p2;
-        p2.path = octtreeprims->getPath();
-        p2.type = SoIntersectingPrimitive::TRIANGLE;
-        t2->getValue(p2.xf_vertex[0], p2.xf_vertex[1], p2.xf_vertex[2]);
-        octtreeprims->invtransform.multVecMatrix(p2.xf_vertex[0], p2.vertex[0]);
-        octtreeprims->invtransform.multVecMatrix(p2.xf_vertex[1], p2.vertex[1]);
-        octtreeprims->invtransform.multVecMatrix(p2.xf_vertex[2], p2.vertex[2]);
-
-        std::vector<SoIntersectionCallback>::iterator it = this->callbacks.begin();
-        while (it != this->callbacks.end()) {
-          switch ( (*it).first((*it).second, &p1, &p2) ) {
-          case SoIntersectionDetectionAction::NEXT_PRIMITIVE:
-            // Break out of the switch, invoke next callback.
-            break;
-          case SoIntersectionDetectionAction::NEXT_SHAPE:
-            // FIXME: remaining callbacks won't be invoked -- should they? 20030328 mortene.
-            cont = TRUE;
-            goto done;
-          case SoIntersectionDetectionAction::ABORT:
-            // FIXME: remaining callbacks won't be invoked -- should they? 20030328 mortene.
-            cont = FALSE;
-            goto done;
-          default:
-            assert(0);
-          }
-          ++it;
-        }
-      }
-    }
-  }
+typedef struct {
+  int count;
+  const SoNode * stale;
+  int numstale;
+} ida_test_paths;
 
-done:
-  // for debugging
-  if (ida_debug()) {
-    const unsigned int total = primitives1->numTriangles() + primitives2->numTriangles();
-    SoDebugError::postInfo("SoIntersectionDetectionAction::PImpl::doPrimitiveIntersectionTesting",
-                           "intersection checks = %d (pr primitive: %f)",
-                           nrisectchks, float(nrisectchks) / total);
-    SbString chksprhit;
-    if (nrhits == 0) { chksprhit = "-"; }
-    else { chksprhit.sprintf("%f", float(nrisectchks) / nrhits); }
-    SoDebugError::postInfo("SoIntersectionDetectionAction::PImpl::doPrimitiveIntersectionTesting",
-                           "hits = %d (chks pr hit: %s)", nrhits, chksprhit.getString());
-  }
+static SoIntersectionDetectionAction::Resp
+intersectionPathCB(void * closure,
+                   const SoIntersectingPrimitive * pr1,
+                   const SoIntersectingPrimitive * pr2)
+{
+  ida_test_paths * paths = static_cast<ida_test_paths *>(closure);
+  paths->count++;
+  if (pr1->path->containsNode(paths->stale)) paths->numstale++;
+  if (pr2->path->containsNode(paths->stale)) paths->numstale++;
+  return SoIntersectionDetectionAction::NEXT_PRIMITIVE;
 }
 
-// Does intersection testing internally within the same
-// shape. Triangles are not tested against themselves.
-//
-// Can ignore epsilon setting, as that only indicates a distance
-// between distinct shapes.
-void
-SoIntersectionDetectionAction::PImpl::doInternalPrimitiveIntersectionTesting(PrimitiveData * primitives,
-                                                                     SbBool & cont)
+BOOST_AUTO_TEST_CASE(replacedIntermediateNode)
 {
-  // for debugging
-  if (ida_debug()) {
-    SoDebugError::postInfo("SoIntersectionDetectionAction::PImpl::doInternalPrimitiveIntersectionTesting",
-                           "triangles shape = %d", primitives->numTriangles());
-  }
-  unsigned int nrisectchks = 0;
-
-  // FIXME: use the SbOctTree optimization, as above. Should refactor
-  // doPrimitiveIntersectionTesting() and
-  // doInternalPrimitiveIntersectionTesting() into common
-  // code. 20030328 mortene.
-
-  cont = TRUE;
-  const int numprimitives = primitives->numTriangles();
-  for (int i = 0; i < numprimitives; i++ ) {
-    SbTri3f * t1 = static_cast<SbTri3f *>(primitives->getTriangle(i));
-    for (int j = i + 1; j < numprimitives; j++ ) {
-      SbTri3f * t2 = static_cast<SbTri3f *>(primitives->getTriangle(j));
-      nrisectchks++;
-      if ( t1->intersect(*t2) ) {
-        SoIntersectingPrimitive p1;
-        p1.path = primitives->getPath();
-        p1.type = SoIntersectingPrimitive::TRIANGLE;
-        t1->getValue(p1.xf_vertex[0], p1.xf_vertex[1], p1.xf_vertex[2]);
-        primitives->invtransform.multVecMatrix(p1.xf_vertex[0], p1.vertex[0]);
-        primitives->invtransform.multVecMatrix(p1.xf_vertex[1], p1.vertex[1]);
-        primitives->invtransform.multVecMatrix(p1.xf_vertex[2], p1.vertex[2]);
-
-        SoIntersectingPrimitive p2;
-        p2.path = primitives->getPath();
-        p2.type = SoIntersectingPrimitive::TRIANGLE;
-        t2->getValue(p2.xf_vertex[0], p2.xf_vertex[1], p2.xf_vertex[2]);
-        primitives->invtransform.multVecMatrix(p2.xf_vertex[0], p2.vertex[0]);
-        primitives->invtransform.multVecMatrix(p2.xf_vertex[1], p2.vertex[1]);
-        primitives->invtransform.multVecMatrix(p2.xf_vertex[2], p2.vertex[2]);
-
-        std::vector<SoIntersectionCallback>::iterator it = this->callbacks.begin();
-        while (it != this->callbacks.end()) {
-          switch ( (*it).first((*it).second, &p1, &p2) ) {
-          case SoIntersectionDetectionAction::NEXT_PRIMITIVE:
-            break;
-          case SoIntersectionDetectionAction::NEXT_SHAPE:
-            cont = TRUE;
-            goto done;
-          case SoIntersectionDetectionAction::ABORT:
-            cont = FALSE;
-            goto done;
-          default:
-            assert(0);
-          }
-          ++it;
-        }
-      }
-    }
-  }
- done:
-  // for debugging
-  if (ida_debug()) {
-    SoDebugError::postInfo("SoIntersectionDetectionAction::PImpl::doInternalPrimitiveIntersectionTesting",
-                           "intersection checks = %d", nrisectchks);
+  SoSeparator * root = new SoSeparator;
+  root->ref();
+  root->addChild(new SoCube);
+
+  // the same face set below two groups with different coordinates,
+  // so that only the intermediate node of its path differs
+  SoFaceSet * faceset = new SoFaceSet;
+  SoGroup * groups[2];
+  for (int i = 0; i < 2; i++) {
+    const float offset = (i == 0) ? 10.0f : 0.0f;
+    SoCoordinate3 * coords = new SoCoordinate3;
+    coords->point.set1Value(0, SbVec3f(offset - 2.0f, -2.0f, 0.0f));
+    coords->point.set1Value(1, SbVec3f(offset + 2.0f, -2.0f, 0.0f));
+    coords->point.set1Value(2, SbVec3f(offset, 2.0f, 0.0f));
+    groups[i] = new SoGroup;
+    groups[i]->ref();
+    groups[i]->addChild(coords);
+    groups[i]->addChild(faceset);
   }
+  root->addChild(groups[0]);
+
+  ida_test_paths paths;
+  paths.count = 0;
+  paths.stale = groups[0];
+  paths.numstale = 0;
+  SoIntersectionDetectionAction ida;
+  ida.addIntersectionCallback(intersectionPathCB, &paths);
+  ida.apply(root);
+  BOOST_CHECK_MESSAGE(paths.count == 0, "distant triangle should not intersect");
+
+  root->replaceChild(groups[0], groups[1]);
+  paths.count = 0;
+  ida.apply(root);
+  BOOST_CHECK_MESSAGE(paths.count > 0, "triangle moved by a replaced group should intersect");
+  BOOST_CHECK_MESSAGE(paths.numstale == 0,
+                      "intersections must be reported with the current path");
+
+  groups[0]->unref();
+  groups[1]->unref();
+  root->unref();
 }
 
-#undef PRIVATE
+#endif // COIN_TEST_SUITE
@@ -61,6 +61,7 @@
 
 #include "glue/glp.h"
 #include "rendering/SoGL.h"
+#include "rendering/SoGLTextureMemory.h"
 #include "coindefs.h"
 
 #ifndef COIN_WORKAROUND_NO_USING_STD_FUNCS
@@ -210,6 +211,7 @@ SoGLDisplayList::~SoGLDisplayList()
     // It is only possible to create one texture object at a time, so
     // there's only one index to delete.
     cc_glglue_glDeleteTextures(glw, 1, &tmpindex);
+    SoGLTextureMemory::deleted(this);
   }
   delete PRIVATE(this);
 }
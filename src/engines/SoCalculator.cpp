@@ -330,6 +330,18 @@ public:
   float oa_od[4];
   SbVec3f oA_oD[4];
   SbList <struct so_eval_node*> evaluatorList;
+  // the expressions compiled into one program, or NULL if they
+  // couldn't be compiled
+  so_eval_program * program;
+
+  void clearExpressions(void) {
+    for (int i = 0; i < this->evaluatorList.getLength(); i++) {
+      so_eval_delete(this->evaluatorList[i]);
+    }
+    this->evaluatorList.truncate(0);
+    so_eval_program_delete(this->program);
+    this->program = NULL;
+  }
 };
 
 #define PRIVATE(thisp) (thisp->pimpl)
@@ -343,6 +355,7 @@ SO_ENGINE_SOURCE(SoCalculator);
 SoCalculator::SoCalculator(void)
 {
   PRIVATE(this) = new SoCalculatorP;
+  PRIVATE(this)->program = NULL;
 
   SO_ENGINE_INTERNAL_CONSTRUCTOR(SoCalculator);
 
@@ -386,9 +399,7 @@ SoCalculator::SoCalculator(void)
 */
 SoCalculator::~SoCalculator(void)
 {
-  for (int i = 0; i < PRIVATE(this)->evaluatorList.getLength(); i++) {
-    so_eval_delete(PRIVATE(this)->evaluatorList[i]);
-  }
+  PRIVATE(this)->clearExpressions();
   delete PRIVATE(this);
 }
 
@@ -424,6 +435,9 @@ SoCalculator::evaluate(void)
       }
       else PRIVATE(this)->evaluatorList.append(NULL);
     }
+    PRIVATE(this)->program =
+      so_eval_compile(PRIVATE(this)->evaluatorList.getArrayPtr(),
+                      PRIVATE(this)->evaluatorList.getLength());
   }
 
 
@@ -465,6 +479,11 @@ SoCalculator::evaluate(void)
   if (outused[6]) { SO_ENGINE_OUTPUT(oC, SoMFVec3f, setNum(maxnum)); }
   if (outused[7]) { SO_ENGINE_OUTPUT(oD, SoMFVec3f, setNum(maxnum)); }
 
+  if (PRIVATE(this)->program) {
+    this->evaluateProgram(maxnum, inused, outused);
+    return;
+  }
+
   // loop through all fieldindices and evaluate
   for (i = 0; i < maxnum; i++) {
     // just initialize output registers to default values
@@ -487,6 +506,101 @@ SoCalculator::evaluate(void)
   }
 }
 
+// Evaluates the compiled program for all field indices, a batch of
+// indices at a time.
+void
+SoCalculator::evaluateProgram(const int maxnum, const char * inused, const char * outused)
+{
+  so_eval_program * program = PRIVATE(this)->program;
+  const int numlanes = so_eval_program_get_num_lanes(program);
+  int i, j, k;
+
+  const SoMFFloat * fltinputs[] = {
+    &this->a, &this->b, &this->c, &this->d, &this->e, &this->f, &this->g, &this->h
+  };
+  const SoMFVec3f * vecinputs[] = {
+    &this->A, &this->B, &this->C, &this->D, &this->E, &this->F, &this->G, &this->H
+  };
+
+  // the temporary registers keep their values between evaluations
+  for (i = 0; i < 8; i++) {
+    float * reg = so_eval_program_get_register(program, SO_EVAL_REG_TMP_FLT + i);
+    for (k = 0; k < numlanes; k++) reg[k] = PRIVATE(this)->ta_th[i];
+    for (j = 0; j < 3; j++) {
+      reg = so_eval_program_get_register(program, SO_EVAL_REG_TMP_VEC + i * 3 + j);
+      for (k = 0; k < numlanes; k++) reg[k] = PRIVATE(this)->tA_tH[i][j];
+    }
+  }
+
+  SbList<float> fltoutputs[4];
+  SbList<SbVec3f> vecoutputs[4];
+
+  int numinbatch = 0;
+  for (int start = 0; start < maxnum; start += numlanes) {
+    numinbatch = SbMin(numlanes, maxnum - start);
+
+    // copy the input values into the registers. The last value is
+    // used for indices past the end of a field.
+    for (i = 0; i < 8; i++) {
+      if (inused[i]) {
+        float * reg = so_eval_program_get_register(program, SO_EVAL_REG_IN_FLT + i);
+        const int num = fltinputs[i]->getNum();
+        const float * values = fltinputs[i]->getValues(0);
+        for (k = 0; k < numinbatch; k++) {
+          reg[k] = num ? values[SbMin(start + k, num - 1)] : 0.0f;
+        }
+      }
+      if (inused[i + 8]) {
+        const int num = vecinputs[i]->getNum();
+        const SbVec3f * values = vecinputs[i]->getValues(0);
+        for (j = 0; j < 3; j++) {
+          float * reg = so_eval_program_get_register(program, SO_EVAL_REG_IN_VEC + i * 3 + j);
+          for (k = 0; k < numinbatch; k++) {
+            reg[k] = num ? values[SbMin(start + k, num - 1)][j] : 0.0f;
+          }
+        }
+      }
+    }
+
+    so_eval_program_run(program, numinbatch);
+
+    for (i = 0; i < 4; i++) {
+      if (outused[i]) {
+        const float * reg = so_eval_program_get_register(program, SO_EVAL_REG_OUT_FLT + i);
+        for (k = 0; k < numinbatch; k++) fltoutputs[i].append(reg[k]);
+      }
+      if (outused[i + 4]) {
+        const float * x = so_eval_program_get_register(program, SO_EVAL_REG_OUT_VEC + i * 3);
+        const float * y = so_eval_program_get_register(program, SO_EVAL_REG_OUT_VEC + i * 3 + 1);
+        const float * z = so_eval_program_get_register(program, SO_EVAL_REG_OUT_VEC + i * 3 + 2);
+        for (k = 0; k < numinbatch; k++) vecoutputs[i].append(SbVec3f(x[k], y[k], z[k]));
+      }
+    }
+  }
+
+  // store the values from the last field index in the temporary
+  // registers
+  const int last = numinbatch - 1;
+  for (i = 0; i < 8; i++) {
+    PRIVATE(this)->ta_th[i] =
+      so_eval_program_get_register(program, SO_EVAL_REG_TMP_FLT + i)[last];
+    for (j = 0; j < 3; j++) {
+      PRIVATE(this)->tA_tH[i][j] =
+        so_eval_program_get_register(program, SO_EVAL_REG_TMP_VEC + i * 3 + j)[last];
+    }
+  }
+
+  if (outused[0]) { SO_ENGINE_OUTPUT(oa, SoMFFloat, setValues(0, maxnum, fltoutputs[0].getArrayPtr())); }
+  if (outused[1]) { SO_ENGINE_OUTPUT(ob, SoMFFloat, setValues(0, maxnum, fltoutputs[1].getArrayPtr())); }
+  if (outused[2]) { SO_ENGINE_OUTPUT(oc, SoMFFloat, setValues(0, maxnum, fltoutputs[2].getArrayPtr())); }
+  if (outused[3]) { SO_ENGINE_OUTPUT(od, SoMFFloat, setValues(0, maxnum, fltoutputs[3].getArrayPtr())); }
+
+  if (outused[4]) { SO_ENGINE_OUTPUT(oA, SoMFVec3f, setValues(0, maxnum, vecoutputs[0].getArrayPtr())); }
+  if (outused[5]) { SO_ENGINE_OUTPUT(oB, SoMFVec3f, setValues(0, maxnum, vecoutputs[1].getArrayPtr())); }
+  if (outused[6]) { SO_ENGINE_OUTPUT(oC, SoMFVec3f, setValues(0, maxnum, vecoutputs[2].getArrayPtr())); }
+  if (outused[7]) { SO_ENGINE_OUTPUT(oD, SoMFVec3f, setValues(0, maxnum, vecoutputs[3].getArrayPtr())); }
+}
+
 // "extern C" wrapper and C-function typedefs are needed with the
 // OSF1/cxx compiler (probably a bug in the compiler, but it doesn't
 // seem to hurt to do this anyway).
@@ -607,10 +721,7 @@ SoCalculator::inputChanged(SoField *which)
 {
   // if expression changes we have to rebuild the eval tree structure
   if (which == &this->expression) {
-    for (int i = 0; i < PRIVATE(this)->evaluatorList.getLength(); i++) {
-      so_eval_delete(PRIVATE(this)->evaluatorList[i]);
-    }
-    PRIVATE(this)->evaluatorList.truncate(0);
+    PRIVATE(this)->clearExpressions();
   }
 }
 
@@ -713,3 +824,57 @@ SoCalculator::writefieldcb(const char *fieldname, float *data,
 
 #undef THISP
 #undef PRIVATE
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/engines/SoCalculator.h>
+#include <Inventor/fields/SoMFFloat.h>
+#include <Inventor/fields/SoMFVec3f.h>
+
+// Uses enough values to need several batches in the compiled program.
+BOOST_AUTO_TEST_CASE(evaluateManyValues)
+{
+  const int num = 300;
+  SoCalculator * calc = new SoCalculator;
+  calc->ref();
+  calc->a.setNum(num);
+  calc->A.setNum(num);
+  for (int i = 0; i < num; i++) {
+    calc->a.set1Value(i, float(i));
+    calc->A.set1Value(i, SbVec3f(float(i), 0.0f, 1.0f));
+  }
+  calc->b.setValue(2.0f);
+
+  SoMFFloat oa, ob;
+  SoMFVec3f oA;
+  oa.connectFrom(&calc->oa);
+  ob.connectFrom(&calc->ob);
+  oA.connectFrom(&calc->oA);
+
+  calc->expression.setValue("oa = (a > 100) ? a / b : -a; oA = A * b + vec3f(0, a, 0)");
+  BOOST_REQUIRE_EQUAL(oa.getNum(), num);
+  BOOST_REQUIRE_EQUAL(oA.getNum(), num);
+  SbBool ok = TRUE;
+  for (int i = 0; i < num; i++) {
+    ok = ok && oa[i] == ((i > 100) ? float(i) / 2.0f : -float(i));
+    ok = ok && oA[i] == SbVec3f(float(i) * 2.0f, float(i), 2.0f);
+  }
+  BOOST_CHECK_MESSAGE(ok, "wrong output values");
+
+  // the temporary register carries the sum over from the previous
+  // field index
+  calc->expression.setValue("ta = ta + a; ob = ta");
+  BOOST_REQUIRE_EQUAL(ob.getNum(), num);
+  ok = TRUE;
+  for (int i = 0; i < num; i++) {
+    ok = ok && ob[i] == float(i * (i + 1) / 2);
+  }
+  BOOST_CHECK_MESSAGE(ok, "wrong running sum");
+
+  oa.disconnect();
+  ob.disconnect();
+  oA.disconnect();
+  calc->unref();
+}
+
+#endif // COIN_TEST_SUITE
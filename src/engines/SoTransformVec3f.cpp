@@ -110,17 +110,37 @@ SoTransformVec3f::evaluate(void)
   SO_ENGINE_OUTPUT(direction, SoMFVec3f, setNum(numoutputs));
   SO_ENGINE_OUTPUT(normalDirection, SoMFVec3f, setNum(numoutputs));
 
-  SbVec3f pt, dir, ndir;
-
+  if (numoutputs <= 0) return;
+
+  SbVec3f * pt = new SbVec3f[numoutputs];
+  SbVec3f * dir = new SbVec3f[numoutputs];
+  SbVec3f * ndir = new SbVec3f[numoutputs];
+
+  if (nummatrices == 1 && numvec == numoutputs) {
+    // the common case; transform the whole input array in one go
+    const SbMatrix & m = this->matrix[0];
+    const SbVec3f * v = this->vector.getValues(0);
+    m.multVecMatrix(v, pt, numoutputs);
+    m.multDirMatrix(v, dir, numoutputs);
+  }
+  else {
+    for (int i = 0; i < numoutputs; i++) {
+      const SbVec3f & v = this->vector[SbMin(i, numvec-1)];
+      const SbMatrix & m = this->matrix[SbMin(i, nummatrices-1)];
+      m.multVecMatrix(v, pt[i]);
+      m.multDirMatrix(v, dir[i]);
+    }
+  }
   for (int i = 0; i < numoutputs; i++) {
-    const SbVec3f & v = this->vector[SbMin(i, numvec-1)];
-    const SbMatrix & m = this->matrix[SbMin(i, nummatrices-1)];
-    m.multVecMatrix(v, pt);
-    m.multDirMatrix(v, dir);
-    ndir = dir;
-    (void) ndir.normalize(); // null vector is ok
-    SO_ENGINE_OUTPUT(point, SoMFVec3f, set1Value(i, pt));
-    SO_ENGINE_OUTPUT(direction, SoMFVec3f, set1Value(i, dir));
-    SO_ENGINE_OUTPUT(normalDirection, SoMFVec3f, set1Value(i, ndir));
+    ndir[i] = dir[i];
+    (void) ndir[i].normalize(); // null vector is ok
   }
+
+  SO_ENGINE_OUTPUT(point, SoMFVec3f, setValues(0, numoutputs, pt));
+  SO_ENGINE_OUTPUT(direction, SoMFVec3f, setValues(0, numoutputs, dir));
+  SO_ENGINE_OUTPUT(normalDirection, SoMFVec3f, setValues(0, numoutputs, ndir));
+
+  delete[] pt;
+  delete[] dir;
+  delete[] ndir;
 }
@@ -36,6 +36,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h> /* NULL */
+#include <string.h> /* memcmp */
 #include <float.h> /* FLT_EPSILON */
 
 /*
@@ -465,6 +466,512 @@ so_eval_evaluate(so_eval_node *node, const so_eval_cbdata *cbdata)
   so_eval_traverse(node, &dummy, cbdata);
 }
 
+/* ********************************************************************** */
+
+/*
+ * the register based program. See evaluator.h.
+ */
+
+/* number of lanes in a batch */
+#define SO_EVAL_MAX_LANES 128
+
+/* instruction op codes */
+enum {
+  OP_MOV,
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_FMOD,
+  OP_NEG,
+  OP_AND,
+  OP_OR,
+  OP_NOT,
+  OP_LEQ,
+  OP_GEQ,
+  OP_EQ,
+  OP_NEQ,
+  OP_LT,
+  OP_GT,
+  OP_TEST,
+  OP_COS,
+  OP_SIN,
+  OP_TAN,
+  OP_ACOS,
+  OP_ASIN,
+  OP_ATAN,
+  OP_ATAN2,
+  OP_COSH,
+  OP_SINH,
+  OP_TANH,
+  OP_SQRT,
+  OP_SQRT_NOCHECK,
+  OP_EXP,
+  OP_LOG,
+  OP_LOG10,
+  OP_CEIL,
+  OP_FLOOR,
+  OP_FABS,
+  OP_POW,
+  OP_SELECT,
+  OP_NORMALIZE
+};
+
+typedef struct {
+  int op;
+  int dst, src1, src2, src3;
+} so_eval_instruction;
+
+struct so_eval_program {
+  so_eval_instruction *code;
+  int numcode, maxcode;
+  int numregs;
+  int numlanes;
+  float *regs;
+
+  /* constants are put in registers which are never written */
+  int *constregs;
+  float *constvalues;
+  int numconsts, maxconsts;
+
+  /* used for finding temporary registers which are read before they
+     are written */
+  char written[SO_EVAL_NUM_NAMED_REGS];
+  char readfirst[SO_EVAL_NUM_NAMED_REGS];
+  int failed;
+};
+
+static void
+emit(so_eval_program *p, int op, int dst, int src1, int src2, int src3)
+{
+  so_eval_instruction *instr;
+  if (p->numcode == p->maxcode) {
+    p->maxcode = p->maxcode ? p->maxcode * 2 : 64;
+    p->code = (so_eval_instruction*)
+      realloc(p->code, p->maxcode * sizeof(so_eval_instruction));
+  }
+  instr = &p->code[p->numcode++];
+  instr->op = op;
+  instr->dst = dst;
+  instr->src1 = src1;
+  instr->src2 = src2;
+  instr->src3 = src3;
+}
+
+/*
+ * allocates 'num' consecutive registers.
+ */
+static int
+alloc_regs(so_eval_program *p, int num)
+{
+  int reg = p->numregs;
+  p->numregs += num;
+  return reg;
+}
+
+static int
+emit_op(so_eval_program *p, int op, int src1, int src2, int src3)
+{
+  int dst = alloc_regs(p, 1);
+  emit(p, op, dst, src1, src2, src3);
+  return dst;
+}
+
+static int
+const_reg(so_eval_program *p, float value)
+{
+  int i;
+  for (i = 0; i < p->numconsts; i++) {
+    /* compare the bits, so that -0.0 and 0.0 are kept apart */
+    if (memcmp(&p->constvalues[i], &value, sizeof(float)) == 0) {
+      return p->constregs[i];
+    }
+  }
+  if (p->numconsts == p->maxconsts) {
+    p->maxconsts = p->maxconsts ? p->maxconsts * 2 : 16;
+    p->constregs = (int*) realloc(p->constregs, p->maxconsts * sizeof(int));
+    p->constvalues = (float*) realloc(p->constvalues, p->maxconsts * sizeof(float));
+  }
+  p->constregs[p->numconsts] = alloc_regs(p, 1);
+  p->constvalues[p->numconsts] = value;
+  return p->constregs[p->numconsts++];
+}
+
+/*
+ * returns the first register of a field, or -1 if the name is invalid.
+ */
+static int
+named_reg(const char *regname)
+{
+  char c;
+  int fltbase, vecbase, num;
+  if (regname[0] == 't' || regname[0] == 'o') {
+    c = regname[1];
+    fltbase = regname[0] == 't' ? SO_EVAL_REG_TMP_FLT : SO_EVAL_REG_OUT_FLT;
+    vecbase = regname[0] == 't' ? SO_EVAL_REG_TMP_VEC : SO_EVAL_REG_OUT_VEC;
+    num = regname[0] == 't' ? 8 : 4;
+  }
+  else {
+    c = regname[0];
+    fltbase = SO_EVAL_REG_IN_FLT;
+    vecbase = SO_EVAL_REG_IN_VEC;
+    num = 8;
+  }
+  if (c >= 'a' && c < 'a' + num) return fltbase + (c - 'a');
+  if (c >= 'A' && c < 'A' + num) return vecbase + (c - 'A') * 3;
+  return -1;
+}
+
+static void
+read_named(so_eval_program *p, int reg, int num)
+{
+  int i;
+  for (i = 0; i < num; i++) {
+    if (!p->written[reg + i]) p->readfirst[reg + i] = 1;
+  }
+}
+
+static int
+compile_node(so_eval_program *p, so_eval_node *node);
+
+static int
+compile_unary(so_eval_program *p, int op, so_eval_node *child)
+{
+  return emit_op(p, op, compile_node(p, child), -1, -1);
+}
+
+static int
+compile_binary(so_eval_program *p, int op, so_eval_node *node)
+{
+  int src1 = compile_node(p, node->child1);
+  int src2 = compile_node(p, node->child2);
+  return emit_op(p, op, src1, src2, -1);
+}
+
+static int
+compile_dot(so_eval_program *p, int v0, int v1)
+{
+  /* same evaluation order as dot_product() */
+  int sum = emit_op(p, OP_ADD,
+                    emit_op(p, OP_MUL, v0, v1, -1),
+                    emit_op(p, OP_MUL, v0 + 1, v1 + 1, -1), -1);
+  return emit_op(p, OP_ADD, sum, emit_op(p, OP_MUL, v0 + 2, v1 + 2, -1), -1);
+}
+
+/*
+ * compiles the node, and returns the register holding the result
+ * (the first of three registers for vectors).
+ */
+static int
+compile_node(so_eval_program *p, so_eval_node *node)
+{
+  int i, op, reg, src1, src2, src3, dst;
+
+  switch (node->id) {
+  case ID_ADD: return compile_binary(p, OP_ADD, node);
+  case ID_SUB: return compile_binary(p, OP_SUB, node);
+  case ID_MUL: return compile_binary(p, OP_MUL, node);
+  case ID_DIV: return compile_binary(p, OP_DIV, node);
+  case ID_FMOD: return compile_binary(p, OP_FMOD, node);
+  case ID_AND: return compile_binary(p, OP_AND, node);
+  case ID_OR: return compile_binary(p, OP_OR, node);
+  case ID_LEQ: return compile_binary(p, OP_LEQ, node);
+  case ID_GEQ: return compile_binary(p, OP_GEQ, node);
+  case ID_LT: return compile_binary(p, OP_LT, node);
+  case ID_GT: return compile_binary(p, OP_GT, node);
+  /* vectors are compared by their first component only, like in
+     so_eval_traverse() */
+  case ID_EQ: return compile_binary(p, OP_EQ, node);
+  case ID_NEQ: return compile_binary(p, OP_NEQ, node);
+  case ID_ATAN2: return compile_binary(p, OP_ATAN2, node);
+  case ID_POW: return compile_binary(p, OP_POW, node);
+  case ID_NEG: return compile_unary(p, OP_NEG, node->child1);
+  case ID_NOT: return compile_unary(p, OP_NOT, node->child1);
+  case ID_TEST_FLT: return compile_unary(p, OP_TEST, node->child1);
+  case ID_COS: return compile_unary(p, OP_COS, node->child1);
+  case ID_SIN: return compile_unary(p, OP_SIN, node->child1);
+  case ID_TAN: return compile_unary(p, OP_TAN, node->child1);
+  case ID_ACOS: return compile_unary(p, OP_ACOS, node->child1);
+  case ID_ASIN: return compile_unary(p, OP_ASIN, node->child1);
+  case ID_ATAN: return compile_unary(p, OP_ATAN, node->child1);
+  case ID_COSH: return compile_unary(p, OP_COSH, node->child1);
+  case ID_SINH: return compile_unary(p, OP_SINH, node->child1);
+  case ID_TANH: return compile_unary(p, OP_TANH, node->child1);
+  case ID_SQRT: return compile_unary(p, OP_SQRT, node->child1);
+  case ID_EXP: return compile_unary(p, OP_EXP, node->child1);
+  case ID_LOG: return compile_unary(p, OP_LOG, node->child1);
+  case ID_LOG10: return compile_unary(p, OP_LOG10, node->child1);
+  case ID_CEIL: return compile_unary(p, OP_CEIL, node->child1);
+  case ID_FLOOR: return compile_unary(p, OP_FLOOR, node->child1);
+  case ID_FABS: return compile_unary(p, OP_FABS, node->child1);
+
+  case ID_ADD_VEC:
+  case ID_SUB_VEC:
+    op = node->id == ID_ADD_VEC ? OP_ADD : OP_SUB;
+    src1 = compile_node(p, node->child1);
+    src2 = compile_node(p, node->child2);
+    dst = alloc_regs(p, 3);
+    for (i = 0; i < 3; i++) emit(p, op, dst + i, src1 + i, src2 + i, -1);
+    return dst;
+  case ID_MUL_VEC_FLT:
+  case ID_DIV_VEC_FLT:
+    /* OP_DIV handles division by zero the same way as ID_DIV_VEC_FLT */
+    op = node->id == ID_MUL_VEC_FLT ? OP_MUL : OP_DIV;
+    src1 = compile_node(p, node->child1);
+    src2 = compile_node(p, node->child2);
+    dst = alloc_regs(p, 3);
+    for (i = 0; i < 3; i++) emit(p, op, dst + i, src1 + i, src2, -1);
+    return dst;
+  case ID_NEG_VEC:
+    src1 = compile_node(p, node->child1);
+    dst = alloc_regs(p, 3);
+    for (i = 0; i < 3; i++) emit(p, OP_NEG, dst + i, src1 + i, -1, -1);
+    return dst;
+  case ID_CROSS:
+    src1 = compile_node(p, node->child1);
+    src2 = compile_node(p, node->child2);
+    dst = alloc_regs(p, 3);
+    for (i = 0; i < 3; i++) {
+      int j = (i + 1) % 3, k = (i + 2) % 3;
+      emit(p, OP_SUB, dst + i,
+           emit_op(p, OP_MUL, src1 + j, src2 + k, -1),
+           emit_op(p, OP_MUL, src1 + k, src2 + j, -1), -1);
+    }
+    return dst;
+  case ID_DOT:
+    src1 = compile_node(p, node->child1);
+    src2 = compile_node(p, node->child2);
+    return compile_dot(p, src1, src2);
+  case ID_LEN:
+    src1 = compile_node(p, node->child1);
+    return emit_op(p, OP_SQRT_NOCHECK, compile_dot(p, src1, src1), -1, -1);
+  case ID_NORMALIZE:
+    src1 = compile_node(p, node->child1);
+    src2 = emit_op(p, OP_SQRT_NOCHECK, compile_dot(p, src1, src1), -1, -1);
+    dst = alloc_regs(p, 3);
+    for (i = 0; i < 3; i++) emit(p, OP_NORMALIZE, dst + i, src1 + i, src2, -1);
+    return dst;
+  case ID_TEST_VEC:
+    src1 = compile_node(p, node->child1);
+    return emit_op(p, OP_OR,
+                   emit_op(p, OP_OR,
+                           emit_op(p, OP_TEST, src1, -1, -1),
+                           emit_op(p, OP_TEST, src1 + 1, -1, -1), -1),
+                   emit_op(p, OP_TEST, src1 + 2, -1, -1), -1);
+  case ID_VEC3F:
+    src1 = compile_node(p, node->child1);
+    src2 = compile_node(p, node->child2);
+    src3 = compile_node(p, node->child3);
+    dst = alloc_regs(p, 3);
+    emit(p, OP_MOV, dst, src1, -1, -1);
+    emit(p, OP_MOV, dst + 1, src2, -1, -1);
+    emit(p, OP_MOV, dst + 2, src3, -1, -1);
+    return dst;
+
+  /* both branches are evaluated. This is safe since the expressions
+     have no side effects (rand() is not compiled) */
+  case ID_FLT_COND:
+  case ID_VEC_COND:
+    src1 = compile_node(p, node->child1);
+    src2 = compile_node(p, node->child2);
+    src3 = compile_node(p, node->child3);
+    if (node->id == ID_FLT_COND) return emit_op(p, OP_SELECT, src1, src2, src3);
+    dst = alloc_regs(p, 3);
+    for (i = 0; i < 3; i++) emit(p, OP_SELECT, dst + i, src1, src2 + i, src3 + i);
+    return dst;
+
+  case ID_FLT_REG:
+  case ID_VEC_REG:
+  case ID_VEC_REG_COMP:
+    reg = named_reg(node->regname);
+    if (reg < 0 || (node->id == ID_VEC_REG_COMP && (node->regidx < 0 || node->regidx > 2))) {
+      p->failed = 1;
+      return 0;
+    }
+    if (node->id == ID_VEC_REG_COMP) reg += node->regidx;
+    read_named(p, reg, node->id == ID_VEC_REG ? 3 : 1);
+    return reg;
+  case ID_VALUE:
+    return const_reg(p, node->value);
+
+  case ID_ASSIGN_FLT:
+  case ID_ASSIGN_VEC:
+    src1 = compile_node(p, node->child2);
+    reg = named_reg(node->child1->regname);
+    if (reg < 0 || node->child1->regidx > 2) {
+      p->failed = 1;
+      return -1;
+    }
+    if (node->child1->regidx >= 0) reg += node->child1->regidx;
+    for (i = 0; i < (node->id == ID_ASSIGN_VEC ? 3 : 1); i++) {
+      emit(p, OP_MOV, reg + i, src1 + i, -1, -1);
+      p->written[reg + i] = 1;
+    }
+    return -1;
+  case ID_SEPARATOR:
+    if (node->child1) (void) compile_node(p, node->child1);
+    if (node->child2) (void) compile_node(p, node->child2);
+    return -1;
+
+  default: /* ID_RAND */
+    p->failed = 1;
+    return 0;
+  }
+}
+
+so_eval_program *
+so_eval_compile(so_eval_node *const *nodes, int numnodes)
+{
+  int i, j, loopcarried;
+  so_eval_program *p = (so_eval_program*) malloc(sizeof(so_eval_program));
+  p->code = NULL;
+  p->numcode = p->maxcode = 0;
+  p->numregs = SO_EVAL_NUM_NAMED_REGS;
+  p->regs = NULL;
+  p->constregs = NULL;
+  p->constvalues = NULL;
+  p->numconsts = p->maxconsts = 0;
+  p->failed = 0;
+  for (i = 0; i < SO_EVAL_NUM_NAMED_REGS; i++) {
+    p->written[i] = p->readfirst[i] = 0;
+  }
+
+  for (i = 0; i < numnodes && !p->failed; i++) {
+    if (nodes[i]) (void) compile_node(p, nodes[i]);
+  }
+  if (p->failed) {
+    so_eval_program_delete(p);
+    return NULL;
+  }
+
+  /* if a temporary register is read before it is written, the value
+     from the previous field index is used, and the lanes must be
+     evaluated one by one */
+  loopcarried = 0;
+  for (i = SO_EVAL_REG_TMP_FLT; i < SO_EVAL_REG_OUT_FLT; i++) {
+    if (p->readfirst[i] && p->written[i]) loopcarried = 1;
+  }
+  p->numlanes = loopcarried ? 1 : SO_EVAL_MAX_LANES;
+
+  p->regs = (float*) malloc(p->numregs * p->numlanes * sizeof(float));
+  for (i = 0; i < p->numregs * p->numlanes; i++) p->regs[i] = 0.0f;
+  for (i = 0; i < p->numconsts; i++) {
+    float *reg = p->regs + p->constregs[i] * p->numlanes;
+    for (j = 0; j < p->numlanes; j++) reg[j] = p->constvalues[i];
+  }
+  return p;
+}
+
+void
+so_eval_program_delete(so_eval_program *program)
+{
+  if (program) {
+    free(program->code);
+    free(program->regs);
+    free(program->constregs);
+    free(program->constvalues);
+    free(program);
+  }
+}
+
+int
+so_eval_program_get_num_lanes(const so_eval_program *program)
+{
+  return program->numlanes;
+}
+
+float *
+so_eval_program_get_register(so_eval_program *program, int reg)
+{
+  assert(reg >= 0 && reg < SO_EVAL_NUM_NAMED_REGS);
+  return program->regs + reg * program->numlanes;
+}
+
+/* loops over the lanes for one instruction */
+#define SO_EVAL_LANES(expr) \
+  for (j = 0; j < n; j++) { d[j] = (expr); } \
+  break
+
+void
+so_eval_program_run(so_eval_program *program, int numlanes)
+{
+  int i, j;
+  const int n = numlanes;
+  const int stride = program->numlanes;
+  float *regs = program->regs;
+  float *d;
+  const float *a, *b, *c;
+
+  assert(numlanes <= program->numlanes);
+
+  /* the output registers are reset for every field index */
+  for (i = SO_EVAL_REG_OUT_FLT; i < SO_EVAL_NUM_NAMED_REGS; i++) {
+    d = regs + i * stride;
+    for (j = 0; j < n; j++) d[j] = 0.0f;
+  }
+
+  for (i = 0; i < program->numcode; i++) {
+    const so_eval_instruction *instr = &program->code[i];
+    d = regs + instr->dst * stride;
+    a = regs + instr->src1 * stride;
+    b = instr->src2 >= 0 ? regs + instr->src2 * stride : NULL;
+    c = instr->src3 >= 0 ? regs + instr->src3 * stride : NULL;
+
+    /* keep in sync with so_eval_traverse() */
+    switch (instr->op) {
+    case OP_MOV: SO_EVAL_LANES(a[j]);
+    case OP_ADD: SO_EVAL_LANES(a[j] + b[j]);
+    case OP_SUB: SO_EVAL_LANES(a[j] - b[j]);
+    case OP_MUL: SO_EVAL_LANES(a[j] * b[j]);
+    case OP_DIV: SO_EVAL_LANES(b[j] == 0.0f ? a[j] / FLT_EPSILON : a[j] / b[j]);
+    case OP_FMOD: SO_EVAL_LANES(b[j] != 0.0f ? (float) fmod(a[j], b[j]) : 0.0f);
+    case OP_NEG: SO_EVAL_LANES(- a[j]);
+    case OP_AND: SO_EVAL_LANES((a[j] != 0.0f && b[j] != 0.0f) ? 1.0f : 0.0f);
+    case OP_OR: SO_EVAL_LANES((a[j] != 0.0f || b[j] != 0.0f) ? 1.0f : 0.0f);
+    case OP_NOT: SO_EVAL_LANES(a[j] == 0.0f ? 1.0f : 0.0f);
+    case OP_LEQ: SO_EVAL_LANES(a[j] <= b[j] ? 1.0f : 0.0f);
+    case OP_GEQ: SO_EVAL_LANES(a[j] >= b[j] ? 1.0f : 0.0f);
+    case OP_EQ: SO_EVAL_LANES(a[j] == b[j] ? 1.0f : 0.0f);
+    case OP_NEQ: SO_EVAL_LANES(a[j] != b[j] ? 1.0f : 0.0f);
+    case OP_LT: SO_EVAL_LANES(a[j] < b[j] ? 1.0f : 0.0f);
+    case OP_GT: SO_EVAL_LANES(a[j] > b[j] ? 1.0f : 0.0f);
+    case OP_TEST: SO_EVAL_LANES(a[j] != 0.0f ? 1.0f : 0.0f);
+    case OP_COS: SO_EVAL_LANES((float) cos(a[j]));
+    case OP_SIN: SO_EVAL_LANES((float) sin(a[j]));
+    case OP_TAN: SO_EVAL_LANES((float) tan(a[j]));
+    case OP_ACOS: SO_EVAL_LANES((float) acos(clamp(a[j], -1.0f, 1.0f)));
+    case OP_ASIN: SO_EVAL_LANES((float) asin(clamp(a[j], -1.0f, 1.0f)));
+    case OP_ATAN: SO_EVAL_LANES((float) atan(a[j]));
+    case OP_ATAN2:
+      SO_EVAL_LANES(b[j] == 0.0f ?
+                    (float) (a[j] >= 0.0f ? M_PI * 0.5 : - M_PI * 0.5) :
+                    (float) atan2(a[j], b[j]));
+    case OP_COSH: SO_EVAL_LANES((float) cosh(a[j]));
+    case OP_SINH: SO_EVAL_LANES((float) sinh(a[j]));
+    case OP_TANH: SO_EVAL_LANES((float) tanh(a[j]));
+    case OP_SQRT: SO_EVAL_LANES(a[j] > 0.0f ? (float) sqrt(a[j]) : 0.0f);
+    case OP_SQRT_NOCHECK: SO_EVAL_LANES((float) sqrt(a[j]));
+    case OP_EXP: SO_EVAL_LANES((float) exp(a[j]));
+    case OP_LOG: SO_EVAL_LANES(a[j] <= 0.0f ? -128.0f : (float) log(a[j]));
+    case OP_LOG10: SO_EVAL_LANES(a[j] <= 0.0f ? -38.0f : (float) log10(a[j]));
+    case OP_CEIL: SO_EVAL_LANES((float) ceil(a[j]));
+    case OP_FLOOR: SO_EVAL_LANES((float) floor(a[j]));
+    case OP_FABS: SO_EVAL_LANES((float) fabs(a[j]));
+    case OP_POW:
+      SO_EVAL_LANES(a[j] == 0.0f ? 0.0f :
+                    (a[j] > 0.0f ? (float) pow(a[j], b[j]) :
+                     (float) pow(a[j], floor(b[j] + 0.5))));
+    case OP_SELECT: SO_EVAL_LANES(a[j] != 0.0f ? b[j] : c[j]);
+    case OP_NORMALIZE: SO_EVAL_LANES(b[j] > 0.0f ? a[j] / b[j] : 0.0f);
+    default:
+      assert(0 && "unknown op code");
+      break;
+    }
+  }
+}
+
+#undef SO_EVAL_LANES
+
 
 void
 so_eval_delete(so_eval_node *node)
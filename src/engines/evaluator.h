@@ -59,6 +59,14 @@
  * value to some function, it will be clamped or the result will
  * be set to some (hopefully) useful value.
  *                                              pederb, 20000307
+ *
+ * The trees can also be compiled into a register based program with
+ * so_eval_compile(). A program evaluates the expressions for many
+ * field indices at once: each register holds one value for each
+ * index in a batch ("lane"), and each instruction loops over all
+ * the lanes. The input, temporary and output fields of SoCalculator
+ * map to fixed registers (see SO_EVAL_REG_*), vectors to three
+ * consecutive registers.
  */
 #ifdef __cplusplus
 extern "C" {
@@ -108,6 +116,29 @@ extern "C" {
   so_eval_node *so_eval_create_reg_comp(const char *regname, int index);
   so_eval_node *so_eval_create_flt_val(float val);
 
+  /* the compiled program */
+  typedef struct so_eval_program so_eval_program;
+
+  /* compile the expression trees into a program. Returns NULL if the
+     expressions can't be compiled (if they use rand(), as the random
+     numbers would be drawn in a different order) */
+  so_eval_program *so_eval_compile(so_eval_node *const *nodes, int numnodes);
+
+  /* free memory used by program */
+  void so_eval_program_delete(so_eval_program *program);
+
+  /* returns the number of lanes evaluated in one batch. This is 1 if
+     a temporary register is read before it is written, as the value
+     is then carried over from the previous field index */
+  int so_eval_program_get_num_lanes(const so_eval_program *program);
+
+  /* returns the lane values of register 'reg' */
+  float *so_eval_program_get_register(so_eval_program *program, int reg);
+
+  /* evaluates the first 'numlanes' lanes. The output registers are
+     set to zero first */
+  void so_eval_program_run(so_eval_program *program, int numlanes);
+
 
 /* node ids */
 enum {
@@ -168,6 +199,17 @@ enum {
   ID_DIV_VEC_FLT
 };
 
+/* fixed registers of the SoCalculator fields in a compiled program */
+enum {
+  SO_EVAL_REG_IN_FLT = 0,   /* a-h */
+  SO_EVAL_REG_IN_VEC = 8,   /* A-H */
+  SO_EVAL_REG_TMP_FLT = 32, /* ta-th */
+  SO_EVAL_REG_TMP_VEC = 40, /* tA-tH */
+  SO_EVAL_REG_OUT_FLT = 64, /* oa-od */
+  SO_EVAL_REG_OUT_VEC = 68, /* oA-oD */
+  SO_EVAL_NUM_NAMED_REGS = 80
+};
+
 /* lexical tokens */
 /* do not uncomment. Bison will define these
 enum {
@@ -109,6 +109,9 @@ SoMFShort::getNumValuesPerLine(void) const
 
 #ifdef COIN_TEST_SUITE
 
+#include <Inventor/SoInput.h>
+#include <Inventor/SoOutput.h>
+
 BOOST_AUTO_TEST_CASE(initialized)
 {
   SoMFShort field;
@@ -117,4 +120,47 @@ BOOST_AUTO_TEST_CASE(initialized)
   BOOST_CHECK_EQUAL(field.getNum(), 0);
 }
 
+static void *
+binaryinput_realloc(void * ptr, size_t size)
+{
+  return realloc(ptr, size);
+}
+
+BOOST_AUTO_TEST_CASE(binaryinput)
+{
+  // more values than are converted to and from 32-bit words at a time
+  SoMFShort field;
+  const int num = 3000;
+  field.setNum(num);
+  short * values = field.startEditing();
+  for (int i = 0; i < num; i++) values[i] = (short) ((i * 37) % 65536 - 32768);
+  field.finishEditing();
+
+  SoOutput out;
+  out.setBinary(TRUE);
+  out.setBuffer(malloc(1024), 1024, binaryinput_realloc);
+  out.setStage(SoOutput::WRITE);
+  field.write(&out, "field");
+  void * buffer;
+  size_t size;
+  out.getBuffer(buffer, size);
+
+  // each value is stored as a 32-bit big-endian word
+  const unsigned char * last =
+    static_cast<unsigned char *>(buffer) + size - 2 * sizeof(int32_t);
+  const int32_t lastvalue = values[num-1];
+  BOOST_CHECK_EQUAL(last[0], (lastvalue >> 24) & 0xff);
+  BOOST_CHECK_EQUAL(last[3], lastvalue & 0xff);
+
+  SoInput in;
+  in.setBuffer(buffer, size);
+  SbName name;
+  SoMFShort readfield;
+  BOOST_CHECK(in.read(name, TRUE));
+  BOOST_CHECK(name == "field");
+  BOOST_CHECK(readfield.read(&in, name));
+  BOOST_CHECK(readfield == field);
+  free(buffer);
+}
+
 #endif // COIN_TEST_SUITE
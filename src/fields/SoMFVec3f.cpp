@@ -170,6 +170,11 @@ SoMFVec3f::setValue(const float xyz[3])
 
 #ifdef COIN_TEST_SUITE
 
+#include <Inventor/SbString.h>
+#include <Inventor/SoInput.h>
+#include <Inventor/SoOutput.h>
+#include <Inventor/fields/SoSFVec3f.h>
+
 BOOST_AUTO_TEST_CASE(initialized)
 {
   SoMFVec3f field;
@@ -178,4 +183,126 @@ BOOST_AUTO_TEST_CASE(initialized)
   BOOST_CHECK_EQUAL(field.getNum(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(textinput)
+{
+  SbBool ok;
+  SoMFVec3f field;
+  ok = field.set("[1 2 3, 4 5 6,]");
+  BOOST_CHECK_EQUAL(ok, TRUE);
+  BOOST_CHECK_EQUAL(field.getNum(), 2);
+  BOOST_CHECK(field[1] == SbVec3f(4, 5, 6));
+  ok = field.set("[1 2 3 # comment ] with bracket\n 4 5 6]");
+  BOOST_CHECK_EQUAL(ok, TRUE);
+  BOOST_CHECK_EQUAL(field.getNum(), 2);
+  // not separated by whitespace, handled by the value-by-value reader
+  ok = field.set("[1-2 3]");
+  BOOST_CHECK_EQUAL(ok, TRUE);
+  BOOST_CHECK_EQUAL(field.getNum(), 1);
+  BOOST_CHECK(field[0] == SbVec3f(1, -2, 3));
+
+  TestSuite::ResetReadErrorCount();
+  static const char * expected[] = { "Coin read error", NULL };
+  TestSuite::PushMessageSuppressFilters(expected);
+  ok = field.set("[1 2 3, 4 5]");
+  BOOST_CHECK_EQUAL(ok, FALSE);
+  ok = field.set("[1, 2 3]");
+  BOOST_CHECK_EQUAL(ok, FALSE);
+  TestSuite::PopMessageSuppressFilters();
+  TestSuite::ResetReadErrorCount();
+}
+
+BOOST_AUTO_TEST_CASE(largetextinput)
+{
+  // big enough to be split into several independently decoded chunks
+  const int num = 20000;
+  SbString str("[");
+  for (int i = 0; i < num; i++) {
+    SbString v;
+    v.sprintf("%d.%d -%de-2 .%03d%s", i, i % 7, i % 13, i % 1000,
+              (i % 3) ? ",\n" : " ");
+    str += v;
+  }
+  str += "]";
+
+  SoMFVec3f field;
+  SbBool ok = field.set(str.getString());
+  BOOST_CHECK_EQUAL(ok, TRUE);
+  BOOST_REQUIRE_EQUAL(field.getNum(), num);
+
+  // must be bit-identical with values read one at a time
+  for (int i = 0; i < num; i += 997) {
+    SbString v;
+    v.sprintf("%d.%d -%de-2 .%03d", i, i % 7, i % 13, i % 1000);
+    SoSFVec3f single;
+    single.set(v.getString());
+    BOOST_CHECK(field[i] == single.getValue());
+  }
+}
+
+static void *
+binaryinput_realloc(void * ptr, size_t size)
+{
+  return realloc(ptr, size);
+}
+
+BOOST_AUTO_TEST_CASE(binaryinput)
+{
+  SoMFVec3f field;
+  const int num = 5000;
+  field.setNum(num);
+  SbVec3f * values = field.startEditing();
+  for (int i = 0; i < num; i++) {
+    values[i].setValue(i * 0.5f, -i * 1.25f, i * 1.0e-3f);
+  }
+  field.finishEditing();
+
+  SoOutput out;
+  out.setBinary(TRUE);
+  out.setBuffer(malloc(1024), 1024, binaryinput_realloc);
+  out.setStage(SoOutput::WRITE);
+  field.write(&out, "field");
+  void * buffer;
+  size_t size;
+  out.getBuffer(buffer, size);
+
+  SoInput in;
+  in.setBuffer(buffer, size);
+  SbName name;
+  SoMFVec3f readfield;
+  BOOST_CHECK(in.read(name, TRUE));
+  BOOST_CHECK(readfield.read(&in, name));
+  BOOST_CHECK(readfield == field);
+  free(buffer);
+}
+
+BOOST_AUTO_TEST_CASE(plaintextinput)
+{
+  // only numbers and whitespace, to exercise the block scanner, with
+  // the odd integer part too long for exact integer accumulation
+  const int num = 30000;
+  SbString str("[");
+  for (int i = 0; i < num; i++) {
+    SbString v;
+    v.sprintf("%s%d.%d\t-%d %dE+1%s",
+              (i % 101) ? "" : "1234567890123456", i, i % 9, i % 17,
+              i % 5, (i % 4) ? " " : "\r\n");
+    str += v;
+  }
+  str += "]";
+
+  SoMFVec3f field;
+  SbBool ok = field.set(str.getString());
+  BOOST_CHECK_EQUAL(ok, TRUE);
+  BOOST_REQUIRE_EQUAL(field.getNum(), num);
+
+  for (int i = 0; i < num; i += 50) {
+    SbString v;
+    v.sprintf("%s%d.%d -%d %dE+1",
+              (i % 101) ? "" : "1234567890123456", i, i % 9, i % 17, i % 5);
+    SoSFVec3f single;
+    single.set(v.getString());
+    BOOST_CHECK(field[i] == single.getValue());
+  }
+}
+
 #endif // COIN_TEST_SUITE
@@ -252,7 +252,36 @@
 #include <Inventor/errors/SoDebugError.h>
 #include <Inventor/errors/SoReadError.h>
 #include <Inventor/fields/SoSubField.h>
-
+#include <Inventor/fields/SoMFColor.h>
+#include <Inventor/fields/SoMFDouble.h>
+#include <Inventor/fields/SoMFFloat.h>
+#include <Inventor/fields/SoMFInt32.h>
+#include <Inventor/fields/SoMFMatrix.h>
+#include <Inventor/fields/SoMFShort.h>
+#include <Inventor/fields/SoMFUInt32.h>
+#include <Inventor/fields/SoMFUShort.h>
+#include <Inventor/fields/SoMFVec2b.h>
+#include <Inventor/fields/SoMFVec2d.h>
+#include <Inventor/fields/SoMFVec2f.h>
+#include <Inventor/fields/SoMFVec2i32.h>
+#include <Inventor/fields/SoMFVec2s.h>
+#include <Inventor/fields/SoMFVec3b.h>
+#include <Inventor/fields/SoMFVec3d.h>
+#include <Inventor/fields/SoMFVec3f.h>
+#include <Inventor/fields/SoMFVec3i32.h>
+#include <Inventor/fields/SoMFVec3s.h>
+#include <Inventor/fields/SoMFVec4b.h>
+#include <Inventor/fields/SoMFVec4d.h>
+#include <Inventor/fields/SoMFVec4f.h>
+#include <Inventor/fields/SoMFVec4i32.h>
+#include <Inventor/fields/SoMFVec4s.h>
+#include <Inventor/fields/SoMFVec4ub.h>
+#include <Inventor/fields/SoMFVec4ui32.h>
+#include <Inventor/fields/SoMFVec4us.h>
+#include <Inventor/sensors/SoFieldSensor.h>
+
+#include "io/SoInputP.h"
+#include "io/SoInput_Reader.h"
 #include "threads/threadsutilp.h"
 #include "tidbitsp.h"
 #include "coindefs.h" // COIN_WORKAROUND_*
@@ -298,6 +327,288 @@ somfield_mutex_cleanup(void)
   CC_MUTEX_DESTRUCT(somfield_mutex);
 }
 
+// Finds the layout of fields which store packed arrays of plain
+// numbers, and which read each value with the plain SoInput::read()
+// methods. Such fields can be imported through the bulk ASCII
+// number array reader in SoInputP. Only exact type matches count, as
+// subclasses may override read1Value().
+static SbBool
+somfield_get_number_layout(const SoType & type, const int valuesize,
+                           SoInputP::NumberType & numbertype,
+                           int & numcomponents)
+{
+#define SOMFIELD_NUMBER_LAYOUT(_class_, _numbertype_, _scalar_, _num_) \
+  if (type == _class_::getClassTypeId()) { \
+    numbertype = SoInputP::_numbertype_; \
+    numcomponents = _num_; \
+    return valuesize == (int) (sizeof(_scalar_) * _num_); \
+  }
+
+  SOMFIELD_NUMBER_LAYOUT(SoMFFloat, NUMBER_FLOAT, float, 1);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec2f, NUMBER_FLOAT, float, 2);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec3f, NUMBER_FLOAT, float, 3);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec4f, NUMBER_FLOAT, float, 4);
+  SOMFIELD_NUMBER_LAYOUT(SoMFColor, NUMBER_FLOAT, float, 3);
+  SOMFIELD_NUMBER_LAYOUT(SoMFMatrix, NUMBER_FLOAT, float, 16);
+  SOMFIELD_NUMBER_LAYOUT(SoMFDouble, NUMBER_DOUBLE, double, 1);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec2d, NUMBER_DOUBLE, double, 2);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec3d, NUMBER_DOUBLE, double, 3);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec4d, NUMBER_DOUBLE, double, 4);
+  SOMFIELD_NUMBER_LAYOUT(SoMFInt32, NUMBER_INT32, int32_t, 1);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec2i32, NUMBER_INT32, int32_t, 2);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec3i32, NUMBER_INT32, int32_t, 3);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec4i32, NUMBER_INT32, int32_t, 4);
+  SOMFIELD_NUMBER_LAYOUT(SoMFUInt32, NUMBER_UINT32, uint32_t, 1);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec4ui32, NUMBER_UINT32, uint32_t, 4);
+  SOMFIELD_NUMBER_LAYOUT(SoMFShort, NUMBER_INT16, int16_t, 1);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec2s, NUMBER_INT16, int16_t, 2);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec3s, NUMBER_INT16, int16_t, 3);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec4s, NUMBER_INT16, int16_t, 4);
+  SOMFIELD_NUMBER_LAYOUT(SoMFUShort, NUMBER_UINT16, uint16_t, 1);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec4us, NUMBER_UINT16, uint16_t, 4);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec2b, NUMBER_INT8, int8_t, 2);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec3b, NUMBER_INT8, int8_t, 3);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec4b, NUMBER_INT8, int8_t, 4);
+  SOMFIELD_NUMBER_LAYOUT(SoMFVec4ub, NUMBER_UINT8, uint8_t, 4);
+
+#undef SOMFIELD_NUMBER_LAYOUT
+  return FALSE;
+}
+
+// Number of values converted at a time when narrowing to or from the
+// 32-bit words used for all integer types in binary files.
+static const int SOMFIELD_BINARY_BLOCK = 1024;
+
+// Number of bytes passed to SoInput and SoOutput at a time for raw
+// arrays, as their length arguments are ints.
+static const size_t SOMFIELD_BINARY_CHUNK = 1 << 30;
+
+// Reads \a num numbers of the given type in one go, instead of
+// calling SoInput::read() once for each of them. The values end up
+// the same, including the replacement of invalid floating point
+// numbers.
+static SbBool
+somfield_read_binary_numbers(SoInput * in, void * values,
+                             const SoInputP::NumberType numbertype,
+                             const int num)
+{
+  switch (numbertype) {
+  case SoInputP::NUMBER_FLOAT:
+    {
+      float * f = static_cast<float *>(values);
+      if (!in->readBinaryArray(f, num)) return FALSE;
+      for (int i = 0; i < num; i++) {
+        if (!coin_finite((double) f[i])) {
+          SoReadError::post(in,
+                            "Detected non-valid floating point number, "
+                            "replacing with 0.0f");
+          f[i] = 0.0f;
+        }
+      }
+    }
+    return TRUE;
+  case SoInputP::NUMBER_DOUBLE:
+    {
+      double * d = static_cast<double *>(values);
+      if (!in->readBinaryArray(d, num)) return FALSE;
+      for (int i = 0; i < num; i++) {
+        if (!coin_finite(d[i])) {
+          SoReadError::post(in,
+                            "Detected non-valid floating point number, "
+                            "replacing with 0.0");
+          d[i] = 0.0;
+        }
+      }
+    }
+    return TRUE;
+  case SoInputP::NUMBER_INT32:
+  case SoInputP::NUMBER_UINT32:
+    return in->readBinaryArray(static_cast<int32_t *>(values), num);
+  default:
+    break;
+  }
+
+  int32_t block[SOMFIELD_BINARY_BLOCK];
+  for (int start = 0; start < num; start += SOMFIELD_BINARY_BLOCK) {
+    const int n = SbMin(num - start, SOMFIELD_BINARY_BLOCK);
+    if (!in->readBinaryArray(block, n)) return FALSE;
+    int i;
+    switch (numbertype) {
+    case SoInputP::NUMBER_INT16:
+      for (i = 0; i < n; i++) {
+        static_cast<int16_t *>(values)[start+i] = (int16_t) block[i];
+      }
+      break;
+    case SoInputP::NUMBER_UINT16:
+      for (i = 0; i < n; i++) {
+        static_cast<uint16_t *>(values)[start+i] = (uint16_t) block[i];
+      }
+      break;
+    case SoInputP::NUMBER_INT8:
+      for (i = 0; i < n; i++) {
+        static_cast<int8_t *>(values)[start+i] = (int8_t) block[i];
+      }
+      break;
+    case SoInputP::NUMBER_UINT8:
+      for (i = 0; i < n; i++) {
+        static_cast<uint8_t *>(values)[start+i] = (uint8_t) block[i];
+      }
+      break;
+    default:
+      assert(0 && "unknown number type");
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// Writes \a num numbers of the given type in one go, with the same
+// output as calling SoOutput::write() once for each of them.
+static void
+somfield_write_binary_numbers(SoOutput * out, const void * values,
+                              const SoInputP::NumberType numbertype,
+                              const int num)
+{
+  switch (numbertype) {
+  case SoInputP::NUMBER_FLOAT:
+    out->writeBinaryArray(static_cast<const float *>(values), num);
+    return;
+  case SoInputP::NUMBER_DOUBLE:
+    out->writeBinaryArray(static_cast<const double *>(values), num);
+    return;
+  case SoInputP::NUMBER_INT32:
+  case SoInputP::NUMBER_UINT32:
+    out->writeBinaryArray(static_cast<const int32_t *>(values), num);
+    return;
+  default:
+    break;
+  }
+
+  int32_t block[SOMFIELD_BINARY_BLOCK];
+  for (int start = 0; start < num; start += SOMFIELD_BINARY_BLOCK) {
+    const int n = SbMin(num - start, SOMFIELD_BINARY_BLOCK);
+    int i;
+    switch (numbertype) {
+    case SoInputP::NUMBER_INT16:
+      for (i = 0; i < n; i++) {
+        block[i] = static_cast<const int16_t *>(values)[start+i];
+      }
+      break;
+    case SoInputP::NUMBER_UINT16:
+      for (i = 0; i < n; i++) {
+        block[i] = static_cast<const uint16_t *>(values)[start+i];
+      }
+      break;
+    case SoInputP::NUMBER_INT8:
+      for (i = 0; i < n; i++) {
+        block[i] = static_cast<const int8_t *>(values)[start+i];
+      }
+      break;
+    case SoInputP::NUMBER_UINT8:
+      for (i = 0; i < n; i++) {
+        block[i] = static_cast<const uint8_t *>(values)[start+i];
+      }
+      break;
+    default:
+      assert(0 && "unknown number type");
+      return;
+    }
+    out->writeBinaryArray(block, n);
+  }
+}
+
+// Snapshot files store the number arrays of multi-value fields just
+// as they are laid out in memory, in the byte order of the host which
+// wrote them. Each array is preceded by padding to align it in the
+// file, so it can be used straight from a mapping of the file. See
+// SoWriteAction::setSnapshot().
+static const size_t SOMFIELD_SNAPSHOT_ALIGNMENT = 16;
+
+// Smaller arrays are copied, as there is little to gain from using
+// them in place.
+static const size_t SOMFIELD_SNAPSHOT_MIN_MAPPED = 4096;
+
+class SoOutputP;
+extern SbBool SoOutput_isSnapshot(const SoOutputP * pout);
+
+static int
+somfield_get_number_size(const SoInputP::NumberType numbertype)
+{
+  switch (numbertype) {
+  case SoInputP::NUMBER_DOUBLE: return sizeof(double);
+  case SoInputP::NUMBER_FLOAT: return sizeof(float);
+  case SoInputP::NUMBER_INT32: return sizeof(int32_t);
+  case SoInputP::NUMBER_UINT32: return sizeof(uint32_t);
+  case SoInputP::NUMBER_INT16: return sizeof(int16_t);
+  case SoInputP::NUMBER_UINT16: return sizeof(uint16_t);
+  default: return 1;
+  }
+}
+
+// Writes the array, which will start at position \a pos in the file
+// if no padding is needed.
+static void
+somfield_write_snapshot_numbers(SoOutput * out, const size_t pos,
+                                const void * values, const size_t length)
+{
+  static const unsigned char zeros[SOMFIELD_SNAPSHOT_ALIGNMENT] = { 0 };
+
+  const size_t padding =
+    (SOMFIELD_SNAPSHOT_ALIGNMENT - (pos % SOMFIELD_SNAPSHOT_ALIGNMENT)) %
+    SOMFIELD_SNAPSHOT_ALIGNMENT;
+  out->write((int32_t) (padding / sizeof(int32_t)));
+  if (padding) out->writeBinaryArray(zeros, (int) padding);
+
+  const unsigned char * bytes = static_cast<const unsigned char *>(values);
+  for (size_t start = 0; start < length; start += SOMFIELD_BINARY_CHUNK) {
+    const size_t n = SbMin(length - start, SOMFIELD_BINARY_CHUNK);
+    out->writeBinaryArray(bytes + start, (int) n);
+  }
+  // keep the stream aligned to 32-bit words
+  if (length % 4) out->writeBinaryArray(zeros, (int) (4 - (length % 4)));
+}
+
+static void
+somfield_swap_numbers(void * values, const size_t num, const int size)
+{
+  unsigned char * p = static_cast<unsigned char *>(values);
+  for (size_t i = 0; i < num; i++, p += size) {
+    for (int j = 0; j < size / 2; j++) {
+      const unsigned char tmp = p[j];
+      p[j] = p[size - 1 - j];
+      p[size - 1 - j] = tmp;
+    }
+  }
+}
+
+// Keeps the file mapping a field uses in place alive for as long as
+// the field exists.
+class SoMField_MappingSensor : public SoFieldSensor {
+public:
+  SoMField_MappingSensor(SoField * field, SoInput_FileMapping * mappingarg)
+  {
+    this->mapping = mappingarg;
+    this->attach(field);
+  }
+
+  // Only the death of the field is of interest, not its changes.
+  virtual void notify(SoNotList * COIN_UNUSED_ARG(l)) { }
+
+  virtual void dyingReference(void)
+  {
+    this->detach();
+    delete this;
+  }
+
+private:
+  virtual ~SoMField_MappingSensor()
+  {
+    this->mapping->unref();
+  }
+
+  SoInput_FileMapping * mapping;
+};
+
 // *************************************************************************
 
 
@@ -499,8 +810,21 @@ SoMField::readValue(SoInput * in)
     }
 #endif // disabled
 
-    this->makeRoom(numtoread);
-    if (!this->readBinaryValues(in, numtoread)) { return FALSE; }
+    SoInputP::NumberType numbertype;
+    int numcomponents;
+    SbBool swapped;
+    if ((numtoread > 0) && SoInputP::isSnapshot(in, swapped) &&
+        somfield_get_number_layout(this->getTypeId(), this->fieldSizeof(),
+                                   numbertype, numcomponents)) {
+      if (!this->readSnapshotValues(in, numtoread,
+                                    somfield_get_number_size(numbertype))) {
+        return FALSE;
+      }
+    }
+    else {
+      this->makeRoom(numtoread);
+      if (!this->readBinaryValues(in, numtoread)) { return FALSE; }
+    }
   }
 
   // ** ASCII format *******************************************************
@@ -518,6 +842,26 @@ SoMField::readValue(SoInput * in)
       else {
         in->putBack(c);
 
+        // Try the bulk reader first, which decodes large arrays of
+        // plain numbers in parallel. It leaves the stream untouched
+        // if it fails, and we then fall back on reading value by
+        // value below, which also handles error reporting.
+        SoInputP::NumberType numbertype;
+        int numcomponents;
+        if (somfield_get_number_layout(this->getTypeId(), this->fieldSizeof(),
+                                       numbertype, numcomponents)) {
+          SoInputP::NumberArray array;
+          if (SoInputP::readNumberArray(in, numcomponents, array)) {
+            const int numvalues = array.numtokens / numcomponents;
+            this->makeRoom(numvalues);
+            if (SoInputP::parseNumberArray(in, array, numbertype,
+                                           this->valuesPtr())) {
+              this->valueChanged();
+              return TRUE;
+            }
+          }
+        }
+
         while (TRUE) {
           // makeRoom() makes sure the allocation strategy is decent.
           if (currentidx >= this->num) this->makeRoom(currentidx + 1);
@@ -610,6 +954,17 @@ SoMField::readBinaryValues(SoInput * in, int numarg)
   assert(in->isBinary());
   assert(numarg >= 0);
 
+  // Arrays of plain numbers are read in bulk.
+  SoInputP::NumberType numbertype;
+  int numcomponents;
+  if ((numarg > 0) &&
+      somfield_get_number_layout(this->getTypeId(), this->fieldSizeof(),
+                                 numbertype, numcomponents)) {
+    assert(numarg <= this->num);
+    return somfield_read_binary_numbers(in, this->valuesPtr(), numbertype,
+                                        numarg * numcomponents);
+  }
+
   for (int i=0; i < numarg; i++) if (!this->read1Value(in, i)) return FALSE;
   return TRUE;
 }
@@ -624,9 +979,84 @@ SoMField::writeBinaryValues(SoOutput * out) const
 
   const int count = this->getNum();
   out->write(count);
+
+  SoInputP::NumberType numbertype;
+  int numcomponents;
+  if ((count > 0) &&
+      somfield_get_number_layout(this->getTypeId(), this->fieldSizeof(),
+                                 numbertype, numcomponents)) {
+    if (SoOutput_isSnapshot(out->pimpl)) {
+      // the array follows the padding count
+      somfield_write_snapshot_numbers(out, out->bytesInBuf() + sizeof(int32_t),
+                                      const_cast<SoMField *>(this)->valuesPtr(),
+                                      size_t(count) * size_t(this->fieldSizeof()));
+      return;
+    }
+    somfield_write_binary_numbers(out,
+                                  const_cast<SoMField *>(this)->valuesPtr(),
+                                  numbertype, count * numcomponents);
+    return;
+  }
+
   for (int i=0; i < count; i++) this->write1Value(out, i);
 }
 
+// Reads a number array from a snapshot file, after its number of
+// values. Large arrays in mapped files of the host's byte order are
+// used in place, like with setValuesPointer(). The mapping is private,
+// so pages are copied on write, and it is kept alive until the field
+// dies. Unlike regular binary import, values are taken as written,
+// without replacing invalid floating point numbers.
+SbBool
+SoMField::readSnapshotValues(SoInput * in, int numarg, int numbersize)
+{
+  int32_t padwords;
+  if (!in->read(padwords) || (padwords < 0) ||
+      (size_t(padwords) >= SOMFIELD_SNAPSHOT_ALIGNMENT / sizeof(int32_t))) {
+    SoReadError::post(in, "Invalid number array in snapshot file");
+    return FALSE;
+  }
+  for (int32_t i = 0; i < padwords; i++) {
+    int32_t pad;
+    if (!in->read(pad)) return FALSE;
+  }
+
+  const size_t length = size_t(numarg) * size_t(this->fieldSizeof());
+  const size_t padded = (length + 3) & ~size_t(3);
+  SbBool swapped;
+  (void) SoInputP::isSnapshot(in, swapped);
+
+  if (!swapped && (length >= SOMFIELD_SNAPSHOT_MIN_MAPPED)) {
+    char * data;
+    SoInput_FileMapping * mapping =
+      SoInputP::mapSnapshotBytes(in, padded, numbersize, data);
+    if (mapping) {
+      this->allocValues(0);
+      this->setValuesPtr(data);
+      this->num = this->maxNum = numarg;
+      this->userDataIsUsed = TRUE;
+      // deletes itself, and releases the mapping, with the field
+      (void) new SoMField_MappingSensor(this, mapping);
+      return TRUE;
+    }
+  }
+
+  this->makeRoom(numarg);
+  unsigned char * bytes = static_cast<unsigned char *>(this->valuesPtr());
+  for (size_t start = 0; start < length; start += SOMFIELD_BINARY_CHUNK) {
+    const size_t n = SbMin(length - start, SOMFIELD_BINARY_CHUNK);
+    if (!in->readBinaryArray(bytes + start, (int) n)) return FALSE;
+  }
+  if (padded > length) {
+    unsigned char pad[4];
+    if (!in->readBinaryArray(pad, (int) (padded - length))) return FALSE;
+  }
+  if (swapped) {
+    somfield_swap_numbers(bytes, length / numbersize, numbersize);
+  }
+  return TRUE;
+}
+
 // Number of values written to each line during export to ASCII format
 // files. Override this in subclasses for prettier formating.
 int
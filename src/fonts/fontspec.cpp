@@ -36,6 +36,12 @@
 
 #include "glue/freetype.h"
 
+static uint32_t
+fontspec_namehash(const cc_font_specification * spec)
+{
+  return cc_string_hash(&spec->name) * 31 + cc_string_hash(&spec->style);
+}
+
 void
 cc_fontspec_construct(cc_font_specification * spec,
                       const char * name_style, float size, float complexity)
@@ -65,6 +71,7 @@ cc_fontspec_construct(cc_font_specification * spec,
       }
     }
 
+    spec->namehash = fontspec_namehash(spec);
     return;
   }
 
@@ -114,6 +121,7 @@ cc_fontspec_construct(cc_font_specification * spec,
     }
 
   }
+  spec->namehash = fontspec_namehash(spec);
 }
 
 void
@@ -127,6 +135,7 @@ cc_fontspec_copy(const cc_font_specification * from,
   cc_string_set_string(&to->name, &from->name);
   cc_string_construct(&to->style);
   cc_string_set_string(&to->style, &from->style);
+  to->namehash = from->namehash;
 }
 
 void
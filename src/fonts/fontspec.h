@@ -58,6 +58,8 @@ extern "C" {
                        underlying font API? (I.e. FreeType or Win32.)
                        20050519 mortene. */
 
+    uint32_t namehash; /* hash of name and style, for the glyph caches */
+
   } cc_font_specification;
 
   void cc_fontspec_construct(cc_font_specification * spec,
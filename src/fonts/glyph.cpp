@@ -40,10 +40,11 @@
 #include "glyph.h"
 
 #include <cassert>
-
-#include <Inventor/C/base/list.h>
+#include <cstdlib>
+#include <cstring>
 
 #include "fontlib_wrapper.h"
+#include "threads/threadsutilp.h"
 #include "coindefs.h"
 
 #ifndef COIN_WORKAROUND_NO_USING_STD_FUNCS
@@ -52,39 +53,272 @@ using namespace std;
 
 /* ********************************************************************** */
 
-void 
-cc_glyph_unref(cc_dict * dict, cc_glyph * glyph, cc_glyph_finalize * f)
+/*
+  The glyph cache is a hash table keyed on the character, a hash of
+  the font specification and the angle. It is split into shards with
+  one mutex each, selected by the top bits of the hash value, so that
+  threads rendering text rarely wait for each other, and a whole
+  string of characters can be looked up while locking each shard
+  only once.
+
+  The font specification hash must only depend on the fields
+  compared by the specmatch function, since glyphs are only compared
+  with the ones having the same hash value.
+
+  Releasing a glyph which is still referenced elsewhere only
+  decrements its reference count with an atomic compare-and-swap.
+  The shard is locked just for the last reference, so the count only
+  drops to zero while the glyph can not be found by a lookup.
+*/
+
+#define GLYPHCACHE_SHARDBITS 4
+#define GLYPHCACHE_NUMSHARDS (1 << GLYPHCACHE_SHARDBITS)
+
+#if defined(__GNUC__)
+#define GLYPHCACHE_HAVE_ATOMICS
+#define GLYPHCACHE_ATOMIC_ADD(_ptr_, _val_) __sync_add_and_fetch((_ptr_), (_val_))
+#define GLYPHCACHE_ATOMIC_CAS(_ptr_, _old_, _new_) \
+  __sync_bool_compare_and_swap((_ptr_), (_old_), (_new_))
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define GLYPHCACHE_HAVE_ATOMICS
+#define GLYPHCACHE_ATOMIC_ADD(_ptr_, _val_) \
+  (_InterlockedExchangeAdd((volatile long *)(_ptr_), (_val_)) + (_val_))
+#define GLYPHCACHE_ATOMIC_CAS(_ptr_, _old_, _new_) \
+  (_InterlockedCompareExchange((volatile long *)(_ptr_), (_new_), (_old_)) == (_old_))
+#else
+/* only used with the shard locked when there are no atomics */
+#define GLYPHCACHE_ATOMIC_ADD(_ptr_, _val_) (*(_ptr_) += (_val_))
+#endif
+
+struct cc_glyphcache_shard {
+  void * mutex;
+  cc_glyph ** buckets;
+  unsigned int numbuckets; /* always a power of two */
+  unsigned int numglyphs;
+};
+
+struct cc_glyphcache {
+  struct cc_glyphcache_shard shards[GLYPHCACHE_NUMSHARDS];
+  cc_glyph_specmatch * match;
+  cc_glyph_create * create;
+  cc_glyph_finalize * finalize;
+};
+
+static uint32_t
+glyphcache_hash(uint32_t character, uint32_t spechash, float angle)
+{
+  uint32_t anglebits = 0;
+  /* 0 and -0 must give the same hash value */
+  if (angle != 0.0f) { (void)memcpy(&anglebits, &angle, sizeof(anglebits)); }
+
+  uint32_t h = spechash ^ (character * 0x9e3779b1u) ^ (anglebits * 0x85ebca6bu);
+  /* finalizer from MurmurHash3, to spread the bits to the shard index */
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+static struct cc_glyphcache_shard *
+glyphcache_get_shard(cc_glyphcache * cache, uint32_t hash)
+{
+  return &cache->shards[hash >> (32 - GLYPHCACHE_SHARDBITS)];
+}
+
+static void
+glyphcache_grow(struct cc_glyphcache_shard * shard)
+{
+  unsigned int i;
+  const unsigned int numbuckets = shard->numbuckets * 2;
+  cc_glyph ** buckets = (cc_glyph **) calloc(numbuckets, sizeof(cc_glyph *));
+  assert(buckets);
+
+  for (i = 0; i < shard->numbuckets; i++) {
+    cc_glyph * glyph = shard->buckets[i];
+    while (glyph) {
+      cc_glyph * next = glyph->next;
+      const unsigned int idx = glyph->hash & (numbuckets - 1);
+      glyph->next = buckets[idx];
+      buckets[idx] = glyph;
+      glyph = next;
+    }
+  }
+  free(shard->buckets);
+  shard->buckets = buckets;
+  shard->numbuckets = numbuckets;
+}
+
+/* Must be called with the shard locked. */
+static cc_glyph *
+glyphcache_ref_glyph(cc_glyphcache * cache, struct cc_glyphcache_shard * shard,
+                     uint32_t hash, uint32_t character,
+                     const cc_font_specification * spec, float angle)
+{
+  unsigned int idx = hash & (shard->numbuckets - 1);
+  cc_glyph * glyph;
+
+  for (glyph = shard->buckets[idx]; glyph; glyph = glyph->next) {
+    if ((glyph->hash == hash) && (glyph->character == character) &&
+        (glyph->angle == angle) && cache->match(spec, glyph->fontspec)) {
+      (void)GLYPHCACHE_ATOMIC_ADD(&glyph->refcount, 1);
+      return glyph;
+    }
+  }
+
+  /* Should _always_ be able to get hold of a glyph -- if no glyph is
+     available for a specific character, a default empty rectangle
+     should be used.  -mortene. */
+  glyph = cache->create(character, spec, angle);
+  assert(glyph);
+  glyph->refcount = 1;
+  glyph->hash = hash;
+  glyph->angle = angle;
+
+  if (shard->numglyphs >= shard->numbuckets) {
+    glyphcache_grow(shard);
+    idx = hash & (shard->numbuckets - 1);
+  }
+  glyph->next = shard->buckets[idx];
+  shard->buckets[idx] = glyph;
+  shard->numglyphs++;
+  return glyph;
+}
+
+cc_glyphcache *
+cc_glyphcache_construct(cc_glyph_specmatch * match,
+                        cc_glyph_create * create,
+                        cc_glyph_finalize * finalize)
 {
-  cc_list * glyphlist;
-  int ret;
-  void * tmp;
   int i;
+  cc_glyphcache * cache = (cc_glyphcache *) malloc(sizeof(cc_glyphcache));
+  assert(cache);
+  cache->match = match;
+  cache->create = create;
+  cache->finalize = finalize;
 
-  glyph->refcount--;
+  for (i = 0; i < GLYPHCACHE_NUMSHARDS; i++) {
+    struct cc_glyphcache_shard * shard = &cache->shards[i];
+    shard->mutex = NULL;
+    CC_MUTEX_CONSTRUCT(shard->mutex);
+    shard->numbuckets = 16;
+    shard->numglyphs = 0;
+    shard->buckets = (cc_glyph **) calloc(shard->numbuckets, sizeof(cc_glyph *));
+    assert(shard->buckets);
+  }
+  return cache;
+}
 
-  assert(glyph->refcount >= 0);
-  if (glyph->refcount > 0) { return; }
+/*
+  Glyphs still in use are not deleted, as they may still be
+  referenced by someone.
+*/
+void
+cc_glyphcache_destruct(cc_glyphcache * cache)
+{
+  int i;
+  for (i = 0; i < GLYPHCACHE_NUMSHARDS; i++) {
+    CC_MUTEX_DESTRUCT(cache->shards[i].mutex);
+    free(cache->shards[i].buckets);
+  }
+  free(cache);
+}
 
-  /* external finalizing: */
-  if (f) { (*f)(glyph); }
+/*
+  Looks up, or creates, the glyphs for num characters, and returns
+  them with their reference count increased.
 
-  /* handling of common data: */
+  The lookups are grouped on shards, so that each shard is locked
+  only once, which makes it cheap to fetch the glyphs for a whole
+  string at a time.
+*/
+void
+cc_glyphcache_ref(cc_glyphcache * cache,
+                  const uint32_t * characters, int num,
+                  const cc_font_specification * spec,
+                  uint32_t spechash, float angle,
+                  cc_glyph ** glyphs)
+{
+  uint32_t stackhashes[64];
+  uint32_t * hashes = stackhashes;
+  unsigned int touched = 0;
+  int i, s;
+
+  if (num <= 0) { return; }
+  if (num == 1) {
+    const uint32_t hash = glyphcache_hash(characters[0], spechash, angle);
+    struct cc_glyphcache_shard * shard = glyphcache_get_shard(cache, hash);
+    CC_MUTEX_LOCK(shard->mutex);
+    glyphs[0] = glyphcache_ref_glyph(cache, shard, hash, characters[0], spec, angle);
+    CC_MUTEX_UNLOCK(shard->mutex);
+    return;
+  }
+  if (num > 64) {
+    hashes = (uint32_t *) malloc(num * sizeof(uint32_t));
+    assert(hashes);
+  }
 
-  ret = cc_dict_get(dict, (uintptr_t)glyph->character, &tmp);
-  assert(ret);
-  glyphlist = (cc_list *)tmp;
-    
-  for (i = 0; i < cc_list_get_length(glyphlist); i++) {
-    if (glyph == (cc_glyph *)cc_list_get(glyphlist, i)) break;
-  }    
-  assert(i < cc_list_get_length(glyphlist));
-
-  cc_list_remove_fast(glyphlist, i);
-  if (cc_list_get_length(glyphlist) == 0) {
-    (void)cc_dict_remove(dict, (uintptr_t)glyph->character);
-    cc_list_destruct(glyphlist);
+  for (i = 0; i < num; i++) {
+    hashes[i] = glyphcache_hash(characters[i], spechash, angle);
+    touched |= 1u << (hashes[i] >> (32 - GLYPHCACHE_SHARDBITS));
   }
 
+  for (s = 0; s < GLYPHCACHE_NUMSHARDS; s++) {
+    struct cc_glyphcache_shard * shard = &cache->shards[s];
+    if (!(touched & (1u << s))) { continue; }
+
+    CC_MUTEX_LOCK(shard->mutex);
+    for (i = 0; i < num; i++) {
+      if ((int)(hashes[i] >> (32 - GLYPHCACHE_SHARDBITS)) == s) {
+        glyphs[i] = glyphcache_ref_glyph(cache, shard, hashes[i],
+                                         characters[i], spec, angle);
+      }
+    }
+    CC_MUTEX_UNLOCK(shard->mutex);
+  }
+
+  if (hashes != stackhashes) { free(hashes); }
+}
+
+void 
+cc_glyphcache_unref(cc_glyphcache * cache, cc_glyph * glyph)
+{
+  struct cc_glyphcache_shard * shard = glyphcache_get_shard(cache, glyph->hash);
+  cc_glyph ** ptr;
+  int refcount;
+
+#ifdef GLYPHCACHE_HAVE_ATOMICS
+  /* no need for the shard lock unless this may be the last reference */
+  for (refcount = *(volatile int *)&glyph->refcount; refcount > 1;
+       refcount = *(volatile int *)&glyph->refcount) {
+    if (GLYPHCACHE_ATOMIC_CAS(&glyph->refcount, refcount, refcount - 1)) { return; }
+  }
+#endif /* GLYPHCACHE_HAVE_ATOMICS */
+
+  CC_MUTEX_LOCK(shard->mutex);
+  /* a lookup may have referenced the glyph again before we got the lock */
+  refcount = GLYPHCACHE_ATOMIC_ADD(&glyph->refcount, -1);
+  assert(refcount >= 0);
+  if (refcount > 0) {
+    CC_MUTEX_UNLOCK(shard->mutex);
+    return;
+  }
+
+  ptr = &shard->buckets[glyph->hash & (shard->numbuckets - 1)];
+  while (*ptr != glyph) {
+    assert(*ptr);
+    ptr = &(*ptr)->next;
+  }
+  *ptr = glyph->next;
+  shard->numglyphs--;
+  CC_MUTEX_UNLOCK(shard->mutex);
+
+  /* external finalizing: */
+  if (cache->finalize) { (*cache->finalize)(glyph); }
+
+  /* handling of common data: */
   cc_fontspec_clean(glyph->fontspec);
   free(glyph->fontspec);
 
@@ -94,4 +328,166 @@ cc_glyph_unref(cc_dict * dict, cc_glyph * glyph, cc_glyph_finalize * f)
   free(glyph);
 }
 
+#undef GLYPHCACHE_SHARDBITS
+#undef GLYPHCACHE_NUMSHARDS
+#undef GLYPHCACHE_ATOMIC_ADD
+#ifdef GLYPHCACHE_HAVE_ATOMICS
+#undef GLYPHCACHE_ATOMIC_CAS
+#undef GLYPHCACHE_HAVE_ATOMICS
+#endif /* GLYPHCACHE_HAVE_ATOMICS */
+
 /* ********************************************************************** */
+
+#ifdef COIN_TEST_SUITE
+#ifdef COIN_TEST_INTERNALS
+
+#include "fonts/glyph.h"
+#include "fonts/fontlib_wrapper.h"
+#include "threads/parallelp.h"
+
+/* Glyphs from the default font, which is used when no font library
+   is available, counting the glyphs made and finalized. */
+
+static int glyph_test_created = 0;
+static int glyph_test_finalized = 0;
+
+static SbBool
+glyph_test_specmatch(const cc_font_specification * spec1,
+                     const cc_font_specification * spec2)
+{
+  return !cc_string_compare(&spec1->name, &spec2->name) &&
+    (int(spec1->size) == int(spec2->size));
+}
+
+static cc_glyph *
+glyph_test_create(uint32_t character, const cc_font_specification * spec, float angle)
+{
+  cc_glyph * glyph = (cc_glyph *) malloc(sizeof(cc_glyph));
+  glyph->character = character;
+  glyph->fontspec = (cc_font_specification *) malloc(sizeof(cc_font_specification));
+  cc_fontspec_copy(spec, glyph->fontspec);
+  glyph->fontidx = cc_flw_get_font_id(cc_string_get_text(&spec->name),
+                                      (unsigned int)(spec->size), angle, -1.0f);
+  cc_flw_ref_font(glyph->fontidx);
+  glyph->glyphidx = cc_flw_get_glyph(glyph->fontidx, character);
+  glyph_test_created++;
+  return glyph;
+}
+
+static void
+glyph_test_finalize(cc_glyph *)
+{
+  glyph_test_finalized++;
+}
+
+BOOST_AUTO_TEST_CASE(refString)
+{
+  cc_font_specification spec;
+  cc_fontspec_construct(&spec, "defaultFont", 12.0f, 0.0f);
+  const uint32_t spechash = spec.namehash * 31 + 12;
+  cc_glyphcache * cache =
+    cc_glyphcache_construct(glyph_test_specmatch, glyph_test_create, glyph_test_finalize);
+  glyph_test_created = glyph_test_finalized = 0;
+
+  // longer than 64 characters, so the hash values are malloc'ed
+  const int num = 100;
+  uint32_t characters[num];
+  cc_glyph * glyphs[num];
+  int i;
+  for (i = 0; i < num; i++) { characters[i] = 'a' + (i % 26); }
+  cc_glyphcache_ref(cache, characters, num, &spec, spechash, 0.0f, glyphs);
+
+  BOOST_CHECK_EQUAL(glyph_test_created, 26);
+  int wrong = 0;
+  for (i = 0; i < num; i++) {
+    if (glyphs[i]->character != characters[i]) wrong++;
+    if ((i >= 26) && (glyphs[i] != glyphs[i - 26])) wrong++;
+    if ((i > 0) && (i % 26 != 0) && (glyphs[i] == glyphs[i - 1])) wrong++;
+  }
+  BOOST_CHECK_MESSAGE(wrong == 0, "repeated characters must give the same glyph");
+  // 'a' is at 0, 26, 52 and 78, 'z' at 25, 51 and 77
+  BOOST_CHECK_EQUAL(glyphs[0]->refcount, 4);
+  BOOST_CHECK_EQUAL(glyphs[25]->refcount, 3);
+
+  // looking up a single character finds the same glyph
+  cc_glyph * a = NULL;
+  cc_glyphcache_ref(cache, &characters[0], 1, &spec, spechash, 0.0f, &a);
+  BOOST_CHECK(a == glyphs[0]);
+  BOOST_CHECK_EQUAL(a->refcount, 5);
+
+  // -0 is the same angle as 0, but other angles give new glyphs
+  cc_glyph * rotated[2];
+  cc_glyphcache_ref(cache, &characters[0], 1, &spec, spechash, -0.0f, &rotated[0]);
+  cc_glyphcache_ref(cache, &characters[0], 1, &spec, spechash, 1.0f, &rotated[1]);
+  BOOST_CHECK(rotated[0] == a);
+  BOOST_CHECK(rotated[1] != a);
+  BOOST_CHECK_EQUAL(glyph_test_created, 27);
+  cc_glyphcache_unref(cache, rotated[0]);
+  cc_glyphcache_unref(cache, rotated[1]);
+  BOOST_CHECK_EQUAL(glyph_test_finalized, 1);
+
+  for (i = 0; i < num; i++) { cc_glyphcache_unref(cache, glyphs[i]); }
+  BOOST_CHECK_EQUAL(a->refcount, 1);
+  BOOST_CHECK_EQUAL(glyph_test_finalized, 26);
+
+  cc_glyphcache_unref(cache, a);
+  BOOST_CHECK_EQUAL(glyph_test_finalized, 27);
+
+  cc_glyphcache_destruct(cache);
+  cc_fontspec_clean(&spec);
+}
+
+struct glyph_test_parallel_data {
+  cc_glyphcache * cache;
+  const cc_font_specification * spec;
+  uint32_t spechash;
+  const uint32_t * characters;
+  int num;
+};
+
+static void
+glyph_test_parallel_job(void * closure, int)
+{
+  glyph_test_parallel_data * data = (glyph_test_parallel_data *) closure;
+  cc_glyph * glyphs[26];
+  int i, j;
+  for (i = 0; i < 1000; i++) {
+    cc_glyphcache_ref(data->cache, data->characters, data->num,
+                      data->spec, data->spechash, 0.0f, glyphs);
+    for (j = 0; j < data->num; j++) { cc_glyphcache_unref(data->cache, glyphs[j]); }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(refParallel)
+{
+  cc_font_specification spec;
+  cc_fontspec_construct(&spec, "defaultFont", 12.0f, 0.0f);
+  cc_glyphcache * cache =
+    cc_glyphcache_construct(glyph_test_specmatch, glyph_test_create, glyph_test_finalize);
+  glyph_test_created = glyph_test_finalized = 0;
+
+  uint32_t characters[26];
+  cc_glyph * held[26];
+  int i;
+  for (i = 0; i < 26; i++) { characters[i] = 'a' + i; }
+  // holding a reference keeps the jobs from creating or finalizing glyphs
+  cc_glyphcache_ref(cache, characters, 26, &spec, spec.namehash, 0.0f, held);
+
+  glyph_test_parallel_data data = { cache, &spec, spec.namehash, characters, 26 };
+  cc_parallel_run(16, glyph_test_parallel_job, &data);
+
+  int wrong = 0;
+  for (i = 0; i < 26; i++) { if (held[i]->refcount != 1) wrong++; }
+  BOOST_CHECK_MESSAGE(wrong == 0, "concurrent ref and unref must balance");
+  BOOST_CHECK_EQUAL(glyph_test_created, 26);
+  BOOST_CHECK_EQUAL(glyph_test_finalized, 0);
+
+  for (i = 0; i < 26; i++) { cc_glyphcache_unref(cache, held[i]); }
+  BOOST_CHECK_EQUAL(glyph_test_finalized, 26);
+
+  cc_glyphcache_destruct(cache);
+  cc_fontspec_clean(&spec);
+}
+
+#endif // COIN_TEST_INTERNALS
+#endif // COIN_TEST_SUITE
@@ -46,7 +46,6 @@
 
 /* ********************************************************************** */
 
-#include "base/dict.h"
 #include "fonts/fontspec.h"
 
 /* ********************************************************************** */
@@ -67,6 +66,11 @@ struct cc_glyph {
 
   int fontidx;    
   cc_font_specification * fontspec;
+
+  /* lookup data for the glyph cache */
+  uint32_t hash;
+  float angle;
+  struct cc_glyph * next;
 };
 
 typedef struct cc_glyph cc_glyph;
@@ -74,8 +78,25 @@ typedef struct cc_glyph cc_glyph;
 /* ********************************************************************** */
 
 typedef void cc_glyph_finalize(cc_glyph *);
-
-void cc_glyph_unref(cc_dict * d, cc_glyph * g, cc_glyph_finalize * f);
+typedef SbBool cc_glyph_specmatch(const cc_font_specification * spec1,
+                                  const cc_font_specification * spec2);
+typedef cc_glyph * cc_glyph_create(uint32_t character,
+                                   const cc_font_specification * spec,
+                                   float angle);
+
+typedef struct cc_glyphcache cc_glyphcache;
+
+cc_glyphcache * cc_glyphcache_construct(cc_glyph_specmatch * match,
+                                        cc_glyph_create * create,
+                                        cc_glyph_finalize * finalize);
+void cc_glyphcache_destruct(cc_glyphcache * cache);
+
+void cc_glyphcache_ref(cc_glyphcache * cache,
+                       const uint32_t * characters, int num,
+                       const cc_font_specification * spec,
+                       uint32_t spechash, float angle,
+                       cc_glyph ** glyphs);
+void cc_glyphcache_unref(cc_glyphcache * cache, cc_glyph * glyph);
 
 /* ********************************************************************** */
 
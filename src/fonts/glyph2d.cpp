@@ -38,7 +38,6 @@
 
 #include <Inventor/C/base/string.h>
 
-#include "base/dict.h"
 #include "threads/threadsutilp.h"
 #include "tidbitsp.h"
 #include "fonts/glyph2d.h"
@@ -66,104 +65,31 @@ struct cc_glyph2d {
   SbBool mono;
 };
 
-static cc_dict * glyph2d_fonthash = NULL;
-static SbBool glyph2d_initialized = FALSE;
+static cc_glyphcache * glyph2d_cache = NULL;
 
 /*
-  Mutex lock for the static ang global font hash
+  Mutex lock for the initialization of the static and global glyph
+  cache
 */
-static void * glyph2d_fonthash_lock = NULL;
-
-/* Set '#if 1' to enable debug output to stderr for tracking mutex locking. */
-#if 0
-#define GLYPH2D_MUTEX_LOCK(m) \
-  do { \
-    (void)fprintf(stderr, "glyph2d mutex lock in %s\n", __func__); \
-    CC_MUTEX_LOCK(m); \
-  } while (0)
-#define GLYPH2D_MUTEX_UNLOCK(m) \
-  do { \
-    (void)fprintf(stderr, "glyph2d mutex unlock in %s\n", __func__); \
-    CC_MUTEX_UNLOCK(m); \
-  } while (0)
-#else
-#define GLYPH2D_MUTEX_LOCK(m) CC_MUTEX_LOCK(m)
-#define GLYPH2D_MUTEX_UNLOCK(m) CC_MUTEX_UNLOCK(m)
-#endif
+static void * glyph2d_initlock = NULL;
 
 static void
 cc_glyph2d_cleanup(void)
 {
-  CC_MUTEX_DESTRUCT(glyph2d_fonthash_lock);
-  cc_dict_destruct(glyph2d_fonthash);
-  glyph2d_fonthash = NULL;
-  glyph2d_initialized = FALSE;
+  CC_MUTEX_DESTRUCT(glyph2d_initlock);
+  cc_glyphcache_destruct(glyph2d_cache);
+  glyph2d_cache = NULL;
 }
 
-static void
-cc_glyph2d_initialize()
+static cc_glyph *
+glyph2d_create(uint32_t character, const cc_font_specification * spec, float angle)
 {
-  CC_MUTEX_CONSTRUCT(glyph2d_fonthash_lock);
-  GLYPH2D_MUTEX_LOCK(glyph2d_fonthash_lock);
-  
-  if (glyph2d_initialized) {
-    GLYPH2D_MUTEX_UNLOCK(glyph2d_fonthash_lock);
-    return;
-  }
-  glyph2d_initialized = TRUE;
-  
-  glyph2d_fonthash = cc_dict_construct(15, 0.75);
-
-  /* +1, so it happens before the underlying font abstraction layer
-     cleans itself up: */
-  coin_atexit((coin_atexit_f*) cc_glyph2d_cleanup, CC_ATEXIT_FONT_SUBSYSTEM_HIGHPRIORITY);
-  
-  GLYPH2D_MUTEX_UNLOCK(glyph2d_fonthash_lock);
-}
-
-cc_glyph2d * 
-cc_glyph2d_ref(uint32_t character, const cc_font_specification * spec, float angle)
-{
-  void * val;
   cc_glyph2d * glyph;
   int fontidx;
   int glyphidx;
-  int i;
   struct cc_font_bitmap * bm;
   cc_font_specification * newspec;
   cc_string * fonttoload;
-  cc_list * glyphlist;
-
-
-  /* because this function is the entry point for glyph2d, the mutex
-     is initialized here. */
-  if (glyph2d_fonthash_lock == NULL) 
-    cc_glyph2d_initialize();
-  
-  assert(spec);
-
-  GLYPH2D_MUTEX_LOCK(glyph2d_fonthash_lock);
-
-  /* Has the glyph been created before? */
-  if (cc_dict_get(glyph2d_fonthash, (uintptr_t)character, &val)) {
-    glyphlist = (cc_list *) val;
-    for (i = 0; i < cc_list_get_length(glyphlist); ++i) {
-      glyph = (cc_glyph2d *) cc_list_get(glyphlist, i);
-      if (glyph2d_specmatch(spec, glyph->c.fontspec)) {
-        GLYPH2D_MUTEX_UNLOCK(glyph2d_fonthash_lock);
-        glyph->c.refcount++;
-        return glyph;
-      }
-    }    
-  } 
-  else {
-    /* No glyphlist for this character is found. Create one and
-       add it to the hashtable. */
-    glyphlist = cc_list_construct();
-    cc_dict_put(glyph2d_fonthash, (uintptr_t)character, glyphlist);
-  }
-
-  assert(glyphlist);
 
   /* build a new glyph struct with bitmap */    
   glyph = (cc_glyph2d *) malloc(sizeof(cc_glyph2d));
@@ -228,19 +154,86 @@ cc_glyph2d_ref(uint32_t character, const cc_font_specification * spec, float ang
   glyph->bitmapoffsety = bm->bearingY;
   glyph->bitmap = bm->buffer;
   glyph->mono = bm->mono;
-  glyph->c.refcount = 1;
+
+  return &glyph->c;
+}
+
+static void
+cc_glyph2d_initialize()
+{
+  CC_MUTEX_CONSTRUCT(glyph2d_initlock);
+  CC_MUTEX_LOCK(glyph2d_initlock);
   
-  /* Store newly created glyph in the list for this character */
-  cc_list_append(glyphlist, glyph);
+  if (glyph2d_cache == NULL) {
+    glyph2d_cache = cc_glyphcache_construct(glyph2d_specmatch, glyph2d_create, NULL);
+
+    /* +1, so it happens before the underlying font abstraction layer
+       cleans itself up: */
+    coin_atexit((coin_atexit_f*) cc_glyph2d_cleanup, CC_ATEXIT_FONT_SUBSYSTEM_HIGHPRIORITY);
+  }
+
+  CC_MUTEX_UNLOCK(glyph2d_initlock);
+}
+
+/* Hash value for the fields compared by glyph2d_specmatch(). */
+static uint32_t
+glyph2d_spechash(const cc_font_specification * spec)
+{
+  return spec->namehash * 31 + (uint32_t)(int(spec->size));
+}
+
+cc_glyph2d * 
+cc_glyph2d_ref(uint32_t character, const cc_font_specification * spec, float angle)
+{
+  cc_glyph * glyph;
+
+  /* because this function is the entry point for glyph2d, the cache
+     is initialized here. */
+  if (glyph2d_cache == NULL) 
+    cc_glyph2d_initialize();
   
-  GLYPH2D_MUTEX_UNLOCK(glyph2d_fonthash_lock);
-  return glyph;
+  assert(spec);
+
+  cc_glyphcache_ref(glyph2d_cache, &character, 1, spec,
+                    glyph2d_spechash(spec), angle, &glyph);
+  return (cc_glyph2d *) glyph;
+}
+
+/*
+  Fetches the glyphs for num characters in one go, hashing the font
+  specification only once. The glyphs must be unref'ed one by one.
+*/
+void
+cc_glyph2d_ref_string(const uint32_t * characters, int num,
+                      const cc_font_specification * spec, float angle,
+                      cc_glyph2d ** glyphs)
+{
+  cc_glyph * stackglyphs[64];
+  cc_glyph ** tmpglyphs = stackglyphs;
+  int i;
+
+  if (glyph2d_cache == NULL) 
+    cc_glyph2d_initialize();
+  
+  assert(spec);
+  if (num <= 0) return;
+
+  if (num > 64) {
+    tmpglyphs = (cc_glyph **) malloc(num * sizeof(cc_glyph *));
+    assert(tmpglyphs);
+  }
+  cc_glyphcache_ref(glyph2d_cache, characters, num, spec,
+                    glyph2d_spechash(spec), angle, tmpglyphs);
+  for (i = 0; i < num; i++) {
+    glyphs[i] = (cc_glyph2d *) tmpglyphs[i];
+  }
+  if (tmpglyphs != stackglyphs) free(tmpglyphs);
 }
 
 void
 cc_glyph2d_unref(cc_glyph2d * glyph)
 {
-  cc_glyph_unref(glyph2d_fonthash, &(glyph->c), NULL);
+  cc_glyphcache_unref(glyph2d_cache, &(glyph->c));
 }
 
 static SbBool 
@@ -294,6 +287,3 @@ cc_glyph2d_getmono(const cc_glyph2d * g)
 {
   return g->mono;
 }
-
-#undef GLYPH2D_MUTEX_LOCK
-#undef GLYPH2D_MUTEX_UNLOCK
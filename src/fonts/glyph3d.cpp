@@ -42,7 +42,6 @@
 #include <Inventor/C/base/string.h>
 
 #include "tidbitsp.h"
-#include "base/dict.h"
 #include "threads/threadsutilp.h"
 #include "fonts/fontlib_wrapper.h"
 #include "fonts/glyph.h"
@@ -57,6 +56,7 @@ using namespace std;
 
 static SbBool glyph3d_specmatch(const cc_font_specification * spec1, 
                                 const cc_font_specification * spec2);
+static uint32_t glyph3d_spechash(const cc_font_specification * spec);
 static void glyph3d_calcboundingbox(cc_glyph3d * g);
 
 struct cc_glyph3d {
@@ -70,13 +70,13 @@ struct cc_glyph3d {
 
 /* ********************************************************************** */
 
-static cc_dict * glyph3d_fonthash = NULL;
+static cc_glyphcache * glyph3d_cache = NULL;
 static int glyph3d_spaceglyphindices[] = { -1, -1 };
 static float glyph3d_spaceglyphvertices[] = { 0, 0 };
-static SbBool glyph3d_initialized = FALSE;
 
-/* Mutex lock for the static ang global font hash */
-static void * glyph3d_fonthash_lock = NULL;
+/* Mutex lock for the initialization of the static and global glyph
+   cache */
+static void * glyph3d_initlock = NULL;
 
 /* Because the 3D glyphs are normalized when generated, a standard
    fontsize is used for all glyphs. This also prevent Windows from
@@ -87,100 +87,30 @@ static unsigned int glyph3d_standardfontsize = 50;
 
 /* ********************************************************************** */
 
-/* Set '#if 1' to enable debug info to stderr when tracking mutex locking. */
-#if 0
-#define GLYPH3D_MUTEX_LOCK(m) \
-  do { \
-    (void)fprintf(stderr, "glyph3d mutex lock in %s\n", __func__); \
-    CC_MUTEX_LOCK(m); \
-  } while (0)
-#define GLYPH3D_MUTEX_UNLOCK(m) \
-  do { \
-    (void)fprintf(stderr, "glyph3d mutex unlock in %s\n", __func__); \
-    CC_MUTEX_UNLOCK(m); \
-  } while (0)
-#else
-#define GLYPH3D_MUTEX_LOCK(m) CC_MUTEX_LOCK(m)
-#define GLYPH3D_MUTEX_UNLOCK(m) CC_MUTEX_UNLOCK(m)
-#endif
+static void finalize_glyph3d(cc_glyph * g);
 
 static void
 cc_glyph3d_cleanup(void)
 {
-  CC_MUTEX_DESTRUCT(glyph3d_fonthash_lock);
-  cc_dict_destruct(glyph3d_fonthash);
-  glyph3d_fonthash = NULL;
-  glyph3d_initialized = FALSE;
+  CC_MUTEX_DESTRUCT(glyph3d_initlock);
+  cc_glyphcache_destruct(glyph3d_cache);
+  glyph3d_cache = NULL;
 }
 
-static void
-cc_glyph3d_initialize()
-{
-  CC_MUTEX_CONSTRUCT(glyph3d_fonthash_lock);
-  GLYPH3D_MUTEX_LOCK(glyph3d_fonthash_lock);
-  
-  if (glyph3d_initialized) {
-    GLYPH3D_MUTEX_UNLOCK(glyph3d_fonthash_lock);
-    return;
-  }
-  glyph3d_initialized = TRUE;
-  
-  glyph3d_fonthash = cc_dict_construct(15, 0.75);
-
-  /* +1, so it happens before the underlying font abstraction layer
-     cleans itself up: */
-  coin_atexit((coin_atexit_f*) cc_glyph3d_cleanup, CC_ATEXIT_FONT_SUBSYSTEM_HIGHPRIORITY);
-
-  GLYPH3D_MUTEX_UNLOCK(glyph3d_fonthash_lock);  
-}
-
-cc_glyph3d *
-cc_glyph3d_ref(uint32_t character, const cc_font_specification * spec)
+static cc_glyph *
+glyph3d_create(uint32_t character, const cc_font_specification * spec,
+               float COIN_UNUSED_ARG(angle))
 {
   cc_glyph3d * glyph;
   int glyphidx;
   int fontidx;
-  void * val;
   cc_font_specification * newspec;
   cc_string * fonttoload;
-  cc_list * glyphlist = NULL;
-
-  /* because this function is the entry point for glyph3d, the mutex
-     is initialized here. */
-  if (glyph3d_fonthash_lock == NULL) 
-    cc_glyph3d_initialize();
-  
-  assert(spec);
-
-  GLYPH3D_MUTEX_LOCK(glyph3d_fonthash_lock);
-
-  /* Has the glyph been created before? */
-  if (cc_dict_get(glyph3d_fonthash, (uintptr_t)character, &val)) {
-    int i;
-    glyphlist = (cc_list *) val;
-    for (i=0;i<cc_list_get_length(glyphlist);++i) {
-      glyph = (cc_glyph3d *) cc_list_get(glyphlist, i);
-      if (glyph3d_specmatch(spec, glyph->c.fontspec)) {
-        GLYPH3D_MUTEX_UNLOCK(glyph3d_fonthash_lock);
-        glyph->c.refcount++;
-        return glyph;
-      }
-    }    
-  } else {
-    /* No glyphlist for this character is found. Create one and
-       add it to the hashtable. */
-    glyphlist = cc_list_construct();
-    cc_dict_put(glyph3d_fonthash, (uintptr_t)character, glyphlist);
-  }
-
-  assert(glyphlist);
 
   /* build a new glyph struct */
   glyph = (cc_glyph3d *) malloc(sizeof(cc_glyph3d));
 
   glyph->c.character = character;
-  glyph->c.refcount = 1;
-
 
   newspec = (cc_font_specification *) malloc(sizeof(cc_font_specification));
   assert(newspec);
@@ -246,11 +176,73 @@ cc_glyph3d_ref(uint32_t character, const cc_font_specification * spec)
   glyph3d_calcboundingbox(glyph);
   glyph->width = glyph->bbox[2] - glyph->bbox[0];
 
-  /* Store newly created glyph in the list for this character */
-  cc_list_append(glyphlist, glyph);
+  return &glyph->c;
+}
+
+static void
+cc_glyph3d_initialize()
+{
+  CC_MUTEX_CONSTRUCT(glyph3d_initlock);
+  CC_MUTEX_LOCK(glyph3d_initlock);
+  
+  if (glyph3d_cache == NULL) {
+    glyph3d_cache = cc_glyphcache_construct(glyph3d_specmatch, glyph3d_create,
+                                            finalize_glyph3d);
+
+    /* +1, so it happens before the underlying font abstraction layer
+       cleans itself up: */
+    coin_atexit((coin_atexit_f*) cc_glyph3d_cleanup, CC_ATEXIT_FONT_SUBSYSTEM_HIGHPRIORITY);
+  }
 
-  GLYPH3D_MUTEX_UNLOCK(glyph3d_fonthash_lock);
-  return glyph;
+  CC_MUTEX_UNLOCK(glyph3d_initlock);
+}
+
+cc_glyph3d *
+cc_glyph3d_ref(uint32_t character, const cc_font_specification * spec)
+{
+  cc_glyph * glyph;
+
+  /* because this function is the entry point for glyph3d, the cache
+     is initialized here. */
+  if (glyph3d_cache == NULL) 
+    cc_glyph3d_initialize();
+  
+  assert(spec);
+
+  cc_glyphcache_ref(glyph3d_cache, &character, 1, spec,
+                    glyph3d_spechash(spec), 0.0f, &glyph);
+  return (cc_glyph3d *) glyph;
+}
+
+/*
+  Fetches the glyphs for num characters in one go, hashing the font
+  specification only once. The glyphs must be unref'ed one by one.
+*/
+void
+cc_glyph3d_ref_string(const uint32_t * characters, int num,
+                      const cc_font_specification * spec,
+                      cc_glyph3d ** glyphs)
+{
+  cc_glyph * stackglyphs[64];
+  cc_glyph ** tmpglyphs = stackglyphs;
+  int i;
+
+  if (glyph3d_cache == NULL) 
+    cc_glyph3d_initialize();
+  
+  assert(spec);
+  if (num <= 0) return;
+
+  if (num > 64) {
+    tmpglyphs = (cc_glyph **) malloc(num * sizeof(cc_glyph *));
+    assert(tmpglyphs);
+  }
+  cc_glyphcache_ref(glyph3d_cache, characters, num, spec,
+                    glyph3d_spechash(spec), 0.0f, tmpglyphs);
+  for (i = 0; i < num; i++) {
+    glyphs[i] = (cc_glyph3d *) tmpglyphs[i];
+  }
+  if (tmpglyphs != stackglyphs) free(tmpglyphs);
 }
 
 static void
@@ -263,7 +255,7 @@ finalize_glyph3d(cc_glyph * g)
 void 
 cc_glyph3d_unref(cc_glyph3d * glyph)
 {
-  cc_glyph_unref(glyph3d_fonthash, &(glyph->c), finalize_glyph3d);
+  cc_glyphcache_unref(glyph3d_cache, &(glyph->c));
 }
 
 const float *
@@ -406,30 +398,39 @@ cc_glyph3d_getkerning(const cc_glyph3d * left, const cc_glyph3d * right,
   cc_flw_get_vector_kerning(right->c.fontidx, left->c.glyphidx, right->c.glyphidx, x, y);
 }
 
+/* Reducing precision of the complexity variable. This is done to
+   prevent the user from flooding the memory with generated glyphs
+   which might be more or less identical */
+static int
+glyph3d_complexitylevel(const cc_font_specification * spec)
+{
+  float c = spec->complexity;
+
+  /* Clamp values to [0...1] */
+  if (c > 1.0f) c = 1.0f;
+  if (c < 0.0f) c = 0.0f;
+
+  return (int) (c * 10.0f);
+}
+
+/* Hash value for the fields compared by glyph3d_specmatch(). */
+static uint32_t
+glyph3d_spechash(const cc_font_specification * spec)
+{
+  return spec->namehash * 31 + (uint32_t) glyph3d_complexitylevel(spec);
+}
+
 static SbBool
 glyph3d_specmatch(const cc_font_specification * spec1,
                   const cc_font_specification * spec2)
 {
-  float c1, c2;
   int temp1,temp2;
   
   assert(spec1);
   assert(spec2);
   
-  /* Reducing precision of the complexity variable. This is done to
-     prevent the user from flooding the memory with generated glyphs
-     which might be more or less identical */
-  c1 = spec1->complexity;
-  c2 = spec2->complexity;
-  
-  /* Clamp values to [0...1] */
-  if (c1 > 1.0f) c1 = 1.0f;
-  if (c1 < 0.0f) c1 = 0.0f;
-  if (c2 > 1.0f) c2 = 1.0f;
-  if (c2 < 0.0f) c2 = 0.0f;
-  
-  temp1 = (int) (c1 * 10.0f);
-  temp2 = (int) (c2 * 10.0f);
+  temp1 = glyph3d_complexitylevel(spec1);
+  temp2 = glyph3d_complexitylevel(spec2);
   
   if ((!cc_string_compare(&spec1->name, &spec2->name)) &&
       (!cc_string_compare(&spec1->style, &spec2->style)) &&
@@ -440,6 +441,3 @@ glyph3d_specmatch(const cc_font_specification * spec1,
 
   return FALSE;
 }
-
-#undef GLYPH3D_MUTEX_LOCK
-#undef GLYPH3D_MUTEX_UNLOCK
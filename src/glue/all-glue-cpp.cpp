@@ -33,6 +33,7 @@
 #include "gl.cpp"
 #include "gl_wgl.cpp"
 #include "gl_glx.cpp"
+#include "gl_egl.cpp"
 #include "gl_agl.cpp"
 #include "gl_cgl.cpp"
 
@@ -247,6 +247,7 @@
 #include "glue/dlp.h"
 #include "glue/gl_agl.h"
 #include "glue/gl_cgl.h"
+#include "glue/gl_egl.h"
 #include "glue/gl_glx.h"
 #include "glue/gl_wgl.h"
 #include "threads/threadsutilp.h"
@@ -584,6 +585,9 @@ cc_glglue_getprocaddress(const cc_glglue * glue, const char * symname)
   ptr = coin_wgl_getprocaddress(glue, symname);
   if (ptr) goto returnpoint;
 
+  ptr = eglglue_getprocaddress(glue, symname);
+  if (ptr) goto returnpoint;
+
   ptr = glxglue_getprocaddress(glue, symname);
   if (ptr) goto returnpoint;
 
@@ -620,6 +624,7 @@ glglue_cleanup(void)
   }
   offscreen_cb = NULL;
 
+  eglglue_cleanup();
 #ifdef HAVE_GLX
   glxglue_cleanup();
 #elif defined(HAVE_WGL)
@@ -4383,6 +4388,8 @@ cc_glglue_context_create_offscreen(unsigned int width, unsigned int height)
 {
   if (offscreen_cb && offscreen_cb->create_offscreen) {
     return (*offscreen_cb->create_offscreen)(width, height);
+  } else if (eglglue_offscreen_enabled()) {
+    return eglglue_context_create_offscreen(width, height);
   } else {
 #ifdef HAVE_NOGL
   assert(FALSE && "unimplemented");
@@ -4411,6 +4418,8 @@ cc_glglue_context_make_current(void * ctx)
 {
   if (offscreen_cb && offscreen_cb->make_current) {
     return (*offscreen_cb->make_current)(ctx);
+  } else if (eglglue_offscreen_enabled()) {
+    return eglglue_context_make_current(ctx);
   } else {
 #ifdef HAVE_NOGL
   assert(FALSE && "unimplemented");
@@ -4450,6 +4459,8 @@ cc_glglue_context_reinstate_previous(void * ctx)
 
   if (offscreen_cb && offscreen_cb->reinstate_previous) {
     (*offscreen_cb->reinstate_previous)(ctx);
+  } else if (eglglue_offscreen_enabled()) {
+    eglglue_context_reinstate_previous(ctx);
   } else {
 #ifdef HAVE_NOGL
   assert(FALSE && "unimplemented");
@@ -4475,6 +4486,8 @@ cc_glglue_context_destruct(void * ctx)
 {
   if (offscreen_cb && offscreen_cb->destruct) {
     (*offscreen_cb->destruct)(ctx);
+  } else if (eglglue_offscreen_enabled()) {
+    eglglue_context_destruct(ctx);
   } else {
 #ifdef HAVE_NOGL
   assert(FALSE && "unimplemented");
@@ -4599,15 +4612,20 @@ cc_glglue_context_max_dimensions(unsigned int * width, unsigned int * height)
     /* query functions below should return TRUE if implemented, and
        the current offscreen buffer is a pbuffer: */
     SbBool ok = FALSE;
+    if (!offscreen_cb && eglglue_offscreen_enabled()) {
+      ok = eglglue_context_pbuffer_max(ctx, pbufmax);
+    }
+    else {
 #if defined(HAVE_WGL)
-    ok = wglglue_context_pbuffer_max(ctx, pbufmax);
+      ok = wglglue_context_pbuffer_max(ctx, pbufmax);
 #elif defined(HAVE_GLX)
-    ok = glxglue_context_pbuffer_max(ctx, pbufmax);
+      ok = glxglue_context_pbuffer_max(ctx, pbufmax);
 #elif defined(HAVE_AGL) || defined(HAVE_CGL)
-    /* FIXME: implement check on max pbuffer width, height and number
-       of pixels for AGL/CGL, if any such limits are imposed there.
-       20040713 mortene. */
+      /* FIXME: implement check on max pbuffer width, height and number
+         of pixels for AGL/CGL, if any such limits are imposed there.
+         20040713 mortene. */
 #endif
+    }
     if (ok) {
       int modulo = 0;
 
@@ -0,0 +1,407 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+/*
+  Offscreen contexts through EGL, for rendering without an X11
+  display.
+
+  Environment variable controls available:
+
+  - COIN_EGLGLUE_OFFSCREEN: set to 1 to always create offscreen
+    contexts through EGL, or to 0 to never use EGL for offscreen
+    contexts. The default is to use EGL if Coin was built without GLX,
+    or if the DISPLAY environment variable is not set.
+
+  - COIN_EGLGLUE_NO_SURFACELESS_PLATFORM: set to 1 to open the default
+    EGL display instead of Mesa's surfaceless platform display.
+
+  With Mesa, rendering is then done by the llvmpipe software
+  rasterizer (or by a GPU driver, if one is available through the
+  render nodes), and no X server (or Xvfb) is needed.
+
+  EGL keeps a current context per thread, so offscreen contexts can be
+  made current and rendered into from several threads concurrently.
+*/
+
+#include "glue/gl_egl.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+
+#include <Inventor/C/basic.h>
+#include <Inventor/C/errors/debugerror.h>
+#include <Inventor/C/tidbits.h>
+
+#include "glue/glp.h"
+#include "threads/threadsutilp.h"
+
+/* ********************************************************************** */
+
+#ifndef HAVE_EGL
+
+/* Dummy versions of the functions, when built without EGL: */
+
+SbBool eglglue_offscreen_enabled(void) { return FALSE; }
+
+void * eglglue_getprocaddress(const cc_glglue * glue, const char * fname) { return NULL; }
+
+void * eglglue_context_create_offscreen(unsigned int width, unsigned int height) { assert(FALSE); return NULL; }
+SbBool eglglue_context_make_current(void * ctx) { assert(FALSE); return FALSE; }
+void eglglue_context_reinstate_previous(void * ctx) { assert(FALSE); }
+void eglglue_context_destruct(void * ctx) { assert(FALSE); }
+
+SbBool eglglue_context_pbuffer_max(void * ctx, unsigned int * lims) { assert(FALSE); return FALSE; }
+
+void eglglue_cleanup(void) { }
+
+#else /* HAVE_EGL */
+
+/* ********************************************************************** */
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif /* !EGL_PLATFORM_SURFACELESS_MESA */
+
+typedef EGLDisplay (APIENTRY * COIN_PFNEGLGETPLATFORMDISPLAYEXT)(EGLenum platform, void * native_display, const EGLint * attrib_list);
+
+/* -1 means "not decided yet" */
+static int eglglue_enabled = -1;
+
+static EGLDisplay eglglue_display = EGL_NO_DISPLAY;
+static SbBool eglglue_initialize_failed = FALSE;
+
+struct eglglue_contextdata {
+  EGLConfig config;
+  EGLContext context;
+  EGLSurface surface;
+  unsigned int width, height;
+
+  EGLDisplay storeddisplay;
+  EGLSurface storeddraw;
+  EGLSurface storedread;
+  EGLContext storedcontext;
+};
+
+/* ********************************************************************** */
+
+SbBool
+eglglue_offscreen_enabled(void)
+{
+  if (eglglue_enabled == -1) {
+    const char * env = coin_getenv("COIN_EGLGLUE_OFFSCREEN");
+    if (env) {
+      eglglue_enabled = (atoi(env) > 0) ? 1 : 0;
+    }
+    else {
+#ifdef HAVE_GLX
+      const char * display = coin_getenv("DISPLAY");
+      eglglue_enabled = (display == NULL || display[0] == '\0') ? 1 : 0;
+#else /* !HAVE_GLX */
+      eglglue_enabled = 1;
+#endif /* !HAVE_GLX */
+    }
+
+    if (coin_glglue_debug()) {
+      cc_debugerror_postinfo("eglglue_offscreen_enabled",
+                             "offscreen contexts will %sbe made through EGL",
+                             eglglue_enabled ? "" : "NOT ");
+    }
+  }
+  return eglglue_enabled ? TRUE : FALSE;
+}
+
+/* Opens and initializes the EGL display shared by all offscreen
+   contexts. Mesa's surfaceless platform is preferred, as it works
+   without any window system. */
+static EGLDisplay
+eglglue_get_display(void)
+{
+  CC_SYNC_BEGIN(eglglue_get_display);
+
+  if ((eglglue_display == EGL_NO_DISPLAY) && !eglglue_initialize_failed) {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLint major, minor;
+
+    const char * clientext = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    const char * env = coin_getenv("COIN_EGLGLUE_NO_SURFACELESS_PLATFORM");
+    const SbBool trysurfaceless = (env == NULL || atoi(env) <= 0) &&
+      clientext && strstr(clientext, "EGL_MESA_platform_surfaceless");
+
+    if (trysurfaceless) {
+      COIN_PFNEGLGETPLATFORMDISPLAYEXT getplatformdisplay =
+        (COIN_PFNEGLGETPLATFORMDISPLAYEXT)eglGetProcAddress("eglGetPlatformDisplayEXT");
+      if (getplatformdisplay) {
+        display = getplatformdisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                     EGL_DEFAULT_DISPLAY, NULL);
+      }
+    }
+    if (display == EGL_NO_DISPLAY) {
+      display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    if (display != EGL_NO_DISPLAY && eglInitialize(display, &major, &minor)) {
+      eglglue_display = display;
+      if (coin_glglue_debug()) {
+        cc_debugerror_postinfo("eglglue_get_display",
+                               "initialized EGL %d.%d display %p (%s)",
+                               major, minor, display,
+                               eglQueryString(display, EGL_VENDOR));
+      }
+    }
+    else {
+      cc_debugerror_post("eglglue_get_display",
+                         "Couldn't initialize an EGL display "
+                         "(eglGetError()==0x%x).", eglGetError());
+      eglglue_initialize_failed = TRUE;
+    }
+  }
+
+  CC_SYNC_END(eglglue_get_display);
+  return eglglue_display;
+}
+
+void *
+eglglue_getprocaddress(const cc_glglue * glue, const char * fname)
+{
+  if (eglglue_display == EGL_NO_DISPLAY) { return NULL; }
+  if (eglGetCurrentContext() == EGL_NO_CONTEXT) { return NULL; }
+  /* eglGetProcAddress() may return a dispatch stub for any name, also
+     for functions which are unknown to the EGL implementation, so GLX
+     functions must be left to glxglue_getprocaddress(). */
+  if (strncmp(fname, "glX", 3) == 0) { return NULL; }
+  return (void *)eglGetProcAddress(fname);
+}
+
+/* ********************************************************************** */
+
+static void
+eglglue_contextdata_cleanup(struct eglglue_contextdata * ctx)
+{
+  if (ctx == NULL) { return; }
+
+  if (ctx->context != EGL_NO_CONTEXT) eglDestroyContext(eglglue_display, ctx->context);
+  if (ctx->surface != EGL_NO_SURFACE) eglDestroySurface(eglglue_display, ctx->surface);
+
+  free(ctx);
+}
+
+void *
+eglglue_context_create_offscreen(unsigned int width, unsigned int height)
+{
+  EGLint attrs[] = {
+    EGL_STENCIL_SIZE, 1, /* must be first, see below */
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE,   8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE,  8,
+    EGL_ALPHA_SIZE, 8,
+    EGL_DEPTH_SIZE, 24,
+    EGL_NONE
+  };
+  EGLint pbufferattrs[] = {
+    EGL_WIDTH, (EGLint)width,
+    EGL_HEIGHT, (EGLint)height,
+    EGL_NONE
+  };
+  EGLint numconfigs = 0;
+  struct eglglue_contextdata * ctx;
+
+  /* Same hack as for the GLX and WGL offscreen contexts. */
+  const int v = coin_glglue_stencil_bits_hack();
+  assert(attrs[0] == EGL_STENCIL_SIZE);
+  if (v != -1) { attrs[1] = v; }
+
+  EGLDisplay display = eglglue_get_display();
+  if (display == EGL_NO_DISPLAY) { return NULL; }
+
+  ctx = (struct eglglue_contextdata *)malloc(sizeof(struct eglglue_contextdata));
+  ctx->context = EGL_NO_CONTEXT;
+  ctx->surface = EGL_NO_SURFACE;
+  ctx->width = width;
+  ctx->height = height;
+  ctx->storeddisplay = EGL_NO_DISPLAY;
+  ctx->storeddraw = EGL_NO_SURFACE;
+  ctx->storedread = EGL_NO_SURFACE;
+  ctx->storedcontext = EGL_NO_CONTEXT;
+
+  if (!eglChooseConfig(display, attrs, &ctx->config, 1, &numconfigs) ||
+      (numconfigs == 0)) {
+    cc_debugerror_postwarning("eglglue_context_create_offscreen",
+                              "eglChooseConfig() gave no valid configs");
+    eglglue_contextdata_cleanup(ctx);
+    return NULL;
+  }
+
+  ctx->surface = eglCreatePbufferSurface(display, ctx->config, pbufferattrs);
+  if (ctx->surface == EGL_NO_SURFACE) {
+    cc_debugerror_postwarning("eglglue_context_create_offscreen",
+                              "eglCreatePbufferSurface(..., ..., %u, %u) "
+                              "failed (eglGetError()==0x%x)",
+                              width, height, eglGetError());
+    eglglue_contextdata_cleanup(ctx);
+    return NULL;
+  }
+
+  /* The client API is a per-thread setting in EGL, so it must be set
+     before each context creation and make-current call. */
+  eglBindAPI(EGL_OPENGL_API);
+  ctx->context = eglCreateContext(display, ctx->config, EGL_NO_CONTEXT, NULL);
+  if (ctx->context == EGL_NO_CONTEXT) {
+    cc_debugerror_postwarning("eglglue_context_create_offscreen",
+                              "Couldn't create EGL context "
+                              "(eglGetError()==0x%x).", eglGetError());
+    eglglue_contextdata_cleanup(ctx);
+    return NULL;
+  }
+
+  if (coin_glglue_debug()) {
+    cc_debugerror_postinfo("eglglue_context_create_offscreen",
+                           "made new pbuffer offscreen context == %p",
+                           ctx->context);
+  }
+
+  return ctx;
+}
+
+SbBool
+eglglue_context_make_current(void * ctx)
+{
+  struct eglglue_contextdata * context = (struct eglglue_contextdata *)ctx;
+
+  /* Only a context made current through EGL can be stored and
+     restored here, as EGL has no knowledge of e.g. GLX contexts. */
+  eglBindAPI(EGL_OPENGL_API);
+  context->storedcontext = eglGetCurrentContext();
+  if (context->storedcontext != EGL_NO_CONTEXT) {
+    context->storeddisplay = eglGetCurrentDisplay();
+    context->storeddraw = eglGetCurrentSurface(EGL_DRAW);
+    context->storedread = eglGetCurrentSurface(EGL_READ);
+  }
+
+  EGLBoolean r = eglMakeCurrent(eglglue_display, context->surface,
+                                context->surface, context->context);
+
+  if (coin_glglue_debug()) {
+    cc_debugerror_postinfo("eglglue_context_make_current",
+                           "%s context %p current",
+                           r ? "successfully made" : "failed to make",
+                           context->context);
+  }
+
+  return r ? TRUE : FALSE;
+}
+
+void
+eglglue_context_reinstate_previous(void * ctx)
+{
+  struct eglglue_contextdata * context = (struct eglglue_contextdata *)ctx;
+
+  eglBindAPI(EGL_OPENGL_API);
+  (void)eglMakeCurrent(eglglue_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                       EGL_NO_CONTEXT); /* release */
+
+  /* See the comment in glxglue_context_reinstate_previous() on why
+     the previous context is restored. */
+  if (context->storedcontext != EGL_NO_CONTEXT) {
+    if (coin_glglue_debug()) {
+      cc_debugerror_postinfo("eglglue_context_reinstate_previous",
+                             "restoring context %p to be current",
+                             context->storedcontext);
+    }
+    (void)eglMakeCurrent(context->storeddisplay, context->storeddraw,
+                         context->storedread, context->storedcontext);
+    context->storedcontext = EGL_NO_CONTEXT;
+  }
+}
+
+void
+eglglue_context_destruct(void * ctx)
+{
+  struct eglglue_contextdata * context = (struct eglglue_contextdata *)ctx;
+
+  if (coin_glglue_debug()) {
+    cc_debugerror_postinfo("eglglue_context_destruct",
+                           "destroy context %p", context->context);
+  }
+
+  eglglue_contextdata_cleanup(context);
+}
+
+/* ********************************************************************** */
+
+SbBool
+eglglue_context_pbuffer_max(void * ctx, unsigned int * lims)
+{
+  int i;
+  const EGLint attribs[] = {
+    EGL_MAX_PBUFFER_WIDTH, EGL_MAX_PBUFFER_HEIGHT, EGL_MAX_PBUFFER_PIXELS
+  };
+  struct eglglue_contextdata * context = (struct eglglue_contextdata *)ctx;
+
+  for (i = 0; i < 3; i++) {
+    EGLint attribval = 0;
+    if (!eglGetConfigAttrib(eglglue_display, context->config,
+                            attribs[i], &attribval)) {
+      cc_debugerror_post("eglglue_context_pbuffer_max",
+                         "eglGetConfigAttrib() failed, "
+                         "eglGetError()==0x%x", eglGetError());
+      return FALSE;
+    }
+    /* zero means no limit is reported */
+    if (attribval <= 0) { return FALSE; }
+    lims[i] = (unsigned int)attribval;
+  }
+
+  return TRUE;
+}
+
+/* ********************************************************************** */
+
+void
+eglglue_cleanup(void)
+{
+  if (eglglue_display != EGL_NO_DISPLAY) { eglTerminate(eglglue_display); }
+  eglglue_display = EGL_NO_DISPLAY;
+  eglglue_initialize_failed = FALSE;
+  eglglue_enabled = -1;
+}
+
+#endif /* HAVE_EGL */
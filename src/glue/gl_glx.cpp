@@ -58,6 +58,7 @@
 
 #include "glue/dlp.h"
 #include "glue/glp.h"
+#include "glue/gl_egl.h"
 
 /* ********************************************************************** */
 
@@ -263,6 +264,7 @@ glxglue_get_display(const cc_glglue * currentcontext = NULL)
       cc_debugerror_post("glxglue_init",
                          "Couldn't open NULL display.");
       glxglue_opendisplay_failed = TRUE;
+      return NULL;
     }
     
     glxglue_screen = XScreenNumberOfScreen(
@@ -349,8 +351,11 @@ glxglue_isdirect(cc_glglue * w)
   GLXContext ctx = glXGetCurrentContext();
 
   if (!ctx) {
-    cc_debugerror_postwarning("glxglue_isdirect",
-                              "Couldn't get current GLX context.");
+    /* no warning for EGL offscreen contexts, which are always direct */
+    if (!eglglue_offscreen_enabled()) {
+      cc_debugerror_postwarning("glxglue_isdirect",
+                                "Couldn't get current GLX context.");
+    }
     return TRUE;
   }
 
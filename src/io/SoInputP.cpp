@@ -37,8 +37,21 @@
 
 #include <Inventor/SoInput.h>
 
+#include <cstdlib>
+#include <cstring>
+#include <cmath> // pow()
+
+#include <Inventor/errors/SoReadError.h>
+
 #include "io/SoInputP.h"
 #include "io/SoInput_FileInfo.h"
+#include "threads/parallelp.h"
+#include "tidbitsp.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOINPUTP_HAVE_SSE2
+#include <emmintrin.h>
+#endif
 
 // *************************************************************************
 
@@ -332,3 +345,581 @@ SoInputP::isNameCharVRML2(unsigned char c, SbBool validIdent)
   if (validIdent) return (valid_ident_invalid_vrml2_table[c] == 0);
   return (invalid_vrml2_table[c] == 0);
 }
+
+// *************************************************************************
+
+// Bulk import of ASCII number arrays.
+//
+// Large multi-value fields used to be read one number at a time
+// through SoInput::read(), with a get()/putBack() roundtrip for each
+// character. For the common case of an array of plain numbers, we
+// instead grab the raw text of the whole bracketed array in one go,
+// split it into chunks at token boundaries, and decode the chunks
+// in parallel on the shared worker pool.
+//
+// The text is scanned straight out of the read buffer of the
+// SoInput_FileInfo, and where SSE2 is available, runs of plain
+// numbers and whitespace are classified 16 characters at a time.
+//
+// The decoding mirrors SoInput_FileInfo::readReal() and
+// readInteger() exactly, so the resulting values are bit-identical
+// to what the value-by-value code produces. Anything outside the
+// plain case (malformed numbers, nested data, premature end of
+// array, etc) makes us put all the text back into the stream and
+// return FALSE, so the caller can fall back to the regular code
+// path, which also takes care of the error reporting.
+
+// Target size of each independently decoded chunk.
+static const size_t SOINPUTP_CHUNK_SIZE = 64 * 1024;
+
+SoInputP::NumberArray::NumberArray(void)
+{
+  this->text = NULL;
+  this->length = 0;
+  this->allocated = 0;
+  this->numtokens = 0;
+}
+
+SoInputP::NumberArray::~NumberArray()
+{
+  delete[] this->text;
+}
+
+static inline SbBool
+soinputp_is_number_char(const char c)
+{
+  return
+    ((c >= '0') && (c <= '9')) ||
+    ((c >= 'a') && (c <= 'f')) ||
+    ((c >= 'A') && (c <= 'F')) ||
+    (c == '-') || (c == '+') || (c == '.') ||
+    (c == 'x') || (c == 'X');
+}
+
+static inline SbBool
+soinputp_is_digit(const char c)
+{
+  return (c >= '0') && (c <= '9');
+}
+
+static void
+soinputp_append(SoInputP::NumberArray & array, const char * s, const size_t n)
+{
+  if (array.length + n >= array.allocated) {
+    size_t newsize = array.allocated ? array.allocated * 2 : 4096;
+    while (array.length + n >= newsize) newsize *= 2;
+    char * newtext = new char[newsize];
+    if (array.length) memcpy(newtext, array.text, array.length);
+    delete[] array.text;
+    array.text = newtext;
+    array.allocated = newsize;
+  }
+  memcpy(array.text + array.length, s, n);
+  array.length += n;
+}
+
+// Puts back everything read into the array, preceded by the
+// character which stopped the scan (if any), so the stream is left
+// as if we never touched it.
+static void
+soinputp_unread(SoInput_FileInfo * fi, SoInputP::NumberArray & array,
+                const char * last)
+{
+  if (last) fi->putBack(*last);
+  if (array.length) {
+    array.text[array.length] = '\0';
+    fi->putBack(array.text);
+  }
+  array.length = 0;
+  array.numtokens = 0;
+  array.chunkoffset.truncate(0);
+  array.chunktoken.truncate(0);
+}
+
+namespace {
+
+enum soinputp_scan_result {
+  SCAN_CONTINUE,
+  SCAN_END,
+  SCAN_FAIL
+};
+
+struct soinputp_scan_state {
+  SbBool intoken;
+  SbBool incomment;
+  SbBool gotcomma;
+  size_t lastchunk;
+  int numcomponents;
+};
+
+} // anonymous namespace
+
+// Feeds one character to the array scanner. \a pos is the offset the
+// character will get in the array text.
+static inline soinputp_scan_result
+soinputp_scan_char(SoInput_FileInfo * fi, soinputp_scan_state & st,
+                   SoInputP::NumberArray & array, const char c,
+                   const size_t pos)
+{
+  if (st.incomment) {
+    if ((c == '\n') || (c == '\r')) st.incomment = FALSE;
+  }
+  else if (c == ']') {
+    return SCAN_END;
+  }
+  else if (c == '#') {
+    st.intoken = FALSE;
+    st.incomment = TRUE;
+  }
+  else if (fi->isSpace(c)) {
+    st.intoken = FALSE;
+  }
+  else if (c == ',') {
+    // Outside VRML97 files, a single comma is allowed between
+    // values, but not between the components of a value.
+    if ((array.numtokens == 0) || st.gotcomma ||
+        ((array.numtokens % st.numcomponents) != 0)) {
+      return SCAN_FAIL;
+    }
+    st.gotcomma = TRUE;
+    st.intoken = FALSE;
+  }
+  else if (!soinputp_is_number_char(c)) {
+    return SCAN_FAIL;
+  }
+  else if (!st.intoken) {
+    st.intoken = TRUE;
+    st.gotcomma = FALSE;
+    if ((array.numtokens == 0) ||
+        (pos - st.lastchunk >= SOINPUTP_CHUNK_SIZE)) {
+      array.chunkoffset.append(pos);
+      array.chunktoken.append(array.numtokens);
+      st.lastchunk = pos;
+    }
+    array.numtokens++;
+  }
+  return SCAN_CONTINUE;
+}
+
+// Skips ahead over 16 character blocks made up of nothing but
+// decimal number characters and plain whitespace, counting the
+// tokens started within them. Blocks needing more attention (chunk
+// boundaries, commas, comments, etc) are left for
+// soinputp_scan_char(). Returns the number of characters skipped.
+static size_t
+soinputp_skip_plain(const char * s, const size_t length, const size_t pos,
+                    soinputp_scan_state & st, SoInputP::NumberArray & array)
+{
+  size_t i = 0;
+#ifdef SOINPUTP_HAVE_SSE2
+  const __m128i below0 = _mm_set1_epi8('0' - 1);
+  const __m128i above9 = _mm_set1_epi8('9' + 1);
+  const __m128i dot = _mm_set1_epi8('.');
+  const __m128i minus = _mm_set1_epi8('-');
+  const __m128i plus = _mm_set1_epi8('+');
+  const __m128i lowere = _mm_set1_epi8('e');
+  const __m128i uppere = _mm_set1_epi8('E');
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+
+  if (array.numtokens == 0) return 0;
+
+  while (i + 16 <= length) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    __m128i num = _mm_and_si128(_mm_cmpgt_epi8(v, below0),
+                                _mm_cmplt_epi8(v, above9));
+    num = _mm_or_si128(num, _mm_or_si128(_mm_cmpeq_epi8(v, dot),
+                                         _mm_cmpeq_epi8(v, minus)));
+    num = _mm_or_si128(num, _mm_or_si128(_mm_cmpeq_epi8(v, plus),
+                                         _mm_cmpeq_epi8(v, lowere)));
+    num = _mm_or_si128(num, _mm_cmpeq_epi8(v, uppere));
+    __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, space),
+                              _mm_cmpeq_epi8(v, tab));
+    ws = _mm_or_si128(ws, _mm_or_si128(_mm_cmpeq_epi8(v, lf),
+                                       _mm_cmpeq_epi8(v, cr)));
+
+    const unsigned int nummask = (unsigned int) _mm_movemask_epi8(num);
+    const unsigned int wsmask = (unsigned int) _mm_movemask_epi8(ws);
+    if ((nummask | wsmask) != 0xffff) break;
+
+    unsigned int starts =
+      nummask & ~((nummask << 1) | (st.intoken ? 1 : 0)) & 0xffff;
+    if (starts) {
+      if (pos + i + 16 - st.lastchunk >= SOINPUTP_CHUNK_SIZE) break;
+      while (starts) {
+        starts &= starts - 1;
+        array.numtokens++;
+      }
+      st.gotcomma = FALSE;
+    }
+    st.intoken = (nummask & 0x8000) ? TRUE : FALSE;
+    i += 16;
+  }
+#endif // SOINPUTP_HAVE_SSE2
+  return i;
+}
+
+/*
+  Reads the raw text of an ASCII number array, up to and including
+  the closing bracket. The opening bracket must already have been
+  consumed. Returns FALSE if the array is not a plain sequence of
+  numbers laid out in groups of \a numcomponents, in which case the
+  stream is left untouched.
+*/
+SbBool
+SoInputP::readNumberArray(SoInput * in, int numcomponents, NumberArray & array)
+{
+  SoInput_FileInfo * fi = in->getTopOfStack();
+  assert(fi && !fi->isBinary());
+  assert(numcomponents > 0);
+
+  array.length = 0;
+  array.numtokens = 0;
+  array.chunkoffset.truncate(0);
+  array.chunktoken.truncate(0);
+
+  soinputp_scan_state st;
+  st.intoken = FALSE;
+  st.incomment = FALSE;
+  st.gotcomma = FALSE;
+  st.lastchunk = 0;
+  st.numcomponents = numcomponents;
+
+  soinputp_scan_result result = SCAN_CONTINUE;
+  char c = 0;
+
+  while (result == SCAN_CONTINUE) {
+    const char * block;
+    size_t blocklength;
+    if (fi->getUnreadBlock(block, blocklength)) {
+      size_t i = 0;
+      while (i < blocklength) {
+        if (!st.incomment) {
+          i += soinputp_skip_plain(block + i, blocklength - i,
+                                   array.length + i, st, array);
+          if (i == blocklength) break;
+        }
+        c = block[i];
+        result = soinputp_scan_char(fi, st, array, c, array.length + i);
+        if (result != SCAN_CONTINUE) break;
+        i++;
+      }
+      soinputp_append(array, block, i);
+      fi->skipUnreadBlock((result == SCAN_CONTINUE) ? i : i + 1);
+    }
+    else {
+      if (!fi->get(c)) {
+        soinputp_unread(fi, array, NULL);
+        return FALSE;
+      }
+      result = soinputp_scan_char(fi, st, array, c, array.length);
+      if (result == SCAN_CONTINUE) soinputp_append(array, &c, 1);
+    }
+  }
+
+  if ((result == SCAN_FAIL) || (array.numtokens == 0) ||
+      ((array.numtokens % numcomponents) != 0)) {
+    soinputp_unread(fi, array, &c);
+    return FALSE;
+  }
+
+  array.chunkoffset.append(array.length);
+  array.chunktoken.append(array.numtokens);
+  return TRUE;
+}
+
+// Same algorithm as SoInput_FileInfo::readReal(), but working on a
+// token in memory. The whole token must be consumed.
+static SbBool
+soinputp_parse_real(const char * s, const char * end, double & d)
+{
+  SbBool minus = FALSE;
+  SbBool gotnum = FALSE;
+  double number = 0.0;
+  int i, n;
+
+  if ((s < end) && ((*s == '-') || (*s == '+'))) {
+    minus = (*s == '-');
+    s++;
+  }
+
+  for (n = 0; (s + n < end) && soinputp_is_digit(s[n]); n++) { }
+  if (n > 0) {
+    gotnum = TRUE;
+    if (n <= 15) {
+      // All partial sums of the loop below are exact below 10^15,
+      // so integer accumulation gives the very same value.
+      uint64_t integer = 0;
+      for (i = 0; i < n; i++) integer = integer * 10 + (s[i] - '0');
+      number = (double) integer;
+    }
+    else {
+      double mul = 1.0;
+      for (i = 0; i < n; i++) {
+        number += (s[(n-1)-i] - '0') * mul;
+        mul *= 10.0;
+      }
+    }
+    s += n;
+  }
+  if ((s < end) && (*s == '.')) {
+    s++;
+    for (n = 0; (s + n < end) && soinputp_is_digit(s[n]); n++) { }
+    if (n > 0) {
+      gotnum = TRUE;
+      double mul = 0.1;
+      for (i = 0; i < n; i++) {
+        number += (s[i]-'0') * mul;
+        mul *= 0.1;
+      }
+      s += n;
+    }
+  }
+
+  if (!gotnum) return FALSE;
+  if (minus) number = -number;
+
+  if ((s < end) && ((*s == 'e') || (*s == 'E'))) {
+    s++;
+    minus = FALSE;
+    if ((s < end) && ((*s == '-') || (*s == '+'))) {
+      minus = (*s == '-');
+      s++;
+    }
+    for (n = 0; (s + n < end) && soinputp_is_digit(s[n]); n++) { }
+    if (n == 0) return FALSE;
+
+    double exponent = 0.0;
+    double mul = 1.0;
+    for (i = 0; i < n; i++) {
+      exponent += (s[(n-1)-i]-'0') * mul;
+      mul *= 10.0;
+    }
+    if (minus) exponent = -exponent;
+    number *= pow(10.0, exponent);
+    s += n;
+  }
+
+  d = number;
+  return s == end;
+}
+
+// Validates the token against the grammar of
+// SoInput_FileInfo::readInteger() / readUnsignedInteger(), and
+// converts it with strtol() / strtoul(), just like those functions.
+static SbBool
+soinputp_parse_integer(const char * s, const char * end, SbBool issigned,
+                       int32_t & l, uint32_t & ul)
+{
+  char buf[512];
+  const char * p = s;
+  if (issigned && (p < end) && ((*p == '-') || (*p == '+'))) p++;
+
+  const char * digits = p;
+  if ((p < end) && (*p == '0')) {
+    p++;
+    if ((p < end) && (*p == 'x')) {
+      p++;
+      while ((p < end) && isxdigit(*p)) p++;
+      if (p - digits < 3) return FALSE;
+    }
+    else {
+      while ((p < end) && soinputp_is_digit(*p)) p++;
+    }
+  }
+  else {
+    while ((p < end) && soinputp_is_digit(*p)) p++;
+    if (p == digits) return FALSE;
+  }
+  if ((p != end) || (end - s >= (ptrdiff_t) sizeof(buf))) return FALSE;
+
+  memcpy(buf, s, end - s);
+  buf[end - s] = '\0';
+  if (issigned) l = strtol(buf, NULL, 0);
+  else ul = strtoul(buf, NULL, 0);
+  return TRUE;
+}
+
+namespace {
+
+struct soinputp_parse_data {
+  const SoInputP::NumberArray * array;
+  SoInputP::NumberType type;
+  void * values;
+  SbBool * failed;
+  int * numnonfinite;
+};
+
+} // anonymous namespace
+
+static void
+soinputp_parse_chunk(void * closure, int chunk)
+{
+  soinputp_parse_data * data = static_cast<soinputp_parse_data *>(closure);
+  const char * s = data->array->text + data->array->chunkoffset[chunk];
+  const char * end = data->array->text + data->array->chunkoffset[chunk+1];
+  int idx = data->array->chunktoken[chunk];
+  int numnonfinite = 0;
+
+  while (s < end) {
+    if (*s == '#') {
+      while ((s < end) && (*s != '\n') && (*s != '\r')) s++;
+      continue;
+    }
+    if (!soinputp_is_number_char(*s)) { s++; continue; }
+
+    const char * tokenend = s;
+    while ((tokenend < end) && soinputp_is_number_char(*tokenend)) tokenend++;
+
+    double d = 0.0;
+    int32_t l = 0;
+    uint32_t ul = 0;
+    SbBool ok;
+    switch (data->type) {
+    case SoInputP::NUMBER_FLOAT:
+    case SoInputP::NUMBER_DOUBLE:
+      ok = soinputp_parse_real(s, tokenend, d);
+      break;
+    case SoInputP::NUMBER_INT32:
+    case SoInputP::NUMBER_INT16:
+    case SoInputP::NUMBER_INT8:
+      ok = soinputp_parse_integer(s, tokenend, TRUE, l, ul);
+      break;
+    default:
+      ok = soinputp_parse_integer(s, tokenend, FALSE, l, ul);
+      break;
+    }
+    if (!ok) {
+      data->failed[chunk] = TRUE;
+      return;
+    }
+
+    switch (data->type) {
+    case SoInputP::NUMBER_FLOAT:
+      {
+        float f = (float) d;
+        if (!coin_finite((double) f)) { f = 0.0f; numnonfinite++; }
+        static_cast<float *>(data->values)[idx] = f;
+      }
+      break;
+    case SoInputP::NUMBER_DOUBLE:
+      if (!coin_finite(d)) { d = 0.0; numnonfinite++; }
+      static_cast<double *>(data->values)[idx] = d;
+      break;
+    case SoInputP::NUMBER_INT32:
+      static_cast<int32_t *>(data->values)[idx] = l;
+      break;
+    case SoInputP::NUMBER_UINT32:
+      static_cast<uint32_t *>(data->values)[idx] = ul;
+      break;
+    case SoInputP::NUMBER_INT16:
+      static_cast<int16_t *>(data->values)[idx] = (int16_t) l;
+      break;
+    case SoInputP::NUMBER_UINT16:
+      static_cast<uint16_t *>(data->values)[idx] = (uint16_t) ul;
+      break;
+    case SoInputP::NUMBER_INT8:
+      static_cast<int8_t *>(data->values)[idx] = (int8_t) l;
+      break;
+    case SoInputP::NUMBER_UINT8:
+      static_cast<uint8_t *>(data->values)[idx] = (uint8_t) ul;
+      break;
+    default:
+      assert(0 && "unknown number type");
+      break;
+    }
+    idx++;
+    s = tokenend;
+  }
+  data->numnonfinite[chunk] = numnonfinite;
+}
+
+/*
+  Decodes an array read with readNumberArray() into \a values, which
+  must have room for array.numtokens numbers of the given type.
+  Returns FALSE if some token is not a valid number, in which case
+  the array text is put back into the stream.
+*/
+SbBool
+SoInputP::parseNumberArray(SoInput * in, NumberArray & array,
+                           NumberType type, void * values)
+{
+  const int numchunks = array.chunkoffset.getLength() - 1;
+  assert(numchunks > 0);
+
+  SbList<SbBool> failed(numchunks);
+  SbList<int> numnonfinite(numchunks);
+  for (int i = 0; i < numchunks; i++) {
+    failed.append(FALSE);
+    numnonfinite.append(0);
+  }
+
+  soinputp_parse_data data;
+  data.array = &array;
+  data.type = type;
+  data.values = values;
+  data.failed = const_cast<SbBool *>(failed.getArrayPtr());
+  data.numnonfinite = const_cast<int *>(numnonfinite.getArrayPtr());
+
+  cc_parallel_run(numchunks, soinputp_parse_chunk, &data);
+
+  for (int i = 0; i < numchunks; i++) {
+    if (failed[i]) {
+      const char bracket = ']';
+      soinputp_unread(in->getTopOfStack(), array, &bracket);
+      return FALSE;
+    }
+  }
+  // Report invalid numbers the same way SoInput::read() does.
+  for (int i = 0; i < numchunks; i++) {
+    for (int j = 0; j < numnonfinite[i]; j++) {
+      SoReadError::post(in,
+                        (type == NUMBER_FLOAT) ?
+                        "Detected non-valid floating point number, replacing "
+                        "with 0.0f" :
+                        "Detected non-valid floating point number, replacing "
+                        "with 0.0");
+    }
+  }
+  return TRUE;
+}
+
+// Returns TRUE if the current file is a snapshot, and sets \a swapped
+// if its number arrays are in the opposite byte order of this host.
+SbBool
+SoInputP::isSnapshot(SoInput * in, SbBool & swapped)
+{
+  const SoInput_FileInfo::SnapshotType type =
+    in->getTopOfStack()->snapshotType();
+  swapped = (type == SoInput_FileInfo::SWAPPED_SNAPSHOT);
+  return type != SoInput_FileInfo::NO_SNAPSHOT;
+}
+
+SoInput_FileMapping *
+SoInputP::mapSnapshotBytes(SoInput * in, const size_t length,
+                           const size_t alignment, char *& data)
+{
+  SoInput_FileInfo * fi = in->getTopOfStack();
+  SoInput_FileMapping * mapping = fi->getMapping();
+  if (mapping == NULL) return NULL;
+
+  const char * block;
+  size_t blocklength;
+  if (!fi->getUnreadBlock(block, blocklength) || (blocklength < length)) {
+    return NULL;
+  }
+  // the read buffer is a copy of the file data if it was read ahead
+  const char * start = mapping->getData();
+  if ((block < start) || (block + length > start + mapping->getLength())) {
+    return NULL;
+  }
+  if (((size_t) block) % alignment) return NULL;
+
+  fi->skipUnreadBlock(length);
+  mapping->ref();
+  // the mapping is writable, see SoInput_FileMapping::create()
+  data = const_cast<char *>(block);
+  return mapping;
+}
@@ -40,9 +40,11 @@
 // *************************************************************************
 
 #include "misc/SbHash.h"
+#include <Inventor/lists/SbList.h>
 
 class SoInput;
 class SoInput_FileInfo;
+class SoInput_FileMapping;
 
 // *************************************************************************
 
@@ -58,6 +60,50 @@ public:
 
   SoInput_FileInfo * getTopOfStackPopOnEOF(void);
 
+  // Bulk import of bracketed ASCII number arrays, as found in
+  // multi-value fields like SoMFVec3f and SoMFInt32.
+  enum NumberType {
+    NUMBER_FLOAT,
+    NUMBER_DOUBLE,
+    NUMBER_INT32,
+    NUMBER_UINT32,
+    NUMBER_INT16,
+    NUMBER_UINT16,
+    NUMBER_INT8,
+    NUMBER_UINT8
+  };
+
+  // The raw text of an array, split into chunks at token boundaries
+  // so the chunks can be decoded independently of each other.
+  class NumberArray {
+  public:
+    NumberArray(void);
+    ~NumberArray();
+
+    char * text;
+    size_t length;
+    size_t allocated;
+    int numtokens;
+    SbList<size_t> chunkoffset;
+    SbList<int> chunktoken;
+  };
+
+  static SbBool readNumberArray(SoInput * in, int numcomponents,
+                                NumberArray & array);
+  static SbBool parseNumberArray(SoInput * in, NumberArray & array,
+                                 NumberType type, void * values);
+
+  // Number arrays of snapshot files, see SoWriteAction::setSnapshot().
+  // mapSnapshotBytes() consumes the next length bytes and returns the
+  // mapping they can be used from in place, with a new reference,
+  // provided the bytes are aligned to the given number of
+  // bytes. Returns NULL without consuming anything otherwise.
+  static SbBool isSnapshot(SoInput * in, SbBool & swapped);
+  static SoInput_FileMapping * mapSnapshotBytes(SoInput * in,
+                                                const size_t length,
+                                                const size_t alignment,
+                                                char *& data);
+
   static SbBool isNameStartChar(unsigned char c, SbBool validIdent);
   static SbBool isNameChar(unsigned char c, SbBool validIdent);
   static SbBool isNameStartCharVRML1(unsigned char c, SbBool validIdent);
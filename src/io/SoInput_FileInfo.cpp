@@ -47,6 +47,7 @@
 
 #include "tidbitsp.h"
 #include "glue/zlib.h"
+#include "misc/SoDBP.h"
 
 // *************************************************************************
 
@@ -70,10 +71,10 @@ SoInput_FileInfo::SoInput_FileInfo(SoInput_Reader * readerptr,
   this->threadreadidx = 0;
   this->threadbufidx = 0;
   this->threadeof = FALSE;
+#endif // HAVE_THREADS && SOINPUT_ASYNC_IO
+  // allocated on demand, as readers with direct access don't need it
+  this->ownbuf = NULL;
   this->readbuf = NULL;
-#else // HAVE_THREADS && SOINPUT_ASYNC_IO
-  this->readbuf = new char[READBUFSIZE];
-#endif // !(HAVE_THREADS && SOINPUT_ASYNC_IO)
   this->readbuflen = 0;
   this->readbufidx = 0;
 
@@ -86,6 +87,7 @@ SoInput_FileInfo::SoInput_FileInfo(SoInput_Reader * readerptr,
   this->lastchar = -1;
   this->eof = FALSE;
   this->isbinary = FALSE;
+  this->snapshot = NO_SNAPSHOT;
   this->vrml1file = FALSE;
   this->vrml2file = FALSE;
   this->prefunc = NULL;
@@ -109,9 +111,8 @@ SoInput_FileInfo::~SoInput_FileInfo()
   cc_mutex_destruct(this->mutex);
   delete[] this->threadbuf[0];
   delete[] this->threadbuf[1];
-#else // HAVE_THREADS && SOINPUT_ASYNC_IO
-  delete[] this->readbuf;
-#endif // !(HAVE_THREADS && SOINPUT_ASYNC_IO)
+#endif // HAVE_THREADS && SOINPUT_ASYNC_IO
+  delete[] this->ownbuf;
   delete this->reader;
   // to be safe, delete this after deleting the reader
   delete[] this->deletebuffer;
@@ -181,7 +182,18 @@ SoInput_FileInfo::doBufferRead(void)
 
 #else // HAVE_THREADS && SOINPUT_ASYNC_IO
 
-  size_t len = this->getReader()->readBuffer(this->readbuf, READBUFSIZE);
+  SoInput_Reader * r = this->getReader();
+  const char * buf;
+  size_t len;
+  if (r->hasDirectAccess()) {
+    // scan the reader's data in place, no need to copy it
+    len = r->readDirect(buf);
+  }
+  else {
+    if (this->ownbuf == NULL) { this->ownbuf = new char[READBUFSIZE]; }
+    len = r->readBuffer(this->ownbuf, READBUFSIZE);
+    buf = this->ownbuf;
+  }
   if (len == 0) {
     this->readbufidx = 0;
     this->readbuflen = 0;
@@ -194,6 +206,7 @@ SoInput_FileInfo::doBufferRead(void)
     this->totalread += this->readbufidx;
     this->readbufidx = 0;
     this->readbuflen = len;
+    this->readbuf = buf;
   }
 #endif // !(HAVE_THREADS && SOINPUT_ASYNC_IO)
 }
@@ -280,6 +293,49 @@ SoInput_FileInfo::get(char & c)
   return TRUE;
 }
 
+SbBool
+SoInput_FileInfo::getUnreadBlock(const char *& block, size_t & length)
+{
+  if ((this->readbufidx == 0) && (this->backbuffer.getLength() > 0)) {
+    return FALSE;
+  }
+  if (this->readbufidx >= this->readbuflen) {
+    this->doBufferRead();
+    if (this->eof) return FALSE;
+  }
+  block = this->readbuf + this->readbufidx;
+  length = this->readbuflen - this->readbufidx;
+  return TRUE;
+}
+
+// Consumes the first length characters of the block returned from
+// getUnreadBlock(), with the same line counting as get().
+void
+SoInput_FileInfo::skipUnreadBlock(const size_t length)
+{
+  assert(this->readbufidx + length <= this->readbuflen);
+  if (length == 0) return;
+
+  if (this->isbinary) {
+    // no lines to count, and binary blocks can be large
+    this->lastchar = this->readbuf[this->readbufidx + length - 1];
+    this->lastputback = -1;
+    this->readbufidx += length;
+    return;
+  }
+
+  const char * ptr = this->readbuf + this->readbufidx;
+  int lastc = this->lastchar;
+  for (size_t i = 0; i < length; i++) {
+    const char c = ptr[i];
+    if ((c == '\r') || ((c == '\n') && (lastc != '\r'))) this->linenr++;
+    lastc = c;
+  }
+  this->lastchar = lastc;
+  this->lastputback = -1;
+  this->readbufidx += length;
+}
+
 void
 SoInput_FileInfo::putBack(const char c)
 {
@@ -383,6 +439,7 @@ SoInput_FileInfo::readHeaderInternal(SoInput * soinput)
 
   this->header = "";
   this->ivversion = 0.0f;
+  this->snapshot = NO_SNAPSHOT;
   this->vrml1file = FALSE;
   this->vrml2file = FALSE;
 
@@ -419,6 +476,12 @@ SoInput_FileInfo::readHeaderInternal(SoInput * soinput)
                      vrml2string.getLength()) == 0) {
       this->vrml2file = TRUE;
     }
+    else if ((this->header.compareSubString(SoDBP::SnapshotHeaders::LITTLE_ENDIAN_HEADER) == 0) ||
+             (this->header.compareSubString(SoDBP::SnapshotHeaders::BIG_ENDIAN_HEADER) == 0)) {
+      this->snapshot =
+        (this->header.compareSubString(SoDBP::getSnapshotHeader()) == 0) ?
+        NATIVE_SNAPSHOT : SWAPPED_SNAPSHOT;
+    }
     if (this->prefunc) this->prefunc(this->userdata, soinput);
   }
   return TRUE;
@@ -81,6 +81,12 @@ public:
   SbBool getChunkOfBytes(unsigned char * ptr, size_t length);
   SbBool get(char & c);
 
+  // Direct access to the unread part of the read buffer, for bulk
+  // scanners. getUnreadBlock() returns FALSE when the next character
+  // can only be fetched with get() (put back characters or EOF).
+  SbBool getUnreadBlock(const char *& block, size_t & length);
+  void skipUnreadBlock(const size_t length);
+
   void putBack(const char c);
   void putBack(const char * const str);
 
@@ -117,6 +123,21 @@ public:
   float ivVersion(void) {
     return this->ivversion;
   }
+  // Snapshot files store number arrays in the byte order of the host
+  // which wrote them, see SoWriteAction::setSnapshot().
+  enum SnapshotType {
+    NO_SNAPSHOT,
+    NATIVE_SNAPSHOT,
+    SWAPPED_SNAPSHOT
+  };
+  SnapshotType snapshotType(void) const {
+    return this->snapshot;
+  }
+  // The mapping the unread block points into, for mapped files.
+  SoInput_FileMapping * getMapping(void) {
+    if (this->reader == NULL) return NULL;
+    return this->getReader()->getMapping();
+  }
   SbBool isFileVRML1(void) {
     return this->vrml1file;
   }
@@ -227,8 +248,12 @@ private:
   SoDBHeaderCB * prefunc, * postfunc;
   void * userdata;
   SbBool isbinary;
+  SnapshotType snapshot;
 
-  char * readbuf;
+  // points either into ownbuf, or directly into the reader's data
+  // for readers with direct access (memory buffers, mapped files)
+  const char * readbuf;
+  char * ownbuf;
   size_t readbufidx;
   size_t readbuflen;
   size_t totalread;
@@ -33,6 +33,7 @@
 #include "io/SoInput_Reader.h"
 
 #include <cstring>
+#include <cstdlib>
 #include <cassert>
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -50,9 +51,20 @@
 #include <sys/stat.h>
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h> // mmap()
+#endif // HAVE_SYS_MMAN_H
+
+#if defined(HAVE_WINDOWS_H) && defined(_WIN32)
+#include <windows.h> // CreateFileMapping()
+#include <io.h> // _get_osfhandle()
+#endif // HAVE_WINDOWS_H && _WIN32
+
 #include <Inventor/errors/SoDebugError.h>
+#include <Inventor/C/tidbits.h>
 
 #include "io/gzmemio.h"
+#include "threads/threadsutilp.h"
 #include "glue/zlib.h"
 #include "glue/bzip2.h"
 
@@ -66,6 +78,85 @@
 #define BZ_STREAM_END 4
 #endif // BZ_STREAM_END
 
+//
+// file mapping
+//
+
+SoInput_FileMapping::SoInput_FileMapping(void * dataarg, const size_t lengtharg)
+{
+  this->data = static_cast<char *>(dataarg);
+  this->length = lengtharg;
+  this->refcount = 1;
+}
+
+SoInput_FileMapping::~SoInput_FileMapping()
+{
+#ifdef HAVE_SYS_MMAN_H
+  (void) munmap(this->data, this->length);
+#elif defined(HAVE_WINDOWS_H) && defined(_WIN32)
+  (void) UnmapViewOfFile(this->data);
+#endif // win32
+}
+
+// Maps the complete file. The mapping is private and writable, so
+// data used in place can be modified without touching the file;
+// pages are copied by the operating system on their first write.
+// Returns NULL if the file can't be mapped. The new mapping has one
+// reference.
+SoInput_FileMapping *
+SoInput_FileMapping::create(FILE * fp)
+{
+#if defined(HAVE_FSTAT) && (defined(HAVE_SYS_MMAN_H) || (defined(HAVE_WINDOWS_H) && defined(_WIN32)))
+  struct stat sb;
+  if (fstat(fileno(fp), &sb) != 0) return NULL;
+  if (sb.st_size <= 0) return NULL;
+  // don't try to map more than we can address
+  if ((uint64_t) sb.st_size > (uint64_t) ((size_t) -1)) return NULL;
+
+  const size_t filelen = (size_t) sb.st_size;
+  void * mapping = NULL;
+
+#ifdef HAVE_SYS_MMAN_H
+  mapping = mmap(NULL, filelen, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                 fileno(fp), 0);
+  if (mapping == MAP_FAILED) return NULL;
+#ifdef MADV_SEQUENTIAL
+  (void) madvise(mapping, filelen, MADV_SEQUENTIAL);
+#endif // MADV_SEQUENTIAL
+#else // win32
+  HANDLE file = (HANDLE) _get_osfhandle(fileno(fp));
+  if (file == INVALID_HANDLE_VALUE) return NULL;
+  HANDLE filemapping = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  if (filemapping == NULL) return NULL;
+  mapping = MapViewOfFile(filemapping, FILE_MAP_COPY, 0, 0, 0);
+  // the view keeps a reference to the mapping object
+  CloseHandle(filemapping);
+  if (mapping == NULL) return NULL;
+#endif // win32
+
+  return new SoInput_FileMapping(mapping, filelen);
+#else // no mmap support
+  return NULL;
+#endif // no mmap support
+}
+
+void
+SoInput_FileMapping::ref(void)
+{
+  CC_GLOBAL_LOCK;
+  this->refcount++;
+  CC_GLOBAL_UNLOCK;
+}
+
+void
+SoInput_FileMapping::unref(void)
+{
+  CC_GLOBAL_LOCK;
+  const int count = --this->refcount;
+  CC_GLOBAL_UNLOCK;
+  if (count == 0) delete this;
+}
+
 //
 // abstract class
 //
@@ -91,6 +182,26 @@ SoInput_Reader::getFilePointer(void)
   return NULL;
 }
 
+SbBool
+SoInput_Reader::hasDirectAccess(void) const
+{
+  return FALSE;
+}
+
+size_t
+SoInput_Reader::readDirect(const char *& buf)
+{
+  assert(0 && "readDirect() called on reader without direct access");
+  buf = NULL;
+  return 0;
+}
+
+SoInput_FileMapping *
+SoInput_Reader::getMapping(void)
+{
+  return NULL;
+}
+
 // creates the correct reader based on the file type in fp (will
 // examine the file header). If fullname is empty, it's assumed that
 // file FILE pointer is passed from the user, and that we cannot
@@ -181,6 +292,12 @@ SoInput_Reader::createReader(FILE * fp, const SbString & fullname)
     }
   }
 
+  // Plain files are memory mapped when possible, so we avoid copying
+  // the whole file through fread() and an intermediate buffer.
+  if ((reader == NULL) && trycompression) {
+    reader = SoInput_MMapFileReader::create(fullname.getString(), fp);
+  }
+
   if (reader == NULL) {
     reader = new SoInput_FileReader(fullname.getString(), fp);
   }
@@ -236,6 +353,91 @@ SoInput_FileReader::getFilePointer(void)
   return this->fp;
 }
 
+//
+// memory mapped FILE * class
+//
+
+SoInput_MMapFileReader::SoInput_MMapFileReader(const char * const filenamearg,
+                                               FILE * filepointer)
+  : SoInput_FileReader(filenamearg, filepointer)
+{
+  this->mapping = NULL;
+  this->data = NULL;
+  this->datalen = 0;
+  this->datapos = 0;
+}
+
+// Maps the file from its current read position to the end. Returns
+// NULL if the file can't be mapped, and the caller should then fall
+// back on the regular file reader.
+SoInput_MMapFileReader *
+SoInput_MMapFileReader::create(const char * const filenamearg, FILE * fp)
+{
+  static int nommap = -1;
+  if (nommap == -1) {
+    const char * env = coin_getenv("COIN_SOINPUT_NO_MMAP");
+    nommap = (env && (atoi(env) > 0)) ? 1 : 0;
+  }
+  if (nommap) return NULL;
+
+  const long offset = ftell(fp);
+  if (offset < 0) return NULL;
+
+  SoInput_FileMapping * mapping = SoInput_FileMapping::create(fp);
+  if (mapping == NULL) return NULL;
+  // mapping an empty remainder buys us nothing
+  if ((size_t) offset >= mapping->getLength()) {
+    mapping->unref();
+    return NULL;
+  }
+
+  SoInput_MMapFileReader * reader = new SoInput_MMapFileReader(filenamearg, fp);
+  reader->mapping = mapping;
+  reader->data = mapping->getData() + offset;
+  reader->datalen = mapping->getLength() - (size_t) offset;
+  reader->datapos = 0;
+  return reader;
+}
+
+SoInput_MMapFileReader::~SoInput_MMapFileReader()
+{
+  if (this->mapping) this->mapping->unref();
+}
+
+size_t
+SoInput_MMapFileReader::readBuffer(char * buf, const size_t readlen)
+{
+  size_t len = this->datalen - this->datapos;
+  if (len > readlen) len = readlen;
+
+  memcpy(buf, this->data + this->datapos, len);
+  this->datapos += len;
+
+  return len;
+}
+
+SbBool
+SoInput_MMapFileReader::hasDirectAccess(void) const
+{
+  return TRUE;
+}
+
+size_t
+SoInput_MMapFileReader::readDirect(const char *& buf)
+{
+  // hand out the rest of the file in one go
+  buf = this->data + this->datapos;
+  const size_t len = this->datalen - this->datapos;
+  this->datapos = this->datalen;
+  return len;
+}
+
+SoInput_FileMapping *
+SoInput_MMapFileReader::getMapping(void)
+{
+  return this->mapping;
+}
+
 //
 // standard membuffer class
 //
@@ -269,6 +471,21 @@ SoInput_MemBufferReader::readBuffer(char * buffer, const size_t readlen)
   return len;
 }
 
+SbBool
+SoInput_MemBufferReader::hasDirectAccess(void) const
+{
+  return TRUE;
+}
+
+size_t
+SoInput_MemBufferReader::readDirect(const char *& buffer)
+{
+  buffer = this->buf + this->bufpos;
+  const size_t len = this->buflen - this->bufpos;
+  this->bufpos = this->buflen;
+  return len;
+}
+
 //
 // gzip readers
 //
@@ -44,6 +44,29 @@
 
 // *************************************************************************
 
+// A reference counted, copy-on-write memory mapping of a complete
+// file. Readers hold one reference, and number arrays used in place
+// from snapshot files hold one each, so the mapping outlives the
+// reader if necessary.
+class SoInput_FileMapping {
+public:
+  static SoInput_FileMapping * create(FILE * fp);
+
+  void ref(void);
+  void unref(void);
+
+  const char * getData(void) const { return this->data; }
+  size_t getLength(void) const { return this->length; }
+
+private:
+  SoInput_FileMapping(void * data, const size_t length);
+  ~SoInput_FileMapping();
+
+  char * data;
+  size_t length;
+  int refcount;
+};
+
 class SoInput_Reader {
 public:
   SoInput_Reader(void);
@@ -73,6 +96,20 @@ public:
   // reader uses FILE * to read data.
   virtual FILE * getFilePointer(void);
 
+  // should be overloaded to return TRUE by readers which have all
+  // their data in memory already, and which can hand it out through
+  // readDirect() without copying. Default method returns FALSE.
+  virtual SbBool hasDirectAccess(void) const;
+
+  // only called if hasDirectAccess() returns TRUE. Should set buf to
+  // point to the next chunk of data, and return its size, or 0 if
+  // eof. The data must stay valid for the lifetime of the reader.
+  virtual size_t readDirect(const char *& buf);
+
+  // returns the mapping the data from readDirect() points into, for
+  // readers which map files. Default method returns NULL.
+  virtual SoInput_FileMapping * getMapping(void);
+
   static SoInput_Reader * createReader(FILE * fp, const SbString & fullname);
 
 public:
@@ -96,6 +133,28 @@ public:
 
 };
 
+// Reads regular files through a memory mapping, so the parser can
+// scan the file contents directly.
+class SoInput_MMapFileReader : public SoInput_FileReader {
+public:
+  static SoInput_MMapFileReader * create(const char * const filename,
+                                         FILE * filepointer);
+  virtual ~SoInput_MMapFileReader();
+
+  virtual size_t readBuffer(char * buf, const size_t readlen);
+  virtual SbBool hasDirectAccess(void) const;
+  virtual size_t readDirect(const char *& buf);
+  virtual SoInput_FileMapping * getMapping(void);
+
+private:
+  SoInput_MMapFileReader(const char * const filename, FILE * filepointer);
+
+  SoInput_FileMapping * mapping;
+  const char * data;
+  size_t datalen;
+  size_t datapos;
+};
+
 class SoInput_MemBufferReader : public SoInput_Reader {
 public:
   SoInput_MemBufferReader(const void * bufPointer, size_t bufSize);
@@ -103,6 +162,8 @@ public:
 
   virtual ReaderType getType(void) const;
   virtual size_t readBuffer(char * buf, const size_t readlen);
+  virtual SbBool hasDirectAccess(void) const;
+  virtual size_t readDirect(const char *& buf);
 
 public:
   char * buf;
@@ -101,6 +101,7 @@
 #include "glue/bzip2.h"
 #include "io/SoOutput_Writer.h"
 #include "io/SoWriterefCounter.h"
+#include "misc/SoDBP.h"
 
 // *************************************************************************
 
@@ -144,6 +145,10 @@ static const char EOLSTR[] = "\n";
 // 19990627 mortene.
 static const size_t HOSTWORDSIZE = 4;
 
+// Number of values converted at a time by the writeBinaryArray()
+// functions.
+static const int SOOUTPUT_CONVERT_BLOCK = 1024;
+
 // *************************************************************************
 
 // helper classes for storing ROUTEs
@@ -1052,12 +1057,12 @@ SoOutput::writeBinaryArray(const unsigned char * constc, const int length)
 void
 SoOutput::writeBinaryArray(const int32_t * const l, const int length)
 {
-  // Slooooow. We can do much better by using convertInt32Array().
-
-  char val[sizeof(int32_t)];
-  for (int i=0; i < length; i++) {
-    this->convertInt32(l[i], val);
-    this->writeBytesWithPadding(val, sizeof(int32_t));
+  // Convert and write in blocks, to keep the number of writes down.
+  char buf[SOOUTPUT_CONVERT_BLOCK * sizeof(int32_t)];
+  for (int i=0; i < length; i += SOOUTPUT_CONVERT_BLOCK) {
+    const int n = SbMin(length - i, SOOUTPUT_CONVERT_BLOCK);
+    this->convertInt32Array(const_cast<int32_t *>(l + i), buf, n);
+    this->writeBytesWithPadding(buf, n * sizeof(int32_t));
   }
 }
 
@@ -1067,12 +1072,12 @@ SoOutput::writeBinaryArray(const int32_t * const l, const int length)
 void
 SoOutput::writeBinaryArray(const float * const f, const int length)
 {
-  // Slooooow. We can do much better by using convertFloatArray().
-
-  char val[sizeof(float)];
-  for (int i=0; i < length; i++) {
-    this->convertFloat(f[i], val);
-    this->writeBytesWithPadding(val, sizeof(float));
+  // Convert and write in blocks, to keep the number of writes down.
+  char buf[SOOUTPUT_CONVERT_BLOCK * sizeof(float)];
+  for (int i=0; i < length; i += SOOUTPUT_CONVERT_BLOCK) {
+    const int n = SbMin(length - i, SOOUTPUT_CONVERT_BLOCK);
+    this->convertFloatArray(const_cast<float *>(f + i), buf, n);
+    this->writeBytesWithPadding(buf, n * sizeof(float));
   }
 }
 
@@ -1082,12 +1087,12 @@ SoOutput::writeBinaryArray(const float * const f, const int length)
 void
 SoOutput::writeBinaryArray(const double * const d, const int length)
 {
-  // Slooooow. We can do much better by using convertDoubleArray().
-
-  char val[sizeof(double)];
-  for (int i=0; i < length; i++) {
-    this->convertDouble(d[i], val);
-    this->writeBytesWithPadding(val, sizeof(double));
+  // Convert and write in blocks, to keep the number of writes down.
+  char buf[SOOUTPUT_CONVERT_BLOCK * sizeof(double)];
+  for (int i=0; i < length; i += SOOUTPUT_CONVERT_BLOCK) {
+    const int n = SbMin(length - i, SOOUTPUT_CONVERT_BLOCK);
+    this->convertDoubleArray(const_cast<double *>(d + i), buf, n);
+    this->writeBytesWithPadding(buf, n * sizeof(double));
   }
 }
 
@@ -1716,4 +1721,13 @@ SoOutput_getHeaderString(const SoOutputP * pout)
   else return SoOutput::getDefaultASCIIHeader();
 }
 
+// Used from SoMField, which writes number arrays of snapshot files in
+// the native byte order. See SoWriteAction::setSnapshot().
+SbBool
+SoOutput_isSnapshot(const SoOutputP * pout)
+{
+  return pout->binarystream && pout->headerstring &&
+    (pout->headerstring->compareSubString(SoDBP::getSnapshotHeader()) == 0);
+}
+
 #undef PRIVATE
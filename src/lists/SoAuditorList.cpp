@@ -38,6 +38,13 @@
 
   This class is mainly for internal use (from SoBase) and it should
   not be necessary to be familiar with it for "ordinary" Coin use.
+
+  Lists with more than a few dozen auditors (typically a field with a
+  large number of slave fields or field sensors connected to it) get
+  a hash index from auditor to list position. This makes find() and
+  remove() constant time operations for such lists. Auditors removed
+  from an indexed list leave a hole which is compacted away later, so
+  the order of the remaining auditors is kept.
 */
 
 
@@ -63,6 +70,64 @@
 #define NOTIFY_UNLOCK
 #endif // !COIN_THREADSAFE
 
+#include "misc/SbHash.h"
+#include "tidbitsp.h"
+
+// *************************************************************************
+
+// Lists with more auditors than this are indexed. Below it, a linear
+// search through the list is just as fast as a hash lookup.
+static const int SOAUDITORLIST_INDEX_THRESHOLD = 32;
+
+// Maps from auditor pointer to its position in the list.
+//
+// Removing an auditor from an indexed list only clears its pointer,
+// leaving a hole. The holes are compacted away when they outnumber
+// the auditors, or when a position is asked for while there are holes
+// between the auditors. Removing auditors from the front of the list,
+// as done when a field with many slaves is destructed, therefore
+// stays a constant time operation.
+class SoAuditorListIndex : public SbHash<uintptr_t, int> {
+public:
+  SoAuditorListIndex(const int size)
+    : SbHash<uintptr_t, int>(size), first(0), numholes(0) { }
+  int first;     // position of the first auditor, holes in front of it
+  int numholes;  // total number of holes
+};
+
+// The indices are kept in a dictionary on the side instead of in the
+// SoAuditorList instances, so we don't have to grow the class (see
+// the note in SoAuditorList.h). An indexed list has an entry in the
+// dictionary if and only if it has more than
+// SOAUDITORLIST_INDEX_THRESHOLD auditors. The entry is NULL if the
+// list contains the same auditor more than once, as the index can
+// only map an auditor to a single position.
+//
+// The dictionary is protected by the notify lock, as are the lists.
+typedef SbHash<const SoAuditorList *, SoAuditorListIndex *> SoAuditorListIndexDict;
+static SoAuditorListIndexDict * soauditorlist_indexdict = NULL;
+
+static unsigned int
+SbHashFunc(const SoAuditorList * key)
+{
+  return SbHashFunc(reinterpret_cast<size_t>(key));
+}
+
+static void
+soauditorlist_cleanup(void)
+{
+  delete soauditorlist_indexdict;
+  soauditorlist_indexdict = NULL;
+}
+
+static inline uintptr_t
+soauditorlist_key(const void * auditor)
+{
+  return reinterpret_cast<uintptr_t>(auditor);
+}
+
+// *************************************************************************
+
 /*!
   Default constructor.
 */
@@ -76,6 +141,11 @@ SoAuditorList::SoAuditorList(void)
 */
 SoAuditorList::~SoAuditorList()
 {
+  if (SbPList::getLength() / 2 > SOAUDITORLIST_INDEX_THRESHOLD) {
+    NOTIFY_LOCK;
+    this->dropIndex();
+    NOTIFY_UNLOCK;
+  }
 }
 
 /*!
@@ -87,6 +157,19 @@ SoAuditorList::append(void * const auditor, const SoNotRec::Type type)
   NOTIFY_LOCK;
   SbPList::append(auditor);
   SbPList::append((void *)type);
+
+  const int num = SbPList::getLength() / 2;
+  if (num == SOAUDITORLIST_INDEX_THRESHOLD + 1) {
+    this->buildIndex();
+  }
+  else if (num > SOAUDITORLIST_INDEX_THRESHOLD) {
+    SoAuditorListIndex * index = this->getIndex();
+    if (index && !index->put(soauditorlist_key(auditor), num - 1)) {
+      // auditor was already in the list
+      this->dropIndex();
+      (void)soauditorlist_indexdict->put(this, NULL);
+    }
+  }
   NOTIFY_UNLOCK;
 }
 
@@ -100,8 +183,22 @@ SoAuditorList::set(const int index,
   NOTIFY_LOCK;
   assert(index >= 0 && index < this->getLength());
 
-  SbPList::set(index * 2, auditor);
-  SbPList::set(index * 2 + 1, (void *)type);
+  const int pos = this->position(index);
+  SoAuditorListIndex * auditorindex = NULL;
+  if (SbPList::getLength() / 2 > SOAUDITORLIST_INDEX_THRESHOLD) {
+    auditorindex = this->getIndex();
+    if (auditorindex) {
+      (void)auditorindex->erase(soauditorlist_key(SbPList::operator[](pos * 2)));
+    }
+  }
+
+  SbPList::set(pos * 2, auditor);
+  SbPList::set(pos * 2 + 1, (void *)type);
+
+  if (auditorindex && !auditorindex->put(soauditorlist_key(auditor), pos)) {
+    this->dropIndex();
+    (void)soauditorlist_indexdict->put(this, NULL);
+  }
   NOTIFY_UNLOCK;
 }
 
@@ -111,7 +208,14 @@ SoAuditorList::set(const int index,
 int
 SoAuditorList::getLength(void) const
 {
-  return SbPList::getLength() / 2;
+  int num = SbPList::getLength() / 2;
+  if (num > SOAUDITORLIST_INDEX_THRESHOLD) {
+    NOTIFY_LOCK;
+    const SoAuditorListIndex * index = this->getIndex();
+    if (index) num -= index->numholes;
+    NOTIFY_UNLOCK;
+  }
+  return num;
 }
 
 /*!
@@ -121,7 +225,24 @@ SoAuditorList::getLength(void) const
 int
 SoAuditorList::find(void * const auditor, const SoNotRec::Type type) const
 {
-  const int num = this->getLength();
+  const int num = SbPList::getLength() / 2;
+  if (num > SOAUDITORLIST_INDEX_THRESHOLD) {
+    NOTIFY_LOCK;
+    const SoAuditorListIndex * index = this->getIndex();
+    int i = -1;
+    if (index && index->get(soauditorlist_key(auditor), i)) {
+      if (this->getEntryType(i) != type) { i = -1; }
+      else if (index->numholes != index->first) {
+        // holes between the auditors, compact to get the index
+        const_cast<SoAuditorList *>(this)->compact();
+        index = this->getIndex();
+        (void)index->get(soauditorlist_key(auditor), i);
+      }
+      else { i -= index->first; }
+    }
+    NOTIFY_UNLOCK;
+    if (index) return i;
+  }
   for (int i = 0; i < num; i++) {
     if (this->getObject(i) == auditor && this->getType(i) == type)
       return i;
@@ -135,7 +256,7 @@ SoAuditorList::find(void * const auditor, const SoNotRec::Type type) const
 void *
 SoAuditorList::getObject(const int index) const
 {
-  return SbPList::operator[](index * 2);
+  return SbPList::operator[](this->position(index) * 2);
 }
 
 /*!
@@ -144,8 +265,7 @@ SoAuditorList::getObject(const int index) const
 SoNotRec::Type
 SoAuditorList::getType(const int index) const
 {
-  const uintptr_t tmp = (uintptr_t)(SbPList::operator[](index*2+1));
-  return (SoNotRec::Type)tmp;
+  return this->getEntryType(this->position(index));
 }
 
 /*!
@@ -156,8 +276,7 @@ SoAuditorList::remove(const int index)
 {
   NOTIFY_LOCK;
   assert(index >= 0 && index < this->getLength());
-  SbPList::remove(index * 2); // ptr
-  SbPList::remove(index * 2); // type
+  this->removeEntry(this->position(index));
   NOTIFY_UNLOCK;
 }
 
@@ -167,7 +286,21 @@ SoAuditorList::remove(const int index)
 void
 SoAuditorList::remove(void * const auditor, const SoNotRec::Type type)
 {
-  this->remove(this->find(auditor, type));
+  NOTIFY_LOCK;
+  const SoAuditorListIndex * index =
+    (SbPList::getLength() / 2 > SOAUDITORLIST_INDEX_THRESHOLD) ? this->getIndex() : NULL;
+  if (index) {
+    // look up the position directly, to avoid compacting the list
+    int pos = -1;
+    if (index->get(soauditorlist_key(auditor), pos) &&
+        this->getEntryType(pos) != type) { pos = -1; }
+    assert(pos >= 0);
+    this->removeEntry(pos);
+  }
+  else {
+    this->remove(this->find(auditor, type));
+  }
+  NOTIFY_UNLOCK;
 }
 
 /*!
@@ -189,16 +322,60 @@ SoAuditorList::notify(SoNotList * l)
     // FIXME: should perhaps use a more general mechanism to detect when
     // to ignore notification? (In SoFieldContainer::notify() -- based
     // on SoNotList::getTimeStamp()?) 20000304 mortene.
-    SbPList notified(num);
 
-    for (int i = 0; i < num; i++) {
-      void * auditor = this->getObject(i);
-      if (notified.find(auditor) == -1) {
+    // An index is only kept for lists without duplicate auditors, so
+    // we then don't need to check for them.
+    SbBool unique = FALSE;
+    if (num > SOAUDITORLIST_INDEX_THRESHOLD) {
+      NOTIFY_LOCK;
+      unique = this->getIndex() != NULL;
+      NOTIFY_UNLOCK;
+    }
+
+    if (unique) {
+      // copy the auditors, skipping the holes, as the list may be
+      // compacted if an auditor is removed and another added by a
+      // notification
+      SbList<const void *> auditors(num * 2);
+      const int numentries = SbPList::getLength() / 2;
+      for (int i = 0; i < numentries; i++) {
+        const void * auditor = SbPList::operator[](i * 2);
+        if (auditor) {
+          auditors.append(auditor);
+          auditors.append(SbPList::operator[](i * 2 + 1));
+        }
+      }
+      for (int i = 0; i < num; i++) {
         // use a copy of 'l', since the notification list might change
         // when auditors are notified
         SoNotList listcopy(l);
-        this->doNotify(&listcopy, auditor, this->getType(i));
-        notified.append(auditor);
+        const uintptr_t type = reinterpret_cast<uintptr_t>(auditors[i * 2 + 1]);
+        this->doNotify(&listcopy, auditors[i * 2], static_cast<SoNotRec::Type>(type));
+      }
+    }
+    else if (num <= SOAUDITORLIST_INDEX_THRESHOLD) {
+      SbPList notified(num);
+
+      for (int i = 0; i < num; i++) {
+        void * auditor = this->getObject(i);
+        if (notified.find(auditor) == -1) {
+          // use a copy of 'l', since the notification list might change
+          // when auditors are notified
+          SoNotList listcopy(l);
+          this->doNotify(&listcopy, auditor, this->getType(i));
+          notified.append(auditor);
+        }
+      }
+    }
+    else {
+      SbHash<uintptr_t, SbBool> notified(num * 2);
+
+      for (int i = 0; i < num; i++) {
+        void * auditor = this->getObject(i);
+        if (notified.put(soauditorlist_key(auditor), TRUE)) {
+          SoNotList listcopy(l);
+          this->doNotify(&listcopy, auditor, this->getType(i));
+        }
       }
     }
 
@@ -210,6 +387,176 @@ SoAuditorList::notify(SoNotList * l)
   }
 }
 
+//
+// Private method which returns the auditor index of this list, or
+// NULL if the list isn't indexed. Must be called with the notify
+// lock held.
+//
+SoAuditorListIndex *
+SoAuditorList::getIndex(void) const
+{
+  SoAuditorListIndex * index = NULL;
+  if (soauditorlist_indexdict) (void)soauditorlist_indexdict->get(this, index);
+  return index;
+}
+
+//
+// Private method which indexes all auditors in the list. Must be
+// called with the notify lock held.
+//
+void
+SoAuditorList::buildIndex(void)
+{
+  if (soauditorlist_indexdict == NULL) {
+    soauditorlist_indexdict = new SoAuditorListIndexDict;
+    coin_atexit(static_cast<coin_atexit_f *>(soauditorlist_cleanup), CC_ATEXIT_NORMAL);
+  }
+  const int num = SbPList::getLength() / 2;
+  SoAuditorListIndex * index = new SoAuditorListIndex(num * 2);
+  for (int i = 0; i < num; i++) {
+    if (!index->put(soauditorlist_key(SbPList::operator[](i * 2)), i)) {
+      delete index;
+      index = NULL;
+      break;
+    }
+  }
+  (void)soauditorlist_indexdict->put(this, index);
+}
+
+//
+// Private method which removes the auditor index of this list,
+// compacting away the holes first. Must be called with the notify
+// lock held.
+//
+void
+SoAuditorList::dropIndex(void)
+{
+  SoAuditorListIndex * index = this->getIndex();
+  if (index && index->numholes) {
+    this->compactEntries(index);
+  }
+  delete index;
+  if (soauditorlist_indexdict) (void)soauditorlist_indexdict->erase(this);
+}
+
+//
+// Private method which moves the auditors of an indexed list down
+// over the holes, keeping their order. Must be called with the
+// notify lock held.
+//
+void
+SoAuditorList::compactEntries(SoAuditorListIndex * index)
+{
+  const int num = SbPList::getLength() / 2;
+  int dst = 0;
+  for (int src = index->first; src < num; src++) {
+    void * auditor = SbPList::operator[](src * 2);
+    if (auditor == NULL) continue;
+    if (dst != src) {
+      SbPList::set(dst * 2, auditor);
+      SbPList::set(dst * 2 + 1, SbPList::operator[](src * 2 + 1));
+      (void)index->put(soauditorlist_key(auditor), dst);
+    }
+    dst++;
+  }
+  SbPList::truncate(dst * 2);
+  index->first = 0;
+  index->numholes = 0;
+}
+
+//
+// Private method which compacts the list if it has holes. Must be
+// called with the notify lock held.
+//
+void
+SoAuditorList::compact(void)
+{
+  SoAuditorListIndex * index = this->getIndex();
+  if (index && index->numholes) this->compactEntries(index);
+}
+
+//
+// Private method which returns the position of the auditor at \a
+// index, compacting the list first if there are holes between the
+// auditors.
+//
+int
+SoAuditorList::position(const int index) const
+{
+  if (SbPList::getLength() / 2 <= SOAUDITORLIST_INDEX_THRESHOLD) return index;
+
+  NOTIFY_LOCK;
+  const SoAuditorListIndex * auditorindex = this->getIndex();
+  int pos = index;
+  if (auditorindex && auditorindex->numholes) {
+    if (auditorindex->numholes != auditorindex->first) {
+      const_cast<SoAuditorList *>(this)->compact();
+    }
+    else {
+      pos += auditorindex->first;
+    }
+  }
+  NOTIFY_UNLOCK;
+  return pos;
+}
+
+//
+// Private method which returns the type of the auditor at position
+// \a pos.
+//
+SoNotRec::Type
+SoAuditorList::getEntryType(const int pos) const
+{
+  const uintptr_t tmp = (uintptr_t)(SbPList::operator[](pos*2+1));
+  return (SoNotRec::Type)tmp;
+}
+
+//
+// Private method which removes the auditor at position \a pos. Must
+// be called with the notify lock held.
+//
+void
+SoAuditorList::removeEntry(const int pos)
+{
+  const int numentries = SbPList::getLength() / 2;
+  SoAuditorListIndex * index =
+    (numentries > SOAUDITORLIST_INDEX_THRESHOLD) ? this->getIndex() : NULL;
+  if (index == NULL) {
+    SbPList::remove(pos * 2); // ptr
+    SbPList::remove(pos * 2); // type
+    if (numentries == SOAUDITORLIST_INDEX_THRESHOLD + 1) {
+      this->dropIndex();
+    }
+    return;
+  }
+
+  (void)index->erase(soauditorlist_key(SbPList::operator[](pos * 2)));
+  SbPList::set(pos * 2, NULL);
+  index->numholes++;
+
+  // skip holes in front of the list and drop holes at the end of it
+  if (pos == index->first) {
+    while (index->first < numentries &&
+           SbPList::operator[](index->first * 2) == NULL) {
+      index->first++;
+    }
+  }
+  int num = numentries;
+  while (num > index->first && SbPList::operator[]((num - 1) * 2) == NULL) {
+    num--;
+    index->numholes--;
+  }
+  if (num < numentries) SbPList::truncate(num * 2);
+
+  const int numauditors = num - index->numholes;
+  if (numauditors <= SOAUDITORLIST_INDEX_THRESHOLD) {
+    this->dropIndex();
+  }
+  else if (index->numholes > numauditors) {
+    this->compactEntries(index);
+  }
+}
+
 //
 // Private method used to propagate 'l' to the 'auditor' of type 'type'
 //
@@ -261,3 +608,88 @@ SoAuditorList::doNotify(SoNotList * l, const void * auditor, const SoNotRec::Typ
 
 #undef NOTIFY_LOCK
 #undef NOTIFY_UNLOCK
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/fields/SoSFFloat.h>
+#include <Inventor/lists/SoAuditorList.h>
+
+BOOST_AUTO_TEST_CASE(indexedFindAndRemove)
+{
+  static char auditors[100];
+  SoAuditorList list;
+  for (int i = 0; i < 100; i++) { list.append(&auditors[i], SoNotRec::FIELD); }
+
+  // remove every other auditor, and check that the rest can be found
+  for (int i = 0; i < 100; i += 2) { list.remove(&auditors[i], SoNotRec::FIELD); }
+  BOOST_CHECK_EQUAL(list.getLength(), 50);
+  SbBool ok = TRUE;
+  for (int i = 0; i < 100; i++) {
+    const int idx = list.find(&auditors[i], SoNotRec::FIELD);
+    if (i % 2) { ok = ok && idx >= 0 && list.getObject(idx) == &auditors[i]; }
+    else { ok = ok && idx == -1; }
+  }
+  BOOST_CHECK_MESSAGE(ok, "auditors not found after removal");
+  BOOST_CHECK_EQUAL(list.find(&auditors[1], SoNotRec::SENSOR), -1);
+
+  // a duplicate auditor must still be found and removed correctly
+  list.append(&auditors[1], SoNotRec::FIELD);
+  list.remove(&auditors[1], SoNotRec::FIELD);
+  BOOST_CHECK(list.find(&auditors[1], SoNotRec::FIELD) >= 0);
+
+  while (list.getLength() > 0) { list.remove(list.getLength() / 2); }
+}
+
+BOOST_AUTO_TEST_CASE(indexedRemoveKeepsOrder)
+{
+  static char auditors[200];
+  SoAuditorList list;
+  for (int i = 0; i < 200; i++) { list.append(&auditors[i], SoNotRec::FIELD); }
+
+  // remove from the front, the back and the middle of the list
+  for (int i = 0; i < 20; i++) { list.remove(&auditors[i], SoNotRec::FIELD); }
+  for (int i = 190; i < 200; i++) { list.remove(&auditors[i], SoNotRec::FIELD); }
+  for (int i = 21; i < 190; i += 3) { list.remove(&auditors[i], SoNotRec::FIELD); }
+
+  SbList<const char *> expected;
+  for (int i = 20; i < 190; i++) {
+    if ((i < 21) || ((i - 21) % 3)) expected.append(&auditors[i]);
+  }
+  BOOST_CHECK_EQUAL(list.getLength(), expected.getLength());
+  SbBool ok = list.getLength() == expected.getLength();
+  for (int i = 0; ok && i < expected.getLength(); i++) {
+    ok = list.getObject(i) == expected[i] &&
+      list.find(&auditors[expected[i] - auditors], SoNotRec::FIELD) == i;
+  }
+  BOOST_CHECK_MESSAGE(ok, "removal changed the order of the auditors");
+
+  // appending after the holes keeps the order too
+  list.append(&auditors[0], SoNotRec::FIELD);
+  BOOST_CHECK(list.getObject(list.getLength() - 1) == &auditors[0]);
+  BOOST_CHECK(list.getObject(0) == &auditors[20]);
+
+  while (list.getLength() > 0) { list.remove(0); }
+}
+
+BOOST_AUTO_TEST_CASE(manySlaveFields)
+{
+  SoSFFloat master;
+  SoSFFloat slaves[100];
+  master.setValue(0.0f);
+  for (int i = 0; i < 100; i++) { slaves[i].connectFrom(&master); }
+  for (int i = 0; i < 100; i += 3) {
+    slaves[i].disconnect();
+    slaves[i].setValue(-1.0f);
+  }
+
+  master.setValue(1.0f);
+  SbBool ok = TRUE;
+  for (int i = 0; i < 100; i++) {
+    ok = ok && (slaves[i].getValue() == ((i % 3) ? 1.0f : -1.0f));
+  }
+  BOOST_CHECK_MESSAGE(ok, "wrong values in slave fields");
+
+  for (int i = 0; i < 100; i++) { slaves[i].disconnect(); }
+}
+
+#endif // COIN_TEST_SUITE
@@ -85,6 +85,7 @@
 #include <Inventor/sensors/SoDataSensor.h>
 
 #include "misc/SoBaseP.h"
+#include "misc/SoDBP.h"
 #include "nodes/SoUnknownNode.h"
 #include "fields/SoGlobalField.h"
 #include "misc/SbHash.h"
@@ -804,6 +805,9 @@ SoBase::notify(SoNotList * l)
   SoDebugError::postInfo("SoBase::notify", "base %p, list %p", this, l);
 #endif // debug
 
+  // see SoDB::enableNotifyBatching()
+  if (SoDBP::notifybatching && !SoDBP::addToNotifyBatch(this)) return;
+
   SoBase::PImpl::NotifyData notdata;
   notdata.cnt = cc_rbptree_size(&this->auditortree);
   notdata.list = l;
@@ -826,6 +830,8 @@ SoBase::addAuditor(void * const auditor, const SoNotRec::Type type)
   // casting to void*.
   const uintptr_t val = (uintptr_t)type;
   cc_rbptree_insert(&this->auditortree, auditor, (void *)val);
+  // see SoDB::enableNotifyBatching()
+  if (SoDBP::notifybatching) SoDBP::clearNotifyBatch();
 }
 
 /*!
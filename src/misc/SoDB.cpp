@@ -151,6 +151,11 @@
 #ifndef DOXYGEN_SKIP_THIS
 const char * SoDBP::EnvVars::COIN_PROFILER = "COIN_PROFILER";
 const char * SoDBP::EnvVars::COIN_PROFILER_OVERLAY = "COIN_PROFILER_OVERLAY";
+
+const char * SoDBP::SnapshotHeaders::LITTLE_ENDIAN_HEADER =
+  "#Inventor V2.1 snapshot little-endian";
+const char * SoDBP::SnapshotHeaders::BIG_ENDIAN_HEADER =
+  "#Inventor V2.1 snapshot big-endian";
 #endif // DOXYGEN_SKIP_THIS
 
 // *************************************************************************
@@ -360,6 +365,12 @@ SoDB::init(void)
                        NULL, NULL, NULL);
   SoDB::registerHeader(SbString("#Inventor V2.1 binary  "), TRUE, 2.1f,
                        NULL, NULL, NULL);
+  // Snapshots are binary V2.1 files with number arrays stored in
+  // native byte order, see SoWriteAction::setSnapshot().
+  SoDB::registerHeader(SbString(SoDBP::SnapshotHeaders::LITTLE_ENDIAN_HEADER),
+                       TRUE, 2.1f, NULL, NULL, NULL);
+  SoDB::registerHeader(SbString(SoDBP::SnapshotHeaders::BIG_ENDIAN_HEADER),
+                       TRUE, 2.1f, NULL, NULL, NULL);
 
   // FIXME: this is really only valid if the HAVE_VRML97 define is in
   // place. If it is not, we should register the header in a way so
@@ -1163,6 +1174,7 @@ SoDB::endNotify(void)
 {
   SoDBP::notificationcounter--;
   if (SoDBP::notificationcounter == 0) {
+    SoDBP::clearNotifyBatch();
     // Process zero-priority sensors after notification has been done.
     SoSensorManager * sm = SoDB::getSensorManager();
     if (sm->isDelaySensorPending()) sm->processImmediateQueue();
@@ -1173,6 +1185,61 @@ SoDB::endNotify(void)
 
 }
 
+/*!
+  Turn on or off batching of notifications. Batching is off by
+  default.
+
+  With batching on, an object passes notification on to its auditors
+  only once for each outermost startNotify() / endNotify() pair. A
+  large number of changes can then be done as one batch:
+
+  \code
+  SoDB::enableNotifyBatching(TRUE);
+  SoDB::startNotify();
+  for (int i = 0; i < num; i++) {
+    materials[i]->diffuseColor.setValue(colors[i]);
+  }
+  SoDB::endNotify();
+  \endcode
+
+  Without batching, every change is propagated all the way up to the
+  root of the scene graph, so for instance the parents of a node which
+  is shared by many groups would be notified once for each of the
+  changes.
+
+  Every change still reaches the object it was made to, but the
+  object only passes notification on the first time within a
+  batch. Node sensors are therefore triggered with the trigger
+  information of the first change in the batch. Adding an auditor
+  (for instance a child to a group, or a sensor to a node) makes all
+  objects pass on notification again, so new auditors don't miss any
+  changes.
+
+  Note that caches are only invalidated by the first notification
+  which reaches them, so the scene graph should not be traversed by
+  any action in the middle of a batch.
+
+  \since Coin 4.1
+  \sa isNotifyBatchingEnabled(), startNotify()
+*/
+void
+SoDB::enableNotifyBatching(const SbBool on)
+{
+  SoDBP::notifybatching = on;
+}
+
+/*!
+  Returns whether or not notifications are batched.
+
+  \since Coin 4.1
+  \sa enableNotifyBatching()
+*/
+SbBool
+SoDB::isNotifyBatchingEnabled(void)
+{
+  return SoDBP::notifybatching;
+}
+
 /*!
   Turn on or off the real time sensor.
 
@@ -1700,6 +1767,8 @@ SoDB::removeRoute(SoNode * fromnode, const char * eventout,
 #include <Inventor/nodes/SoNode.h>
 #include <Inventor/nodes/SoSeparator.h>
 #include <Inventor/nodes/SoRotationXYZ.h>
+#include <Inventor/nodes/SoMaterial.h>
+#include <Inventor/sensors/SoNodeSensor.h>
 #include <boost/detail/workaround.hpp>
 
 BOOST_AUTO_TEST_CASE(globalRealTimeField)
@@ -1742,6 +1811,30 @@ BOOST_AUTO_TEST_CASE(readChildList)
   root->unref();
 }
 
+BOOST_AUTO_TEST_CASE(readFilePointerAtOffset)
+{
+  // reading must start at the current position of a FILE * passed
+  // in by the application, also when the file is memory mapped
+  FILE * fp = tmpfile();
+  BOOST_REQUIRE(fp);
+  fputs("garbage which should be skipped\n", fp);
+  const long offset = ftell(fp);
+  fputs("#Inventor V2.1 ascii\n\nDEF mappedfile Group { Group {} Group {} }\n", fp);
+  fflush(fp);
+  fseek(fp, offset, SEEK_SET);
+
+  SoInput in;
+  in.setFilePointer(fp);
+  SoSeparator * root = SoDB::readAll(&in);
+  BOOST_REQUIRE(root);
+  root->ref();
+  SoGroup * group = (SoGroup *) SoNode::getByName("mappedfile");
+  BOOST_REQUIRE(group);
+  BOOST_CHECK_EQUAL(group->getNumChildren(), 2);
+  root->unref();
+  fclose(fp);
+}
+
 BOOST_AUTO_TEST_CASE(readEmptyChildList)
 {
   // FIXME: We are forced to restore the global state before terminating,
@@ -1899,4 +1992,61 @@ BOOST_AUTO_TEST_CASE(globalfield_import)
 
 // *************************************************************************
 
+// Counts the notifications which reach the sensor.
+class SoDBTestCountingSensor : public SoNodeSensor {
+public:
+  SoDBTestCountingSensor(void) : count(0) { }
+  virtual void notify(SoNotList * l) { this->count++; SoNodeSensor::notify(l); }
+  int count;
+};
+
+BOOST_AUTO_TEST_CASE(notifyBatching)
+{
+  SoGroup * root = new SoGroup;
+  root->ref();
+  SoGroup * group = new SoGroup;
+  SoMaterial * material = new SoMaterial;
+  root->addChild(group);
+  group->addChild(material);
+
+  SoDBTestCountingSensor rootsensor;
+  rootsensor.attach(root);
+
+  for (int batching = 0; batching < 2; batching++) {
+    SoDB::enableNotifyBatching(batching);
+    rootsensor.count = 0;
+    SoDB::startNotify();
+    material->diffuseColor.setValue(1.0f, 0.0f, 0.0f);
+    material->transparency.setValue(0.5f);
+    SoDB::endNotify();
+    BOOST_CHECK_MESSAGE(rootsensor.count == (batching ? 1 : 2),
+                        "wrong number of notifications reached the root");
+  }
+
+  // an auditor added in the middle of a batch must not miss
+  // notifications from objects which have already been notified
+  SoDBTestCountingSensor groupsensor;
+  rootsensor.count = 0;
+  SoDB::startNotify();
+  material->shininess.setValue(0.5f);
+  groupsensor.attach(group);
+  material->shininess.setValue(0.2f);
+  SoDB::endNotify();
+  BOOST_CHECK_MESSAGE(groupsensor.count == 1,
+                      "auditor added during batch was not notified");
+  BOOST_CHECK_MESSAGE(rootsensor.count == 2,
+                      "wrong number of notifications reached the root");
+
+  // notification is passed on again in the next batch
+  rootsensor.count = 0;
+  material->shininess.setValue(0.3f);
+  BOOST_CHECK_MESSAGE(rootsensor.count == 1,
+                      "notification not passed on after batch");
+
+  SoDB::enableNotifyBatching(FALSE);
+  groupsensor.detach();
+  rootsensor.detach();
+  root->unref();
+}
+
 #endif // COIN_TEST_SUITE
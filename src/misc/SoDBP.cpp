@@ -5,6 +5,7 @@
 #include <Inventor/fields/SoField.h>
 #include <Inventor/fields/SoSFTime.h>
 #include <Inventor/errors/SoDebugError.h>
+#include <Inventor/C/tidbits.h>
 #include <Inventor/sensors/SoTimerSensor.h>
 
 #ifdef HAVE_CONFIG_H
@@ -19,6 +20,7 @@
 #include "coindefs.h"
 
 #ifdef COIN_THREADSAFE
+#include "threads/recmutexp.h"
 // need to include SbRWMutex.h to make C++ call the actual destructor,
 // and not just default destructor
 #include <Inventor/threads/SbRWMutex.h>
@@ -30,6 +32,9 @@ SoTimerSensor * SoDBP::globaltimersensor = NULL;
 UInt32ToInt16Map * SoDBP::converters = NULL;
 SbBool SoDBP::isinitialized = FALSE;
 int SoDBP::notificationcounter = 0;
+SbBool SoDBP::notifybatching = FALSE;
+SbHash<const SoBase *, SbBool> * SoDBP::notifybatch = NULL;
+SbList<const SoBase *> * SoDBP::notifybatchlist = NULL;
 SbList<SoDBP::ProgressCallbackInfo> * SoDBP::progresscblist = NULL;
 
 // *************************************************************************
@@ -73,6 +78,15 @@ forward_sprintf(char * dst, unsigned int realdstlen, const char * fmtstr, ...)
   va_end(args);
 }
 
+// Returns the snapshot header matching the byte order of this host.
+const char *
+SoDBP::getSnapshotHeader(void)
+{
+  return (coin_host_get_endianness() == COIN_HOST_IS_BIGENDIAN) ?
+    SoDBP::SnapshotHeaders::BIG_ENDIAN_HEADER :
+    SoDBP::SnapshotHeaders::LITTLE_ENDIAN_HEADER;
+}
+
 void
 SoDBP::variableArgsSanityCheck(void)
 {
@@ -110,6 +124,11 @@ SoDBP::clean(void)
   delete SoDBP::progresscblist;
   SoDBP::progresscblist = NULL;
 
+  delete SoDBP::notifybatch;
+  SoDBP::notifybatch = NULL;
+  delete SoDBP::notifybatchlist;
+  SoDBP::notifybatchlist = NULL;
+
   // Avoid having the SoSensorManager instance trigging the callback
   // into the So@Gui@ class -- not only have it possible "died", but
   // the whole GUI toolkit could have died until we come here.
@@ -166,6 +185,45 @@ SoDBP::updateRealTimeFieldCB(void * COIN_UNUSED_ARG(data), SoSensor * COIN_UNUSE
   }
 }
 
+// Returns FALSE if notification has already been passed on from
+// 'base' in the current notification epoch, otherwise records it as
+// passed on and returns TRUE. Must be called with the notify lock
+// held.
+SbBool
+SoDBP::addToNotifyBatch(const SoBase * base)
+{
+  if (SoDBP::notificationcounter == 0) { return TRUE; }
+  if (SoDBP::notifybatch == NULL) {
+    SoDBP::notifybatch = new SbHash<const SoBase *, SbBool>;
+    SoDBP::notifybatchlist = new SbList<const SoBase *>;
+  }
+  if (!SoDBP::notifybatch->put(base, TRUE)) { return FALSE; }
+  SoDBP::notifybatchlist->append(base);
+  return TRUE;
+}
+
+// Makes all objects pass on notification again. Called at the end of
+// each notification epoch, and when an auditor is added in the middle
+// of one, so that the new auditor doesn't miss notifications from
+// objects further down in the scene graph. The entries are erased one
+// by one, as clearing the hash table would visit all its buckets.
+void
+SoDBP::clearNotifyBatch(void)
+{
+  if (SoDBP::notifybatchlist == NULL) { return; }
+#ifdef COIN_THREADSAFE
+  (void) cc_recmutex_internal_notify_lock();
+#endif // COIN_THREADSAFE
+  const int num = SoDBP::notifybatchlist->getLength();
+  for (int i = 0; i < num; i++) {
+    (void)SoDBP::notifybatch->erase((*SoDBP::notifybatchlist)[i]);
+  }
+  SoDBP::notifybatchlist->truncate(0);
+#ifdef COIN_THREADSAFE
+  (void) cc_recmutex_internal_notify_unlock();
+#endif // COIN_THREADSAFE
+}
+
 SbBool
 SoDBP::is3dsFile(SoInput * in)
 {
@@ -77,6 +77,15 @@ public:
     static const char * COIN_PROFILER_OVERLAY;
   };
 
+  // Headers of the snapshot format written by
+  // SoWriteAction::setSnapshot(), one for each byte order of the
+  // number arrays in the file.
+  struct SnapshotHeaders {
+    static const char * LITTLE_ENDIAN_HEADER;
+    static const char * BIG_ENDIAN_HEADER;
+  };
+  static const char * getSnapshotHeader(void);
+
   static void variableArgsSanityCheck(void);
 
   static void clean(void);
@@ -94,6 +103,12 @@ public:
   static int notificationcounter;
   static SbBool isinitialized;
 
+  static SbBool notifybatching;
+  static SbHash<const SoBase *, SbBool> * notifybatch;
+  static SbList<const SoBase *> * notifybatchlist;
+  static SbBool addToNotifyBatch(const SoBase * base);
+  static void clearNotifyBatch(void);
+
   static SbBool is3dsFile(SoInput * in);
   static SoSeparator * read3DSFile(SoInput * in);
 
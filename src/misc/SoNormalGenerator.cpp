@@ -42,10 +42,12 @@
 #include <Inventor/misc/SoNormalGenerator.h>
 
 #include <cstdio>
+#include <cstring>
 
 #include <Inventor/errors/SoDebugError.h>
 
 #include "tidbitsp.h"
+#include "threads/parallelp.h"
 #include "coindefs.h" // COIN_OBSOLETED()
 
 /*!
@@ -55,8 +57,7 @@
 */
 SoNormalGenerator::SoNormalGenerator(const SbBool isccw,
                                      const int approxVertices)
-  : bsp(128, approxVertices),
-    vertexList(approxVertices),
+  : vertexCoords(approxVertices),
     vertexFace(approxVertices),
     faceNormals(approxVertices / 4),
     vertexNormals(approxVertices),
@@ -84,8 +85,7 @@ void
 SoNormalGenerator::reset(const SbBool ccwarg)
 {
   this->ccw = ccwarg;
-  this->bsp.clear();
-  this->vertexList.truncate(0);
+  this->vertexCoords.truncate(0);
   this->vertexFace.truncate(0);
   this->faceNormals.truncate(0);
   this->vertexNormals.truncate(0);
@@ -100,7 +100,7 @@ SoNormalGenerator::reset(const SbBool ccwarg)
 void
 SoNormalGenerator::beginPolygon(void)
 {
-  this->currFaceStart = this->vertexList.getLength();
+  this->currFaceStart = this->vertexCoords.getLength();
 }
 
 /*!
@@ -111,7 +111,7 @@ SoNormalGenerator::beginPolygon(void)
 void
 SoNormalGenerator::polygonVertex(const SbVec3f &v)
 {
-  this->vertexList.append(this->bsp.addPoint(v));
+  this->vertexCoords.append(v);
   this->vertexFace.append(this->faceNormals.getLength());
 }
 
@@ -165,14 +165,13 @@ SoNormalGenerator::quad(const SbVec3f &v0,
 //
 static void
 calc_normal_vec(const SbVec3f *facenormals, const int facenum,
-                SbList <int32_t> &faceArray, const float threshold,
+                const int32_t * faceArray, const int n, const float threshold,
                 SbVec3f &vertnormal)
 {
   // start with face normal vector
   const SbVec3f * facenormal = &facenormals[facenum];
   vertnormal = *facenormal;
 
-  int n = faceArray.getLength();
   int currface;
 
   for (int i = 0; i < n; i++) {
@@ -187,6 +186,90 @@ calc_normal_vec(const SbVec3f *facenormals, const int facenum,
   }
 }
 
+static uint32_t
+sonormalgenerator_hash(const SbVec3f & v)
+{
+  uint32_t h = 2166136261u;
+  for (int i = 0; i < 3; i++) {
+    // adding 0 turns -0 into 0, as they compare equal
+    const float f = v[i] + 0.0f;
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    h = (h ^ u) * 16777619u;
+  }
+  return h ^ (h >> 15);
+}
+
+//
+// Finds the unique vertex of each of the num coordinates, using a
+// hash table with linear probing. Coordinates are considered equal
+// if they compare equal, just like in SbBSPTree::addPoint(). Returns
+// the number of unique vertices.
+//
+static int
+sonormalgenerator_weld(const SbVec3f * coords, const int num, int * vertexidx)
+{
+  int tablesize = 64;
+  while (tablesize < num * 2) tablesize <<= 1;
+  const uint32_t mask = uint32_t(tablesize - 1);
+
+  // the table holds the first coordinate index of each unique vertex
+  int * table = new int[tablesize];
+  for (int i = 0; i < tablesize; i++) table[i] = -1;
+
+  int numunique = 0;
+  for (int i = 0; i < num; i++) {
+    const SbVec3f & v = coords[i];
+    uint32_t slot = sonormalgenerator_hash(v) & mask;
+    while (table[slot] >= 0 && !(coords[table[slot]] == v)) {
+      slot = (slot + 1) & mask;
+    }
+    if (table[slot] < 0) {
+      table[slot] = i;
+      vertexidx[i] = numunique++;
+    }
+    else {
+      vertexidx[i] = vertexidx[table[slot]];
+    }
+  }
+  delete [] table;
+  return numunique;
+}
+
+// Data for the jobs calculating vertex normals in generate().
+typedef struct {
+  const SbVec3f * facenormals;
+  const int * vertexface;
+  const int * vertexidx;
+  const int * corners;
+  const int * facestart;
+  const int32_t * faces;
+  float threshold;
+  SbVec3f * result;
+  int num;
+  int numjobs;
+} sonormalgenerator_data;
+
+static void
+sonormalgenerator_job(void * closure, int job)
+{
+  const sonormalgenerator_data * data =
+    static_cast<const sonormalgenerator_data *>(closure);
+  const int start = int((int64_t(data->num) * job) / data->numjobs);
+  const int end = int((int64_t(data->num) * (job + 1)) / data->numjobs);
+
+  for (int i = start; i < end; i++) {
+    const int corner = data->corners ? data->corners[i] : i;
+    const int vidx = data->vertexidx[corner];
+    const int first = data->facestart[vidx];
+    SbVec3f & tmpvec = data->result[i];
+    calc_normal_vec(data->facenormals, data->vertexface[corner],
+                    data->faces + first, data->facestart[vidx+1] - first,
+                    data->threshold, tmpvec);
+    (void) tmpvec.normalize();
+  }
+}
+
 /*!
   Triggers the normal generation. Normals are generated using
   \a creaseAngle to find which edges should be flat-shaded
@@ -212,67 +295,83 @@ SoNormalGenerator::generate(const float creaseAngle,
   // longer triangle strips).
 
   int i;
-
-  // for each vertex, store all faceindices the vertex is a part of
-  SbList <int32_t> * vertexFaceArray = new SbList<int32_t>[bsp.numPoints()];
-
-  int numvi = this->vertexList.getLength();
-
-  for (i = 0; i < numvi; i++) {
-    vertexFaceArray[vertexList[i]].append(this->vertexFace[i]);
-  }
-
-  float threshold = (float)cos(SbClamp(creaseAngle, 0.0f, (float) M_PI));
-
+  const int numvi = this->vertexFace.getLength();
+  const SbVec3f * coords = this->vertexCoords.getArrayPtr();
+
+  // find the unique vertex of each polygon vertex
+  int * vertexidx = new int[SbMax(numvi, 1)];
+  const int numunique = sonormalgenerator_weld(coords, numvi, vertexidx);
+
+  // for each unique vertex, store all faceindices the vertex is a
+  // part of, in a single array with facestart[v] as the first index
+  // for vertex v
+  int * facestart = new int[numunique + 1];
+  int32_t * faces = new int32_t[SbMax(numvi, 1)];
+  for (i = 0; i <= numunique; i++) facestart[i] = 0;
+  for (i = 0; i < numvi; i++) facestart[vertexidx[i] + 1]++;
+  for (i = 0; i < numunique; i++) facestart[i+1] += facestart[i];
+  int * pos = new int[SbMax(numunique, 1)];
+  for (i = 0; i < numunique; i++) pos[i] = facestart[i];
+  for (i = 0; i < numvi; i++) faces[pos[vertexidx[i]]++] = this->vertexFace[i];
+  delete [] pos;
+
+  // for triangle strips, find the polygon vertices that get a normal
+  int * corners = NULL;
+  int numnormals = numvi;
   if (striplens) {
+    SbList <int> cornerlist(numvi);
     i = 0;
     for (int j = 0; j < numstrips; j++) {
       assert(i+2 < numvi);
-      SbVec3f tmpvec;
-      calc_normal_vec(this->faceNormals.getArrayPtr(),
-                      this->vertexFace[i],
-                      vertexFaceArray[vertexList[i]],
-                      threshold, tmpvec);
-      (void) tmpvec.normalize();
-      this->vertexNormals.append(tmpvec);
-      calc_normal_vec(this->faceNormals.getArrayPtr(),
-                      this->vertexFace[i+1],
-                      vertexFaceArray[vertexList[i+1]],
-                      threshold, tmpvec);
-      (void) tmpvec.normalize();
-      this->vertexNormals.append(tmpvec);
+      cornerlist.append(i);
+      cornerlist.append(i+1);
 
       int num = striplens[j] - 2;
 
       while (num--) {
         i += 2;
         assert(i < numvi);
-        calc_normal_vec(this->faceNormals.getArrayPtr(),
-                        this->vertexFace[i],
-                        vertexFaceArray[vertexList[i]],
-                        threshold, tmpvec);
-        (void) tmpvec.normalize();
-        this->vertexNormals.append(tmpvec);
+        cornerlist.append(i);
         i++;
       }
     }
+    numnormals = cornerlist.getLength();
+    corners = new int[SbMax(numnormals, 1)];
+    for (i = 0; i < numnormals; i++) corners[i] = cornerlist[i];
   }
-  else {
-    for (i = 0; i < numvi; i++) {
-      SbVec3f tmpvec;
-      calc_normal_vec(this->faceNormals.getArrayPtr(),
-                      this->vertexFace[i],
-                      vertexFaceArray[vertexList[i]],
-                      threshold, tmpvec);
-      (void) tmpvec.normalize();
-      this->vertexNormals.append(tmpvec);
-    }
-  }
-  delete [] vertexFaceArray;
+
+  SbVec3f * result = new SbVec3f[SbMax(numnormals, 1)];
+
+  sonormalgenerator_data data;
+  data.facenormals = this->faceNormals.getArrayPtr();
+  data.vertexface = this->vertexFace.getArrayPtr();
+  data.vertexidx = vertexidx;
+  data.corners = corners;
+  data.facestart = facestart;
+  data.faces = faces;
+  data.threshold = (float)cos(SbClamp(creaseAngle, 0.0f, (float) M_PI));
+  data.result = result;
+  data.num = numnormals;
+
+  // the normals are independent of each other, so spread them over
+  // the available CPUs for large meshes
+  const int numthreads = cc_parallel_get_num_threads();
+  const int maxjobs = (numthreads > 1) ? numthreads * 4 : 1;
+  data.numjobs = SbMax(1, SbMin(maxjobs, numnormals / 4096));
+  cc_parallel_run(data.numjobs, sonormalgenerator_job, &data);
+
+  this->vertexNormals.truncate(0);
+  this->vertexNormals.ensureCapacity(numnormals);
+  for (i = 0; i < numnormals; i++) this->vertexNormals.append(result[i]);
+
+  delete [] result;
+  delete [] corners;
+  delete [] faces;
+  delete [] facestart;
+  delete [] vertexidx;
+  this->vertexCoords.truncate(0, TRUE);
   this->vertexFace.truncate(0, TRUE);
-  this->vertexList.truncate(0, TRUE);
   this->faceNormals.truncate(0, TRUE);
-  this->bsp.clear();
   this->vertexNormals.fit();
 
   // return vertex normals
@@ -300,6 +399,9 @@ SoNormalGenerator::generatePerStrip(const int32_t * striplens,
   }
   // strip normals can now be found in faceNormals array
   this->faceNormals.truncate(numstrips, TRUE);
+  this->vertexCoords.truncate(0, TRUE);
+  this->vertexFace.truncate(0, TRUE);
+  this->vertexNormals.truncate(0, TRUE);
   this->perVertex = FALSE;
 }
 
@@ -313,6 +415,9 @@ SoNormalGenerator::generatePerFace(void)
   // face normals have already been generated. Just set flag.
   this->perVertex = FALSE;
   this->faceNormals.fit();
+  this->vertexCoords.truncate(0, TRUE);
+  this->vertexFace.truncate(0, TRUE);
+  this->vertexNormals.truncate(0, TRUE);
 }
 
 /*!
@@ -330,6 +435,9 @@ SoNormalGenerator::generateOverall(void)
   (void) acc.normalize();
   this->faceNormals.truncate(0, TRUE);
   this->faceNormals.append(acc);
+  this->vertexCoords.truncate(0, TRUE);
+  this->vertexFace.truncate(0, TRUE);
+  this->vertexNormals.truncate(0, TRUE);
 
   // normals are not per vertex
   this->perVertex = FALSE;
@@ -401,16 +509,15 @@ SoNormalGenerator::setNormal(const int32_t /* index */,
 SbVec3f
 SoNormalGenerator::calcFaceNormal(void)
 {
-  const int num = this->vertexList.getLength() - this->currFaceStart;
+  const int num = this->vertexCoords.getLength() - this->currFaceStart;
 
   assert(num >= 3);
-  const int * cind = (const int *) this->vertexList.getArrayPtr() + this->currFaceStart;
-  const SbVec3f * coords = this->bsp.getPointsArrayPtr();
+  const SbVec3f * coords = this->vertexCoords.getArrayPtr(this->currFaceStart);
   SbVec3f ret;
 
   if (num == 3) { // triangle
-    const SbVec3f v0 = coords[cind[0]] - coords[cind[1]];
-    const SbVec3f v1 = coords[cind[2]] - coords[cind[1]];
+    const SbVec3f v0 = coords[0] - coords[1];
+    const SbVec3f v1 = coords[2] - coords[1];
     if (!this->ccw) { ret = v0.cross(v1); }
     else { ret = v1.cross(v0); }
   }
@@ -418,10 +525,10 @@ SoNormalGenerator::calcFaceNormal(void)
     // For non-triangle faces
     const SbVec3f *vert1, *vert2;
     ret.setValue(0.0f, 0.0f, 0.0f);
-    vert2 = coords + cind[num-1];
+    vert2 = coords + num - 1;
     for (int i = 0; i < num; i++) {
       vert1 = vert2;
-      vert2 = coords + cind[i];
+      vert2 = coords + i;
       ret[0] += ((*vert1)[1] - (*vert2)[1]) * ((*vert1)[2] + (*vert2)[2]);
       ret[1] += ((*vert1)[2] - (*vert2)[2]) * ((*vert1)[0] + (*vert2)[0]);
       ret[2] += ((*vert1)[0] - (*vert2)[0]) * ((*vert1)[1] + (*vert2)[1]);
@@ -436,7 +543,7 @@ SoNormalGenerator::calcFaceNormal(void)
     if (coin_debug_extra()) {
       SbString s;
       for (int i = 0; i < num; i++) {
-        const SbVec3f v = coords[cind[i]];
+        const SbVec3f v = coords[i];
         SbString c;
         c.sprintf(" <%f, %f, %f>", v[0], v[1], v[2]);
         s += c;
@@ -452,3 +559,35 @@ SoNormalGenerator::calcFaceNormal(void)
   }
   return ret;
 }
+
+#ifdef COIN_TEST_SUITE
+
+BOOST_AUTO_TEST_CASE(creaseAngle)
+{
+  // two triangles sharing the edge along the y axis, folded 90
+  // degrees. -0 and 0 must be treated as the same coordinate.
+  const SbVec3f a(0.0f, 0.0f, 0.0f), b(-0.0f, 1.0f, 0.0f), b2(0.0f, 1.0f, 0.0f);
+  const SbVec3f c(1.0f, 0.0f, 0.0f), d(0.0f, 0.0f, 1.0f);
+
+  for (int smooth = 0; smooth < 2; smooth++) {
+    SoNormalGenerator gen(TRUE);
+    gen.triangle(a, c, b);
+    gen.triangle(a, b2, d);
+    gen.generate(smooth ? float(M_PI) * 0.75f : float(M_PI) * 0.25f);
+    BOOST_REQUIRE_EQUAL(gen.getNumNormals(), 6);
+
+    const SbVec3f n0(0.0f, 0.0f, 1.0f), n1(1.0f, 0.0f, 0.0f);
+    SbVec3f avg = n0 + n1;
+    (void) avg.normalize();
+    const SbVec3f expected[6] = {
+      smooth ? avg : n0, n0, smooth ? avg : n0,
+      smooth ? avg : n1, smooth ? avg : n1, n1
+    };
+    for (int i = 0; i < 6; i++) {
+      BOOST_CHECK_MESSAGE(gen.getNormal(i).equals(expected[i], 1e-6f),
+                          "unexpected vertex normal");
+    }
+  }
+}
+
+#endif // COIN_TEST_SUITE
@@ -98,19 +98,6 @@
 
 // *************************************************************************
 
-// Internal class used to store which elements are pushed for a depth.
-// This makes it possible to avoid searching through all elements
-// and testing depth in pop().
-class sostate_pushstore {
-public:
-  sostate_pushstore(void) {
-    this->next = this->prev = NULL;
-  }
-  SbList <int> elements;
-  sostate_pushstore * next;
-  sostate_pushstore * prev;
-};
-
 // class to store private data members
 class SoStateP {
 public:
@@ -118,7 +105,14 @@ public:
   SoElement ** initial;
   int depth;
   SbBool ispopping;
-  class sostate_pushstore * pushstore;
+  // The stack indices of the elements pushed for each depth, so that
+  // pop() doesn't have to search through all elements and test
+  // depth. The indices for all depths are stored after each other in
+  // one array, and pushstart holds the position of the first index
+  // for each depth above 0. Both arrays are kept between traversals,
+  // so push() and pop() normally don't allocate any memory.
+  SbList<int> pushed;
+  SbList<int> pushstart;
 };
 
 #define PRIVATE(obj) ((obj)->pimpl)
@@ -171,7 +165,6 @@ SoState::SoState(SoAction * theAction, const SoTypeList & enabledelements)
       element->init(this); // called for first element in state stack
     }
   }
-  PRIVATE(this)->pushstore = new sostate_pushstore;
 }
 
 /*!
@@ -195,14 +188,6 @@ SoState::~SoState(void)
 
   delete[] PRIVATE(this)->initial;
   delete[] this->stack;
-
-  sostate_pushstore * item = PRIVATE(this)->pushstore;
-  while (item->prev) item = item->prev; // go to first item
-  while (item) {
-    sostate_pushstore * next = item->next;
-    delete item;
-    item = next;
-  }
   delete PRIVATE(this);
 }
 
@@ -257,7 +242,7 @@ SoState::getElement(const int stackindex)
     next->push(this);
     this->stack[stackindex] = next;
     element = next;
-    PRIVATE(this)->pushstore->elements.append(stackindex);
+    PRIVATE(this)->pushed.append(stackindex);
   }
   return element;
 }
@@ -274,13 +259,7 @@ SoState::getElement(const int stackindex)
 void
 SoState::push(void)
 {
-  if (PRIVATE(this)->pushstore->next == NULL) {
-    sostate_pushstore * store = new sostate_pushstore;
-    store->prev = PRIVATE(this)->pushstore;
-    PRIVATE(this)->pushstore->next = store;
-  }
-  PRIVATE(this)->pushstore = PRIVATE(this)->pushstore->next;
-  PRIVATE(this)->pushstore->elements.truncate(0);
+  PRIVATE(this)->pushstart.append(PRIVATE(this)->pushed.getLength());
   PRIVATE(this)->depth++;
 }
 
@@ -293,12 +272,14 @@ SoState::push(void)
 void
 SoState::pop(void)
 {
+  assert(PRIVATE(this)->depth > 0);
   PRIVATE(this)->ispopping = TRUE;
   PRIVATE(this)->depth--;
-  int n = PRIVATE(this)->pushstore->elements.getLength();
-  if (n) {
-    const int * array = PRIVATE(this)->pushstore->elements.getArrayPtr();
-    for (int i = n-1; i >= 0; i--) {
+  const int start = PRIVATE(this)->pushstart.pop();
+  const int n = PRIVATE(this)->pushed.getLength();
+  if (n > start) {
+    const int * array = PRIVATE(this)->pushed.getArrayPtr();
+    for (int i = n-1; i >= start; i--) {
       int idx = array[i];
       SoElement * elem = this->stack[idx];
       SoElement * prev = elem->nextdown;
@@ -306,9 +287,8 @@ SoState::pop(void)
       prev->pop(this, elem);
       this->stack[idx] = prev;
     }
+    PRIVATE(this)->pushed.truncate(start);
   }
-  PRIVATE(this)->pushstore->elements.truncate(0);
-  PRIVATE(this)->pushstore = PRIVATE(this)->pushstore->prev;
   PRIVATE(this)->ispopping = FALSE;
 }
 
@@ -168,7 +168,8 @@ struct SoTypeData {
              const SoType theParent = SoType::badType(),
              const SoType::instantiationMethod createMethod = NULL)
     : name(theName), type(type), isPublic(ispublic), data(theData),
-      parent(theParent), method(createMethod) { };
+      parent(theParent), method(createMethod), depth(0), ancestors(NULL) { };
+  ~SoTypeData() { delete[] this->ancestors; }
 
   SbName name;
   SoType type;
@@ -176,6 +177,14 @@ struct SoTypeData {
   uint16_t data;
   SoType parent;
   SoType::instantiationMethod method;
+
+  // The keys of the types on the path from the root class down to
+  // and including this type, indexed on depth in the hierarchy. A
+  // type is then derived from a type at depth d exactly when its own
+  // ancestors[d] is that type, which makes SoType::isDerivedFrom() a
+  // constant-time check.
+  int depth;
+  int16_t * ancestors;
 };
 
 // OBSOLETED: this code was only active for GCC 2.7.x, and I don't
@@ -300,6 +309,16 @@ SoType::createType(const SoType parent, const SbName name,
   SoType newType;
   newType.index = SoType::typedatalist->getLength();
   SoTypeData * typeData = new SoTypeData(name, newType, TRUE, data, parent, method);
+
+  const SoTypeData * parentdata =
+    parent.isBad() ? NULL : (*SoType::typedatalist)[(int)parent.getKey()];
+  typeData->depth = parentdata ? parentdata->depth + 1 : 0;
+  typeData->ancestors = new int16_t[typeData->depth + 1];
+  for (int i = 0; i < typeData->depth; i++) {
+    typeData->ancestors[i] = parentdata->ancestors[i];
+  }
+  typeData->ancestors[typeData->depth] = newType.getKey();
+
   SoType::typedatalist->append(typeData);
 
   // add to dictionary for fast lookup
@@ -748,19 +767,19 @@ SoType::isDerivedFrom(const SoType parent) const
     return FALSE;
   }
 
-  SoType type = *this;
-  do {
-#if COIN_DEBUG && 0 // debug
-    SoDebugError::postInfo("SoType::isDerivedFrom",
-                           "this: '%s' parent: '%s'",
-                           type.getName().getString(),
-                           parent.getName().getString());
-#endif // debug
-    if (type == parent) return TRUE;
-    type = (*SoType::typedatalist)[(int)type.getKey()]->parent;
-  } while (!type.isBad());
+  const SoTypeData * data = (*SoType::typedatalist)[(int)this->getKey()];
+  const SoTypeData * parentdata = (*SoType::typedatalist)[(int)parent.getKey()];
 
-  return FALSE;
+  if (parentdata == NULL) { // removed type, check the full path
+    for (int i = 0; i <= data->depth; i++) {
+      if (data->ancestors[i] == parent.getKey()) return TRUE;
+    }
+    return FALSE;
+  }
+
+  const int depth = parentdata->depth;
+  return (depth <= data->depth &&
+          data->ancestors[depth] == parent.getKey()) ? TRUE : FALSE;
 }
 
 /*!
@@ -988,4 +1007,27 @@ BOOST_AUTO_TEST_CASE(testRemoveType)
                       "Type didn't deregister correctly");
 }
 
+BOOST_AUTO_TEST_CASE(testIsDerivedFrom)
+{
+  SoType base = SoType::createType(SoNode::getClassTypeId(), SbName("MyBaseClass"));
+  SoType derived = SoType::createType(base, SbName("MyDerivedClass"), createInstance);
+  SoType sibling = SoType::createType(base, SbName("MySiblingClass"), createInstance);
+
+  BOOST_CHECK(derived.isDerivedFrom(derived));
+  BOOST_CHECK(derived.isDerivedFrom(base));
+  BOOST_CHECK(derived.isDerivedFrom(SoNode::getClassTypeId()));
+  BOOST_CHECK(derived.isDerivedFrom(SoBase::getClassTypeId()));
+  BOOST_CHECK(!derived.isDerivedFrom(sibling));
+  BOOST_CHECK(!base.isDerivedFrom(derived));
+  BOOST_CHECK(!SoNode::getClassTypeId().isDerivedFrom(base));
+  BOOST_CHECK(!derived.isDerivedFrom(SoType::badType()));
+
+  BOOST_CHECK(SoType::removeType(SbName("MyBaseClass")));
+  BOOST_CHECK(derived.isDerivedFrom(base));
+  BOOST_CHECK(!sibling.isDerivedFrom(derived));
+
+  BOOST_CHECK(SoType::removeType(SbName("MyDerivedClass")));
+  BOOST_CHECK(SoType::removeType(SbName("MySiblingClass")));
+}
+
 #endif // COIN_TEST_SUITE
@@ -110,6 +110,7 @@ SoCacheHint::initClass(void)
   SO_NODE_INTERNAL_INIT_CLASS(SoCacheHint, SO_FROM_COIN_2_4);
   
   SO_ENABLE(SoGLRenderAction, SoCacheHintElement);
+  SO_ENABLE(SoCallbackAction, SoCacheHintElement);
 }
 
 void
@@ -130,8 +131,9 @@ SoCacheHint::GLRender(SoGLRenderAction * action)
 void
 SoCacheHint::callback(SoCallbackAction * action)
 {
-  // do nothing
-  SoNode::callback(action);
+  // needed to tell which shapes will be rendered with vertex arrays
+  // when prebuilding their caches (see SoGLRenderAction)
+  SoCacheHint::doAction(action);
 }
 
 void
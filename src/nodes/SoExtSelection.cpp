@@ -82,6 +82,8 @@
 #include <cmath>
 #include <climits>
 #include <cstring> // memset()
+#include <algorithm> // std::sort()
+#include <vector>
 
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -94,8 +96,10 @@
 #include <Inventor/SbMatrix.h>
 #include <Inventor/SbTesselator.h>
 #include <Inventor/SbTime.h>
+#include <Inventor/SbVec2f.h>
 #include <Inventor/SbVec2s.h>
 #include <Inventor/SbVec3f.h>
+#include <Inventor/SbVec4f.h>
 #include <Inventor/SbViewVolume.h>
 #include <Inventor/SbViewportRegion.h>
 #include <Inventor/SoOffscreenRenderer.h>
@@ -105,6 +109,7 @@
 #include <Inventor/actions/SoHandleEventAction.h>
 #include <Inventor/caches/SoBoundingBoxCache.h>
 #include <Inventor/details/SoFaceDetail.h>
+#include <Inventor/elements/SoCoordinateElement.h>
 #include <Inventor/elements/SoCullElement.h>
 #include <Inventor/elements/SoModelMatrixElement.h>
 #include <Inventor/elements/SoPointSizeElement.h>
@@ -122,13 +127,16 @@
 #include <Inventor/misc/SoState.h>
 #include <Inventor/nodes/SoCallback.h>
 #include <Inventor/nodes/SoCamera.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
 #include <Inventor/nodes/SoShape.h>
 #include <Inventor/nodes/SoVertexShape.h>
 #include <Inventor/sensors/SoTimerSensor.h>
 #include <Inventor/misc/SoGLDriverDatabase.h>
 
 #include "nodes/SoSubNodeP.h"
+#include "threads/parallelp.h"
 #include "coindefs.h" // COIN_OBSOLETED()
+#include "SbBasicP.h"
 
 // *************************************************************************
 
@@ -349,8 +357,20 @@ public:
                       SoCallbackAction * action,
                       const SoPrimitiveVertex * v);
 
+  SbBool testFaceSet(SoCallbackAction * action,
+                     const SoIndexedFaceSet * faceset);
+
+  SbBool pointInLasso(const SbVec2s & p) const;
+  SbBool lineInLasso(const SbVec2s & p0, const SbVec2s & p1,
+                     const SbBool full) const;
+  SbBool triangleInLasso(const SbVec2s & p0, const SbVec2s & p1,
+                         const SbVec2s & p2, const SbBool full) const;
+  SbBool polygonInLasso(const SbVec2s * projcoords, const int32_t * indices,
+                        const int numindices, const SbBool full,
+                        SbList <SbVec2s> & tmppoly) const;
+
   void selectAndReset(SoHandleEventAction * action);
-  void performSelection(SoHandleEventAction * action);
+  void performSelection(SoNode * root, const SbViewportRegion & vp);
 
   void validateViewportBBox(SbBox2s & bbox, 
                             const SbVec2s & vpsize);
@@ -394,6 +414,31 @@ public:
     }
   } runningselection;
 
+  // The lasso rasterized to the pixels it covers, for constant time
+  // point-in-lasso tests, and for quickly finding out whether a
+  // primitive is close to the lasso outline. A primitive that doesn't
+  // come close to the outline is either completely inside or
+  // completely outside the lasso, which can then be decided from a
+  // single vertex.
+  class LassoGrid {
+  public:
+    LassoGrid(void) : valid(FALSE) { }
+
+    void build(const SbList <SbVec2s> & coords);
+    void clear(void);
+    SbBool isValid(void) const { return this->valid; }
+    SbBool isInside(const SbVec2s & p) const;
+    SbBool hasOutline(const SbBox2s & box) const;
+
+  private:
+    SbBool valid;
+    int orgx, orgy, width, height;
+    std::vector <unsigned char> inside;
+    // summed area table of the pixels close to the lasso outline,
+    // (width + 1) * (height + 1) entries
+    std::vector <int> outlinesum;
+  } lassogrid;
+
   // Note: Microsoft Visual C++ 6.0 needs to have a type definition
   // and an explicit variable declaration, just using
   //     struct { ... } structname;
@@ -408,7 +453,6 @@ public:
     SbVec2s vpsize;
     SbBool abort;
     SbBool allhit;
-    SbBool onlyrect;
     SbBool allshapes;
     SbBool hasgeometry;
   } primcbdata_t;
@@ -429,7 +473,6 @@ public:
   SbBool callfiltercbonlyifselectable;
   SbBool wasshiftdown;
 
-  SoHandleEventAction *offscreenaction;
   SbViewVolume offscreenviewvolume;
   int offscreencolorcounter;
   int offscreencolorcounterpasses;
@@ -726,6 +769,254 @@ poly_projbox_intersect(const SbList <SbVec2s> & poly,
 
 // *************************************************************************
 
+// Upper limit for the number of pixels in the lasso grid. For larger
+// lassos, the primitives are tested against the lasso polygon
+// directly.
+static const double SOEXTSELECTION_MAX_GRID_PIXELS = 8.0 * 1024.0 * 1024.0;
+
+void
+SoExtSelectionP::LassoGrid::build(const SbList <SbVec2s> & coords)
+{
+  this->clear();
+
+  const int npol = coords.getLength();
+  if (npol == 0) return;
+
+  SbBox2s box;
+  int i, j;
+  for (i = 0; i < npol; i++) { box.extendBy(coords[i]); }
+
+  // the outline marks the pixels next to the ones it passes through,
+  // so leave room for those around the lasso bounding box
+  this->orgx = box.getMin()[0] - 1;
+  this->orgy = box.getMin()[1] - 1;
+  this->width = box.getMax()[0] - box.getMin()[0] + 3;
+  this->height = box.getMax()[1] - box.getMin()[1] + 3;
+  if (double(this->width) * double(this->height) > SOEXTSELECTION_MAX_GRID_PIXELS) return;
+
+  const int w = this->width;
+  const int h = this->height;
+  this->inside.assign(w * h, 0);
+
+  // Scan convert the lasso with the same even-odd rule, and the same
+  // arithmetic, as point_in_poly(), so that both give the same result
+  // for every pixel.
+  std::vector <float> crossings;
+  SbVec2f pi, pj;
+  for (int row = 0; row < h; row++) {
+    const float y = (float) (this->orgy + row);
+    crossings.clear();
+    for (i = 0, j = npol-1; i < npol; j = i++) {
+      pi[0] = (float) coords[i][0];
+      pi[1] = (float) coords[i][1];
+      pj[0] = (float) coords[j][0];
+      pj[1] = (float) coords[j][1];
+
+      if (((pi[1] <= y) && (y < pj[1])) ||
+          ((pj[1] <= y) && (y < pi[1]))) {
+        crossings.push_back((pj[0] - pi[0]) * (y - pi[1]) / (pj[1] - pi[1]) + pi[0]);
+      }
+    }
+    if (crossings.empty()) continue;
+    std::sort(crossings.begin(), crossings.end());
+
+    // a pixel is inside if an odd number of crossings are to the
+    // right of it
+    unsigned char * dst = &this->inside[row * w];
+    size_t numleft = 0;
+    for (int col = 0; col < w; col++) {
+      const float x = (float) (this->orgx + col);
+      while ((numleft < crossings.size()) && !(x < crossings[numleft])) { numleft++; }
+      dst[col] = ((crossings.size() - numleft) & 1) ? 1 : 0;
+    }
+  }
+
+  // Mark the pixels the outline passes through, and their
+  // neighbours. Sampling each edge at most half a pixel apart along
+  // both axes makes sure that every pixel the edge touches is within
+  // one pixel of a sample.
+  std::vector <unsigned char> outline(w * h, 0);
+  for (i = 0, j = npol-1; i < npol; j = i++) {
+    const float x0 = (float) coords[j][0];
+    const float y0 = (float) coords[j][1];
+    const float dx = (float) coords[i][0] - x0;
+    const float dy = (float) coords[i][1] - y0;
+    const int steps = 2 * SbMax(SbAbs(int(coords[i][0]) - int(coords[j][0])),
+                                SbAbs(int(coords[i][1]) - int(coords[j][1])));
+    for (int k = 0; k <= steps; k++) {
+      const float t = steps ? float(k) / float(steps) : 0.0f;
+      const int cx = (int) floor(x0 + t * dx) - this->orgx;
+      const int cy = (int) floor(y0 + t * dy) - this->orgy;
+      for (int ny = SbMax(cy - 1, 0); ny <= SbMin(cy + 1, h - 1); ny++) {
+        for (int nx = SbMax(cx - 1, 0); nx <= SbMin(cx + 1, w - 1); nx++) {
+          outline[ny * w + nx] = 1;
+        }
+      }
+    }
+  }
+
+  this->outlinesum.assign((w + 1) * (h + 1), 0);
+  for (int row = 0; row < h; row++) {
+    const int * prev = &this->outlinesum[row * (w + 1)];
+    int * sum = &this->outlinesum[(row + 1) * (w + 1)];
+    int rowsum = 0;
+    for (int col = 0; col < w; col++) {
+      rowsum += outline[row * w + col];
+      sum[col + 1] = prev[col + 1] + rowsum;
+    }
+  }
+  this->valid = TRUE;
+}
+
+void
+SoExtSelectionP::LassoGrid::clear(void)
+{
+  this->valid = FALSE;
+  std::vector <unsigned char>().swap(this->inside);
+  std::vector <int>().swap(this->outlinesum);
+}
+
+// Returns point_in_poly() for the lasso.
+SbBool
+SoExtSelectionP::LassoGrid::isInside(const SbVec2s & p) const
+{
+  assert(this->valid);
+  const int x = p[0] - this->orgx;
+  const int y = p[1] - this->orgy;
+  if ((x < 0) || (y < 0) || (x >= this->width) || (y >= this->height)) return FALSE;
+  return this->inside[y * this->width + x] ? TRUE : FALSE;
+}
+
+// Returns TRUE if the lasso outline may pass through the closed
+// pixel area covered by box.
+SbBool
+SoExtSelectionP::LassoGrid::hasOutline(const SbBox2s & box) const
+{
+  assert(this->valid);
+  const int x0 = SbMax(box.getMin()[0] - this->orgx, 0);
+  const int y0 = SbMax(box.getMin()[1] - this->orgy, 0);
+  const int x1 = SbMin(box.getMax()[0] - this->orgx, this->width - 1);
+  const int y1 = SbMin(box.getMax()[1] - this->orgy, this->height - 1);
+  if ((x0 > x1) || (y0 > y1)) return FALSE;
+
+  const int w = this->width + 1;
+  const int sum =
+    this->outlinesum[(y1 + 1) * w + x1 + 1] - this->outlinesum[y0 * w + x1 + 1] -
+    this->outlinesum[(y1 + 1) * w + x0] + this->outlinesum[y0 * w + x0];
+  return sum > 0;
+}
+
+// Returns TRUE if the projected point is inside the lasso.
+SbBool
+SoExtSelectionP::pointInLasso(const SbVec2s & p) const
+{
+  if (this->lassogrid.isValid()) return this->lassogrid.isInside(p);
+  return point_in_poly(this->runningselection.coords, p);
+}
+
+// Returns TRUE if the projected line segment is completely inside
+// the lasso when full is TRUE, or if some part of it is inside the
+// lasso otherwise.
+SbBool
+SoExtSelectionP::lineInLasso(const SbVec2s & p0, const SbVec2s & p1,
+                             const SbBool full) const
+{
+  if (this->lassogrid.isValid()) {
+    SbBox2s box(SbMin(p0[0], p1[0]), SbMin(p0[1], p1[1]),
+                SbMax(p0[0], p1[0]), SbMax(p0[1], p1[1]));
+    if (!this->lassogrid.hasOutline(box)) return this->lassogrid.isInside(p0);
+  }
+
+  const SbList <SbVec2s> & coords = this->runningselection.coords;
+  if (full) {
+    if ((this->runningselection.mode == SelectionState::RECTANGLE) &&
+        !this->pointInLasso(p1)) return FALSE;
+    return this->pointInLasso(p0) && !poly_line_intersect(coords, p0, p1, FALSE);
+  }
+  return this->pointInLasso(p0) || this->pointInLasso(p1) ||
+    poly_line_intersect(coords, p0, p1, FALSE);
+}
+
+// Returns TRUE if the projected triangle is completely inside the
+// lasso when full is TRUE, or if some part of it is inside the lasso
+// otherwise.
+SbBool
+SoExtSelectionP::triangleInLasso(const SbVec2s & p0, const SbVec2s & p1,
+                                 const SbVec2s & p2, const SbBool full) const
+{
+  if (this->lassogrid.isValid()) {
+    SbBox2s box(p0[0], p0[1], p0[0], p0[1]);
+    box.extendBy(p1);
+    box.extendBy(p2);
+    if (!this->lassogrid.hasOutline(box)) return this->lassogrid.isInside(p0);
+  }
+
+  const SbList <SbVec2s> & coords = this->runningselection.coords;
+  if (full) {
+    return
+      this->pointInLasso(p0) && this->pointInLasso(p1) && this->pointInLasso(p2) &&
+      !poly_line_intersect(coords, p0, p1, FALSE) &&
+      !poly_line_intersect(coords, p1, p2, FALSE) &&
+      !poly_line_intersect(coords, p2, p0, FALSE);
+  }
+  if (this->pointInLasso(p0) || this->pointInLasso(p1) || this->pointInLasso(p2)) {
+    return TRUE;
+  }
+  return poly_tri_intersect(coords, p0, p1, p2);
+}
+
+// Same as triangleInLasso(), for a polygon given as indices into an
+// array of projected coordinates. The result does not depend on how
+// the polygon is triangulated.
+SbBool
+SoExtSelectionP::polygonInLasso(const SbVec2s * projcoords,
+                                const int32_t * indices,
+                                const int numindices,
+                                const SbBool full,
+                                SbList <SbVec2s> & tmppoly) const
+{
+  int i;
+  if (numindices == 3) {
+    return this->triangleInLasso(projcoords[indices[0]], projcoords[indices[1]],
+                                 projcoords[indices[2]], full);
+  }
+
+  const SbVec2s & first = projcoords[indices[0]];
+  if (this->lassogrid.isValid()) {
+    SbBox2s box(first[0], first[1], first[0], first[1]);
+    for (i = 1; i < numindices; i++) { box.extendBy(projcoords[indices[i]]); }
+    if (!this->lassogrid.hasOutline(box)) return this->lassogrid.isInside(first);
+  }
+
+  const SbList <SbVec2s> & coords = this->runningselection.coords;
+  if (full) {
+    for (i = 0; i < numindices; i++) {
+      if (!this->pointInLasso(projcoords[indices[i]])) return FALSE;
+    }
+    tmppoly.truncate(0);
+    SbVec2s prev = projcoords[indices[numindices-1]];
+    for (i = 0; i < numindices; i++) {
+      const SbVec2s & p = projcoords[indices[i]];
+      if (poly_line_intersect(coords, prev, p, FALSE)) return FALSE;
+      tmppoly.append(p);
+      prev = p;
+    }
+    // the outline doesn't cross the polygon edges, but the lasso
+    // might still have a hole inside the polygon
+    return !point_in_poly(tmppoly, coords[0]);
+  }
+
+  tmppoly.truncate(0);
+  for (i = 0; i < numindices; i++) {
+    const SbVec2s & p = projcoords[indices[i]];
+    if (this->pointInLasso(p)) return TRUE;
+    tmppoly.append(p);
+  }
+  return poly_poly_intersect(coords, tmppoly);
+}
+
+// *************************************************************************
+
 SO_NODE_SOURCE(SoExtSelection);
 
 // *************************************************************************
@@ -1248,30 +1539,106 @@ SoExtSelection::GLRenderBelowPath(SoGLRenderAction * action)
   state->pop();
 }
 
-/*!
-  Simulate lasso selection programmatically.
+namespace {
 
-  This function is currently just stubbed.
-*/
+struct soextselection_camera_data {
+  SbViewVolume viewvolume;
+  SbBool found;
+};
 
-void
-SoExtSelection::select(SoNode * COIN_UNUSED_ARG(root), int COIN_UNUSED_ARG(numcoords), SbVec3f * COIN_UNUSED_ARG(lasso), const SbViewportRegion & COIN_UNUSED_ARG(vp), SbBool COIN_UNUSED_ARG(shiftpolicy))
+} // namespace
+
+// Stores the view volume of the first camera found.
+static SoCallbackAction::Response
+soextselection_camera_cb(void * closure, SoCallbackAction * action,
+                         const SoNode * COIN_UNUSED_ARG(node))
 {
-  // FIXME: Implement this for TGS compatibility...
-  COIN_STUB_ONCE();
+  soextselection_camera_data * data = static_cast<soextselection_camera_data *>(closure);
+  data->viewvolume = SoViewVolumeElement::get(action->getState());
+  data->found = TRUE;
+  return SoCallbackAction::ABORT;
 }
 
 /*!
-  Simulate lasso selection programmatically.
+  Simulate lasso selection programmatically, with the lasso given in
+  world coordinates. The points are projected to the screen with the
+  first camera found in \a root, and the selection is then done as
+  for the select() method taking normalized coordinates.
 
-  This function is currently just stubbed.
+  \sa select()
 */
+void
+SoExtSelection::select(SoNode * root, int numcoords, SbVec3f * lasso,
+                       const SbViewportRegion & vp, SbBool shiftpolicy)
+{
+  soextselection_camera_data camera;
+  camera.found = FALSE;
+  SoCallbackAction cba(vp);
+  cba.addPostCallback(SoCamera::getClassTypeId(), soextselection_camera_cb, &camera);
+  cba.apply(root);
+  if (!camera.found) {
+    SoDebugError::postWarning("SoExtSelection::select",
+                              "no camera found in the scene graph");
+    return;
+  }
 
+  SbList <SbVec2f> screenlasso(numcoords);
+  for (int i = 0; i < numcoords; i++) {
+    SbVec3f screenpt;
+    camera.viewvolume.projectToScreen(lasso[i], screenpt);
+    screenlasso.append(SbVec2f(screenpt[0], screenpt[1]));
+  }
+  this->select(root, numcoords, const_cast<SbVec2f *>(screenlasso.getArrayPtr()),
+               vp, shiftpolicy);
+}
+
+/*!
+  Simulate lasso selection programmatically, with the lasso given in
+  normalized coordinates, where <0, 0> is the lower left corner and
+  <1, 1> is the upper right corner of \a vp. When the lassoType field
+  is RECTANGLE and two coordinates are given, these are the corners
+  of the rectangle, otherwise the coordinates are the vertices of the
+  lasso polygon.
+
+  The lassoPolicy and lassoMode fields, the selection policy and the
+  filter callbacks are all used as for an interactive selection, and
+  \a shiftpolicy is used in place of the state of the SHIFT key.
+
+  The lasso tests are done on the CPU, and selection with the
+  ALL_SHAPES lassoMode does not need an OpenGL context, so this can
+  be used without any window system. The faces of SoIndexedFaceSet
+  nodes are tested directly from their coordinates and indices, on
+  all available CPUs, when no triangle filter callback is set.
+  VISIBLE_SHAPES needs an offscreen OpenGL context, as for an
+  interactive selection.
+
+  Any interactive selection in progress is cancelled.
+*/
 void
-SoExtSelection::select(SoNode * COIN_UNUSED_ARG(root), int COIN_UNUSED_ARG(numcoords), SbVec2f * COIN_UNUSED_ARG(lasso), const SbViewportRegion & COIN_UNUSED_ARG(vp), SbBool COIN_UNUSED_ARG(shiftpolicy))
+SoExtSelection::select(SoNode * root, int numcoords, SbVec2f * lasso,
+                       const SbViewportRegion & vp, SbBool shiftpolicy)
 {
-  // FIXME: Implement this for TGS compatibility...
-  COIN_STUB_ONCE();
+  SoExtSelectionP::SelectionState & selection = PRIVATE(this)->runningselection;
+  selection.reset();
+  if (numcoords <= 0) return;
+
+  const SbVec2s org = vp.getViewportOriginPixels();
+  const SbVec2s size = vp.getViewportSizePixels();
+  for (int i = 0; i < numcoords; i++) {
+    const float x = lasso[i][0] * float(size[0]) + float(org[0]);
+    const float y = lasso[i][1] * float(size[1]) + float(org[1]);
+    selection.coords.append(SbVec2s((short) SbClamp(x, -32768.0f, 32767.0f),
+                                    (short) SbClamp(y, -32768.0f, 32767.0f)));
+  }
+  selection.mode =
+    ((this->lassoType.getValue() == SoExtSelection::RECTANGLE) && (numcoords == 2)) ?
+    SoExtSelectionP::SelectionState::RECTANGLE :
+    SoExtSelectionP::SelectionState::LASSO;
+
+  PRIVATE(this)->wasshiftdown = shiftpolicy;
+  PRIVATE(this)->performSelection(root, vp);
+  selection.reset();
+  this->touch();
 }
 
 /*!
@@ -1570,25 +1937,59 @@ project_pt(const SbMatrix & projmatrix, const SbVec3f & v,
                  (short) SbClamp(normpt[1], -32768.0f, 32767.0f));
 }
 
-// test for intersection between bounding box and lasso/rectangle
-SoCallbackAction::Response
-SoExtSelectionP::testBBox(SoCallbackAction * action,
-                          const SbMatrix & projmatrix,
-                          const SoShape * shape,
-                          const SbBox2s & lassorect,
-                          const SbBool full)
+// find the object space bounding box of a shape
+static SbBox3f
+get_shape_bbox(SoAction * action, const SoShape * shape)
 {
   SbBox3f bbox;
   SbVec3f center;
   const SoBoundingBoxCache * bboxcache = shape->getBoundingBoxCache();
   if (bboxcache && bboxcache->isValid(action->getState())) {
     bbox = bboxcache->getProjectedBox();
-    if (bboxcache->isCenterSet()) center = bboxcache->getCenter();
-    else center = bbox.getCenter();
   }
   else {
     ((SoShape *)shape)->computeBBox(action, bbox, center);
   }
+  return bbox;
+}
+
+// project the corners of a bounding box to screen, and return the
+// screen bounding box of the projected corners. Returns FALSE if
+// some corner is not in front of the eye, as the projected box is
+// not usable then.
+static SbBool
+project_bbox(const SbMatrix & projmatrix, const SbBox3f & bbox,
+             const SbVec2s & vporg, const SbVec2s & vpsize,
+             SbBox2s & screenbox)
+{
+  if (bbox.isEmpty()) return FALSE;
+  const SbVec3f & mincorner = bbox.getMin();
+  const SbVec3f & maxcorner = bbox.getMax();
+  for (int i = 0; i < 8; i++) {
+    SbVec4f corner(i & 1 ? maxcorner[0] : mincorner[0],
+                   i & 2 ? maxcorner[1] : mincorner[1],
+                   i & 4 ? maxcorner[2] : mincorner[2],
+                   1.0f);
+    SbVec4f clip;
+    projmatrix.multVecMatrix(corner, clip);
+    if (clip[3] <= 0.0f) return FALSE;
+    const float x = (clip[0] / clip[3] + 1.0f) * 0.5f * float(vpsize[0]) + float(vporg[0]);
+    const float y = (clip[1] / clip[3] + 1.0f) * 0.5f * float(vpsize[1]) + float(vporg[1]);
+    screenbox.extendBy(SbVec2s((short) SbClamp(x, -32768.0f, 32767.0f),
+                               (short) SbClamp(y, -32768.0f, 32767.0f)));
+  }
+  return TRUE;
+}
+
+// test for intersection between bounding box and lasso/rectangle
+SoCallbackAction::Response
+SoExtSelectionP::testBBox(SoCallbackAction * action,
+                          const SbMatrix & projmatrix,
+                          const SoShape * shape,
+                          const SbBox2s & lassorect,
+                          const SbBool full)
+{
+  const SbBox3f bbox = get_shape_bbox(action, shape);
   SbVec3f mincorner = bbox.getMin();
   SbVec3f maxcorner = bbox.getMax();
 
@@ -1653,20 +2054,10 @@ SoExtSelectionP::testBBox(SoCallbackAction * action,
 SoCallbackAction::Response
 SoExtSelectionP::testPrimitives(SoCallbackAction * action,
                                 const SbMatrix & projmatrix,
-                                const SoShape * /* shape */,
+                                const SoShape * shape,
                                 const SbBox2s & lassorect,
                                 const SbBool full)
 {
-  // FIXME: consider quick reject based on bounding box for now we
-  // just initialize some variables, and trust that the user has a
-  // sensible scene graph so that shapes are culled in the separators.
-  // ????-??-?? pederb.
-  //
-  // FIXME: I believe what pederb mention above would be a _very_
-  // important optimization -- especially when using VISIBLE_SHAPES
-  // with a small rectangle/polygon selection in a huge scene.
-  // 20050309 mortene.
-
   this->primcbdata.fulltest = full;
   this->primcbdata.projmatrix = projmatrix;
   this->primcbdata.lassorect = lassorect;
@@ -1675,13 +2066,200 @@ SoExtSelectionP::testPrimitives(SoCallbackAction * action,
   this->primcbdata.vporg = SoViewportRegionElement::get(action->getState()).getViewportOriginPixels();
   this->primcbdata.vpsize = SoViewportRegionElement::get(action->getState()).getViewportSizePixels();
   this->primcbdata.abort = FALSE;
-  this->primcbdata.onlyrect = (this->runningselection.mode == SelectionState::LASSO);
   this->primcbdata.hasgeometry = FALSE;
+
+  // With VISIBLE_SHAPES, all shapes must be rendered to the offscreen
+  // buffer, so only ALL_SHAPES can do the tests below.
+  if (this->primcbdata.allshapes) {
+    // Quick reject on the projected bounding box. The lasso rectangle
+    // is grown by one pixel, to be on the safe side of rounding
+    // differences versus projecting the vertices one by one.
+    SbBox2s screenbox;
+    if (project_bbox(projmatrix, get_shape_bbox(action, shape),
+                     this->primcbdata.vporg, this->primcbdata.vpsize, screenbox)) {
+      SbBox2s rect = lassorect;
+      rect.extendBy(SbVec2s(lassorect.getMin()[0] - 1, lassorect.getMin()[1] - 1));
+      rect.extendBy(SbVec2s(lassorect.getMax()[0] + 1, lassorect.getMax()[1] + 1));
+      if (!rect.intersect(screenbox)) {
+        this->primcbdata.allhit = FALSE;
+        return SoCallbackAction::PRUNE;
+      }
+    }
+
+    // Face sets are tested directly from their coordinates and
+    // indices, unless the triangles are needed for the filter
+    // callback.
+    if (!this->triangleFilterCB &&
+        (shape->getTypeId() == SoIndexedFaceSet::getClassTypeId()) &&
+        this->testFaceSet(action, coin_assert_cast<const SoIndexedFaceSet *>(shape))) {
+      return SoCallbackAction::PRUNE;
+    }
+  }
+
   // signal to callback action that we want to generate primitives for
   // this shape
   return SoCallbackAction::CONTINUE;
 }
 
+namespace {
+
+// Shared data for the jobs testing the faces of a face set in
+// parallel.
+struct soextselection_faceset_data {
+  const SoExtSelectionP * thisp;
+  const SbVec3f * coords;
+  int numcoords;
+  SbVec2s * projcoords;
+  const int32_t * cindices;
+  int numindices;
+  int numjobs;
+  SbBool full;
+  // results, one entry per job
+  SbBool * hit;
+  SbBool * allhit;
+  SbBool * hasgeometry;
+  SbBool * invalid;
+};
+
+} // namespace
+
+static void
+soextselection_project_job(void * closure, int job)
+{
+  const soextselection_faceset_data * data =
+    static_cast<const soextselection_faceset_data *>(closure);
+  const SbMatrix & projmatrix = data->thisp->primcbdata.projmatrix;
+  const SbVec2s & vporg = data->thisp->primcbdata.vporg;
+  const SbVec2s & vpsize = data->thisp->primcbdata.vpsize;
+
+  const int end = int((int64_t(data->numcoords) * (job + 1)) / data->numjobs);
+  for (int i = int((int64_t(data->numcoords) * job) / data->numjobs); i < end; i++) {
+    data->projcoords[i] = project_pt(projmatrix, data->coords[i], vporg, vpsize);
+  }
+}
+
+// Returns the start of the first face starting at or after index
+// position pos.
+static int
+soextselection_face_start(const int32_t * cindices, const int numindices, int pos)
+{
+  while ((pos > 0) && (pos < numindices) && (cindices[pos-1] >= 0)) { pos++; }
+  return pos;
+}
+
+static void
+soextselection_face_job(void * closure, int job)
+{
+  const soextselection_faceset_data * data =
+    static_cast<const soextselection_faceset_data *>(closure);
+  const int32_t * cindices = data->cindices;
+  const int numindices = data->numindices;
+  const SbBool full = data->full;
+
+  int pos = soextselection_face_start(cindices, numindices,
+                                      int((int64_t(numindices) * job) / data->numjobs));
+  const int end = soextselection_face_start(cindices, numindices,
+                                            int((int64_t(numindices) * (job + 1)) / data->numjobs));
+  SbBool hit = FALSE;
+  SbBool allhit = TRUE;
+  SbBool hasgeometry = FALSE;
+  SbList <SbVec2s> tmppoly;
+
+  while (pos < end) {
+    const int facestart = pos;
+    while ((pos < numindices) && (cindices[pos] >= 0)) {
+      if (cindices[pos] >= data->numcoords) {
+        data->invalid[job] = TRUE;
+        return;
+      }
+      pos++;
+    }
+    const int facesize = pos - facestart;
+    pos++; // skip the end-of-face index
+
+    if (facesize < 3) continue;
+    hasgeometry = TRUE;
+    if (data->thisp->polygonInLasso(data->projcoords, cindices + facestart,
+                                    facesize, full, tmppoly)) {
+      hit = TRUE;
+      if (!full) break;
+    }
+    else {
+      allhit = FALSE;
+      if (full) break;
+    }
+  }
+  data->hit[job] = hit;
+  data->allhit[job] = allhit;
+  data->hasgeometry[job] = hasgeometry;
+}
+
+// Tests the faces of an SoIndexedFaceSet against the lasso directly
+// from its coordinates and indices, instead of through the triangle
+// callback, projecting the coordinates and testing the faces on all
+// available CPUs. The result is stored in primcbdata, as for the
+// triangle callback. Returns FALSE if the face set could not be
+// handled, in which case its primitives must be generated.
+SbBool
+SoExtSelectionP::testFaceSet(SoCallbackAction * action,
+                             const SoIndexedFaceSet * faceset)
+{
+  SoState * state = action->getState();
+  state->push();
+  if (faceset->vertexProperty.getValue()) {
+    faceset->vertexProperty.getValue()->doAction(action);
+  }
+  const SoCoordinateElement * coordelem = SoCoordinateElement::getInstance(state);
+  const SbVec3f * coords = coordelem->is3D() ? coordelem->getArrayPtr3() : NULL;
+
+  soextselection_faceset_data data;
+  data.thisp = this;
+  data.coords = coords;
+  data.numcoords = coordelem->getNum();
+  data.cindices = faceset->coordIndex.getValues(0);
+  data.numindices = faceset->coordIndex.getNum();
+  data.full = this->primcbdata.fulltest;
+  state->pop();
+
+  if (coords == NULL) return FALSE;
+
+  // a couple of jobs per thread, but not so small that the overhead
+  // of running them matters
+  const int numthreads = cc_parallel_get_num_threads();
+  const int maxjobs = (numthreads > 1) ? numthreads * 4 : 1;
+  const int numcoordjobs = SbMax(1, SbMin(maxjobs, data.numcoords / 4096));
+  const int numfacejobs = SbMax(1, SbMin(maxjobs, data.numindices / 4096));
+
+  std::vector <SbVec2s> projcoords(SbMax(data.numcoords, 1));
+  data.projcoords = &projcoords[0];
+  data.numjobs = numcoordjobs;
+  cc_parallel_run(numcoordjobs, soextselection_project_job, &data);
+
+  std::vector <SbBool> results(4 * numfacejobs, FALSE);
+  data.hit = &results[0];
+  data.allhit = &results[numfacejobs];
+  data.hasgeometry = &results[2 * numfacejobs];
+  data.invalid = &results[3 * numfacejobs];
+  data.numjobs = numfacejobs;
+  cc_parallel_run(numfacejobs, soextselection_face_job, &data);
+
+  SbBool hit = FALSE;
+  SbBool allhit = TRUE;
+  SbBool hasgeometry = FALSE;
+  for (int i = 0; i < numfacejobs; i++) {
+    if (data.invalid[i]) return FALSE;
+    if (data.hasgeometry[i]) {
+      hasgeometry = TRUE;
+      if (data.hit[i]) hit = TRUE;
+      if (!data.allhit[i]) allhit = FALSE;
+    }
+  }
+  this->primcbdata.hit = hit;
+  this->primcbdata.allhit = allhit;
+  this->primcbdata.hasgeometry = hasgeometry;
+  return TRUE;
+}
+
 
 
 // triangle callback from SoCallbackAction
@@ -1767,42 +2345,11 @@ SoExtSelectionP::triangleCB(void * userData,
                           thisp->primcbdata.vporg, thisp->primcbdata.vpsize);
 
 
-  if(thisp->primcbdata.fulltest) { // entire triangle must be inside lasso
-
-    if(thisp->runningselection.mode == SelectionState::RECTANGLE){ // Rectangle check only
-      if (!thisp->primcbdata.lassorect.intersect(p0) || (!point_in_poly(thisp->runningselection.coords, p0))) {
-        thisp->primcbdata.allhit = FALSE;
-        return;
-      }
-      if (!thisp->primcbdata.lassorect.intersect(p1) || (!point_in_poly(thisp->runningselection.coords, p1))) {
-        thisp->primcbdata.allhit = FALSE;
-        return;
-      }
-      if (!thisp->primcbdata.lassorect.intersect(p2) || (!point_in_poly(thisp->runningselection.coords, p2))) {
-        thisp->primcbdata.allhit = FALSE;
-        return;
-      }
-    }
-
-    if(poly_line_intersect(thisp->runningselection.coords, p0, p1, FALSE) || !point_in_poly(thisp->runningselection.coords, p0)) {
-      thisp->primcbdata.allhit = FALSE;
-      return;
-    }
-    if(poly_line_intersect(thisp->runningselection.coords, p1, p2, FALSE) || !point_in_poly(thisp->runningselection.coords, p1)) {
-      thisp->primcbdata.allhit = FALSE;
-      return;
-    }
-    if(poly_line_intersect(thisp->runningselection.coords, p2, p0, FALSE) || !point_in_poly(thisp->runningselection.coords, p2)) {
-      thisp->primcbdata.allhit = FALSE;
-      return;
-    }
-
-
-  } else { // some part of the triangle must be inside lasso
-    if (!poly_tri_intersect(thisp->runningselection.coords, p0, p1, p2)) {
-      thisp->primcbdata.allhit = FALSE;
-      return;
-    }
+  // with fulltest, the entire triangle must be inside the lasso,
+  // otherwise some part of it
+  if (!thisp->triangleInLasso(p0, p1, p2, thisp->primcbdata.fulltest)) {
+    thisp->primcbdata.allhit = FALSE;
+    return;
   }
 
 
@@ -1978,31 +2525,9 @@ SoExtSelectionP::lineSegmentCB(void *userData,
   SbVec2s p1 = project_pt(thisp->primcbdata.projmatrix, v2->getPoint(),
                           thisp->primcbdata.vporg, thisp->primcbdata.vpsize);
 
-  if (thisp->primcbdata.fulltest) {
-
-
-    if (thisp->runningselection.mode == SelectionState::RECTANGLE){ // Rectangle check only
-      if (!thisp->primcbdata.lassorect.intersect(p0) || (!point_in_poly(thisp->runningselection.coords, p0))) {
-        thisp->primcbdata.allhit = FALSE;
-        return;
-      }
-
-      if (!thisp->primcbdata.lassorect.intersect(p1) || (!point_in_poly(thisp->runningselection.coords, p1))) {
-        thisp->primcbdata.allhit = FALSE;
-        return;
-      }
-    }
-
-    if (poly_line_intersect(thisp->runningselection.coords, p0, p1, FALSE) || !point_in_poly(thisp->runningselection.coords, p0)) {
-      thisp->primcbdata.allhit = FALSE;
-      return;
-    }
-  }
-  else {
-    if (!poly_line_intersect(thisp->runningselection.coords, p0, p1, TRUE)) {
-      thisp->primcbdata.allhit = FALSE;
-      return;
-    }
+  if (!thisp->lineInLasso(p0, p1, thisp->primcbdata.fulltest)) {
+    thisp->primcbdata.allhit = FALSE;
+    return;
   }
 
 
@@ -2144,15 +2669,7 @@ SoExtSelectionP::pointCB(void *userData,
   SbVec2s p = project_pt(thisp->primcbdata.projmatrix, v->getPoint(),
                          thisp->primcbdata.vporg, thisp->primcbdata.vpsize);
 
-  if (thisp->runningselection.mode == SelectionState::RECTANGLE){ // Rectangle check only
-
-    SbBool onlyrect = thisp->primcbdata.onlyrect;
-    if (!thisp->primcbdata.lassorect.intersect(p) || (onlyrect || !point_in_poly(thisp->runningselection.coords, p))) {
-      thisp->primcbdata.allhit = FALSE;
-      return;
-    }
-
-  } else if(!point_in_poly(thisp->runningselection.coords, p)) {
+  if (!thisp->pointInLasso(p)) {
     thisp->primcbdata.allhit = FALSE;
     return;
   }
@@ -2322,8 +2839,7 @@ SoExtSelectionP::offscreenRenderLassoCallback(void * userdata, SoAction * action
   SoExtSelectionP * pimpl = (SoExtSelectionP *) userdata;
 
   // Setup optimal screen-aspect according to lasso-size
-  SoHandleEventAction * eventAction = pimpl->offscreenaction;
-  const SbViewportRegion & vp = SoViewportRegionElement::get(eventAction->getState());
+  const SbViewportRegion & vp = pimpl->curvp;
 
   SbVec2s vpo = vp.getViewportOriginPixels();
   SbVec2s vps = vp.getViewportSizePixels();
@@ -2547,13 +3063,14 @@ SoExtSelectionP::scanOffscreenBuffer(SoNode * COIN_UNUSED_ARG(sceneRoot))
 void
 SoExtSelectionP::selectAndReset(SoHandleEventAction * action)
 {
-  this->performSelection(action);
+  this->performSelection(action->getCurPath()->getHead(),
+                         SoViewportRegionElement::get(action->getState()));
   this->runningselection.reset();
 }
 
 // start a selecting for the current lasso/rectangle
 void
-SoExtSelectionP::performSelection(SoHandleEventAction * action)
+SoExtSelectionP::performSelection(SoNode * root, const SbViewportRegion & vp)
 {
   assert(this->runningselection.mode != SelectionState::NONE);
 
@@ -2576,10 +3093,12 @@ SoExtSelectionP::performSelection(SoHandleEventAction * action)
     this->runningselection.coords.append(SbVec2s(p0[0], p1[1]));
   }
 
+  this->lassogrid.build(this->runningselection.coords);
+
   //Send signal to client that tris are coming up,
   PUBLIC(this)->startCBList->invokeCallbacks(PUBLIC(this));
 
-  this->curvp = SoViewportRegionElement::get(action->getState());
+  this->curvp = vp;
   this->cbaction->setViewportRegion(this->curvp);
 
   switch (PUBLIC(this)->policy.getValue()) {
@@ -2603,7 +3122,7 @@ SoExtSelectionP::performSelection(SoHandleEventAction * action)
 
     // Execute 'search' for triangles
     primcbdata.allshapes = TRUE;
-    this->cbaction->apply(action->getCurPath()->getHead());
+    this->cbaction->apply(root);
 
   }
   else {
@@ -2614,8 +3133,7 @@ SoExtSelectionP::performSelection(SoHandleEventAction * action)
     primcbdata.allshapes = FALSE;
 
 
-    this->offscreenaction = action;
-    this->offscreenheadnode = action->getCurPath()->getHead();
+    this->offscreenheadnode = root;
 
     // Check OpenGL capabilities
     SbBool setupok = this->checkOffscreenRendererCapabilities();
@@ -2625,6 +3143,7 @@ SoExtSelectionP::performSelection(SoHandleEventAction * action)
     if (!setupok) {
       // start/finish should be paired up
       PUBLIC(this)->finishCBList->invokeCallbacks(PUBLIC(this));
+      this->lassogrid.clear();
       return;
     }
 
@@ -2652,9 +3171,9 @@ SoExtSelectionP::performSelection(SoHandleEventAction * action)
     unsigned int maxsize[2];
     cc_glglue_context_max_dimensions(&maxsize[0], &maxsize[1]);
 
-    this->requestedsize = action->getViewportRegion().getViewportSizePixels();
+    this->requestedsize = vp.getViewportSizePixels();
 
-    SbViewportRegion vp = action->getViewportRegion();
+    SbViewportRegion offscreenvp = vp;
     if((unsigned int) requestedsize[0] > maxsize[0] || (unsigned int) requestedsize[1] > maxsize[1]){
 
       double maxv = (float) SbMax(requestedsize[0],requestedsize[1]);
@@ -2665,16 +3184,16 @@ SoExtSelectionP::performSelection(SoHandleEventAction * action)
       newsize[0] = (int) (requestedsize[0] * scale);
       newsize[1] = (int) (requestedsize[1] * scale);
 
-      vp = SbViewportRegion(newsize[0],newsize[1]);
+      offscreenvp = SbViewportRegion(newsize[0],newsize[1]);
     }
     // only (re)allocate the renderers if the viewport has changed
-    if (this->renderer == NULL || this->renderer->getViewportRegion() != vp) {
+    if (this->renderer == NULL || this->renderer->getViewportRegion() != offscreenvp) {
       delete this->renderer;
-      this->renderer = new SoOffscreenRenderer(vp);
+      this->renderer = new SoOffscreenRenderer(offscreenvp);
     }
-    if (this->lassorenderer == NULL || this->lassorenderer->getViewportRegion() != vp) {
+    if (this->lassorenderer == NULL || this->lassorenderer->getViewportRegion() != offscreenvp) {
       delete this->lassorenderer;
-      this->lassorenderer = new SoOffscreenRenderer(vp);
+      this->lassorenderer = new SoOffscreenRenderer(offscreenvp);
     }
 
     SoCallback * cbnode = new SoCallback;
@@ -2717,7 +3236,7 @@ SoExtSelectionP::performSelection(SoHandleEventAction * action)
 
       // Scan buffer marking visible colors in the
       // 'visibletrianglesbitarray' array.
-      if (this->scanOffscreenBuffer(action->getCurPath()->getHead()) != 0) {
+      if (this->scanOffscreenBuffer(root) != 0) {
 
         // Render once more, but only selected triangles which are forwarded
         // to client code through 'triangleFilterCB'.
@@ -2729,7 +3248,7 @@ SoExtSelectionP::performSelection(SoHandleEventAction * action)
         this->drawcounter = 0;
 
         this->applyonlyonselectedtriangles = TRUE;
-        this->cbaction->apply(action->getCurPath()->getHead());
+        this->cbaction->apply(root);
         PUBLIC(this)->touch();
 
       } else {
@@ -2747,6 +3266,7 @@ SoExtSelectionP::performSelection(SoHandleEventAction * action)
     delete [] this->visibletrianglesbitarray;
   }
 
+  this->lassogrid.clear();
   this->selectPaths(); // Execute a 'doSelect' on all stored paths.
 
   // Send signal to client that we are finished searching for tris
@@ -2778,3 +3298,117 @@ SoExtSelectionP::validateViewportBBox(SbBox2s & bbox,
 
 #undef PRIVATE
 #undef PUBLIC
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/SoPath.h>
+#include <Inventor/nodes/SoCoordinate3.h>
+#include <Inventor/nodes/SoFaceSet.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/nodes/SoOrthographicCamera.h>
+#include <Inventor/nodes/SoSeparator.h>
+
+// Returns a bitmask of which of the shapes are selected.
+static int
+soextselection_selected(SoExtSelection * sel, SoNode * shape0, SoNode * shape1)
+{
+  int selected = 0;
+  for (int i = 0; i < sel->getNumSelected(); i++) {
+    SoNode * tail = sel->getPath(i)->getTail();
+    if (tail == shape0) selected |= 1;
+    if (tail == shape1) selected |= 2;
+  }
+  return selected;
+}
+
+// Programmatic selection, which does not need an OpenGL context in
+// the ALL_SHAPES lassoMode. One square to the left, drawn with an
+// SoIndexedFaceSet, and one to the right, drawn with an SoFaceSet.
+BOOST_AUTO_TEST_CASE(programmaticSelection)
+{
+  SoExtSelection * sel = new SoExtSelection;
+  sel->ref();
+  SoOrthographicCamera * camera = new SoOrthographicCamera;
+  camera->position.setValue(0.0f, 0.0f, 5.0f);
+  camera->height = 10.0f;
+  sel->addChild(camera);
+
+  static const float left[][3] = { {-4, -1, 0}, {-1, -1, 0}, {-1, 1, 0}, {-4, 1, 0} };
+  static const float right[][3] = { {1, -1, 0}, {4, -1, 0}, {4, 1, 0}, {1, 1, 0} };
+  static const int32_t indices[] = { 0, 1, 2, -1, 0, 2, 3, -1 };
+
+  SoSeparator * sep0 = new SoSeparator;
+  SoCoordinate3 * coords0 = new SoCoordinate3;
+  coords0->point.setValues(0, 4, left);
+  SoIndexedFaceSet * shape0 = new SoIndexedFaceSet;
+  shape0->coordIndex.setValues(0, 8, indices);
+  sep0->addChild(coords0);
+  sep0->addChild(shape0);
+  sel->addChild(sep0);
+
+  SoSeparator * sep1 = new SoSeparator;
+  SoCoordinate3 * coords1 = new SoCoordinate3;
+  coords1->point.setValues(0, 4, right);
+  SoFaceSet * shape1 = new SoFaceSet;
+  shape1->numVertices.set1Value(0, 4);
+  sep1->addChild(coords1);
+  sep1->addChild(shape1);
+  sel->addChild(sep1);
+
+  const SbViewportRegion vp(100, 100);
+  sel->lassoType = SoExtSelection::RECTANGLE;
+
+  // around the left square
+  SbVec2f rect0[] = { SbVec2f(0.05f, 0.35f), SbVec2f(0.55f, 0.65f) };
+  // overlapping both squares
+  SbVec2f rect1[] = { SbVec2f(0.3f, 0.3f), SbVec2f(0.7f, 0.7f) };
+
+  sel->lassoPolicy = SoExtSelection::PART;
+  sel->select(sel, 2, rect0, vp, FALSE);
+  BOOST_CHECK_MESSAGE(soextselection_selected(sel, shape0, shape1) == 1,
+                      "expected only the left square to be selected");
+  sel->select(sel, 2, rect1, vp, FALSE);
+  BOOST_CHECK_MESSAGE(soextselection_selected(sel, shape0, shape1) == 3,
+                      "expected both squares to be selected");
+
+  sel->lassoPolicy = SoExtSelection::FULL;
+  sel->select(sel, 2, rect0, vp, FALSE);
+  BOOST_CHECK_MESSAGE(soextselection_selected(sel, shape0, shape1) == 1,
+                      "expected only the left square to be selected");
+  sel->select(sel, 2, rect1, vp, FALSE);
+  BOOST_CHECK_MESSAGE(soextselection_selected(sel, shape0, shape1) == 0,
+                      "expected no squares to be selected");
+
+  // a concave lasso around both squares, with a notch between them
+  sel->lassoType = SoExtSelection::LASSO;
+  SbVec2f lasso[] = {
+    SbVec2f(0.02f, 0.02f), SbVec2f(0.98f, 0.02f), SbVec2f(0.98f, 0.98f),
+    SbVec2f(0.5f, 0.75f), SbVec2f(0.02f, 0.98f)
+  };
+  sel->select(sel, 5, lasso, vp, FALSE);
+  BOOST_CHECK_MESSAGE(soextselection_selected(sel, shape0, shape1) == 3,
+                      "expected both squares to be selected");
+  // the notch down through the left square
+  lasso[3].setValue(0.25f, 0.45f);
+  sel->select(sel, 5, lasso, vp, FALSE);
+  BOOST_CHECK_MESSAGE(soextselection_selected(sel, shape0, shape1) == 2,
+                      "expected only the right square to be selected");
+  sel->lassoPolicy = SoExtSelection::PART;
+  sel->select(sel, 5, lasso, vp, FALSE);
+  BOOST_CHECK_MESSAGE(soextselection_selected(sel, shape0, shape1) == 3,
+                      "expected both squares to be selected");
+
+  // a lasso in world coordinates around the right square
+  sel->lassoPolicy = SoExtSelection::FULL;
+  SbVec3f worldlasso[] = {
+    SbVec3f(0.5f, -2.0f, 0.0f), SbVec3f(4.5f, -2.0f, 0.0f),
+    SbVec3f(4.5f, 2.0f, 0.0f), SbVec3f(0.5f, 2.0f, 0.0f)
+  };
+  sel->select(sel, 4, worldlasso, vp, FALSE);
+  BOOST_CHECK_MESSAGE(soextselection_selected(sel, shape0, shape1) == 2,
+                      "expected only the right square to be selected");
+
+  sel->unref();
+}
+
+#endif // COIN_TEST_SUITE
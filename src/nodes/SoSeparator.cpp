@@ -67,6 +67,7 @@
 #include <cstdlib> // strtol(), rand()
 #include <climits> // LONG_MIN, LONG_MAX
 
+#include <Inventor/SbXfBox3f.h>
 #include <Inventor/actions/SoCallbackAction.h>
 #include <Inventor/actions/SoGLRenderAction.h>
 #include <Inventor/actions/SoGetBoundingBoxAction.h>
@@ -82,8 +83,10 @@
 #include <Inventor/elements/SoLocalBBoxMatrixElement.h>
 #include <Inventor/elements/SoSoundElement.h>
 #include <Inventor/misc/SoChildList.h>
+#include <Inventor/misc/SoNotification.h>
 #include <Inventor/misc/SoState.h>
 #include <Inventor/errors/SoDebugError.h>
+#include <Inventor/lists/SbList.h>
 #include <Inventor/system/gl.h>
 #include <Inventor/C/tidbits.h> // coin_getenv()
 #include <Inventor/threads/SbStorage.h>
@@ -93,6 +96,7 @@
 #endif // COIN_THREADSAFE
 
 #include "coindefs.h" // COIN_OBSOLETED()
+#include "SbBasicP.h"
 #include "nodes/SoSubNodeP.h"
 #include "glue/glp.h"
 #include "rendering/SoGL.h"
@@ -250,6 +254,13 @@ int SoSeparator::numrendercaches = 2;
   Policy for caching bounding box calculations. Default value is
   SoSeparator::AUTO.
 
+  The bounding boxes of the SoSeparator children are kept with the
+  cache. When a change is notified from a child separator, only that
+  child is traversed again, and the cached boxes of its siblings are
+  reused. As all separators do this, a change in a scene graph of
+  nested separators only causes the separators on the path from the
+  changed node to be traversed again.
+
   See also documentation for SoSeparator::renderCaching.
 */
 /*!
@@ -318,6 +329,30 @@ public:
   uint32_t bboxcache_usecount;
   uint32_t bboxcache_destroycount;
 
+  // The contribution of each child separator to the bounding box
+  // cache. The entries for other children are not used.
+  struct ChildBBox {
+    SbXfBox3f box;
+    SbVec3f center;
+    SbBool centerset;
+  };
+  SbList <ChildBBox> childbboxes;
+  // Child separators that have changed since the bounding box cache
+  // was made. The cache is refit by traversing only these, which are
+  // moved to refitchildren during the traversal.
+  SbList <SoNode *> dirtychildren;
+  SbList <SoNode *> refitchildren;
+  int bboxcachedepth;
+  SbBool bboxbuilding;
+
+  enum { MAX_DIRTY_CHILDREN = 32 };
+
+  SbBool hasValidBBoxCache(SoState * state) const {
+    return this->bboxcache && (this->dirtychildren.getLength() == 0) &&
+      this->bboxcache->isValid(state);
+  }
+  void getChildrenBBox(SoGetBoundingBoxAction * action, const SbBool refit);
+
 #ifdef COIN_THREADSAFE
   // FIXME: a mutex for every SoSeparator instance seems a bit
   // excessive, especially since Microsoft Windows might have rather strict
@@ -362,6 +397,65 @@ public:
 
 // *************************************************************************
 
+// Traverses the children like SoGroup::getBoundingBox(), but keeps
+// the bounding box of each child separator. If refit is TRUE, only
+// the dirty child separators are traversed, and the kept boxes are
+// used for the others. That gives the same result as a full
+// traversal, since a separator doesn't affect the traversal state of
+// its siblings.
+void
+SoSeparatorP::getChildrenBBox(SoGetBoundingBoxAction * action, const SbBool refit)
+{
+  SoChildList * children = PUBLIC(this)->getChildren();
+  const int numchildren = children->getLength();
+  if (!refit) {
+    this->childbboxes.truncate(0);
+    for (int i = 0; i < numchildren; i++) this->childbboxes.append(ChildBBox());
+  }
+  assert(this->childbboxes.getLength() == numchildren);
+
+  SbVec3f acccenter(0.0f, 0.0f, 0.0f);
+  int numcenters = 0;
+
+  for (int i = 0; i < numchildren; i++) {
+    SoNode * child = (*children)[i];
+    if (child->isOfType(SoSeparator::getClassTypeId())) {
+      ChildBBox & childbbox = this->childbboxes[i];
+      if (!refit || (this->refitchildren.find(child) >= 0)) {
+        SbXfBox3f & actionbox = action->getXfBoundingBox();
+        const SbXfBox3f accbox = actionbox;
+        actionbox.makeEmpty();
+        children->traverse(action, i);
+        childbbox.box = actionbox;
+        childbbox.centerset = action->isCenterSet();
+        if (childbbox.centerset) {
+          childbbox.center = action->getCenter();
+          action->resetCenter();
+        }
+        actionbox = accbox;
+      }
+      if (!childbbox.box.isEmpty()) {
+        action->getXfBoundingBox().extendBy(childbbox.box);
+      }
+      if (childbbox.centerset) {
+        acccenter += childbbox.center;
+        numcenters++;
+      }
+    }
+    else {
+      children->traverse(action, i);
+      if (action->isCenterSet()) {
+        acccenter += action->getCenter();
+        numcenters++;
+        action->resetCenter();
+      }
+    }
+  }
+
+  if (numcenters != 0)
+    action->setCenter(acccenter / float(numcenters), FALSE);
+}
+
 SoGLCacheList *
 SoSeparatorP::getGLCacheList(SbBool createifnull)
 {
@@ -441,6 +535,8 @@ SoSeparator::commonConstructor(void)
   PRIVATE(this)->bboxcache = NULL;
   PRIVATE(this)->bboxcache_usecount = 0;
   PRIVATE(this)->bboxcache_destroycount = 0;
+  PRIVATE(this)->bboxcachedepth = -1;
+  PRIVATE(this)->bboxbuilding = FALSE;
 
   // This environment variable is used for local stability / robustness /
   // correctness testing of the render caching. If set >= 1,
@@ -524,7 +620,7 @@ SoSeparator::getBoundingBox(SoGetBoundingBoxAction * action)
     break;
   }
 
-  SbBool validcache = iscaching && PRIVATE(this)->bboxcache && PRIVATE(this)->bboxcache->isValid(state);
+  SbBool validcache = iscaching && PRIVATE(this)->hasValidBBoxCache(state);
 
   if (iscaching && validcache) {
     SoCacheElement::addCacheDependency(state, PRIVATE(this)->bboxcache);
@@ -548,22 +644,50 @@ SoSeparator::getBoundingBox(SoGetBoundingBoxAction * action)
       }
     }
 
+    // the cache can be refit if it is still valid apart from changes
+    // in child separators, and we are at the same state depth as when
+    // it was made, so that it gets the same element dependencies
+    SbBool refit = FALSE;
+
+    // lock before changing the bboxcache pointer so that the notify()
+    // function can be used by another thread.
+    PRIVATE(this)->lock();
+    if (iscaching) {
+      // the cache and the child bounding boxes can only be updated
+      // by one traversal at a time
+      if (PRIVATE(this)->bboxbuilding) iscaching = FALSE;
+      else {
+        PRIVATE(this)->bboxbuilding = TRUE;
+        refit = PRIVATE(this)->bboxcache &&
+          (PRIVATE(this)->dirtychildren.getLength() > 0) &&
+          (PRIVATE(this)->bboxcachedepth == state->getDepth()) &&
+          PRIVATE(this)->bboxcache->isValid(state);
+        // children changed during the traversal will be dirty for
+        // the next one
+        if (refit) PRIVATE(this)->refitchildren = PRIVATE(this)->dirtychildren;
+        PRIVATE(this)->dirtychildren.truncate(0);
+      }
+    }
+    PRIVATE(this)->unlock();
+
     if (iscaching) {
       storedinvalid = SoCacheElement::setInvalid(FALSE);
     }
     state->push();
 
     if (iscaching) {
-      // lock before changing the bboxcache pointer so that the notify()
-      // function can be used by another thread.
       PRIVATE(this)->lock();
-      // if we get here, we know bbox cache is not created or is invalid
-      if (PRIVATE(this)->bboxcache) {
-        PRIVATE(this)->bboxcache_destroycount++;
-        PRIVATE(this)->bboxcache->unref();
+      // if we get here, we know bbox cache is not created or is
+      // invalid, unless it can be refit
+      if (!refit) {
+        if (PRIVATE(this)->bboxcache) {
+          PRIVATE(this)->bboxcache_destroycount++;
+          PRIVATE(this)->bboxcache->unref();
+        }
+        PRIVATE(this)->bboxcache = new SoBoundingBoxCache(state);
+        PRIVATE(this)->bboxcache->ref();
+        PRIVATE(this)->bboxcachedepth = state->getDepth() - 1;
       }
-      PRIVATE(this)->bboxcache = new SoBoundingBoxCache(state);
-      PRIVATE(this)->bboxcache->ref();
       PRIVATE(this)->unlock();
       // set active cache to record cache dependencies
       SoCacheElement::set(state, PRIVATE(this)->bboxcache);
@@ -571,7 +695,8 @@ SoSeparator::getBoundingBox(SoGetBoundingBoxAction * action)
 
     SoLocalBBoxMatrixElement::makeIdentity(state);
     action->getXfBoundingBox().makeEmpty();
-    inherited::getBoundingBox(action);
+    if (iscaching) PRIVATE(this)->getChildrenBBox(action, refit);
+    else inherited::getBoundingBox(action);
 
     childrenbbox = action->getXfBoundingBox();
     childrencenterset = action->isCenterSet();
@@ -581,6 +706,10 @@ SoSeparator::getBoundingBox(SoGetBoundingBoxAction * action)
 
     if (iscaching) {
       PRIVATE(this)->bboxcache->set(childrenbbox, childrencenterset, childrencenter);
+      PRIVATE(this)->lock();
+      PRIVATE(this)->refitchildren.truncate(0);
+      PRIVATE(this)->bboxbuilding = FALSE;
+      PRIVATE(this)->unlock();
     }
     state->pop();
     if (iscaching) SoCacheElement::setInvalid(storedinvalid);
@@ -858,7 +987,7 @@ void
 SoSeparator::rayPick(SoRayPickAction * action)
 {
   if (this->pickCulling.getValue() == OFF ||
-      !PRIVATE(this)->bboxcache || !PRIVATE(this)->bboxcache->isValid(action->getState()) ||
+      !PRIVATE(this)->hasValidBBoxCache(action->getState()) ||
       !action->hasWorldSpaceRay() ||
       ray_intersect(action, PRIVATE(this)->bboxcache->getProjectedBox())) {
     SoSeparator::doAction(action);
@@ -948,12 +1077,36 @@ SoSeparator::getPrimitiveCount(SoGetPrimitiveCountAction * action)
 void
 SoSeparator::notify(SoNotList * nl)
 {
+  // find the child separator the notification came from, if any. Must
+  // be done before the notification is passed on, as that appends a
+  // record for this node.
+  SoNode * fromseparator = NULL;
+  SoNotRec * rec = nl->getLastRec();
+  if (rec && (rec->getBase() != this) && (rec->getType() == SoNotRec::PARENT)) {
+    SoNode * child = coin_assert_cast<SoNode *>(rec->getBase());
+    if (child->isOfType(SoSeparator::getClassTypeId())) fromseparator = child;
+  }
+
   inherited::notify(nl);
 
   // lock before using the cache pointers so that we know the pointers
   // are valid while reading them
   PRIVATE(this)->lock();
-  if (PRIVATE(this)->bboxcache) PRIVATE(this)->bboxcache->invalidate();
+  if (PRIVATE(this)->bboxcache) {
+    // a change in a child separator doesn't affect its siblings, so
+    // the bounding box cache can be refit by traversing only that
+    // child
+    if (fromseparator &&
+        (PRIVATE(this)->childbboxes.getLength() == this->getNumChildren()) &&
+        (PRIVATE(this)->dirtychildren.getLength() < SoSeparatorP::MAX_DIRTY_CHILDREN)) {
+      if (PRIVATE(this)->dirtychildren.find(fromseparator) < 0) {
+        PRIVATE(this)->dirtychildren.append(fromseparator);
+      }
+    }
+    else {
+      PRIVATE(this)->bboxcache->invalidate();
+    }
+  }
   PRIVATE(this)->invalidateGLCaches();
   PRIVATE(this)->hassoundchild = SoSeparatorP::MAYBE;
   PRIVATE(this)->unlock();
@@ -988,8 +1141,7 @@ SoSeparatorP::doCull(SoSeparatorP * thisp, SoState * state,
   if (SoCullElement::completelyInside(state)) return FALSE;
 
   SbBool outside = FALSE;
-  if (thisp->bboxcache &&
-      thisp->bboxcache->isValid(state)) {
+  if (thisp->hasValidBBoxCache(state)) {
     const SbBox3f & bbox = thisp->bboxcache->getProjectedBox();
     if (!bbox.isEmpty()) {
       outside = (*cullfunc)(state, bbox, TRUE);
@@ -1041,3 +1193,100 @@ SoSeparator::cullTestNoPush(SoState * state)
 #undef PRIVATE
 #undef PUBLIC
 #undef GLCACHE_DEBUG
+
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/SbViewportRegion.h>
+#include <Inventor/actions/SoGetBoundingBoxAction.h>
+#include <Inventor/actions/SoSearchAction.h>
+#include <Inventor/lists/SoPathList.h>
+#include <Inventor/nodes/SoCube.h>
+#include <Inventor/nodes/SoSphere.h>
+#include <Inventor/nodes/SoTranslation.h>
+
+// Separators with translated cubes and spheres, nested three levels
+// deep, with a translation between the separators on each level.
+static SoSeparator *
+soseparator_bbox_scene(SbList <SoTranslation *> & translations)
+{
+  SoSeparator * root = new SoSeparator;
+  for (int i = 0; i < 6; i++) {
+    SoSeparator * sep1 = new SoSeparator;
+    for (int j = 0; j < 6; j++) {
+      if (j == 3) {
+        SoTranslation * shift = new SoTranslation;
+        shift->translation.setValue(0.0f, 0.5f, 0.0f);
+        sep1->addChild(shift);
+        translations.append(shift);
+      }
+      SoSeparator * sep2 = new SoSeparator;
+      SoTranslation * t = new SoTranslation;
+      t->translation.setValue(float(i), float(j), 0.0f);
+      sep2->addChild(t);
+      translations.append(t);
+      if ((i + j) % 2) sep2->addChild(new SoCube);
+      else sep2->addChild(new SoSphere);
+      sep1->addChild(sep2);
+    }
+    root->addChild(sep1);
+  }
+  return root;
+}
+
+static SbBool
+soseparator_same_bbox(SoGetBoundingBoxAction & a1, SoGetBoundingBoxAction & a2)
+{
+  return (a1.getBoundingBox() == a2.getBoundingBox()) &&
+    (a1.getCenter() == a2.getCenter());
+}
+
+BOOST_AUTO_TEST_CASE(refitBoundingBoxCache)
+{
+  SbList <SoTranslation *> translations;
+  SoSeparator * root = soseparator_bbox_scene(translations);
+  root->ref();
+
+  SoGetBoundingBoxAction cached(SbViewportRegion(100, 100));
+  SoGetBoundingBoxAction reference(SbViewportRegion(100, 100));
+  cached.apply(root);
+
+  SbBool same = TRUE;
+  for (int i = 0; same && (i < 40); i++) {
+    // move one translation at a time, both inside and between the
+    // child separators, and every fifth time add a new shape
+    SoTranslation * t = translations[(i * 7) % translations.getLength()];
+    SbVec3f v = t->translation.getValue();
+    v[i % 3] += (i % 2) ? 2.5f : -1.5f;
+    t->translation = v;
+    if (i % 5 == 4) {
+      SoSeparator * sep = new SoSeparator;
+      SoTranslation * t2 = new SoTranslation;
+      t2->translation.setValue(float(i), 0.0f, -float(i));
+      sep->addChild(t2);
+      sep->addChild(new SoCube);
+      static_cast<SoGroup *>(root->getChild(i % root->getNumChildren()))->addChild(sep);
+    }
+    cached.apply(root);
+
+    // the same scene graph without bounding box caches
+    SoSeparator * copy = static_cast<SoSeparator *>(root->copy());
+    copy->ref();
+    SoSearchAction sa;
+    sa.setType(SoSeparator::getClassTypeId());
+    sa.setInterest(SoSearchAction::ALL);
+    sa.apply(copy);
+    for (int j = 0; j < sa.getPaths().getLength(); j++) {
+      SoSeparator * sep = static_cast<SoSeparator *>(sa.getPaths()[j]->getTail());
+      sep->boundingBoxCaching = SoSeparator::OFF;
+    }
+    reference.apply(copy);
+    copy->unref();
+
+    same = soseparator_same_bbox(cached, reference);
+  }
+  BOOST_CHECK_MESSAGE(same, "refit bounding box differs from uncached bounding box");
+
+  root->unref();
+}
+
+#endif // COIN_TEST_SUITE
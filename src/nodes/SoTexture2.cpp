@@ -176,6 +176,18 @@
   $ ./test < input.iv
   \endverbatim
 
+  Large image files can take a long time to read. To avoid stalling
+  the application while they are read, see setAsyncLoading(). The
+  following environment variables control asynchronous loading:
+
+  \li COIN_TEXTURE2_ASYNC_LOADING: Set to 1 to make asynchronous
+  loading the default.
+
+  \li COIN_TEXTURE2_UPLOAD_BUDGET: The number of megabytes of texture
+  data from asynchronously loaded images which may be sent to OpenGL
+  each frame. The default is 16. At least one texture is sent each
+  frame, even if it is larger than the budget.
+
   <b>FILE FORMAT/DEFAULTS:</b>
   \code
     Texture2 {
@@ -195,6 +207,8 @@
 #include <Inventor/nodes/SoTexture2.h>
 
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -204,8 +218,11 @@
 #include "elements/SoTextureScalePolicyElement.h"
 #include "nodes/SoSubNodeP.h"
 #include "tidbitsp.h"
+#include "base/imageresize.h"
 #include <Inventor/C/glue/gl.h>
+#include <Inventor/C/threads/sched.h>
 #include <Inventor/SbImage.h>
+#include <Inventor/SbTime.h>
 #include <Inventor/SoInput.h>
 #include <Inventor/actions/SoCallbackAction.h>
 #include <Inventor/actions/SoGLRenderAction.h>
@@ -221,9 +238,13 @@
 #include <Inventor/elements/SoTextureUnitElement.h>
 #include <Inventor/errors/SoDebugError.h>
 #include <Inventor/errors/SoReadError.h>
+#include <Inventor/lists/SbList.h>
 #include <Inventor/lists/SbStringList.h>
 #include <Inventor/misc/SoGLBigImage.h>
 #include <Inventor/sensors/SoFieldSensor.h>
+#include <Inventor/sensors/SoOneShotSensor.h>
+#include <Inventor/sensors/SoTimerSensor.h>
+#include <Inventor/threads/SbCondVar.h>
 #include <Inventor/threads/SbMutex.h>
 
 // *************************************************************************
@@ -374,22 +395,104 @@
 
 // *************************************************************************
 
+// the maximum width and height of the low resolution image used
+// while an asynchronously loaded image is waiting to be sent to
+// OpenGL
+#define PROXY_SIZE 256
+
+class SoTexture2LoadData;
+
 class SoTexture2P {
 public:
+  SoTexture2 * master;
   int readstatus;
   SoGLImage * glimage;
   SbBool glimagevalid;
   SoFieldSensor * filenamesensor;
 
+  // used for asynchronous loading. loadimage is only used to get a
+  // callback when the image is needed, the image is read into a
+  // SoTexture2LoadData instance by the scheduler thread.
+  SbImage loadimage;
+  uint32_t loadgeneration;
+  // the reads scheduled for this node which haven't finished yet
+  SbList <SoTexture2LoadData *> pending;
+  SoTexture2LoadData * loaded;
+  SbBool isdestructing;
+  SoTimerSensor * loadsensor;
+  // low resolution version of the image, used for the GL image until
+  // the upload budget allows the full image to be used
+  SbImage proxyimage;
+  SbBool glimageproxy;
+  SoOneShotSensor * touchsensor;
+
   static SbMutex * mutex;
+  static SbCondVar * loadcond; // signaled when a read has finished
+  static cc_sched * scheduler;
+  static int asyncloading;
+  static size_t uploadbudget;
+  static size_t uploaded;
+  static SoOneShotSensor * uploadsensor;
+
+  static inline void lock(void) {
+#ifdef COIN_THREADSAFE
+    SoTexture2P::mutex->lock();
+#endif // COIN_THREADSAFE
+  }
+  static inline void unlock(void) {
+#ifdef COIN_THREADSAFE
+    SoTexture2P::mutex->unlock();
+#endif // COIN_THREADSAFE
+  }
+
+  static SbBool useAsyncLoading(void);
+  static SbBool reserveUpload(const size_t numbytes);
+  static SbBool readImageCB(const SbString & filename, SbImage * image, void * closure);
+  static void loadJob(void * closure);
+  static void loadSensorCB(void * closure, SoSensor * sensor);
+  static void touchSensorCB(void * closure, SoSensor * sensor);
+  static void uploadSensorCB(void * closure, SoSensor * sensor);
+  void clearLoaded(void);
+  void cancelLoading(void);
 
   static void cleanup(void) {
+    if (SoTexture2P::scheduler) {
+      cc_sched_destruct(SoTexture2P::scheduler);
+      SoTexture2P::scheduler = NULL;
+    }
+    delete SoTexture2P::uploadsensor;
+    SoTexture2P::uploadsensor = NULL;
+    SoTexture2P::uploaded = 0;
+    SoTexture2P::uploadbudget = 0;
+    SoTexture2P::asyncloading = -1;
+
+    delete SoTexture2P::loadcond;
+    SoTexture2P::loadcond = NULL;
     delete SoTexture2P::mutex;
     SoTexture2P::mutex = NULL;
   }
 };
 
+// an image read by the scheduler thread
+class SoTexture2LoadData {
+public:
+  SoTexture2P * pimpl;
+  SbString filename;
+  uint32_t generation;
+  uint32_t schedid;
+  SbVec2s size;
+  int nc;
+  unsigned char * bytes;
+  SbImage proxy;
+};
+
 SbMutex * SoTexture2P::mutex = NULL;
+SbCondVar * SoTexture2P::loadcond = NULL;
+cc_sched * SoTexture2P::scheduler = NULL;
+int SoTexture2P::asyncloading = -1;
+size_t SoTexture2P::uploadbudget = 0;
+size_t SoTexture2P::uploaded = 0;
+SoOneShotSensor * SoTexture2P::uploadsensor = NULL;
 
 #define PRIVATE(p) ((p)->pimpl)
 
@@ -413,6 +516,7 @@ SO_NODE_SOURCE(SoTexture2);
 SoTexture2::SoTexture2(void)
 {
   PRIVATE(this) = new SoTexture2P;
+  PRIVATE(this)->master = this;
 
   SO_NODE_INTERNAL_CONSTRUCTOR(SoTexture2);
 
@@ -439,6 +543,15 @@ SoTexture2::SoTexture2(void)
   PRIVATE(this)->glimage = NULL;
   PRIVATE(this)->glimagevalid = FALSE;
   PRIVATE(this)->readstatus = 1;
+  PRIVATE(this)->loadgeneration = 0;
+  PRIVATE(this)->loaded = NULL;
+  PRIVATE(this)->isdestructing = FALSE;
+  PRIVATE(this)->loadsensor =
+    new SoTimerSensor(SoTexture2P::loadSensorCB, PRIVATE(this));
+  PRIVATE(this)->loadsensor->setInterval(SbTime(0.1));
+  PRIVATE(this)->glimageproxy = FALSE;
+  PRIVATE(this)->touchsensor =
+    new SoOneShotSensor(SoTexture2P::touchSensorCB, PRIVATE(this));
 
   // use field sensor for filename since we will load an image if
   // filename changes. This is a time-consuming task which should
@@ -454,6 +567,29 @@ SoTexture2::SoTexture2(void)
 */
 SoTexture2::~SoTexture2()
 {
+#ifdef COIN_THREADSAFE
+  if (SoTexture2P::scheduler) {
+    SoTexture2P::lock();
+    PRIVATE(this)->isdestructing = TRUE; // signal thread that we are destructing
+    // cancel the reads which haven't started yet, and wait for the
+    // one being read by the scheduler thread, if any
+    SbList <SoTexture2LoadData *> & pending = PRIVATE(this)->pending;
+    for (int i = pending.getLength() - 1; i >= 0; i--) {
+      if (cc_sched_unschedule(SoTexture2P::scheduler, pending[i]->schedid)) {
+        delete pending[i];
+        pending.remove(i);
+      }
+    }
+    while (pending.getLength()) {
+      (void) SoTexture2P::loadcond->wait(*SoTexture2P::mutex);
+    }
+    SoTexture2P::unlock();
+  }
+#endif // COIN_THREADSAFE
+  PRIVATE(this)->clearLoaded();
+  delete PRIVATE(this)->loadsensor;
+  delete PRIVATE(this)->touchsensor;
+
   if (PRIVATE(this)->glimage) PRIVATE(this)->glimage->unref(NULL);
   delete PRIVATE(this)->filenamesensor;
   delete PRIVATE(this);
@@ -479,6 +615,7 @@ SoTexture2::initClass(void)
 
 #ifdef COIN_THREADSAFE
   SoTexture2P::mutex = new SbMutex;
+  SoTexture2P::loadcond = new SbCondVar;
 #endif // COIN_THREADSAFE
 
   coin_atexit(SoTexture2P::cleanup, CC_ATEXIT_NORMAL);
@@ -528,10 +665,28 @@ SoTexture2::GLRender(SoGLRenderAction * action)
     SoTextureScalePolicyElement::get(state);
   SbBool needbig = (scalepolicy == SoTextureScalePolicyElement::FRACTURE);
   SoType glimagetype = PRIVATE(this)->glimage ? PRIVATE(this)->glimage->getTypeId() : SoType::badType();
+
+  // when the image is loaded asynchronously, this starts reading the
+  // image file the first time the texture is rendered
+  SbVec2s loadsize;
+  int loadnc;
+  (void) PRIVATE(this)->loadimage.getValue(loadsize, loadnc);
     
   LOCK_GLIMAGE(this);
+
+  // an asynchronously loaded image is first shown using its low
+  // resolution proxy. Replace it with the full image when the upload
+  // budget for this frame allows it.
+  SbBool swapin = FALSE;
+  if (PRIVATE(this)->glimagevalid && PRIVATE(this)->glimageproxy) {
+    int nc;
+    SbVec2s size;
+    (void) this->image.getValue(size, nc);
+    swapin = SoTexture2P::reserveUpload(size_t(size[0]) * size_t(size[1]) * size_t(nc));
+    if (!swapin) PRIVATE(this)->touchsensor->schedule();
+  }
   
-  if (!PRIVATE(this)->glimagevalid || 
+  if (!PRIVATE(this)->glimagevalid || swapin ||
       (needbig && glimagetype != SoGLBigImage::getClassTypeId()) ||
       (!needbig && glimagetype != SoGLImage::getClassTypeId())) {
     int nc;
@@ -560,10 +715,21 @@ SoTexture2::GLRender(SoGLRenderAction * action)
     }
 
     if (bytes && size != SbVec2s(0,0)) {
+      // SoGLBigImage has its own per-frame limit, so the proxy is
+      // only needed for SoGLImage
+      SbBool useproxy =
+        !swapin && !needbig && PRIVATE(this)->proxyimage.hasData() &&
+        !SoTexture2P::reserveUpload(size_t(size[0]) * size_t(size[1]) * size_t(nc));
+      if (useproxy) {
+        bytes = PRIVATE(this)->proxyimage.getValue(size, nc);
+        PRIVATE(this)->touchsensor->schedule();
+      }
       PRIVATE(this)->glimage->setData(bytes, size, nc,
                              translateWrap((Wrap)this->wrapS.getValue()),
                              translateWrap((Wrap)this->wrapT.getValue()),
                              quality);
+      if (!useproxy) PRIVATE(this)->proxyimage.setValue(SbVec2s(0,0), 0, NULL);
+      PRIVATE(this)->glimageproxy = useproxy;
       PRIVATE(this)->glimagevalid = TRUE;
       // don't cache while creating a texture object
       SoCacheElement::setInvalid(TRUE);
@@ -660,6 +826,12 @@ SoTexture2::doAction(SoAction * action)
 void
 SoTexture2::callback(SoCallbackAction * action)
 {
+  // start reading an asynchronously loaded image file, so that it
+  // is also loaded for scene graphs which are never rendered
+  SbVec2s loadsize;
+  int loadnc;
+  (void) PRIVATE(this)->loadimage.getValue(loadsize, loadnc);
+
   SoTexture2::doAction(action);
 }
 
@@ -709,6 +881,7 @@ SoTexture2::notify(SoNotList * l)
   SoField * f = l->getLastField();
   if (f == &this->image) {
     PRIVATE(this)->glimagevalid = FALSE;
+    PRIVATE(this)->cancelLoading();
 
     // write image, not filename
     this->filename.setDefault(TRUE);
@@ -728,7 +901,20 @@ SbBool
 SoTexture2::loadFilename(void)
 {
   SbBool retval = FALSE;
-  if (this->filename.getValue().getLength()) {
+  PRIVATE(this)->cancelLoading();
+  if (this->filename.getValue().getLength() && SoTexture2P::useAsyncLoading()) {
+    // clear the old image. The file is read in the scheduler thread
+    // the first time the texture is traversed.
+    SbBool oldnotify = this->image.enableNotify(FALSE);
+    this->image.setValue(SbVec2s(0,0), 0, NULL);
+    this->image.enableNotify(oldnotify);
+    PRIVATE(this)->glimagevalid = FALSE;
+    const SbStringList & sl = SoInput::getDirectories();
+    retval = PRIVATE(this)->loadimage.scheduleReadFile(SoTexture2P::readImageCB, PRIVATE(this),
+                                                       this->filename.getValue(),
+                                                       sl.getArrayPtr(), sl.getLength());
+  }
+  else if (this->filename.getValue().getLength()) {
     SbImage tmpimage;
     const SbStringList & sl = SoInput::getDirectories();
     if (tmpimage.readFile(this->filename.getValue(),
@@ -774,6 +960,486 @@ SoTexture2::filenameSensorCB(void * data, SoSensor *)
   }
 }
 
+/*!
+  Sets whether texture image files should be read asynchronously.
+
+  When enabled, the image file is read in a separate thread the first
+  time the texture is rendered or traversed by SoCallbackAction,
+  so that large images don't stall the
+  application. The texture is disabled until the file has been read,
+  and SoTexture2::image is empty until then. Files which are not found
+  are still reported when the scene is read, but other read errors are
+  only reported as warnings when the read has finished.
+
+  After an image has been read, a low resolution version of it is
+  used until it's within the per-frame budget for sending texture
+  data to OpenGL. This avoids long frames when many large textures
+  finish loading at the same time.
+
+  The setting is used for files which are loaded after this call. The
+  default is \c FALSE, unless the environment variable
+  COIN_TEXTURE2_ASYNC_LOADING is set to 1. Coin must be built with
+  thread support for this to have any effect.
+
+  \since Coin 4.1
+*/
+void
+SoTexture2::setAsyncLoading(const SbBool onoff)
+{
+  SoTexture2P::asyncloading = onoff ? 1 : 0;
+}
+
+SbBool
+SoTexture2P::useAsyncLoading(void)
+{
+  if (SoTexture2P::asyncloading < 0) {
+    const char * env = coin_getenv("COIN_TEXTURE2_ASYNC_LOADING");
+    SoTexture2P::asyncloading = (env && atoi(env) > 0) ? 1 : 0;
+  }
+  // the scheduler is only used if COIN_THREADSAFE is defined, since
+  // we need the mutex to use it safely
+#ifdef COIN_THREADSAFE
+  if (SoTexture2P::asyncloading && cc_thread_implementation() != CC_NO_THREADS) {
+    SoTexture2P::lock();
+    if (SoTexture2P::scheduler == NULL) {
+      SoTexture2P::scheduler = cc_sched_construct(1);
+    }
+    SoTexture2P::unlock();
+    return TRUE;
+  }
+#endif // COIN_THREADSAFE
+  return FALSE;
+}
+
+// Reserves numbytes of the budget for texture data sent to OpenGL
+// this frame. Returns FALSE if the budget has been used up. Must be
+// called with the mutex locked.
+SbBool
+SoTexture2P::reserveUpload(const size_t numbytes)
+{
+  if (SoTexture2P::uploadbudget == 0) {
+    const char * env = coin_getenv("COIN_TEXTURE2_UPLOAD_BUDGET");
+    const int mb = env ? SbMax(atoi(env), 1) : 16;
+    SoTexture2P::uploadbudget = size_t(mb) * 1024 * 1024;
+  }
+  if (SoTexture2P::uploaded > 0 &&
+      SoTexture2P::uploaded + numbytes > SoTexture2P::uploadbudget) {
+    return FALSE;
+  }
+  if (SoTexture2P::uploaded == 0) {
+    // reset the budget before the next frame is rendered
+    if (SoTexture2P::uploadsensor == NULL) {
+      SoTexture2P::uploadsensor = new SoOneShotSensor(SoTexture2P::uploadSensorCB, NULL);
+    }
+    SoTexture2P::uploadsensor->schedule();
+  }
+  SoTexture2P::uploaded += numbytes;
+  return TRUE;
+}
+
+void
+SoTexture2P::uploadSensorCB(void * COIN_UNUSED_ARG(closure), SoSensor * COIN_UNUSED_ARG(sensor))
+{
+  SoTexture2P::lock();
+  SoTexture2P::uploaded = 0;
+  SoTexture2P::unlock();
+}
+
+// triggers a redraw when the full image is waiting for the upload
+// budget
+void
+SoTexture2P::touchSensorCB(void * closure, SoSensor * COIN_UNUSED_ARG(sensor))
+{
+  SoTexture2P * thisp = (SoTexture2P *) closure;
+  thisp->master->touch();
+}
+
+//
+// called (from SbImage) when image data is needed.
+//
+SbBool
+SoTexture2P::readImageCB(const SbString & filename, SbImage * COIN_UNUSED_ARG(image),
+                         void * closure)
+{
+  SoTexture2P * thisp = (SoTexture2P *) closure;
+
+  SoTexture2LoadData * data = new SoTexture2LoadData;
+  data->pimpl = thisp;
+  data->filename = filename;
+  data->size.setValue(0, 0);
+  data->nc = 0;
+  data->bytes = NULL;
+
+  // start a timer sensor which polls for the result
+  thisp->loadsensor->schedule();
+
+  SoTexture2P::lock();
+  data->generation = thisp->loadgeneration;
+  thisp->pending.append(data);
+  data->schedid = cc_sched_schedule(SoTexture2P::scheduler, SoTexture2P::loadJob, data, 0);
+  SoTexture2P::unlock();
+  return TRUE;
+}
+
+// reads an image file, and creates the low resolution proxy, in the
+// scheduler thread
+void
+SoTexture2P::loadJob(void * closure)
+{
+  SoTexture2LoadData * data = (SoTexture2LoadData *) closure;
+  SoTexture2P * thisp = data->pimpl;
+
+  SoTexture2P::lock();
+  const SbBool isdestructing = thisp->isdestructing;
+  SoTexture2P::unlock();
+
+  SbImage tmpimage;
+  if (!isdestructing && tmpimage.readFile(data->filename)) {
+    int nc;
+    SbVec2s size;
+    const unsigned char * bytes = tmpimage.getValue(size, nc);
+    const size_t numbytes = size_t(size[0]) * size_t(size[1]) * size_t(nc);
+    if (bytes && numbytes) {
+      // copy the image here, so that the image field can just take
+      // over the buffer
+      data->bytes = new unsigned char[numbytes];
+      (void)memcpy(data->bytes, bytes, numbytes);
+      data->size = size;
+      data->nc = nc;
+
+      const int maxsize = SbMax(size[0], size[1]);
+      if (maxsize > 2 * PROXY_SIZE) {
+        const int w = SbMax(1, size[0] * PROXY_SIZE / maxsize);
+        const int h = SbMax(1, size[1] * PROXY_SIZE / maxsize);
+        data->proxy.setValue(SbVec2s((short) w, (short) h), nc, NULL);
+        SbVec2s proxysize;
+        int proxync;
+        unsigned char * proxybytes = data->proxy.getValue(proxysize, proxync);
+        cc_image_resize(data->bytes, size[0], size[1], nc,
+                        proxybytes, w, h, CC_IMAGE_RESIZE_BOX);
+      }
+    }
+  }
+
+  SoTexture2P::lock();
+  thisp->pending.removeItem(data);
+  if (thisp->loaded) thisp->clearLoaded(); // an older result not picked up yet
+  thisp->loaded = data;
+  // the destructor might be waiting for this read
+  SoTexture2P::loadcond->wakeAll();
+  SoTexture2P::unlock();
+}
+
+// polls for images read in the scheduler thread, and sets the image
+// data in the main thread
+void
+SoTexture2P::loadSensorCB(void * closure, SoSensor * COIN_UNUSED_ARG(sensor))
+{
+  SoTexture2P * thisp = (SoTexture2P *) closure;
+  SoTexture2 * master = thisp->master;
+
+  SoTexture2P::lock();
+  SoTexture2LoadData * data = thisp->loaded;
+  thisp->loaded = NULL;
+  if (thisp->pending.getLength() == 0) thisp->loadsensor->unschedule();
+  SbBool current = data && data->generation == thisp->loadgeneration;
+  SoTexture2P::unlock();
+
+  if (data == NULL) return;
+
+  // ignore the result if the filename or image has been changed
+  if (current && data->bytes) {
+    // disable notification on image while setting data from filename
+    // as a notify will cause a filename.setDefault(TRUE).
+    SbBool oldnotify = master->image.enableNotify(FALSE);
+    master->image.setValue(data->size, data->nc, data->bytes,
+                           SoSFImage::NO_COPY_AND_DELETE);
+    master->image.enableNotify(oldnotify);
+    master->image.setDefault(TRUE); // write filename, not image
+    data->bytes = NULL;
+
+    SoTexture2P::lock();
+    thisp->proxyimage = data->proxy;
+    thisp->glimagevalid = FALSE; // recreate GL image in next GLRender()
+    SoTexture2P::unlock();
+    master->touch(); // trigger redraw
+  }
+  else if (current) {
+    SoDebugError::postWarning("SoTexture2::GLRender",
+                              "Image file '%s' could not be read",
+                              data->filename.getString());
+    thisp->readstatus = 0;
+  }
+  delete[] data->bytes;
+  delete data;
+}
+
+void
+SoTexture2P::clearLoaded(void)
+{
+  if (this->loaded) {
+    delete[] this->loaded->bytes;
+    delete this->loaded;
+    this->loaded = NULL;
+  }
+}
+
+// makes sure that an image which is being read asynchronously isn't
+// used
+void
+SoTexture2P::cancelLoading(void)
+{
+  SoTexture2P::lock();
+  this->loadgeneration++;
+  this->proxyimage.setValue(SbVec2s(0,0), 0, NULL);
+  this->glimageproxy = FALSE;
+  SoTexture2P::unlock();
+  // clears the scheduled read, if any
+  this->loadimage.setValue(SbVec2s(0,0), 0, NULL);
+}
+
+#undef PROXY_SIZE
 #undef LOCK_GLIMAGE
 #undef UNLOCK_GLIMAGE
 #undef PRIVATE
+
+// *************************************************************************
+
+#ifdef COIN_TEST_SUITE
+
+#include "setup.h" // COIN_THREADSAFE
+
+#ifdef COIN_THREADSAFE
+
+#include <cstdio>
+#include <Inventor/SbImage.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/SoDB.h>
+#include <Inventor/actions/SoCallbackAction.h>
+#include <Inventor/sensors/SoSensorManager.h>
+#include <Inventor/threads/SbCondVar.h>
+#include <Inventor/threads/SbMutex.h>
+
+static const char sotexture2_test_filename[] = "SoTexture2AsyncTest.img";
+
+// An image reader which blocks until it is released (or half a
+// second has passed), to check what happens while the scheduler
+// thread is reading.
+class SoTexture2TestReader {
+public:
+  SoTexture2TestReader(const SbBool released)
+    : started(0), finished(0), released(released) {
+    FILE * fp = fopen(sotexture2_test_filename, "wb");
+    if (fp) fclose(fp);
+    SbImage::addReadImageCB(SoTexture2TestReader::readCB, this);
+    SoTexture2::setAsyncLoading(TRUE);
+  }
+  ~SoTexture2TestReader() {
+    SoTexture2::setAsyncLoading(FALSE);
+    SbImage::removeReadImageCB(SoTexture2TestReader::readCB, this);
+    (void) remove(sotexture2_test_filename);
+  }
+
+  int getStarted(void) {
+    this->mutex.lock();
+    const int num = this->started;
+    this->mutex.unlock();
+    return num;
+  }
+  int getFinished(void) {
+    this->mutex.lock();
+    const int num = this->finished;
+    this->mutex.unlock();
+    return num;
+  }
+  void release(void) {
+    this->mutex.lock();
+    this->released = TRUE;
+    this->condvar.wakeAll();
+    this->mutex.unlock();
+  }
+  // waits for the reader, or the given time, whichever comes first
+  void wait(const SbTime & period) {
+    this->mutex.lock();
+    (void) this->condvar.timedWait(this->mutex, period);
+    this->mutex.unlock();
+  }
+
+  static SbBool readCB(const SbString & filename, SbImage * image, void * closure) {
+    if (filename.find(sotexture2_test_filename) < 0) return FALSE;
+    SoTexture2TestReader * thisp = static_cast<SoTexture2TestReader *>(closure);
+    thisp->mutex.lock();
+    thisp->started++;
+    thisp->condvar.wakeAll();
+    const SbTime end = SbTime::getTimeOfDay() + SbTime(0.5);
+    while (!thisp->released && SbTime::getTimeOfDay() < end) {
+      (void) thisp->condvar.timedWait(thisp->mutex, SbTime(0.01));
+    }
+    thisp->mutex.unlock();
+
+    const unsigned char bytes[16] = {
+      1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16
+    };
+    image->setValue(SbVec2s(4, 4), 1, bytes);
+
+    thisp->mutex.lock();
+    thisp->finished++;
+    thisp->condvar.wakeAll();
+    thisp->mutex.unlock();
+    return TRUE;
+  }
+
+private:
+  SbMutex mutex;
+  SbCondVar condvar;
+  int started, finished;
+  SbBool released;
+};
+
+// processes the timer queue, which picks up the loaded images, until
+// done() returns TRUE, or for the given time if done is NULL
+static void
+sotexture2_test_process(SoTexture2TestReader & reader,
+                        SbBool (*done)(void * closure), void * closure,
+                        const double seconds)
+{
+  const SbTime end = SbTime::getTimeOfDay() + SbTime(seconds);
+  while (SbTime::getTimeOfDay() < end) {
+    SoDB::getSensorManager()->processTimerQueue();
+    if (done && done(closure)) return;
+    reader.wait(SbTime(0.01));
+  }
+}
+
+static SbBool
+sotexture2_test_has_image(void * closure)
+{
+  SbVec2s size;
+  int nc;
+  (void) static_cast<SoTexture2 *>(closure)->image.getValue(size, nc);
+  return size != SbVec2s(0, 0);
+}
+
+static SbBool
+sotexture2_test_started(void * closure)
+{
+  return static_cast<SoTexture2TestReader *>(closure)->getStarted() > 0;
+}
+
+static SbBool
+sotexture2_test_finished(void * closure)
+{
+  return static_cast<SoTexture2TestReader *>(closure)->getFinished() > 0;
+}
+
+BOOST_AUTO_TEST_CASE(asyncLoad)
+{
+  SoTexture2TestReader reader(TRUE);
+  SoTexture2 * tex = new SoTexture2;
+  tex->ref();
+  tex->filename = sotexture2_test_filename;
+
+  SbVec2s size;
+  int nc;
+  (void) tex->image.getValue(size, nc);
+  BOOST_CHECK_MESSAGE(size == SbVec2s(0, 0) && reader.getStarted() == 0,
+                      "the image must not be read before the texture is used");
+
+  SoCallbackAction cba;
+  cba.apply(tex);
+  sotexture2_test_process(reader, sotexture2_test_has_image, tex, 5.0);
+
+  const unsigned char * bytes = tex->image.getValue(size, nc);
+  BOOST_CHECK_MESSAGE(size == SbVec2s(4, 4) && nc == 1 && bytes && bytes[15] == 16,
+                      "the image must be set when it has been read");
+  BOOST_CHECK_MESSAGE(tex->image.isDefault() && !tex->filename.isDefault(),
+                      "the filename must still be written, not the image");
+  BOOST_CHECK_EQUAL(reader.getStarted(), 1);
+  tex->unref();
+}
+
+BOOST_AUTO_TEST_CASE(asyncLoadStale)
+{
+  SoTexture2TestReader reader(FALSE);
+  SoTexture2 * tex = new SoTexture2;
+  tex->ref();
+  tex->filename = sotexture2_test_filename;
+
+  SoCallbackAction cba;
+  cba.apply(tex);
+  sotexture2_test_process(reader, sotexture2_test_started, &reader, 5.0);
+  BOOST_REQUIRE_MESSAGE(reader.getStarted() == 1, "the image should be read");
+
+  // replace the image while the file is being read
+  const unsigned char bytes[4] = { 42, 42, 42, 42 };
+  tex->image.setValue(SbVec2s(2, 2), 1, bytes);
+  reader.release();
+
+  sotexture2_test_process(reader, sotexture2_test_finished, &reader, 5.0);
+  BOOST_REQUIRE_MESSAGE(reader.getFinished() == 1, "the read should finish");
+  // give the timer sensor time to pick up the result
+  sotexture2_test_process(reader, NULL, NULL, 0.3);
+
+  SbVec2s size;
+  int nc;
+  const unsigned char * result = tex->image.getValue(size, nc);
+  BOOST_CHECK_MESSAGE(size == SbVec2s(2, 2) && nc == 1 && result && result[0] == 42,
+                      "the result of an outdated read must be discarded");
+  tex->unref();
+}
+
+BOOST_AUTO_TEST_CASE(asyncLoadDelete)
+{
+  SoTexture2TestReader reader(FALSE);
+  SoTexture2 * tex = new SoTexture2;
+  tex->ref();
+  tex->filename = sotexture2_test_filename;
+
+  SoCallbackAction cba;
+  cba.apply(tex);
+  sotexture2_test_process(reader, sotexture2_test_started, &reader, 5.0);
+  BOOST_REQUIRE_MESSAGE(reader.getStarted() == 1, "the image should be read");
+
+  // the reader is still blocked, so the destructor must wait for it
+  tex->unref();
+  BOOST_CHECK_MESSAGE(reader.getFinished() == 1,
+                      "deleting the node must wait for the read to finish");
+
+  // and no sensors may be left behind for the deleted node
+  sotexture2_test_process(reader, NULL, NULL, 0.3);
+}
+
+BOOST_AUTO_TEST_CASE(asyncLoadDeleteQueued)
+{
+  SoTexture2TestReader reader(FALSE);
+  SoTexture2 * tex = new SoTexture2;
+  tex->ref();
+  tex->filename = sotexture2_test_filename;
+  SoTexture2 * queued = new SoTexture2;
+  queued->ref();
+  queued->filename = sotexture2_test_filename;
+
+  SoCallbackAction cba;
+  cba.apply(tex);
+  sotexture2_test_process(reader, sotexture2_test_started, &reader, 5.0);
+  BOOST_REQUIRE_MESSAGE(reader.getStarted() == 1, "the image should be read");
+
+  // the second read waits behind the blocked one, so deleting its
+  // node must cancel it rather than wait for the other node's read
+  cba.apply(queued);
+  queued->unref();
+  BOOST_CHECK_MESSAGE(reader.getFinished() == 0,
+                      "deleting a node must not wait for other nodes' reads");
+
+  reader.release();
+  sotexture2_test_process(reader, sotexture2_test_has_image, tex, 5.0);
+  BOOST_CHECK_MESSAGE(sotexture2_test_has_image(tex),
+                      "the image of the remaining node must be set");
+  BOOST_CHECK_MESSAGE(reader.getStarted() == 1,
+                      "the cancelled read must not be started");
+  tex->unref();
+}
+
+#endif // COIN_THREADSAFE
+
+#endif // COIN_TEST_SUITE
@@ -56,6 +56,12 @@
   is doubled, and creating the texture object is much slower, so we
   avoid this for SoGLBigImage.
 
+  To avoid stalling the rendering when a large image is shown for the
+  first time, only a few subtextures are created or changed each
+  frame (see setChangeLimit()). Subtextures beyond that limit are
+  created from a very low resolution version of the image, and are
+  replaced with the wanted resolution in the following frames.
+
   \COIN_CLASS_EXTENSION
 
   \since Coin 2.0
@@ -87,7 +93,9 @@
 #endif // COIN_THREADSAFE
 
 #include "tidbitsp.h"
+#include "base/imageresize.h"
 #include "rendering/SoGL.h"
+#include "rendering/SoGLTextureMemory.h"
 
 // *************************************************************************
 
@@ -96,6 +104,10 @@
 // on an image, as only few textures are changed each frame.
 static int CHANGELIMIT = 4;
 
+// the minimum size of the low resolution subtextures used for new
+// subtextures when the change limit has been reached
+#define PROXY_SIZE 16
+
 // the texturequality limit when linear filtering will be used
 #define LINEAR_LIMIT 0.1f
 
@@ -448,18 +460,31 @@ SoGLBigImage::applySubImage(SoState * state, const int idx,
   }
   div >>= 1;
 
+  // new subtextures must be created right away, but when the change
+  // limit has been reached, use a low resolution proxy from the
+  // cache. It is replaced in a later frame, just like subtextures
+  // which have the wrong resolution.
+  if (tls->glimagearray[idx] == NULL && tls->changecnt >= CHANGELIMIT) {
+    while (level + 1 < PRIVATE(this)->numcachelevels &&
+           (tls->imagesize[0] >> (level + 1)) >= PROXY_SIZE &&
+           (tls->imagesize[1] >> (level + 1)) >= PROXY_SIZE) {
+      div <<= 1;
+      level++;
+    }
+  }
+
   if (tls->glimagearray[idx] == NULL ||
       (tls->glimagediv[idx] != div && tls->changecnt < CHANGELIMIT)) {
 
     if (tls->glimagearray[idx] == NULL) {
       tls->glimagearray[idx] = new SoGLImage();
+      // count the tile's texture memory as used by this image
+      SoGLTextureMemory::setParent(tls->glimagearray[idx], this);
       if (tls->imagearray[idx] == NULL) {
         tls->imagearray[idx] = new SbImage;
       }
     }
-    else {
-      tls->changecnt++;
-    }
+    tls->changecnt++;
     tls->glimagediv[idx] = div;
 
     uint32_t flags = this->getFlags();
@@ -523,8 +548,9 @@ SoGLBigImage::applySubImage(SoState * state, const int idx,
 
 /*!
   To avoid doing too much work in one frame, there is a limit on the
-  number of subtextures that can be changed each frame. If this limit
-  is exceeded, this function will return TRUE, otherwise FALSE.
+  number of subtextures that can be created or changed each frame. If
+  this limit is exceeded, this function will return TRUE, otherwise
+  FALSE.
 
   \sa setChangeLimit()
 */
@@ -535,7 +561,12 @@ SoGLBigImage::exceededChangeLimit(void)
 }
 
 /*!
-  Sets the change limit. Returns the old limit.
+  Sets the change limit. Returns the old limit. The default limit is
+  4 subtextures per frame.
+
+  New subtextures are always created, but when the limit has been
+  reached, they are created in a very low resolution, and replaced in
+  a later frame.
   
   \sa exceededChangeLimit()
   \since Coin 2.3
@@ -827,48 +858,6 @@ image_downsample(const unsigned char * bytes, const SbVec2s fullsize,
 }
 #endif
 
-// create a lower resolution image by averaging four and four pixels
-// into a new pixel. This is the same technique as the one usually
-// used when creating OpenGL mipmaps. Each level is calculated based
-// on the previous level, not on the full-resolution image.
-static void
-image_downsample_fast(const int width, const int height, const int nc,
-                      const unsigned char * datain, unsigned char * dataout)
-{
-  assert(width > 1 || height > 1);
-
-  int nextrow = width * nc;
-  if (width & 1) nextrow += nc; // in case original image has odd size
-  int newwidth = width >> 1;
-  int newheight = height >> 1;
-  unsigned char * dst = dataout;
-  const unsigned char * src = datain;
-
-  // check for 1D images
-  if (width == 1 || height == 1) {
-    int n = SbMax(newwidth, newheight);
-    for (int i = 0; i < n; i++) {
-      for (int j = 0; j < nc; j++) {
-        *dst = (src[0] + src[nc]) >> 1;
-        dst++; src++;
-      }
-      src += nc; // skip to next pixel
-    }
-  }
-  else {
-    for (int i = 0; i < newheight; i++) {
-      for (int j = 0; j < newwidth; j++) {
-        for (int c = 0; c < nc; c++) {
-          *dst = (src[0] + src[nc] + src[nextrow] + src[nextrow+nc] + 2) >> 2;
-          dst++; src++;
-        }
-        src += nc; // skip to next pixel
-      }
-      src += nextrow;
-    }
-  }
-}
-
 void
 SoGLBigImageP::createCache(const unsigned char * bytes, const SbVec2s size, const int nc)
 {
@@ -902,8 +891,10 @@ SoGLBigImageP::createCache(const unsigned char * bytes, const SbVec2s size, cons
     if (h == 0) h = 1;
     this->cachesize[l] = SbVec2s(w, h);
     this->cache[l] = new unsigned char[w*h*nc];
-    image_downsample_fast(this->cachesize[l-1][0], this->cachesize[l-1][1], nc,
-                          this->cache[l-1], this->cache[l]);
+    // each level is the average of four and four pixels in the
+    // previous level, like when OpenGL mipmaps are created
+    cc_image_halve(this->cache[l-1], this->cachesize[l-1][0], this->cachesize[l-1][1],
+                   nc, this->cache[l]);
 #endif // end of low quality downsample
   }
   this->cache[0] = NULL;
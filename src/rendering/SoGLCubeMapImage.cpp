@@ -69,6 +69,7 @@
 #include "tidbitsp.h"
 #include "glue/glp.h"
 #include "rendering/SoGL.h"
+#include "rendering/SoGLTextureMemory.h"
 
 // *************************************************************************
 
@@ -108,15 +109,18 @@ public:
   class dldata {
   public:
     dldata(void)
-      : dlist(NULL), age(0) { }
-    dldata(SoGLDisplayList *dl)
+      : dlist(NULL), age(0), record(NULL) { }
+    dldata(SoGLDisplayList *dl, SoGLTextureMemory::Record * rec = NULL)
       : dlist(dl),
-        age(0) { }
+        age(0),
+        record(rec) { }
     dldata(const dldata & org)
       : dlist(org.dlist),
-        age(org.age) { }
+        age(org.age),
+        record(org.record) { }
     SoGLDisplayList * dlist;
     uint32_t age;
+    SoGLTextureMemory::Record * record;
   };
 
   SoGLDisplayList * findDL(SoState *state) {
@@ -130,6 +134,28 @@ public:
     return NULL;
   }
 
+  // estimated texture memory for the six faces
+  size_t textureMemory(void) const {
+    size_t numbytes = 0;
+    for (int i = 0; i < 6; i++) {
+      SbVec2s size;
+      int nc;
+      if (this->image[i].getValue(size, nc)) {
+        // RGB textures are normally stored as RGBA
+        numbytes += size_t(size[0]) * size_t(size[1]) * ((nc == 3) ? 4 : nc);
+      }
+    }
+    return numbytes;
+  }
+
+  void unrefDLists(SoState * state) {
+    for (int i = 0; i < this->dlists.getLength(); i++) {
+      SoGLTextureMemory::remove(this->dlists[i].record);
+      this->dlists[i].dlist->unref(state);
+    }
+    this->dlists.truncate(0);
+  }
+
   SbList <dldata> dlists;
   SbImage fakeimage;
 
@@ -160,6 +186,7 @@ public:
 
     while (i < n) {
       if (thisp->dlists[i].dlist->getContext() == (int) context) {
+        SoGLTextureMemory::remove(thisp->dlists[i].record);
         thisp->dlists[i].dlist->unref(NULL);
         thisp->dlists.remove(i);
         n--;
@@ -168,6 +195,9 @@ public:
     }
     thisp->unlock();
   }
+
+  // callback from SoGLTextureMemory when a texture should be evicted
+  static void evictCB(SoGLTextureMemory::Record * record, SoState * state);
 };
 
 SoType SoGLCubeMapImageP::classTypeId STATIC_SOTYPE_INIT;
@@ -177,6 +207,30 @@ SbMutex * SoGLCubeMapImageP::mutex = NULL;
 
 #define PRIVATE(obj) (obj->pimpl)
 
+void
+SoGLCubeMapImageP::evictCB(SoGLTextureMemory::Record * record, SoState * state)
+{
+#ifdef COIN_THREADSAFE
+  SoGLCubeMapImageP::mutex->lock();
+#endif // COIN_THREADSAFE
+  SoGLImage * owner = (SoGLImage *) SoGLTextureMemory::getOwner(record);
+  if (owner) {
+    SoGLCubeMapImageP * thisp = PRIVATE(static_cast<SoGLCubeMapImage *>(owner));
+    for (int i = 0; i < thisp->dlists.getLength(); i++) {
+      if (thisp->dlists[i].record == record) {
+        SoGLDisplayList * dl = thisp->dlists[i].dlist;
+        thisp->dlists.removeFast(i);
+        SoGLTextureMemory::remove(record);
+        dl->unref(state);
+        break;
+      }
+    }
+  }
+#ifdef COIN_THREADSAFE
+  SoGLCubeMapImageP::mutex->unlock();
+#endif // COIN_THREADSAFE
+}
+
 // *************************************************************************
 
 /*!
@@ -194,6 +248,9 @@ SoGLCubeMapImage::SoGLCubeMapImage(void)
 SoGLCubeMapImage::~SoGLCubeMapImage()
 {
   SoContextHandler::removeContextDestructionCallback(SoGLCubeMapImageP::contextCleanup, PRIVATE(this));
+  for (int i = 0; i < PRIVATE(this)->dlists.getLength(); i++) {
+    SoGLTextureMemory::remove(PRIVATE(this)->dlists[i].record);
+  }
   delete PRIVATE(this);
 }
 
@@ -201,11 +258,9 @@ SoGLCubeMapImage::~SoGLCubeMapImage()
 void
 SoGLCubeMapImage::unref(SoState * state)
 {
-  int n = PRIVATE(this)->dlists.getLength();
-  for (int i = 0; i < n; i++) {
-    PRIVATE(this)->dlists[i].dlist->unref(state);
-  }
-  PRIVATE(this)->dlists.truncate(0);
+  PRIVATE(this)->lock();
+  PRIVATE(this)->unrefDLists(state);
+  PRIVATE(this)->unlock();
   inherited::unref(state);
 }
 
@@ -266,10 +321,7 @@ SoGLCubeMapImage::setCubeMapImage(const Target target,
   PRIVATE(this)->image[idx].setValuePtr(size, numcomponents, bytes);
 
   PRIVATE(this)->lock();
-  for (int i = 0; i < PRIVATE(this)->dlists.getLength(); i++) {
-    PRIVATE(this)->dlists[i].dlist->unref(NULL);
-  }
-  PRIVATE(this)->dlists.truncate(0);
+  PRIVATE(this)->unrefDLists(NULL);
   PRIVATE(this)->unlock();
 
   // FIXME: this is a hack. Just set one of the images in
@@ -309,9 +361,18 @@ SoGLCubeMapImage::setData(const SbImage * image,
 SoGLDisplayList *
 SoGLCubeMapImage::getGLDisplayList(SoState * state)
 {
+  SbBool created = FALSE;
   PRIVATE(this)->lock();
   SoGLDisplayList * dl = PRIVATE(this)->findDL(state);
-  if (!dl) {
+  if (dl) {
+    for (int i = 0; i < PRIVATE(this)->dlists.getLength(); i++) {
+      if (PRIVATE(this)->dlists[i].dlist == dl) {
+        SoGLTextureMemory::touch(PRIVATE(this)->dlists[i].record);
+        break;
+      }
+    }
+  }
+  else {
     dl = new SoGLDisplayList(state,
                              SoGLDisplayList::TEXTURE_OBJECT);
     if (dl) {
@@ -351,10 +412,16 @@ SoGLCubeMapImage::getGLDisplayList(SoState * state)
       glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
       glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
       dl->close(state);
-      PRIVATE(this)->dlists.append(SoGLCubeMapImageP::dldata(dl));
+      SoGLTextureMemory::Record * record =
+        SoGLTextureMemory::add(dl, PRIVATE(this)->textureMemory(),
+                               static_cast<SoGLImage *>(this),
+                               SoGLCubeMapImageP::evictCB);
+      PRIVATE(this)->dlists.append(SoGLCubeMapImageP::dldata(dl, record));
+      created = TRUE;
     }
   }
   PRIVATE(this)->unlock();
+  if (created) SoGLTextureMemory::evict(state);
   return dl;
 }
 
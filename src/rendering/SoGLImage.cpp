@@ -113,6 +113,15 @@
   for textures when the texture quality is higher than this value.
   Default value is 0.85
 
+  \li COIN_TEX2_RESIZE_FILTER: The filter used when 2D textures are
+  resized to a power of two size, "box", "bilinear" or "lanczos". By
+  default, a box filter is used if the texture scale quality is below
+  0.5, and a Lanczos filter otherwise.
+
+  \li COIN_TEXTURE_MEMORY_BUDGET: The initial texture memory budget,
+  in megabytes. See setTextureMemoryBudget(). Default value is 0, no
+  limit.
+
   \COIN_CLASS_EXTENSION
 
   \since Coin 2.0
@@ -178,7 +187,10 @@
   \e image is the original image.
 
   Return value: TRUE if the resize has been resized, FALSE if not.
-  If FALSE is returned, Coin will resize the image instead.
+  If FALSE is returned, Coin will resize the image instead. 2D images
+  are then resized with an internal resampler, which uses all
+  available CPUs (see COIN_TEX2_RESIZE_FILTER in the SoGLImage
+  documentation).
 */
 
 // *************************************************************************
@@ -219,9 +231,10 @@
 #endif // COIN_THREADSAFE
 
 #include "tidbitsp.h"
+#include "base/imageresize.h"
 #include "rendering/SoGL.h"
+#include "rendering/SoGLTextureMemory.h"
 #include "elements/SoTextureScaleQualityElement.h"
-#include "glue/GLUWrapper.h"
 #include "glue/glp.h"
 #include "glue/simage_wrapper.h"
 #include "threads/threadsutilp.h"
@@ -248,6 +261,7 @@ static float COIN_TEX2_ANISOTROPIC_LIMIT = -1.0f;
 static int COIN_TEX2_USE_GLTEXSUBIMAGE = -1;
 static int COIN_TEX2_USE_SGIS_GENERATE_MIPMAP = -1;
 static int COIN_ENABLE_CONFORMANT_GL_CLAMP = -1;
+static int COIN_TEX2_RESIZE_FILTER = -2;
 
 // *************************************************************************
 
@@ -335,44 +349,6 @@ compute_log(int value)
   return i;
 }
 
-//FIXME: Use as a special case of 3D image to reduce codelines ? (kintel 20011115)
-static void
-halve_image(const int width, const int height, const int nc,
-            const unsigned char *datain, unsigned char *dataout)
-{
-  assert(width > 1 || height > 1);
-
-  int nextrow = width *nc;
-  int newwidth = width >> 1;
-  int newheight = height >> 1;
-  unsigned char *dst = dataout;
-  const unsigned char *src = datain;
-
-  // check for 1D images
-  if (width == 1 || height == 1) {
-    int n = SbMax(newwidth, newheight);
-    for (int i = 0; i < n; i++) {
-      for (int j = 0; j < nc; j++) {
-        *dst = (src[0] + src[nc]) >> 1;
-        dst++; src++;
-      }
-      src += nc; // skip to next pixel
-    }
-  }
-  else {
-    for (int i = 0; i < newheight; i++) {
-      for (int j = 0; j < newwidth; j++) {
-        for (int c = 0; c < nc; c++) {
-          *dst = (src[0] + src[nc] + src[nextrow] + src[nextrow+nc] + 2) >> 2;
-          dst++; src++;
-        }
-        src += nc; // skip to next pixel
-      }
-      src += nextrow;
-    }
-  }
-}
-
 static void
 halve_image(const int width, const int height, const int depth, const int nc,
             const unsigned char *datain, unsigned char *dataout)
@@ -457,8 +433,12 @@ fast_mipmap(SoState * state, int width, int height, int nc,
   int level = compute_log(height);
   if (level > levels) levels = level;
 
+  // levels are halved back and forth between two parts of the
+  // buffer, as cc_image_halve() may split the work over several
+  // threads, and then needs separate source and destination buffers
   int memreq = (SbMax(width>>1,1))*(SbMax(height>>1,1))*nc;
-  unsigned char * mipmap_buffer = glimage_get_buffer(memreq, TRUE);
+  int memreq2 = (SbMax(width>>2,1))*(SbMax(height>>2,1))*nc;
+  unsigned char * mipmap_buffer = glimage_get_buffer(memreq + memreq2, TRUE);
 
   if (useglsubimage) {
     if (SoGLDriverDatabase::isSupported(glw, SO_GL_TEXSUBIMAGE)) {
@@ -473,10 +453,11 @@ fast_mipmap(SoState * state, int width, int height, int nc,
   }
   unsigned char *src = (unsigned char *) data;
   for (level = 1; level <= levels; level++) {
-    halve_image(width, height, nc, src, mipmap_buffer);
+    unsigned char * dst = mipmap_buffer + ((level & 1) ? 0 : memreq);
+    cc_image_halve(src, width, height, nc, dst);
     if (width > 1) width >>= 1;
     if (height > 1) height >>= 1;
-    src = mipmap_buffer;
+    src = dst;
     if (useglsubimage) {
       if (SoGLDriverDatabase::isSupported(glw, SO_GL_TEXSUBIMAGE)) {
         cc_glglue_glTexSubImage2D(glw, GL_TEXTURE_2D, level, 0, 0,
@@ -545,37 +526,6 @@ fast_mipmap(SoState * state, int width, int height, int depth,
   }
 }
 
-// A low quality resize function. It is only used when neither simage
-// nor GLU is available.
-static void
-fast_image_resize(const unsigned char * src,
-                  unsigned char * dest,
-                  int width,
-                  int height, int num_comp,
-                  int newwidth, int newheight)
-{
-  float sx, sy, dx, dy;
-  int src_bpr, dest_bpr, xstop, ystop, x, y, offset, i;
-
-  dx = ((float)width)/((float)newwidth);
-  dy = ((float)height)/((float)newheight);
-  src_bpr = width * num_comp;
-  dest_bpr = newwidth * num_comp;
-
-  sy = 0.0f;
-  ystop = newheight * dest_bpr;
-  xstop = newwidth * num_comp;
-  for (y = 0; y < ystop; y += dest_bpr) {
-    sx = 0.0f;
-    for (x = 0; x < xstop; x += num_comp) {
-      offset = ((int)sy)*src_bpr + ((int)sx)*num_comp;
-      for (i = 0; i < num_comp; i++) dest[x+y+i] = src[offset+i];
-      sx += dx;
-    }
-    sy += dy;
-  }
-}
-
 // A low quality resize function for 3D texture image buffers. It is
 // only used when neither simage nor GLU is available.
 static void
@@ -650,6 +600,7 @@ public:
   SbImage dummyimage;
   SbVec3s glsize;
   int glcomp;
+  SbBool glcompressed;
 
   SbBool needtransparencytest;
   SbBool hastransparency;
@@ -669,18 +620,24 @@ public:
   class dldata {
   public:
     dldata(void)
-      : dlist(NULL), age(0) { }
-    dldata(SoGLDisplayList *dl)
+      : dlist(NULL), age(0), record(NULL) { }
+    dldata(SoGLDisplayList *dl, SoGLTextureMemory::Record * rec = NULL)
       : dlist(dl),
-        age(0) { }
+        age(0),
+        record(rec) { }
     dldata(const dldata & org)
       : dlist(org.dlist),
-        age(org.age) { }
+        age(org.age),
+        record(org.record) { }
     SoGLDisplayList *dlist;
     uint32_t age;
+    SoGLTextureMemory::Record * record;
   };
 
   SbList <dldata> dlists;
+  void addDL(SoGLDisplayList * dl, const SbBool evictable);
+  size_t textureMemory(const SoGLDisplayList * dl) const;
+  static void evictCB(SoGLTextureMemory::Record * record, SoState * state);
   SoGLDisplayList *findDL(SoState *state);
   void tagDL(SoState *state);
   void unrefOldDL(SoState *state, const uint32_t maxage);
@@ -800,6 +757,15 @@ SoGLImage::SoGLImage(void)
     if (env) COIN_TEX2_ANISOTROPIC_LIMIT = (float) atof(env);
     else COIN_TEX2_ANISOTROPIC_LIMIT = DEFAULT_ANISOTROPIC_LIMIT;
   }
+  if (COIN_TEX2_RESIZE_FILTER < -1) {
+    const char * env = coin_getenv("COIN_TEX2_RESIZE_FILTER");
+    COIN_TEX2_RESIZE_FILTER = -1;
+    if (env) {
+      if (strcmp(env, "box") == 0) COIN_TEX2_RESIZE_FILTER = CC_IMAGE_RESIZE_BOX;
+      else if (strcmp(env, "bilinear") == 0) COIN_TEX2_RESIZE_FILTER = CC_IMAGE_RESIZE_BILINEAR;
+      else if (strcmp(env, "lanczos") == 0) COIN_TEX2_RESIZE_FILTER = CC_IMAGE_RESIZE_LANCZOS;
+    }
+  }
 }
 
 
@@ -820,6 +786,7 @@ SoGLImage::initClass(void)
 
   coin_atexit((coin_atexit_f*)SoGLImage::cleanupClass, CC_ATEXIT_NORMAL);
 
+  SoGLTextureMemory::init();
   SoGLCubeMapImage::initClass();
 }
 
@@ -925,7 +892,8 @@ SoGLImage::setGLDisplayList(SoGLDisplayList * dl,
   PRIVATE(this)->quality = quality;
 
   // don't register this image. There's no way we can reload it if we
-  // delete it because of old age.
+  // delete it because of old age. The texture memory is not counted
+  // either, as we don't know the size of the texture.
 }
 
 /*!
@@ -1077,8 +1045,8 @@ SoGLImage::setData(const SbImage *image,
     if (copyok) {
       dl->ref();
       PRIVATE(this)->unrefDLists(createinstate);
-      PRIVATE(this)->dlists.append(SoGLImageP::dldata(dl));
       PRIVATE(this)->image = NULL; // data is temporary, and only for current context
+      PRIVATE(this)->addDL(dl, FALSE);
       dl->call(createinstate);
 
       SbBool compress =
@@ -1117,8 +1085,9 @@ SoGLImage::setData(const SbImage *image,
       PRIVATE(this)->border = border;
       PRIVATE(this)->unrefDLists(createinstate);
       if (createinstate) {
-        PRIVATE(this)->dlists.append(SoGLImageP::dldata(PRIVATE(this)->createGLDisplayList(createinstate)));
+        SoGLDisplayList * newdl = PRIVATE(this)->createGLDisplayList(createinstate);
         PRIVATE(this)->image = NULL; // data is assumed to be temporary
+        if (newdl) PRIVATE(this)->addDL(newdl, FALSE);
       }
     }
   }
@@ -1188,6 +1157,7 @@ SoGLImage::~SoGLImage()
   SoContextHandler::removeContextDestructionCallback(SoGLImageP::contextCleanup, PRIVATE(this));
   if (PRIVATE(this)->isregistered) SoGLImage::unregisterImage(this);
   PRIVATE(this)->unrefDLists(NULL);
+  SoGLTextureMemory::setParent(this, NULL);
   delete PRIVATE(this);
 }
 
@@ -1243,16 +1213,27 @@ SoGLImage::getImage(void) const
 SoGLDisplayList *
 SoGLImage::getGLDisplayList(SoState *state)
 {
+  SbBool created = FALSE;
   LOCK_GLIMAGE;
   SoGLDisplayList *dl = PRIVATE(this)->findDL(state);
+  if (dl) {
+    const int n = PRIVATE(this)->dlists.getLength();
+    for (int i = 0; i < n; i++) {
+      if (PRIVATE(this)->dlists[i].dlist == dl) {
+        SoGLTextureMemory::touch(PRIVATE(this)->dlists[i].record);
+        break;
+      }
+    }
+  }
   UNLOCK_GLIMAGE;
 
   if (dl == NULL) {
     dl = PRIVATE(this)->createGLDisplayList(state);
     if (dl) {
       LOCK_GLIMAGE;
-      PRIVATE(this)->dlists.append(SoGLImageP::dldata(dl));
+      PRIVATE(this)->addDL(dl, PRIVATE(this)->image != NULL);
       UNLOCK_GLIMAGE;
+      created = TRUE;
     }
   }
   if (dl && !dl->isMipMapTextureObject() && PRIVATE(this)->image) {
@@ -1265,9 +1246,12 @@ SoGLImage::getGLDisplayList(SoState *state)
       int n = PRIVATE(this)->dlists.getLength();
       for (int i = 0; i < n; i++) {
         if (PRIVATE(this)->dlists[i].dlist == dl) {
+          SoGLTextureMemory::remove(PRIVATE(this)->dlists[i].record);
+          PRIVATE(this)->dlists.removeFast(i);
           dl->unref(state); // unref old DL
           dl = PRIVATE(this)->createGLDisplayList(state);
-          PRIVATE(this)->dlists[i].dlist = dl;
+          if (dl) PRIVATE(this)->addDL(dl, TRUE);
+          created = TRUE;
           break;
         }
       }
@@ -1275,6 +1259,7 @@ SoGLImage::getGLDisplayList(SoState *state)
     }
     else PRIVATE(this)->quality = oldquality;
   }
+  if (created) SoGLTextureMemory::evict(state);
   return dl;
 }
 
@@ -1382,6 +1367,7 @@ SoGLImageP::init(void)
   this->pbuffer = NULL;
   this->glsize.setValue(0,0,0);
   this->glcomp = 0;
+  this->glcompressed = FALSE;
   this->wraps = SoGLImage::CLAMP;
   this->wrapt = SoGLImage::CLAMP;
   this->wrapr = SoGLImage::CLAMP;
@@ -1531,52 +1517,19 @@ SoGLImageP::resizeImage(SoState * state, unsigned char *& imageptr,
     }
 
     if (!customresizedone) {
-      // simage version 1.1.1 has a pretty high quality resize
-      // function. We prefer to use that to avoid using GLU, since
-      // there are lots of buggy GLU libraries out there.
       if (zsize == 0) { // 2D image
-        // simage_resize and gluScaleImage can be pretty slow. Use
-        // fast_image_resize() if high quality isn't needed
-        if (SoTextureScaleQualityElement::get(state) < 0.5f) {
-          fast_image_resize(bytes, glimage_tmpimagebuffer,
-                            xsize, ysize, numcomponents,
-                            newx, newy);
-        }
-        else if (simage_wrapper()->available &&
-                 simage_wrapper()->versionMatchesAtLeast(1,1,1) &&
-                 simage_wrapper()->simage_resize) {
-
-          unsigned char *result =
-            simage_wrapper()->simage_resize((unsigned char*) bytes,
-                                            xsize, ysize, numcomponents,
-                                            newx, newy);
-          (void)memcpy(glimage_tmpimagebuffer, result, numbytes);
-          simage_wrapper()->simage_free_image(result);
-        }
-        else if (GLUWrapper()->available) {
-          glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-          glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
-          glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
-          glPixelStorei(GL_PACK_ROW_LENGTH, 0);
-          glPixelStorei(GL_PACK_SKIP_PIXELS, 0);
-          glPixelStorei(GL_PACK_SKIP_ROWS, 0);
-          glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-          glPixelStorei(GL_PACK_ALIGNMENT, 1);
-
-          // FIXME: ignoring the error code. Silly. 20000929 mortene.
-          (void)GLUWrapper()->gluScaleImage(coin_glglue_get_texture_format(glw, numcomponents),
-                                            xsize, ysize,
-                                            GL_UNSIGNED_BYTE, (void*) bytes,
-                                            newx, newy, GL_UNSIGNED_BYTE,
-                                            (void*)glimage_tmpimagebuffer);
-          glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-          glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        // Use the internal resampler, which spreads the work over
+        // the available CPUs. A box filter is good enough (and fast)
+        // if high quality isn't needed.
+        enum cc_image_resize_filter filter = CC_IMAGE_RESIZE_LANCZOS;
+        if (COIN_TEX2_RESIZE_FILTER >= 0) {
+          filter = (enum cc_image_resize_filter) COIN_TEX2_RESIZE_FILTER;
         }
-        else { // fall back to the internal low-quality resize function
-          fast_image_resize(bytes, glimage_tmpimagebuffer,
-                            xsize, ysize, numcomponents,
-                            newx, newy);
+        else if (SoTextureScaleQualityElement::get(state) < 0.5f) {
+          filter = CC_IMAGE_RESIZE_BOX;
         }
+        cc_image_resize(bytes, xsize, ysize, numcomponents,
+                        glimage_tmpimagebuffer, newx, newy, filter);
       }
       else { // (zsize > 0) => 3D image
         if (simage_wrapper()->available &&
@@ -1779,6 +1732,7 @@ SoGLImageP::reallyCreateTexture(SoState *state,
   SbBool compress =
     (this->flags & SoGLImage::COMPRESSED) &&
     SoGLDriverDatabase::isSupported(glw, SO_GL_TEXTURE_COMPRESSION);
+  this->glcompressed = compress;
   GLint internalFormat =
     coin_glglue_get_internal_texture_format(glw, numComponents, compress);
   GLenum dataFormat = coin_glglue_get_texture_format(glw, numComponents);
@@ -1902,11 +1856,69 @@ SoGLImageP::unrefDLists(SoState *state)
 {
   int n = this->dlists.getLength();
   for (int i = 0; i < n; i++) {
+    SoGLTextureMemory::remove(this->dlists[i].record);
     this->dlists[i].dlist->unref(state);
   }
   this->dlists.truncate(0);
 }
 
+//
+// store a newly created dl, and account for its texture memory. Only
+// textures which can be recreated from the image can be evicted.
+//
+void
+SoGLImageP::addDL(SoGLDisplayList * dl, const SbBool evictable)
+{
+  SoGLTextureMemory::Record * record = NULL;
+  if (!this->pbuffer) {
+    record = SoGLTextureMemory::add(dl, this->textureMemory(dl), this->owner,
+                                    evictable ? SoGLImageP::evictCB : NULL);
+  }
+  this->dlists.append(dldata(dl, record));
+}
+
+//
+// estimate the texture memory used by dl, from the size of the last
+// texture sent to OpenGL
+//
+size_t
+SoGLImageP::textureMemory(const SoGLDisplayList * dl) const
+{
+  // RGB textures are normally stored as RGBA
+  const size_t bpp = (this->glcomp == 3) ? 4 : size_t(this->glcomp);
+  size_t numbytes = size_t(this->glsize[0]) * size_t(this->glsize[1]) *
+    size_t(SbMax((short) 1, this->glsize[2])) * bpp;
+  // assume a 4:1 compression ratio
+  if (this->glcompressed) numbytes /= 4;
+  // the mipmap levels add a third
+  if (dl->isMipMapTextureObject()) numbytes += numbytes / 3;
+  return numbytes;
+}
+
+//
+// Callback from SoGLTextureMemory when a texture should be evicted
+//
+void
+SoGLImageP::evictCB(SoGLTextureMemory::Record * record, SoState * state)
+{
+  LOCK_GLIMAGE;
+  SoGLImage * image = (SoGLImage *) SoGLTextureMemory::getOwner(record);
+  if (image) {
+    SoGLImageP * thisp = PRIVATE(image);
+    const int n = thisp->dlists.getLength();
+    for (int i = 0; i < n; i++) {
+      if (thisp->dlists[i].record == record) {
+        SoGLDisplayList * dl = thisp->dlists[i].dlist;
+        thisp->dlists.removeFast(i);
+        SoGLTextureMemory::remove(record);
+        dl->unref(state);
+        break;
+      }
+    }
+  }
+  UNLOCK_GLIMAGE;
+}
+
 // find dl for a context, NULL if not found
 SoGLDisplayList *
 SoGLImageP::findDL(SoState *state)
@@ -1962,6 +1974,7 @@ SoGLImageP::unrefOldDL(SoState *state, const uint32_t maxage)
                              "DL killed because of old age: %p",
                              this->owner);
 #endif // debug
+      SoGLTextureMemory::remove(data.record);
       data.dlist->unref(state);
       this->dlists.removeFast(i);
       n--; // one less in list now
@@ -2085,7 +2098,7 @@ regimage_cleanup(void)
 void
 SoGLImage::beginFrame(SoState * /* state */)
 {
-  // nothing is done for now
+  SoGLTextureMemory::beginFrame();
 }
 
 /*!
@@ -2109,7 +2122,8 @@ SoGLImage::tagImage(SoState *state, SoGLImage *image)
 
 /*!
   Should be called after your scene is rendered. Old display
-  lists will be deleted when you call this method. \a state
+  lists will be deleted when you call this method, and textures
+  will be evicted if the texture memory budget is exceeded. \a state
   should be your SoGLRenderAction state.
 
   \sa beginFrame(), tagImage(), setDisplayListMaxAge()
@@ -2136,6 +2150,7 @@ SoGLImage::endFrame(SoState *state)
            end = cb_list.end(); it != end; ++it)
       it->first(it->second);
   }
+  SoGLTextureMemory::evict(state);
 }
 
 void
@@ -2181,6 +2196,83 @@ SoGLImage::setDisplayListMaxAge(const uint32_t maxage)
   glimage_maxage = maxage;
 }
 
+/*!
+  Sets the maximum amount of texture memory, in bytes, to be used by
+  the SoGLImage, SoGLBigImage and SoGLCubeMapImage instances. When
+  the budget is exceeded, the texture objects which were used the
+  longest time ago are deleted, and will be recreated from the image
+  data if they are needed again. Texture objects used in the current
+  frame are never deleted, so the budget can be exceeded if a single
+  frame needs more texture memory. SoGLRenderAction starts a new
+  frame for every top level traversal.
+
+  The amount of memory used by each texture is estimated from its
+  size and number of components, assuming a 4:1 ratio for compressed
+  textures and an additional third for mipmapped textures.
+
+  Textures from temporary image data (see setData()) are counted, but
+  never evicted. Texture objects set up with setGLDisplayList() or
+  setPBuffer() are not counted, as their size is not known.
+
+  An evicted texture which is still used by the display list of a
+  render cache is counted until the cache is destructed, since the
+  texture object is only deleted then.
+
+  The default value is 0, which means no limit. The initial value can
+  be set with the COIN_TEXTURE_MEMORY_BUDGET environment variable, in
+  megabytes.
+
+  \sa getTextureMemoryBudget(), getResidentTextureMemory()
+  \since Coin 4.1
+*/
+void
+SoGLImage::setTextureMemoryBudget(const size_t numbytes)
+{
+  SoGLTextureMemory::setBudget(numbytes);
+}
+
+/*!
+  Returns the texture memory budget, in bytes, or 0 if there is no
+  limit.
+
+  \sa setTextureMemoryBudget()
+  \since Coin 4.1
+*/
+size_t
+SoGLImage::getTextureMemoryBudget(void)
+{
+  return SoGLTextureMemory::getBudget();
+}
+
+/*!
+  Returns the estimated amount of texture memory, in bytes, used by
+  all the SoGLImage, SoGLBigImage and SoGLCubeMapImage instances, in
+  all GL contexts. This includes textures which are no longer used
+  by an image, but which have not been deleted yet.
+
+  \sa setTextureMemoryBudget(), getResidentMemory()
+  \since Coin 4.1
+*/
+size_t
+SoGLImage::getResidentTextureMemory(void)
+{
+  return SoGLTextureMemory::getResidentBytes();
+}
+
+/*!
+  Returns the estimated amount of texture memory, in bytes, used by
+  this image, in all GL contexts. For an SoGLBigImage, the memory of
+  all the tiles is included.
+
+  \sa getResidentTextureMemory()
+  \since Coin 4.1
+*/
+size_t
+SoGLImage::getResidentMemory(void) const
+{
+  return SoGLTextureMemory::getResidentBytes(this);
+}
+
 // used internally to keep track of the SoGLImages
 void
 SoGLImage::registerImage(SoGLImage *image)
@@ -2242,6 +2334,7 @@ SoGLImageP::contextCleanup(uint32_t context, void * closure)
 
   while (i < n) {
     if (thisp->dlists[i].dlist->getContext() == (int) context) {
+      SoGLTextureMemory::remove(thisp->dlists[i].record);
       thisp->dlists[i].dlist->unref(NULL);
       thisp->dlists.remove(i);
       n--;
@@ -0,0 +1,585 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+// SoGLTextureMemory keeps a global account of the texture memory
+// used by SoGLImage, SoGLBigImage and SoGLCubeMapImage. Each texture
+// object is registered with an estimate of its size, and the records
+// are kept in a list sorted on when the texture was last used. When
+// a budget is set and the resident memory exceeds it, the least
+// recently used textures are handed back to their owners to be
+// deleted, except for the ones used in the current frame.
+//
+// Owners register their texture objects while holding their own
+// lock, and the registry lock is always taken after the owner lock.
+// Eviction therefore picks its victims under the registry lock, and
+// calls the owners after releasing it. The evict callback must take
+// the owner lock, and then use getOwner() to check that the owner
+// did not remove the record (or die) in the meantime.
+//
+// An evicted or removed texture object can still be referenced by
+// the display lists of render caches, so its memory is counted until
+// the SoGLDisplayList is actually deleted, and reports it through
+// deleted(). Records are freed when both have happened.
+
+#include "rendering/SoGLTextureMemory.h"
+
+#include <cassert>
+#include <cstdlib>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <Inventor/C/tidbits.h>
+#include <Inventor/lists/SbList.h>
+#ifdef COIN_THREADSAFE
+#include <Inventor/threads/SbMutex.h>
+#endif // COIN_THREADSAFE
+
+#include "misc/SbHash.h"
+#include "tidbitsp.h"
+
+class SoGLTextureMemory::Record {
+public:
+  SoGLDisplayList * dl;
+  size_t numbytes;
+  uint32_t frame;
+  void * owner;
+  const void * parent;
+  EvictCB * cb;
+  SbBool evicting;
+  SbBool released; // the owner has let go of the texture object
+  Record * prev;
+  Record * next;
+};
+
+// least recently used first
+static SoGLTextureMemory::Record * sogltexmem_head = NULL;
+static SoGLTextureMemory::Record * sogltexmem_tail = NULL;
+static size_t sogltexmem_resident = 0;
+static size_t sogltexmem_budget = 0;
+static uint32_t sogltexmem_frame = 0;
+static SbHash<size_t, const void *> * sogltexmem_parents = NULL;
+// the live records, looked up on their texture object
+static SbHash<size_t, SoGLTextureMemory::Record *> * sogltexmem_records = NULL;
+
+#ifdef COIN_THREADSAFE
+static SbMutex * sogltexmem_mutex = NULL;
+#define SOGLTEXMEM_LOCK sogltexmem_mutex->lock()
+#define SOGLTEXMEM_UNLOCK sogltexmem_mutex->unlock()
+#else // COIN_THREADSAFE
+#define SOGLTEXMEM_LOCK
+#define SOGLTEXMEM_UNLOCK
+#endif // !COIN_THREADSAFE
+
+static void
+sogltexmem_unlink(SoGLTextureMemory::Record * record)
+{
+  if (record->prev) record->prev->next = record->next;
+  else sogltexmem_head = record->next;
+  if (record->next) record->next->prev = record->prev;
+  else sogltexmem_tail = record->prev;
+  record->prev = record->next = NULL;
+}
+
+static void
+sogltexmem_append(SoGLTextureMemory::Record * record)
+{
+  record->prev = sogltexmem_tail;
+  record->next = NULL;
+  if (sogltexmem_tail) sogltexmem_tail->next = record;
+  else sogltexmem_head = record;
+  sogltexmem_tail = record;
+}
+
+static void
+sogltexmem_cleanup(void)
+{
+  // the texture objects should have been deleted by now, but free
+  // whatever is left
+  SbList<size_t> keys;
+  sogltexmem_records->makeKeyList(keys);
+  for (int i = 0; i < keys.getLength(); i++) {
+    SoGLTextureMemory::Record * record = NULL;
+    (void)sogltexmem_records->get(keys[i], record);
+    delete record;
+  }
+  sogltexmem_head = sogltexmem_tail = NULL;
+  sogltexmem_resident = 0;
+  sogltexmem_budget = 0;
+  sogltexmem_frame = 0;
+  delete sogltexmem_parents;
+  sogltexmem_parents = NULL;
+  delete sogltexmem_records;
+  sogltexmem_records = NULL;
+#ifdef COIN_THREADSAFE
+  delete sogltexmem_mutex;
+  sogltexmem_mutex = NULL;
+#endif // COIN_THREADSAFE
+}
+
+void
+SoGLTextureMemory::init(void)
+{
+#ifdef COIN_THREADSAFE
+  sogltexmem_mutex = new SbMutex;
+#endif // COIN_THREADSAFE
+  sogltexmem_parents = new SbHash<size_t, const void *>;
+  sogltexmem_records = new SbHash<size_t, Record *>;
+
+  // budget in megabytes, 0 means no limit
+  const char * env = coin_getenv("COIN_TEXTURE_MEMORY_BUDGET");
+  if (env) {
+    const int mb = atoi(env);
+    if (mb > 0) sogltexmem_budget = size_t(mb) * 1024 * 1024;
+  }
+  coin_atexit((coin_atexit_f *)sogltexmem_cleanup, CC_ATEXIT_NORMAL);
+}
+
+// Registers the texture object dl, owned by owner, as the most
+// recently used one. If cb is NULL, the texture will never be
+// evicted, but it still counts in the resident memory.
+SoGLTextureMemory::Record *
+SoGLTextureMemory::add(SoGLDisplayList * dl, const size_t numbytes,
+                       void * owner, EvictCB * cb)
+{
+  Record * record = new Record;
+  record->dl = dl;
+  record->numbytes = numbytes;
+  record->owner = owner;
+  record->cb = cb;
+  record->evicting = FALSE;
+  record->released = FALSE;
+
+  SOGLTEXMEM_LOCK;
+  record->frame = sogltexmem_frame;
+  record->parent = owner;
+  (void)sogltexmem_parents->get(reinterpret_cast<size_t>(owner), record->parent);
+  sogltexmem_append(record);
+  (void)sogltexmem_records->put(reinterpret_cast<size_t>(dl), record);
+  sogltexmem_resident += numbytes;
+  SOGLTEXMEM_UNLOCK;
+  return record;
+}
+
+// Should be called by the owner when it unrefs the texture object,
+// or after evicting it. The memory stays counted until the texture
+// object is deleted.
+void
+SoGLTextureMemory::remove(Record * record)
+{
+  if (record == NULL) return;
+  SbBool isdeleted = FALSE;
+  SOGLTEXMEM_LOCK;
+  record->owner = NULL;
+  // if evicting, evict() takes care of the record when the callbacks
+  // have been called
+  if (!record->evicting) {
+    if (!record->released) {
+      sogltexmem_unlink(record);
+      record->released = TRUE;
+    }
+    isdeleted = (record->dl == NULL);
+  }
+  SOGLTEXMEM_UNLOCK;
+  if (isdeleted) delete record;
+}
+
+// Called when the texture object dl is deleted, to stop counting its
+// memory.
+void
+SoGLTextureMemory::deleted(const SoGLDisplayList * dl)
+{
+  // texture objects might be deleted after cleanup at exit
+  if (sogltexmem_records == NULL) return;
+  Record * record = NULL;
+  SOGLTEXMEM_LOCK;
+  const size_t key = reinterpret_cast<size_t>(dl);
+  if (sogltexmem_records->get(key, record)) {
+    (void)sogltexmem_records->erase(key);
+    assert(sogltexmem_resident >= record->numbytes);
+    sogltexmem_resident -= record->numbytes;
+    record->dl = NULL;
+    if (!record->released && !record->evicting) {
+      // deleted before the owner let go of it. Let remove() free it.
+      sogltexmem_unlink(record);
+      record->released = TRUE;
+      record = NULL;
+    }
+    else if (record->evicting) record = NULL;
+  }
+  SOGLTEXMEM_UNLOCK;
+  delete record;
+}
+
+static void
+sogltexmem_touch(SoGLTextureMemory::Record * record)
+{
+  if (!record->evicting && !record->released && record->frame != sogltexmem_frame) {
+    record->frame = sogltexmem_frame;
+    if (record != sogltexmem_tail) {
+      sogltexmem_unlink(record);
+      sogltexmem_append(record);
+    }
+  }
+}
+
+// Marks the texture object as used in the current frame.
+void
+SoGLTextureMemory::touch(Record * record)
+{
+  if (record == NULL) return;
+  SOGLTEXMEM_LOCK;
+  sogltexmem_touch(record);
+  SOGLTEXMEM_UNLOCK;
+}
+
+// Marks the texture object dl as used in the current frame, if it
+// is registered. Used by SoGLRenderCache for the textures bound by
+// the display lists it replays, since their owners are not called.
+void
+SoGLTextureMemory::touch(const SoGLDisplayList * dl)
+{
+  SOGLTEXMEM_LOCK;
+  Record * record = NULL;
+  if (sogltexmem_records && sogltexmem_records->get(reinterpret_cast<size_t>(dl), record)) {
+    sogltexmem_touch(record);
+  }
+  SOGLTEXMEM_UNLOCK;
+}
+
+// Returns the owner of a record being evicted, or NULL if the owner
+// has removed it. Must be called from the evict callback, with the
+// owner lock held.
+void *
+SoGLTextureMemory::getOwner(Record * record)
+{
+  SOGLTEXMEM_LOCK;
+  void * owner = record->owner;
+  SOGLTEXMEM_UNLOCK;
+  return owner;
+}
+
+// Makes the memory of textures added later by owner count as used
+// by parent in getResidentBytes(). Used by SoGLBigImage for its
+// tiles. Set parent to NULL when owner is destructed.
+void
+SoGLTextureMemory::setParent(const void * owner, const void * parent)
+{
+  SOGLTEXMEM_LOCK;
+  if (parent) (void)sogltexmem_parents->put(reinterpret_cast<size_t>(owner), parent);
+  else (void)sogltexmem_parents->erase(reinterpret_cast<size_t>(owner));
+  SOGLTEXMEM_UNLOCK;
+}
+
+// Starts a new frame. Textures used in the current frame are never
+// evicted.
+void
+SoGLTextureMemory::beginFrame(void)
+{
+  SOGLTEXMEM_LOCK;
+  sogltexmem_frame++;
+  SOGLTEXMEM_UNLOCK;
+}
+
+// Evicts the least recently used textures until the resident memory
+// is expected to be within the budget. Texture objects which are
+// still referenced by render caches stay resident until the caches
+// are destructed. Must not be called with an owner lock held.
+void
+SoGLTextureMemory::evict(SoState * state)
+{
+  SbList<Record *> victims;
+  SOGLTEXMEM_LOCK;
+  if (sogltexmem_budget > 0) {
+    size_t numbytes = sogltexmem_resident;
+    Record * record = sogltexmem_head;
+    while (record && numbytes > sogltexmem_budget &&
+           record->frame != sogltexmem_frame) {
+      Record * next = record->next;
+      if (record->cb) {
+        sogltexmem_unlink(record);
+        numbytes -= record->numbytes;
+        record->evicting = TRUE;
+        victims.append(record);
+      }
+      record = next;
+    }
+  }
+  SOGLTEXMEM_UNLOCK;
+
+  if (victims.getLength() == 0) return;
+  for (int i = 0; i < victims.getLength(); i++) {
+    victims[i]->cb(victims[i], state);
+  }
+
+  // free the records of the texture objects which were deleted by
+  // the callbacks, and wait for deleted() for the others
+  SOGLTEXMEM_LOCK;
+  for (int i = 0; i < victims.getLength(); i++) {
+    Record * record = victims[i];
+    record->evicting = FALSE;
+    record->released = TRUE;
+    record->owner = NULL;
+    if (record->dl != NULL) victims[i] = NULL;
+  }
+  SOGLTEXMEM_UNLOCK;
+  for (int i = 0; i < victims.getLength(); i++) delete victims[i];
+}
+
+void
+SoGLTextureMemory::setBudget(const size_t numbytes)
+{
+  SOGLTEXMEM_LOCK;
+  sogltexmem_budget = numbytes;
+  SOGLTEXMEM_UNLOCK;
+}
+
+size_t
+SoGLTextureMemory::getBudget(void)
+{
+  return sogltexmem_budget;
+}
+
+size_t
+SoGLTextureMemory::getResidentBytes(void)
+{
+  SOGLTEXMEM_LOCK;
+  const size_t numbytes = sogltexmem_resident;
+  SOGLTEXMEM_UNLOCK;
+  return numbytes;
+}
+
+// Returns the memory used by the textures of owner, and of the
+// owners having it as their parent. Textures the owner has let go of
+// are not included.
+size_t
+SoGLTextureMemory::getResidentBytes(const void * owner)
+{
+  size_t numbytes = 0;
+  SOGLTEXMEM_LOCK;
+  for (Record * record = sogltexmem_head; record; record = record->next) {
+    if (record->parent == owner) numbytes += record->numbytes;
+  }
+  SOGLTEXMEM_UNLOCK;
+  return numbytes;
+}
+
+#undef SOGLTEXMEM_LOCK
+#undef SOGLTEXMEM_UNLOCK
+
+// *************************************************************************
+
+#ifdef COIN_TEST_SUITE
+#ifdef COIN_TEST_INTERNALS
+
+#include <Inventor/lists/SbList.h>
+
+#include "rendering/SoGLTextureMemory.h"
+
+// The registry never dereferences the texture objects or the owners,
+// so these tests use the addresses of array elements for both.
+
+static SbList<void *> * sogltexmem_test_victims = NULL;
+// the texture object to delete in the evict callback, as if no
+// render cache referenced it
+static const SoGLDisplayList * sogltexmem_test_delete = NULL;
+
+static void
+sogltexmem_test_evict_cb(SoGLTextureMemory::Record * record, SoState * state)
+{
+  assert(state == NULL);
+  sogltexmem_test_victims->append(SoGLTextureMemory::getOwner(record));
+  SoGLTextureMemory::remove(record);
+  if (sogltexmem_test_delete) SoGLTextureMemory::deleted(sogltexmem_test_delete);
+}
+
+static SoGLDisplayList *
+sogltexmem_test_dl(int * object)
+{
+  return reinterpret_cast<SoGLDisplayList *>(object);
+}
+
+BOOST_AUTO_TEST_CASE(evictLeastRecentlyUsed)
+{
+  SbList<void *> victims;
+  sogltexmem_test_victims = &victims;
+  const size_t oldbudget = SoGLTextureMemory::getBudget();
+  const size_t base = SoGLTextureMemory::getResidentBytes();
+
+  int owners[3], objects[3];
+  SoGLTextureMemory::Record * records[3];
+  SoGLTextureMemory::beginFrame();
+  for (int i = 0; i < 3; i++) {
+    records[i] = SoGLTextureMemory::add(sogltexmem_test_dl(&objects[i]), 100,
+                                        &owners[i], sogltexmem_test_evict_cb);
+  }
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(), base + 300);
+
+  // use the first texture through its texture object, like
+  // SoGLRenderCache does, and the second through its record
+  SoGLTextureMemory::beginFrame();
+  SoGLTextureMemory::touch(sogltexmem_test_dl(&objects[0]));
+  SoGLTextureMemory::beginFrame();
+  SoGLTextureMemory::touch(records[1]);
+  SoGLTextureMemory::beginFrame();
+
+  SoGLTextureMemory::setBudget(base + 150);
+  SoGLTextureMemory::evict(NULL);
+  BOOST_CHECK_MESSAGE(victims.getLength() == 2 &&
+                      victims[0] == &owners[2] && victims[1] == &owners[0],
+                      "the least recently used textures must be evicted first");
+  // the evicted textures count until the texture objects are deleted
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(), base + 300);
+  SoGLTextureMemory::deleted(sogltexmem_test_dl(&objects[2]));
+  SoGLTextureMemory::deleted(sogltexmem_test_dl(&objects[0]));
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(), base + 100);
+
+  SoGLTextureMemory::remove(records[1]);
+  SoGLTextureMemory::deleted(sogltexmem_test_dl(&objects[1]));
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(), base);
+
+  SoGLTextureMemory::setBudget(oldbudget);
+  sogltexmem_test_victims = NULL;
+}
+
+BOOST_AUTO_TEST_CASE(keepCurrentFrame)
+{
+  SbList<void *> victims;
+  sogltexmem_test_victims = &victims;
+  const size_t oldbudget = SoGLTextureMemory::getBudget();
+  const size_t base = SoGLTextureMemory::getResidentBytes();
+
+  int owners[3], objects[3];
+  SoGLTextureMemory::beginFrame();
+  // the oldest texture has no evict callback, so it must be skipped
+  SoGLTextureMemory::Record * pinned =
+    SoGLTextureMemory::add(sogltexmem_test_dl(&objects[0]), 100, &owners[0], NULL);
+  SoGLTextureMemory::Record * used =
+    SoGLTextureMemory::add(sogltexmem_test_dl(&objects[1]), 100, &owners[1],
+                           sogltexmem_test_evict_cb);
+  (void) SoGLTextureMemory::add(sogltexmem_test_dl(&objects[2]), 100, &owners[2],
+                                sogltexmem_test_evict_cb);
+
+  SoGLTextureMemory::setBudget(base + 1);
+  SoGLTextureMemory::evict(NULL);
+  BOOST_CHECK_MESSAGE(victims.getLength() == 0,
+                      "textures used in the current frame must not be evicted");
+
+  SoGLTextureMemory::beginFrame();
+  SoGLTextureMemory::touch(used);
+  SoGLTextureMemory::evict(NULL);
+  BOOST_CHECK_MESSAGE(victims.getLength() == 1 && victims[0] == &owners[2],
+                      "only the texture unused in this frame must be evicted");
+  SoGLTextureMemory::deleted(sogltexmem_test_dl(&objects[2]));
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(), base + 200);
+
+  SoGLTextureMemory::remove(used);
+  SoGLTextureMemory::remove(pinned);
+  SoGLTextureMemory::deleted(sogltexmem_test_dl(&objects[0]));
+  SoGLTextureMemory::deleted(sogltexmem_test_dl(&objects[1]));
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(), base);
+
+  SoGLTextureMemory::setBudget(oldbudget);
+  sogltexmem_test_victims = NULL;
+}
+
+BOOST_AUTO_TEST_CASE(residentBytesPerOwner)
+{
+  const size_t base = SoGLTextureMemory::getResidentBytes();
+
+  // a big image, one of its tiles, and another image
+  int image, tile, other, objects[3];
+  SoGLTextureMemory::setParent(&tile, &image);
+  SoGLTextureMemory::Record * records[3];
+  records[0] = SoGLTextureMemory::add(sogltexmem_test_dl(&objects[0]), 100, &image, NULL);
+  records[1] = SoGLTextureMemory::add(sogltexmem_test_dl(&objects[1]), 50, &tile, NULL);
+  records[2] = SoGLTextureMemory::add(sogltexmem_test_dl(&objects[2]), 30, &other, NULL);
+
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(&image), size_t(150));
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(&tile), size_t(0));
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(&other), size_t(30));
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(), base + 180);
+
+  SoGLTextureMemory::remove(records[1]);
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(&image), size_t(100));
+  SoGLTextureMemory::setParent(&tile, NULL);
+  SoGLTextureMemory::remove(records[0]);
+  SoGLTextureMemory::remove(records[2]);
+  for (int i = 0; i < 3; i++) SoGLTextureMemory::deleted(sogltexmem_test_dl(&objects[i]));
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(), base);
+}
+
+BOOST_AUTO_TEST_CASE(countUntilDeleted)
+{
+  SbList<void *> victims;
+  sogltexmem_test_victims = &victims;
+  const size_t oldbudget = SoGLTextureMemory::getBudget();
+  const size_t base = SoGLTextureMemory::getResidentBytes();
+
+  int owners[2], objects[2];
+  SoGLTextureMemory::beginFrame();
+  for (int i = 0; i < 2; i++) {
+    (void) SoGLTextureMemory::add(sogltexmem_test_dl(&objects[i]), 100,
+                                  &owners[i], sogltexmem_test_evict_cb);
+  }
+  SoGLTextureMemory::beginFrame();
+  SoGLTextureMemory::setBudget(base + 150);
+
+  // the first texture object is still referenced by a render cache
+  // when it is evicted, so it must be counted until it is deleted
+  SoGLTextureMemory::evict(NULL);
+  BOOST_REQUIRE_EQUAL(victims.getLength(), 1);
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(), base + 200);
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(&owners[0]), size_t(0));
+
+  // replaying the render cache must not make it evictable again
+  SoGLTextureMemory::touch(sogltexmem_test_dl(&objects[0]));
+  SoGLTextureMemory::beginFrame();
+  // the second one is deleted by the evict callback
+  sogltexmem_test_delete = sogltexmem_test_dl(&objects[1]);
+  SoGLTextureMemory::evict(NULL);
+  sogltexmem_test_delete = NULL;
+  BOOST_CHECK_MESSAGE(victims.getLength() == 2 && victims[1] == &owners[1],
+                      "only the texture still owned may be evicted");
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(), base + 100);
+
+  // the render cache is destructed
+  SoGLTextureMemory::deleted(sogltexmem_test_dl(&objects[0]));
+  BOOST_CHECK_EQUAL(SoGLTextureMemory::getResidentBytes(), base);
+
+  SoGLTextureMemory::setBudget(oldbudget);
+  sogltexmem_test_victims = NULL;
+}
+
+#endif // COIN_TEST_INTERNALS
+#endif // COIN_TEST_SUITE
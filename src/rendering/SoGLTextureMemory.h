@@ -0,0 +1,74 @@
+#ifndef COIN_SOGLTEXTUREMEMORY_H
+#define COIN_SOGLTEXTUREMEMORY_H
+
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#ifndef COIN_INTERNAL
+#error this is a private header file
+#endif /* !COIN_INTERNAL */
+
+#include <Inventor/SbBasic.h>
+#include <cstddef>
+
+class SoGLDisplayList;
+class SoState;
+
+// Keeps track of the memory used by the texture objects of
+// SoGLImage, SoGLBigImage and SoGLCubeMapImage, and evicts the least
+// recently used ones when a budget is exceeded.
+class SoGLTextureMemory {
+public:
+  class Record;
+  typedef void EvictCB(Record * record, SoState * state);
+
+  static void init(void);
+
+  static Record * add(SoGLDisplayList * dl, const size_t numbytes,
+                      void * owner, EvictCB * cb);
+  static void remove(Record * record);
+  static void deleted(const SoGLDisplayList * dl);
+  static void touch(Record * record);
+  static void touch(const SoGLDisplayList * dl);
+  static void * getOwner(Record * record);
+  static void setParent(const void * owner, const void * parent);
+
+  static void beginFrame(void);
+  static void evict(SoState * state);
+
+  static void setBudget(const size_t numbytes);
+  static size_t getBudget(void);
+  static size_t getResidentBytes(void);
+  static size_t getResidentBytes(const void * owner);
+};
+
+#endif // !COIN_SOGLTEXTUREMEMORY_H
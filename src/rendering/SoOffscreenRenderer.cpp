@@ -142,6 +142,16 @@
   offscreen context (i.e. OpenGL on X11), WGL (i.e. OpenGL on
   Win32), AGL (old-style OpenGL on the Mac OS X) or CGL (new-style Mac OS X).
 
+  On systems with EGL, offscreen contexts are made through EGL
+  instead of GLX when there is no X11 display to connect to (i.e. the
+  \c DISPLAY environment variable is not set), so batch rendering can
+  be done on machines without an X server, with Mesa's software
+  rasterizer or a GPU render node. Set the environment variable \c
+  COIN_EGLGLUE_OFFSCREEN to 1 or 0 to always or never use EGL. Each
+  EGL context is made current only in the thread rendering with it,
+  so separate SoOffscreenRenderer instances can render concurrently
+  from several threads in a thread safe Coin build.
+
   If the OpenGL driver supports the pbuffer extension, it is detected
   and used to provide hardware accelerated offscreen rendering.
 
@@ -1762,7 +1772,7 @@ SoOffscreenRendererP::offscreenContextsNotSupported(void)
   // still fails, as this can happen due to e.g. lack of resources or
   // other causes that may change during runtime.)
 
-#ifdef HAVE_GLX
+#if defined(HAVE_GLX) || defined(HAVE_EGL)
   return FALSE;
 #elif defined(HAVE_WGL)
   return FALSE;
@@ -37,6 +37,7 @@
 #include "SoGLDriverDatabase.cpp"
 #include "SoGLImage.cpp"
 #include "SoGLNurbs.cpp"
+#include "SoGLTextureMemory.cpp"
 #include "SoOffscreenCGData.cpp"
 #include "SoOffscreenGLXData.cpp"
 #include "SoOffscreenRenderer.cpp"
@@ -113,7 +113,14 @@
 */
 
 unsigned int SbHashFunc(const SoSensor * key) {
-  return SbHashFunc(reinterpret_cast<size_t>(key));
+  // SbHash picks buckets from the hash value modulo a power of two,
+  // so mix in the higher bits of the address, or sensors (all aligned
+  // on the same boundary) would share a fraction of the buckets.
+  size_t value = reinterpret_cast<size_t>(key);
+  value ^= value >> 16;
+  value *= 0x45d9f3b;
+  value ^= value >> 16;
+  return SbHashFunc(value);
 }
 
 /*!
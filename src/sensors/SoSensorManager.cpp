@@ -49,7 +49,10 @@
   Each of these two types has its own queue, which is handled by the
   SoSensorManager. The queues are kept in sorted order by
   SoSensorManager, either according to trigger time (for
-  timer sensors) or by priority (for delay sensors).
+  timer sensors) or by priority (for delay sensors). Sensors with the
+  same trigger time or priority are processed in the order they were
+  scheduled. Inserting and removing a sensor takes O(log n) time, so
+  the queues scale to hundreds of thousands of scheduled sensors.
 
   The SoSensorManager provides methods for managing these queues, by
   insertion and removal of sensors, and processing (emptying) of the
@@ -85,6 +88,8 @@
 #include <Inventor/sensors/SoSensorManager.h>
 
 #include <cassert>
+#include <algorithm>
+#include <vector>
 
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -134,6 +139,100 @@
 
 // *************************************************************************
 
+// A queue of sensors ordered on a key (priority or trigger time), and
+// on insertion order for equal keys, so that such sensors are
+// processed FIFO. The queue is a binary heap, which gives O(log n)
+// insertion and removal of the first sensor.
+//
+// Removing a sensor from anywhere else in the queue only erases it
+// from the dict of queued sensors, which maps each sensor to the
+// sequence number of its heap entry. Heap entries without a match in
+// the dict are skipped when they reach the top of the heap, and are
+// all purged if they start to outnumber the queued sensors.
+template <class SensorType, class KeyType>
+class SoSensorQueue {
+public:
+  SoSensorQueue(void) : sequence(0) { }
+
+  void insert(SensorType * sensor, const KeyType key) {
+    Entry entry;
+    entry.key = key;
+    entry.sequence = this->sequence++;
+    entry.sensor = sensor;
+    (void) this->queued.put(sensor, entry.sequence);
+    this->heap.push_back(entry);
+    std::push_heap(this->heap.begin(), this->heap.end(), Entry::isAfter);
+  }
+
+  SbBool remove(SensorType * sensor) {
+    if (!this->queued.erase(sensor)) return FALSE;
+    if (this->heap.size() > 2 * this->queued.getNumElements() + 64) {
+      this->purge();
+    }
+    return TRUE;
+  }
+
+  // Returns the first sensor in the queue, or NULL if it is empty.
+  SensorType * getFirst(void) {
+    while (!this->heap.empty() && !this->isQueued(this->heap.front())) {
+      this->popHeap();
+    }
+    return this->heap.empty() ? NULL : this->heap.front().sensor;
+  }
+
+  // Removes and returns the first sensor in the queue, or NULL if it
+  // is empty.
+  SensorType * pop(void) {
+    SensorType * sensor = this->getFirst();
+    if (sensor) {
+      this->popHeap();
+      (void) this->queued.erase(sensor);
+    }
+    return sensor;
+  }
+
+  int getLength(void) const {
+    return static_cast<int>(this->queued.getNumElements());
+  }
+
+private:
+  struct Entry {
+    KeyType key;
+    uint64_t sequence;
+    SensorType * sensor;
+
+    static bool isAfter(const Entry & a, const Entry & b) {
+      if (a.key != b.key) return a.key > b.key;
+      return a.sequence > b.sequence;
+    }
+  };
+
+  SbBool isQueued(const Entry & entry) const {
+    uint64_t sequence;
+    return this->queued.get(entry.sensor, sequence) && sequence == entry.sequence;
+  }
+
+  void popHeap(void) {
+    std::pop_heap(this->heap.begin(), this->heap.end(), Entry::isAfter);
+    this->heap.pop_back();
+  }
+
+  void purge(void) {
+    size_t numkept = 0;
+    for (size_t i = 0; i < this->heap.size(); i++) {
+      if (this->isQueued(this->heap[i])) this->heap[numkept++] = this->heap[i];
+    }
+    this->heap.resize(numkept);
+    std::make_heap(this->heap.begin(), this->heap.end(), Entry::isAfter);
+  }
+
+  std::vector<Entry> heap;
+  SbHash<SensorType *, uint64_t> queued;
+  uint64_t sequence;
+};
+
+// *************************************************************************
+
 class SoSensorManagerP {
 public:
   SoSensorManagerP(void) : alive(ALIVE_PATTERN) { }
@@ -143,12 +242,12 @@ public:
   SbBool processingimmediatequeue;
 
   // immediatequeue - stores SoDelayQueueSensors with priority 0. FIFO.
-  // delayqueue   - stores SoDelayQueueSensor's in sorted order.
-  // timerqueue - stores SoTimerSensors in sorted order.
+  // delayqueue   - stores SoDelayQueueSensor's sorted on priority.
+  // timerqueue - stores SoTimerSensors sorted on trigger time.
 
-  SbList <SoDelayQueueSensor *> immediatequeue;
-  SbList <SoDelayQueueSensor *> delayqueue;
-  SbList <SoTimerQueueSensor *> timerqueue;
+  SoSensorQueue <SoDelayQueueSensor, uint32_t> immediatequeue;
+  SoSensorQueue <SoDelayQueueSensor, uint32_t> delayqueue;
+  SoSensorQueue <SoTimerQueueSensor, double> timerqueue;
   SbList <SoTimerSensor*> reschedulelist;
 
   // FIXME: from what I can see, the two dicts below are simply used
@@ -294,7 +393,7 @@ SoSensorManager::insertDelaySensor(SoDelayQueueSensor * newentry)
   // strategy.
   if (newentry->getPriority() == 0) {
     LOCK_IMMEDIATE_QUEUE(this);
-    PRIVATE(this)->immediatequeue.append(newentry);
+    PRIVATE(this)->immediatequeue.insert(newentry, 0);
     UNLOCK_IMMEDIATE_QUEUE(this);
   }
   else {
@@ -305,17 +404,7 @@ SoSensorManager::insertDelaySensor(SoDelayQueueSensor * newentry)
     }
 
     LOCK_DELAY_QUEUE(this);
-    SbList <SoDelayQueueSensor *> & delayqueue = PRIVATE(this)->delayqueue;
-
-    // <= in test since the sensors should be processed FIFO for
-    // sensors with equal priority
-    uint32_t newsensorpriority = newentry->getPriority();
-    int pos = 0;
-    while((pos < delayqueue.getLength()) &&
-          (delayqueue[pos]->getPriority() <= newsensorpriority)) {
-      pos++;
-    }
-    delayqueue.insert(newentry, pos);
+    PRIVATE(this)->delayqueue.insert(newentry, newentry->getPriority());
     UNLOCK_DELAY_QUEUE(this);
     this->notifyChanged();
   }
@@ -343,20 +432,8 @@ SoSensorManager::insertTimerSensor(SoTimerQueueSensor * newentry)
   SoSensorManagerP::assertAlive(PRIVATE(this));
   assert(newentry);
 
-  SbList <SoTimerQueueSensor *> & timerqueue = PRIVATE(this)->timerqueue;
-
   LOCK_TIMER_QUEUE(this);
-  int i = 0;
-
-  // <= in test since the sensors should be processed FIFO for sensors
-  // with the same trigger time
-  double newtime = newentry->getTriggerTime().getValue();
-  while ((i < timerqueue.getLength()) &&
-         (timerqueue[i]->getTriggerTime().getValue() <= newtime)) {
-    i++;
-  }
-  timerqueue.insert(newentry, i);
-
+  PRIVATE(this)->timerqueue.insert(newentry, newentry->getTriggerTime().getValue());
   UNLOCK_TIMER_QUEUE(this);
 
 #if DEBUG_TIMER_SENSORHANDLING || 0 // debug
@@ -387,28 +464,24 @@ SoSensorManager::removeDelaySensor(SoDelayQueueSensor * entry)
 
   LOCK_DELAY_QUEUE(this);
   // Check "real" queue first..
-  int idx = PRIVATE(this)->delayqueue.find(entry);
-  if (idx != -1) PRIVATE(this)->delayqueue.remove(idx);
+  SbBool found = PRIVATE(this)->delayqueue.remove(entry);
   UNLOCK_DELAY_QUEUE(this);
 
   // ..then the immediate queue.
-  if (idx == -1) {
+  if (!found) {
     LOCK_IMMEDIATE_QUEUE(this);
-    idx = PRIVATE(this)->immediatequeue.find(entry);
-    if (idx != -1) PRIVATE(this)->immediatequeue.remove(idx);
+    found = PRIVATE(this)->immediatequeue.remove(entry);
     UNLOCK_IMMEDIATE_QUEUE(this);
   }
   // ..then the reinsert list
-  if (idx == -1) {
-    if (PRIVATE(this)->reinsertdict.erase(entry)) {
-      idx = 0; // make sure notifyChanged() is called.
-    }
+  if (!found) {
+    found = PRIVATE(this)->reinsertdict.erase(entry) ? TRUE : FALSE;
   }
 
-  if (idx != -1) this->notifyChanged();
+  if (found) this->notifyChanged();
 
 #if COIN_DEBUG
-  if (idx == -1) {
+  if (!found) {
     SoDebugError::postWarning("SoSensorManager::removeDelaySensor",
                               "trying to remove element not in list");
   }
@@ -424,9 +497,7 @@ SoSensorManager::removeTimerSensor(SoTimerQueueSensor * entry)
   SoSensorManagerP::assertAlive(PRIVATE(this));
 
   LOCK_TIMER_QUEUE(this);
-  int idx = PRIVATE(this)->timerqueue.find(entry);
-  if (idx != -1) {
-    PRIVATE(this)->timerqueue.remove(idx);
+  if (PRIVATE(this)->timerqueue.remove(entry)) {
     UNLOCK_TIMER_QUEUE(this);
     this->notifyChanged();
   }
@@ -478,15 +549,15 @@ SoSensorManager::processTimerQueue(void)
   LOCK_TIMER_QUEUE(this);
 
   SbTime currenttime = SbTime::getTimeOfDay();
-  while (PRIVATE(this)->timerqueue.getLength() > 0 &&
-         PRIVATE(this)->timerqueue[0]->getTriggerTime() <= currenttime) {
+  SoTimerQueueSensor * first;
+  while ((first = PRIVATE(this)->timerqueue.getFirst()) != NULL &&
+         first->getTriggerTime() <= currenttime) {
 #if DEBUG_TIMER_SENSORHANDLING // debug
     SoDebugError::postInfo("SoSensorManager::processTimerQueue",
                            "process element with triggertime %s",
-                           PRIVATE(this)->timerqueue[0]->getTriggerTime().format().getString());
+                           first->getTriggerTime().format().getString());
 #endif // debug
-    SoSensor * sensor = PRIVATE(this)->timerqueue[0];
-    PRIVATE(this)->timerqueue.remove(0);
+    SoSensor * sensor = PRIVATE(this)->timerqueue.pop();
     UNLOCK_TIMER_QUEUE(this);
     sensor->trigger();
     LOCK_TIMER_QUEUE(this);
@@ -584,15 +655,14 @@ SoSensorManager::processDelayQueue(SbBool isidle)
   LOCK_DELAY_QUEUE(this);
 
   // Sensors with higher priorities are triggered first.
-  while (PRIVATE(this)->delayqueue.getLength()) {
+  SoDelayQueueSensor * sensor;
+  while ((sensor = PRIVATE(this)->delayqueue.pop()) != NULL) {
 #if DEBUG_DELAY_SENSORHANDLING // debug
     SoDebugError::postInfo("SoSensorManager::processDelayQueue",
                            "treat element with pri %d",
-                           PRIVATE(this)->delayqueue[0]->getPriority());
+                           sensor->getPriority());
 #endif // debug
 
-    SoDelayQueueSensor * sensor = PRIVATE(this)->delayqueue[0];
-    PRIVATE(this)->delayqueue.remove(0);
     UNLOCK_DELAY_QUEUE(this);
 
     if (!isidle && sensor->isIdleOnly()) {
@@ -687,13 +757,12 @@ SoSensorManager::processImmediateQueue(void)
 
   LOCK_IMMEDIATE_QUEUE(this);
 
-  while (PRIVATE(this)->immediatequeue.getLength()) {
+  SoSensor * sensor;
+  while ((sensor = PRIVATE(this)->immediatequeue.pop()) != NULL) {
 #if DEBUG_DELAY_SENSORHANDLING || 0 // debug
     SoDebugError::postInfo("SoSensorManager::processImmediateQueue",
                            "trigger element");
 #endif // debug
-    SoSensor * sensor = PRIVATE(this)->immediatequeue[0];
-    PRIVATE(this)->immediatequeue.remove(0);
     UNLOCK_IMMEDIATE_QUEUE(this);
 
     sensor->trigger();
@@ -772,8 +841,9 @@ SoSensorManager::isTimerSensorPending(SbTime & tm)
   SoSensorManagerP::assertAlive(PRIVATE(this));
 
   LOCK_TIMER_QUEUE(this);
-  if (PRIVATE(this)->timerqueue.getLength() > 0) {
-    tm = PRIVATE(this)->timerqueue[0]->getTriggerTime();
+  SoTimerQueueSensor * first = PRIVATE(this)->timerqueue.getFirst();
+  if (first) {
+    tm = first->getTriggerTime();
     UNLOCK_TIMER_QUEUE(this);
     return TRUE;
   }
@@ -899,6 +969,73 @@ SoSensorManager::mergeDelayQueues(void)
   return 0;
 }
 
+#ifdef COIN_TEST_SUITE
+
+#include <Inventor/SoDB.h>
+#include <Inventor/lists/SbList.h>
+#include <Inventor/sensors/SoAlarmSensor.h>
+#include <Inventor/sensors/SoOneShotSensor.h>
+
+static void
+queueorder_cb(void * data, SoSensor * sensor)
+{
+  SbList<SoSensor *> * triggered = static_cast<SbList<SoSensor *> *>(data);
+  triggered->append(sensor);
+}
+
+BOOST_AUTO_TEST_CASE(delayQueueOrder)
+{
+  SbList<SoSensor *> triggered;
+  SoOneShotSensor * sensors[8];
+  // priorities 1, 3, 2, 1, 3, 2, 1, 3
+  for (int i = 0; i < 8; i++) {
+    sensors[i] = new SoOneShotSensor(queueorder_cb, &triggered);
+    sensors[i]->setPriority(1 + (i * 2) % 3);
+    sensors[i]->schedule();
+  }
+  sensors[4]->unschedule();
+  sensors[1]->setPriority(1); // moves behind the other priority 1 sensors
+
+  SoDB::getSensorManager()->processDelayQueue(TRUE);
+
+  const int expected[] = { 0, 3, 6, 1, 2, 5, 7 };
+  BOOST_REQUIRE(triggered.getLength() == 7);
+  for (int i = 0; i < 7; i++) {
+    BOOST_CHECK_MESSAGE(triggered[i] == sensors[expected[i]],
+                        "delay sensors triggered out of order");
+  }
+  for (int i = 0; i < 8; i++) delete sensors[i];
+}
+
+BOOST_AUTO_TEST_CASE(timerQueueOrder)
+{
+  SbList<SoSensor *> triggered;
+  SoAlarmSensor * sensors[6];
+  const SbTime past = SbTime::getTimeOfDay() - SbTime(10.0);
+  // trigger times past+2, past, past+1, past+2, past, past+1
+  for (int i = 0; i < 6; i++) {
+    sensors[i] = new SoAlarmSensor(queueorder_cb, &triggered);
+    sensors[i]->setTime(past + SbTime(double((i + 2) % 3)));
+    sensors[i]->schedule();
+  }
+  sensors[1]->unschedule();
+
+  SbTime first;
+  BOOST_CHECK(SoDB::getSensorManager()->isTimerSensorPending(first));
+  BOOST_CHECK(first <= past);
+
+  SoDB::getSensorManager()->processTimerQueue();
+
+  const int expected[] = { 4, 2, 5, 0, 3 };
+  BOOST_REQUIRE(triggered.getLength() == 5);
+  for (int i = 0; i < 5; i++) {
+    BOOST_CHECK_MESSAGE(triggered[i] == sensors[expected[i]],
+                        "timer sensors triggered out of order");
+  }
+  for (int i = 0; i < 6; i++) delete sensors[i];
+}
+
+#endif // COIN_TEST_SUITE
 
 #undef DEBUG_DELAY_SENSORHANDLING
 #undef DEBUG_TIMER_SENSORHANDLING
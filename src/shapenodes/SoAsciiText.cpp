@@ -878,15 +878,10 @@ SoAsciiTextP::setUpGlyphs(SoState * state, SoAsciiText * textnode)
     const char * p = str.getString();
     size_t length = cc_string_utf8_validate_length(p);
     // No assertion as zero length is handled correctly (results in a new line)
+    const int firstglyph = this->cache->addGlyphs3D(p);
 
     for (unsigned int strcharidx = 0; strcharidx < length; strcharidx++) {
-      uint32_t glyphidx = 0;
-
-      glyphidx = cc_string_utf8_get_char(p);
-      p = cc_string_utf8_next_char(p);
-
-      cc_glyph3d * glyph = cc_glyph3d_ref(glyphidx, fontspecptr);
-      this->cache->addGlyph(glyph);
+      cc_glyph3d * glyph = this->cache->getGlyph3D(firstglyph + strcharidx);
       assert(glyph);
 
       maxbbox = cc_glyph3d_getboundingbox(glyph); // Get max height
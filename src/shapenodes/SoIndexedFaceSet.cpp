@@ -197,6 +197,7 @@
 #include <Inventor/bundles/SoVertexAttributeBundle.h>
 #include <Inventor/caches/SoConvexDataCache.h>
 #include <Inventor/caches/SoNormalCache.h>
+#include <Inventor/caches/SoPrimitiveVertexCache.h>
 #include <Inventor/details/SoFaceDetail.h>
 #include <Inventor/elements/SoCacheElement.h>
 #include <Inventor/elements/SoCoordinateElement.h>
@@ -254,6 +255,17 @@ public:
   SoConvexDataCache * convexCache;
   int concavestatus;
 
+  SbBool addTrianglesToPVCache(SoState * state,
+                               const SoCoordinateElement * coords,
+                               const SbVec3f * normals,
+                               const int numnormals,
+                               const int32_t * cindices,
+                               const int numindices,
+                               const int32_t * nindices,
+                               const int32_t * tindices,
+                               SoTextureCoordinateBundle * tb,
+                               const int32_t * mindices);
+
 #ifdef COIN_THREADSAFE
   // FIXME: a mutex for every instance seems a bit excessive,
   // especially since Microsoft Windows might have rather strict limits on the
@@ -289,6 +301,52 @@ public:
 
 // *************************************************************************
 
+// If SoShape is building its primitive vertex cache, and the shape
+// is a triangle mesh, add the triangles directly from the index
+// arrays instead of through generatePrimitives(). SoShape's
+// triangle callbacks pass every vertex through a hash table to merge
+// duplicates, which dominates the rebuild time for large meshes.
+// Returns FALSE if the triangles must be generated the usual way.
+SbBool
+SoIndexedFaceSetP::addTrianglesToPVCache(SoState * state,
+                                         const SoCoordinateElement * coords,
+                                         const SbVec3f * normals,
+                                         const int numnormals,
+                                         const int32_t * cindices,
+                                         const int numindices,
+                                         const int32_t * nindices,
+                                         const int32_t * tindices,
+                                         SoTextureCoordinateBundle * tb,
+                                         const int32_t * mindices)
+{
+  // SoShape::validatePVCache() sets the cache it builds as the
+  // current cache
+  SoPrimitiveVertexCache * pvcache =
+    dynamic_cast<SoPrimitiveVertexCache *>(SoCacheElement::getCurrentCache(state));
+  if (pvcache == NULL || !coords->is3D()) return FALSE;
+
+  // every face must be a triangle followed by -1, the last one
+  // optional, with valid coordinate and normal indices
+  if ((numindices % 4 == 1) || (numindices % 4 == 2)) return FALSE;
+  const int32_t numcoords = coords->getNum();
+  for (int i = 0; i < numindices; i++) {
+    const int32_t idx = cindices[i];
+    if (i % 4 == 3) {
+      if (idx >= 0) return FALSE;
+    }
+    else if (idx < 0 || idx >= numcoords) return FALSE;
+    else if (nindices && (nindices[i] < 0 || nindices[i] >= numnormals)) return FALSE;
+  }
+
+  pvcache->addIndexedTriangles(numindices, cindices,
+                               coords->getArrayPtr3(), numcoords,
+                               nindices, normals, numnormals,
+                               tindices, tb, mindices);
+  return TRUE;
+}
+
+// *************************************************************************
+
 SO_NODE_SOURCE(SoIndexedFaceSet);
 
 /*!
@@ -801,6 +859,23 @@ SoIndexedFaceSet::generatePrimitives(SoAction *action)
   const int32_t *viendptr = viptr + numindices;
   int32_t v1, v2, v3, v4, v5 = 0; // v5 init unnecessary, but kills a compiler warning.
 
+  if (action->isOfType(SoGLRenderAction::getClassTypeId()) &&
+      (mbind == OVERALL || mbind == PER_VERTEX_INDEXED) &&
+      (nbind == OVERALL || nbind == PER_VERTEX_INDEXED) &&
+      (tbind == NONE || (tbind == PER_VERTEX_INDEXED && !tb.isFunction())) &&
+      PRIVATE(this)->addTrianglesToPVCache(state, coords, normals,
+                                           normalCacheUsed ?
+                                           this->getNormalCache()->getNum() :
+                                           SoNormalElement::getInstance(state)->getNum(),
+                                           cindices, numindices,
+                                           nbind == OVERALL ? NULL : nindices,
+                                           tbind == NONE ? NULL : tindices,
+                                           (tbind == NONE && doTextures) ? &tb : NULL,
+                                           mbind == OVERALL ? NULL : mindices)) {
+    // all triangles were added to the primitive vertex cache
+    viptr = viendptr;
+  }
+
   SoPrimitiveVertex vertex;
   SoPointDetail pointDetail;
   SoFaceDetail faceDetail;
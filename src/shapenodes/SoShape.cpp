@@ -101,7 +101,12 @@
 #include <Inventor/misc/SoGLBigImage.h>
 #include <Inventor/misc/SoGLDriverDatabase.h>
 #include <Inventor/misc/SoState.h>
+#include <Inventor/nodes/SoFaceSet.h>
+#include <Inventor/nodes/SoIndexedFaceSet.h>
+#include <Inventor/nodes/SoIndexedTriangleStripSet.h>
 #include <Inventor/nodes/SoLight.h>
+#include <Inventor/nodes/SoQuadMesh.h>
+#include <Inventor/nodes/SoTriangleStripSet.h>
 #include <Inventor/nodes/SoVertexProperty.h>
 #include <Inventor/nodes/SoVertexShape.h>
 #include <Inventor/system/gl.h>
@@ -120,6 +125,7 @@
 #include "threads/threadsutilp.h"
 #include "tidbitsp.h"
 #include "rendering/SoVBO.h"
+#include "caches/SoRayPickCache.h"
 #include "coindefs.h" // COIN_OBSOLETED()
 
 // SoShape.cpp grew too big, so I had to move some code into new
@@ -175,6 +181,7 @@ public:
   SoShapeP() {
     this->bboxcache = NULL;
     this->pvcache = NULL;
+    this->pickcache = NULL;
     this->bumprender = NULL;
     this->rendercnt = 0;
     this->flags = 0;
@@ -182,6 +189,7 @@ public:
   ~SoShapeP() {
     if (this->bboxcache) { this->bboxcache->unref(); }
     if (this->pvcache) { this->pvcache->unref(); }
+    if (this->pickcache) { this->pickcache->unref(); }
     delete this->bumprender;
   }
   enum {
@@ -192,12 +200,15 @@ public:
     SHOULD_BBOX_CACHE = 0x1,
     NEED_SETUP_SHAPE_HINTS = 0x2,
     DISABLE_VERTEX_ARRAY_CACHE = 0x4,
+    SHOULD_PICK_CACHE = 0x8,
   };
 
   static void calibrateBBoxCache(void);
   static double bboxcachetimelimit;
+  static int pickcachelimit;
   SoBoundingBoxCache * bboxcache;
   SoPrimitiveVertexCache * pvcache;
+  SoRayPickCache * pickcache;
   soshape_bumprender * bumprender;
   uint32_t flags : FLAG_BITS;
   // stores the number of frames rendered with no node changes
@@ -237,11 +248,21 @@ public:
   // pool or something, i suppose).
   //
   // -mortene.
+  //
+  // The caches of different shapes are built in parallel by
+  // SoGLRenderAction, so we now use a fixed size pool of mutexes,
+  // picking one from the address of the instance. The locked regions
+  // never lock another shape, so two shapes sharing a mutex only
+  // wait for each other.
+  enum { NUM_MUTEXES = 64 };
   static SbMutex * mutex;
 
 #ifdef COIN_THREADSAFE
-  void lock(void) { SoShapeP::mutex->lock(); }
-  void unlock(void) { SoShapeP::mutex->unlock(); }
+  SbMutex * getMutex(void) {
+    return &SoShapeP::mutex[(((uintptr_t) this) >> 4) % NUM_MUTEXES];
+  }
+  void lock(void) { this->getMutex()->lock(); }
+  void unlock(void) { this->getMutex()->unlock(); }
 #else // ! COIN_THREADSAFE
   void lock(void) { }
   void unlock(void) { }
@@ -251,6 +272,7 @@ public:
 };
 
 double SoShapeP::bboxcachetimelimit;
+int SoShapeP::pickcachelimit;
 
 SbMutex * SoShapeP::mutex = NULL;
 
@@ -277,6 +299,10 @@ typedef struct {
   // used in generatePrimitives() callbacks to set correct material
   SoMaterialBundle * currentbundle;
 
+  // used in generatePrimitives() callbacks when picking
+  SoRayPickCache * pickcache;
+  int numpicktriangles;
+
   int rendermode;
 } soshape_staticdata;
 
@@ -303,6 +329,8 @@ soshape_construct_staticdata(void * closure)
   data->bigtexturecontext = new SbList <uint32_t>;
   data->primdata = new soshape_primdata();
   data->trianglesort = new soshape_trianglesort();
+  data->pickcache = NULL;
+  data->numpicktriangles = 0;
   data->rendermode = NORMAL;
 }
 
@@ -334,7 +362,7 @@ SoShapeP::cleanup(void)
   delete soshape_staticstorage;
   soshape_staticstorage = NULL;
 
-  delete SoShapeP::mutex;
+  delete[] SoShapeP::mutex;
   SoShapeP::mutex = NULL;
 }
 
@@ -370,7 +398,7 @@ SoShape::initClass(void)
   SO_NODE_INTERNAL_INIT_ABSTRACT_CLASS(SoShape, SO_FROM_INVENTOR_1);
 
 #ifdef COIN_THREADSAFE
-  SoShapeP::mutex = new SbMutex;
+  SoShapeP::mutex = new SbMutex[SoShapeP::NUM_MUTEXES];
 #endif // COIN_THREADSAFE
 
   soshape_staticstorage =
@@ -379,6 +407,13 @@ SoShape::initClass(void)
                   soshape_destruct_staticdata);
   SoShapeP::calibrateBBoxCache();
 
+  // Shapes generating at least this many triangles will store them
+  // in an SoRayPickCache when picked repeatedly. 0 disables the
+  // cache.
+  SoShapeP::pickcachelimit = 5000;
+  const char * env = coin_getenv("COIN_RAYPICK_CACHE_MIN_TRIANGLES");
+  if (env) { SoShapeP::pickcachelimit = atoi(env); }
+
   coin_atexit((coin_atexit_f *)SoShapeP::cleanup, CC_ATEXIT_NORMAL);
 }
 
@@ -445,6 +480,102 @@ soshape_ray_intersect(SoRayPickAction * action, const SbBox3f & box)
   return action->intersect(box, TRUE);
 }
 
+// Only shapes known to create their triangle details without using
+// the picked point can have their triangles stored in an
+// SoRayPickCache. The type is tested exactly, since subclasses might
+// override createTriangleDetail().
+static SbBool
+soshape_is_pick_cacheable(const SoShape * shape)
+{
+  const SoType type = shape->getTypeId();
+  return
+    type == SoIndexedFaceSet::getClassTypeId() ||
+    type == SoFaceSet::getClassTypeId() ||
+    type == SoIndexedTriangleStripSet::getClassTypeId() ||
+    type == SoTriangleStripSet::getClassTypeId() ||
+    type == SoQuadMesh::getClassTypeId()
+#ifdef HAVE_VRML97
+    || type == SoVRMLIndexedFaceSet::getClassTypeId()
+    || type == SoVRMLElevationGrid::getClassTypeId()
+#endif // HAVE_VRML97
+    ;
+}
+
+// test triangle intersection, and add a picked point if the
+// triangle was hit. The detail must be set by the caller.
+static SoPickedPoint *
+soshape_ray_pick_triangle(SoRayPickAction * ra,
+                          const SoPrimitiveVertex * const v1,
+                          const SoPrimitiveVertex * const v2,
+                          const SoPrimitiveVertex * const v3)
+{
+  SbVec3f intersection;
+  SbVec3f barycentric;
+  SbBool front;
+
+  if (!ra->intersect(v1->getPoint(), v2->getPoint(), v3->getPoint(),
+                     intersection, barycentric, front)) return NULL;
+  if (!ra->isBetweenPlanes(intersection)) return NULL;
+
+  if (SoShapeHintsElement::getVertexOrdering(ra->getState()) ==
+      SoShapeHintsElement::CLOCKWISE) {
+    front = !front;
+  }
+  SoPickedPoint * pp = ra->addIntersection(intersection, front);
+  if (pp) {
+    // calculate normal at picked point
+    SbVec3f n =
+      v1->getNormal() * barycentric[0] +
+      v2->getNormal() * barycentric[1] +
+      v3->getNormal() * barycentric[2];
+    n.normalize();
+    pp->setObjectNormal(n);
+
+    // calculate texture coordinate at picked point
+    SbVec4f tc =
+      v1->getTextureCoords() * barycentric[0] +
+      v2->getTextureCoords() * barycentric[1] +
+      v3->getTextureCoords() * barycentric[2];
+
+    pp->setObjectTextureCoords(tc);
+
+    // material index need to be approximated, since there is no
+    // way to average material indices :( This makes it
+    // impossible to fully support color per vertex. An
+    // extension to the OIV API would perhaps be a good idea
+    // here? Maybe calculate the rgba value for diffuse and
+    // transparency and set it in SoPickedPoint?
+    float maxval = barycentric[0];
+    const SoPrimitiveVertex * maxv = v1;
+    if (barycentric[1] > maxval) {
+      maxv = v2;
+      maxval = barycentric[1];
+    }
+    if (barycentric[2] > maxval) {
+      maxv = v3;
+    }
+    pp->setMaterialIndex(maxv->getMaterialIndex());
+  }
+  return pp;
+}
+
+// pick the triangles stored in cache. Only the triangles in the
+// leaf nodes intersected by the ray are tested, in the same order
+// as generatePrimitives() would have generated them.
+static void
+soshape_ray_pick_cache(SoShape * shape, SoRayPickAction * action,
+                       const SoRayPickCache * cache)
+{
+  SbList<int> triangles;
+  cache->findTriangles(action->getLine(), triangles);
+
+  SoPrimitiveVertex v1, v2, v3;
+  for (int i = 0; i < triangles.getLength(); i++) {
+    cache->getTriangle(triangles[i], v1, v2, v3);
+    SoPickedPoint * pp = soshape_ray_pick_triangle(action, &v1, &v2, &v3);
+    if (pp) pp->setDetail(cache->createDetail(triangles[i]), shape);
+  }
+}
 
 /*!
   Calculates picked point based on primitives generated by subclasses.
@@ -455,10 +586,77 @@ SoShape::rayPick(SoRayPickAction * action)
   if (this->shouldRayPick(action)) {
     this->computeObjectSpaceRay(action);
 
-    if (!PRIVATE(this)->bboxcache ||
-        !PRIVATE(this)->bboxcache->isValid(action->getState()) ||
-        soshape_ray_intersect(action, PRIVATE(this)->bboxcache->getProjectedBox())) {
+    SoState * state = action->getState();
+    if (PRIVATE(this)->bboxcache &&
+        PRIVATE(this)->bboxcache->isValid(state) &&
+        !soshape_ray_intersect(action, PRIVATE(this)->bboxcache->getProjectedBox())) {
+      return;
+    }
+
+    // The pick cache is shared among all threads. Take a reference to
+    // it while holding the lock (SoCache reference counting is not
+    // thread safe), and release it again when done.
+    PRIVATE(this)->lock();
+    SoRayPickCache * cache = PRIVATE(this)->pickcache;
+    if (cache && !cache->isValid(state)) {
+      PRIVATE(this)->pickcache = NULL;
+      cache->unref();
+      cache = NULL;
+      // don't create pick caches for shapes that change
+      PRIVATE(this)->flags &= ~SoShapeP::SHOULD_PICK_CACHE;
+    }
+    if (cache) cache->ref();
+    const SbBool buildcache =
+      !cache && (PRIVATE(this)->flags & SoShapeP::SHOULD_PICK_CACHE);
+    PRIVATE(this)->unlock();
+
+    soshape_staticdata * shapedata = soshape_get_staticdata();
+    if (buildcache) {
+      // must push state to make cache dependencies work
+      state->push();
+      SbBool storedinvalid = SoCacheElement::setInvalid(FALSE);
+      cache = new SoRayPickCache(state);
+      cache->ref();
+      SoCacheElement::set(state, cache);
+      // the triangles will be stored in the cache by
+      // invokeTriangleCallbacks()
+      shapedata->pickcache = cache;
+      this->generatePrimitives(action);
+      shapedata->pickcache = NULL;
+      cache->close();
+      state->pop();
+      SoCacheElement::setInvalid(storedinvalid);
+
+      // keep the cache of another thread if it got here first
+      PRIVATE(this)->lock();
+      if (PRIVATE(this)->pickcache == NULL) {
+        cache->ref();
+        PRIVATE(this)->pickcache = cache;
+      }
+      PRIVATE(this)->unlock();
+    }
+
+    if (cache && cache->isUsable()) {
+      soshape_ray_pick_cache(this, action, cache);
+    }
+    else {
+      shapedata->numpicktriangles = 0;
       this->generatePrimitives(action);
+      // create a pick cache the next time this shape is picked if it
+      // is large enough
+      if (!cache && SoShapeP::pickcachelimit > 0 &&
+          shapedata->numpicktriangles >= SoShapeP::pickcachelimit &&
+          soshape_is_pick_cacheable(this)) {
+        PRIVATE(this)->lock();
+        PRIVATE(this)->flags |= SoShapeP::SHOULD_PICK_CACHE;
+        PRIVATE(this)->unlock();
+      }
+    }
+
+    if (cache) {
+      PRIVATE(this)->lock();
+      cache->unref();
+      PRIVATE(this)->unlock();
     }
   }
 }
@@ -988,56 +1186,21 @@ SoShape::invokeTriangleCallbacks(SoAction * const action,
 {
   if (action->getTypeId().isDerivedFrom(SoRayPickAction::getClassTypeId())) {
     SoRayPickAction * ra = (SoRayPickAction *) action;
+    soshape_staticdata * shapedata = soshape_get_staticdata();
 
-    SbVec3f intersection;
-    SbVec3f barycentric;
-    SbBool front;
-
-    if (ra->intersect(v1->getPoint(), v2->getPoint(), v3->getPoint(),
-                      intersection, barycentric, front)) {
-
-      if (ra->isBetweenPlanes(intersection)) {
-        if (SoShapeHintsElement::getVertexOrdering(ra->getState()) ==
-            SoShapeHintsElement::CLOCKWISE) {
-          front = !front;
-        }
-        SoPickedPoint * pp = ra->addIntersection(intersection, front);
-        if (pp) {
-          pp->setDetail(this->createTriangleDetail(ra, v1, v2, v3, pp), this);
-          // calculate normal at picked point
-          SbVec3f n =
-            v1->getNormal() * barycentric[0] +
-            v2->getNormal() * barycentric[1] +
-            v3->getNormal() * barycentric[2];
-          n.normalize();
-          pp->setObjectNormal(n);
-
-          // calculate texture coordinate at picked point
-          SbVec4f tc =
-            v1->getTextureCoords() * barycentric[0] +
-            v2->getTextureCoords() * barycentric[1] +
-            v3->getTextureCoords() * barycentric[2];
-
-          pp->setObjectTextureCoords(tc);
+    if (shapedata->pickcache) {
+      // no picked point is available when creating the cache. This
+      // is safe for the shapes accepted by soshape_is_pick_cacheable().
+      SoDetail * detail = this->createTriangleDetail(ra, v1, v2, v3, NULL);
+      shapedata->pickcache->addTriangle(v1, v2, v3, detail);
+      delete detail;
+      return;
+    }
+    shapedata->numpicktriangles++;
 
-          // material index need to be approximated, since there is no
-          // way to average material indices :( This makes it
-          // impossible to fully support color per vertex. An
-          // extension to the OIV API would perhaps be a good idea
-          // here? Maybe calculate the rgba value for diffuse and
-          // transparency and set it in SoPickedPoint?
-          float maxval = barycentric[0];
-          const SoPrimitiveVertex * maxv = v1;
-          if (barycentric[1] > maxval) {
-            maxv = v2;
-            maxval = barycentric[1];
-          }
-          if (barycentric[2] > maxval) {
-            maxv = v3;
-          }
-          pp->setMaterialIndex(maxv->getMaterialIndex());
-        }
-      }
+    SoPickedPoint * pp = soshape_ray_pick_triangle(ra, v1, v2, v3);
+    if (pp) {
+      pp->setDetail(this->createTriangleDetail(ra, v1, v2, v3, pp), this);
     }
   }
   else if (action->getTypeId().isDerivedFrom(SoCallbackAction::getClassTypeId())) {
@@ -1428,7 +1591,10 @@ SoShape::notify(SoNotList * nl)
   if (PRIVATE(this)->pvcache) {
     PRIVATE(this)->pvcache->invalidate();
   }
-  PRIVATE(this)->flags &= ~SoShapeP::SHOULD_BBOX_CACHE;
+  if (PRIVATE(this)->pickcache) {
+    PRIVATE(this)->pickcache->invalidate();
+  }
+  PRIVATE(this)->flags &= ~(SoShapeP::SHOULD_BBOX_CACHE|SoShapeP::SHOULD_PICK_CACHE);
   PRIVATE(this)->rendercnt = 0;
   PRIVATE(this)->unlock();
 }
@@ -1753,7 +1919,7 @@ SoShape::finishVertexArray(SoGLRenderAction * action,
 }
 
 void
-SoShape::validatePVCache(SoGLRenderAction * action)
+SoShape::validatePVCache(SoAction * action)
 {
   SoState * state = action->getState();
   if (PRIVATE(this)->pvcache == NULL ||
@@ -1788,5 +1954,16 @@ SoShape::validatePVCache(SoGLRenderAction * action)
   }
 }
 
+// Builds the primitive vertex cache ahead of rendering. Called from
+// the threads SoGLRenderAction uses to prebuild the caches of a new
+// scene graph, with the callback action traversing it.
+void
+SoShape::prebuildPVCache(SoAction * action)
+{
+  PRIVATE(this)->lock();
+  this->validatePVCache(action);
+  PRIVATE(this)->unlock();
+}
+
 
 #undef PRIVATE
@@ -344,8 +344,6 @@ SoText2::GLRender(SoGLRenderAction * action)
   PRIVATE(this)->buildGlyphCache(state);
   SoCacheElement::addCacheDependency(state, PRIVATE(this)->cache);
 
-  const cc_font_specification * fontspec = PRIVATE(this)->cache->getCachedFontspec();
-
   // Render only if bbox not outside cull planes.
   SbBox3f box;
   SbVec3f center;
@@ -418,6 +416,8 @@ SoText2::GLRender(SoGLRenderAction * action)
     glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
 
     SbBool drawPixelBuffer = FALSE;
+    // the glyphs were fetched in string order by buildGlyphCache()
+    int glyphnum = 0;
 
     for (int i = 0; i < nrlines; i++) {
       SbString str = this->string[i];
@@ -442,12 +442,7 @@ SoText2::GLRender(SoGLRenderAction * action)
       size_t length = cc_string_utf8_validate_length(p);
 
       for (unsigned int strcharidx = 0; strcharidx < length; strcharidx++) {
-        uint32_t glyphidx = 0;
-
-        glyphidx = cc_string_utf8_get_char(p);
-        p = cc_string_utf8_next_char(p);
-
-        cc_glyph2d * glyph = cc_glyph2d_ref(glyphidx, fontspec, 0.0f);
+        cc_glyph2d * glyph = PRIVATE(this)->cache->getGlyph2D(glyphnum++);
 
         buffer = cc_glyph2d_getbitmap(glyph, bitmapsize, bitmappos);
 
@@ -514,24 +509,12 @@ SoText2::GLRender(SoGLRenderAction * action)
         }
 
         xpos += (advancex + kerningx);
-
-        if (prevglyph) {
-          // should be safe to unref here. SoGlyphCache will have a
-          // ref'ed instance
-          cc_glyph2d_unref(prevglyph);
-        }
         prevglyph = glyph;
       }
 
       ypos -= (int)(((int) fontsize) * this->spacing.getValue());
     }
 
-    if (prevglyph) {
-      // should be safe to unref here. SoGlyphCache will have a ref'ed
-      // instance
-      cc_glyph2d_unref(prevglyph);
-    }
-
     if (drawPixelBuffer) {
       glEnable(GL_ALPHA_TEST);
       glAlphaFunc(GL_GREATER, 0.3f);
@@ -860,8 +843,6 @@ SoText2P::buildGlyphCache(SoState * state)
 
   const int nrlines = PUBLIC(this)->string.getNum();
 
-  const cc_font_specification * fontspec = this->cache->getCachedFontspec();
-
   this->bbox.makeEmpty();
 
   for (int i=0; i < nrlines; i++) {
@@ -881,21 +862,16 @@ SoText2P::buildGlyphCache(SoState * state)
     const char * p = str.getString();
     size_t length = cc_string_utf8_validate_length(p);
 
-    // fetch all glyphs first
-    for (unsigned int strcharidx = 0; strcharidx < length; strcharidx++) {
-      uint32_t glyphidx = 0;
-
-      glyphidx = cc_string_utf8_get_char(p);
-      p = cc_string_utf8_next_char(p);
+    // fetch all glyphs first, GLRender() uses them in the same order
+    const int firstglyph = this->cache->addGlyphs2D(p, 0.0f);
 
-      cc_glyph2d * glyph = cc_glyph2d_ref(glyphidx, fontspec, 0.0f);
+    for (unsigned int strcharidx = 0; strcharidx < length; strcharidx++) {
+      cc_glyph2d * glyph = this->cache->getGlyph2D(firstglyph + strcharidx);
       // Should _always_ be able to get hold of a glyph -- if no
       // glyph is available for a specific character, a default
       // empty rectangle should be used.  -mortene.
       assert(glyph);
 
-      this->cache->addGlyph(glyph);
-
       // Must fetch special modifiers so that heights for chars like
       // 'q' and 'g' will be taken into account when creating a
       // boundingbox.
@@ -51,6 +51,8 @@
 #include <Inventor/C/tidbits.h>
 #include <Inventor/system/gl.h>
 
+#include "base/radixsort.h"
+
 soshape_trianglesort::soshape_trianglesort(void)
 {
   this->pvlist = NULL;
@@ -85,24 +87,6 @@ soshape_trianglesort::triangle(SoState *,
   this->pvlist->append(*v3);
 }
 
-// qsort() callback.
-//
-// "extern C" wrapper is needed with the OSF1/cxx compiler (probably a
-// bug in the compiler, but it doesn't seem to hurt to do this
-// anyway).
-extern "C" {
-static int
-compare_triangles(const void * ptr1, const void * ptr2)
-{
-  soshape_trianglesort::sorted_triangle * tri1 = (soshape_trianglesort::sorted_triangle*) ptr1;
-  soshape_trianglesort::sorted_triangle * tri2 = (soshape_trianglesort::sorted_triangle*) ptr2;
-
-  if (tri1->dist > tri2->dist) return -1;
-  if (tri1->dist == tri2->dist) return tri2->backface - tri1->backface;
-  return 1;
-}
-}
-
 void
 soshape_trianglesort::endShape(SoState * state, SoMaterialBundle & mb)
 {
@@ -181,7 +165,26 @@ soshape_trianglesort::endShape(SoState * state, SoMaterialBundle & mb)
   }
 
   const sorted_triangle * tarray = this->trianglelist->getArrayPtr();
-  qsort((void*)tarray, n, sizeof(sorted_triangle), compare_triangles);
+
+  // Sort on decreasing distance, with back faces before front faces
+  // at the same distance. The radix sort is stable, so the latter is
+  // done by passing in the back faces first.
+  float * keys = new float[n];
+  int * triidx = new int[n];
+  int * order = new int[n];
+  int numkeys = 0;
+  for (int backface = 1; backface >= 0; backface--) {
+    for (i = 0; i < n; i++) {
+      if (int(tarray[i].backface) == backface) {
+        keys[numkeys] = -tarray[i].dist;
+        triidx[numkeys++] = i;
+      }
+    }
+  }
+  (void) cc_radixsort_float(keys, n, order);
+  for (i = 0; i < n; i++) { order[i] = triidx[order[i]]; }
+  delete[] keys;
+  delete[] triidx;
 
   int idx;
 
@@ -190,7 +193,7 @@ soshape_trianglesort::endShape(SoState * state, SoMaterialBundle & mb)
   // sort the triangles anyway.
   glBegin(GL_TRIANGLES);
   for (i = 0; i < n; i++) {
-    idx = tarray[i].idx;
+    idx = tarray[order[i]].idx;
     v = varray + idx;
     glTexCoord4fv(v->getTextureCoords().getValue());
     glNormal3fv(v->getNormal().getValue());
@@ -210,4 +213,5 @@ soshape_trianglesort::endShape(SoState * state, SoMaterialBundle & mb)
     glVertex3fv(v->getPoint().getValue());
   }
   glEnd();
+  delete[] order;
 }
@@ -32,6 +32,7 @@
 
 #include "common.cpp"
 #include "storage.cpp" /* cc_storage ADT works without the thread abstractions */
+#include "parallel.cpp" /* falls back to serial execution without threads */
 
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -0,0 +1,201 @@
+/**************************************************************************\
+ * Copyright (c) Kongsberg Oil & Gas Technologies AS
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ * 
+ * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+\**************************************************************************/
+
+#include "threads/parallelp.h"
+
+#include <cstdlib>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h> /* sysconf() */
+#endif /* HAVE_UNISTD_H */
+
+#ifdef HAVE_WINDOWS_H
+#include <windows.h> /* GetSystemInfo() */
+#endif /* HAVE_WINDOWS_H */
+
+#ifdef HAVE_THREADS
+#include <Inventor/C/threads/mutex.h>
+#include <Inventor/C/threads/wpool.h>
+#include "threads/mutexp.h"
+#endif /* HAVE_THREADS */
+
+#include <Inventor/C/tidbits.h>
+#include "tidbitsp.h"
+
+/* ********************************************************************** */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* don't spawn more threads than this, even on huge machines */
+#define PARALLEL_MAX_THREADS 64
+
+static int parallel_numthreads = -1;
+
+#ifdef HAVE_THREADS
+
+static cc_wpool * parallel_pool = NULL;
+/* held while the pool is running jobs. Only try-locked, so nested or
+   concurrent invocations fall back to running serially */
+static cc_mutex * parallel_busy = NULL;
+
+typedef struct {
+  cc_parallel_f * func;
+  void * closure;
+  int numjobs;
+  int nextjob;
+  cc_mutex * mutex;
+} parallel_run_data;
+
+static void
+parallel_cleanup(void)
+{
+  if (parallel_pool) cc_wpool_destruct(parallel_pool);
+  if (parallel_busy) cc_mutex_destruct(parallel_busy);
+  parallel_pool = NULL;
+  parallel_busy = NULL;
+  parallel_numthreads = -1;
+}
+
+/* pulls jobs until there are none left. Run by both the pool workers
+   and the calling thread. */
+static void
+parallel_worker_cb(void * closure)
+{
+  parallel_run_data * data = (parallel_run_data *) closure;
+  while (TRUE) {
+    cc_mutex_lock(data->mutex);
+    const int job = data->nextjob++;
+    cc_mutex_unlock(data->mutex);
+    if (job >= data->numjobs) break;
+    data->func(data->closure, job);
+  }
+}
+
+#endif /* HAVE_THREADS */
+
+static int
+parallel_num_cpus(void)
+{
+  int num = 1;
+#if defined(HAVE_WINDOWS_H) && defined(_WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  num = (int) info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+  num = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return num < 1 ? 1 : num;
+}
+
+/*!
+  Returns the number of threads (including the calling thread) that
+  cc_parallel_run() will try to spread jobs over.
+*/
+int
+cc_parallel_get_num_threads(void)
+{
+  if (parallel_numthreads < 0) {
+    int num = 1;
+#ifdef HAVE_THREADS
+    const char * env = coin_getenv("COIN_PARALLEL_NUM_THREADS");
+    num = env ? atoi(env) : parallel_num_cpus();
+    if (num < 1) num = 1;
+    if (num > PARALLEL_MAX_THREADS) num = PARALLEL_MAX_THREADS;
+#endif /* HAVE_THREADS */
+    parallel_numthreads = num;
+  }
+  return parallel_numthreads;
+}
+
+/*!
+  Invokes \a func for all job indices in [0, \a numjobs), passing \a
+  closure along. The jobs are spread over the shared worker pool when
+  it is available, and the function returns when all jobs have
+  completed.
+*/
+void
+cc_parallel_run(int numjobs, cc_parallel_f * func, void * closure)
+{
+  int i;
+  if (numjobs <= 0) return;
+
+#ifdef HAVE_THREADS
+  int numthreads = cc_parallel_get_num_threads();
+  if (numthreads > numjobs) numthreads = numjobs;
+
+  if (numthreads > 1) {
+    cc_mutex_global_lock();
+    if (parallel_busy == NULL) {
+      parallel_busy = cc_mutex_construct();
+      parallel_pool = cc_wpool_construct(cc_parallel_get_num_threads() - 1);
+      coin_atexit((coin_atexit_f*) parallel_cleanup, CC_ATEXIT_THREADING_SUBSYSTEM);
+    }
+    cc_mutex_global_unlock();
+
+    if (cc_mutex_try_lock(parallel_busy) == CC_OK) {
+      parallel_run_data data;
+      data.func = func;
+      data.closure = closure;
+      data.numjobs = numjobs;
+      data.nextjob = 0;
+      data.mutex = cc_mutex_construct();
+
+      cc_wpool_begin(parallel_pool, numthreads - 1);
+      for (i = 0; i < numthreads - 1; i++) {
+        cc_wpool_start_worker(parallel_pool, parallel_worker_cb, &data);
+      }
+      cc_wpool_end(parallel_pool);
+
+      parallel_worker_cb(&data);
+      cc_wpool_wait_all(parallel_pool);
+
+      cc_mutex_destruct(data.mutex);
+      cc_mutex_unlock(parallel_busy);
+      return;
+    }
+  }
+#endif /* HAVE_THREADS */
+
+  for (i = 0; i < numjobs; i++) func(closure, i);
+}
+
+#undef PARALLEL_MAX_THREADS
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
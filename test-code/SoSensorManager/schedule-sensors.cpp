@@ -0,0 +1,121 @@
+// Benchmark for the sensor queues in SoSensorManager. Schedules a
+// large number (default 1000000) of delay queue sensors and timer
+// sensors, unschedules every other one, and then processes the
+// queues, checking that sensors trigger in priority / trigger time
+// order, and in scheduling order for equal priorities.
+//
+// Build and run with something like:
+//
+//   $ coin-config --build schedule-sensors schedule-sensors.cpp
+//   $ ./schedule-sensors 1000000
+
+#include <Inventor/SoDB.h>
+#include <Inventor/SbTime.h>
+#include <Inventor/sensors/SoAlarmSensor.h>
+#include <Inventor/sensors/SoOneShotSensor.h>
+#include <Inventor/sensors/SoSensorManager.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static int numtriggered = 0;
+static int numoutoforder = 0;
+static double lastkey = -1.0;
+static int lastindex = -1;
+
+// Each sensor's data is its index, and the key it was scheduled on
+// increases with the index modulo the number of distinct keys.
+static int numkeys = 1000;
+
+static void
+check_order(double key, int index)
+{
+  if (key < lastkey || (key == lastkey && index < lastindex)) numoutoforder++;
+  lastkey = key;
+  lastindex = index;
+  numtriggered++;
+}
+
+static void
+delay_cb(void * data, SoSensor * sensor)
+{
+  SoDelayQueueSensor * s = static_cast<SoDelayQueueSensor *>(sensor);
+  check_order(s->getPriority(), static_cast<int>(reinterpret_cast<size_t>(data)));
+}
+
+static void
+timer_cb(void * data, SoSensor * sensor)
+{
+  SoAlarmSensor * s = static_cast<SoAlarmSensor *>(sensor);
+  check_order(s->getTime().getValue(), static_cast<int>(reinterpret_cast<size_t>(data)));
+}
+
+static double
+seconds_since(const SbTime & start)
+{
+  return (SbTime::getTimeOfDay() - start).getValue();
+}
+
+int
+main(int argc, char ** argv)
+{
+  const int num = (argc > 1) ? atoi(argv[1]) : 1000000;
+
+  SoDB::init();
+  SoSensorManager * sm = SoDB::getSensorManager();
+
+  // Spread the keys with a stride, so that the sensors are not
+  // scheduled in sorted order.
+  std::vector<SoOneShotSensor *> delaysensors(num);
+  for (int i = 0; i < num; i++) {
+    delaysensors[i] = new SoOneShotSensor(delay_cb, reinterpret_cast<void *>(static_cast<size_t>(i)));
+    delaysensors[i]->setPriority(1 + (i * 7919) % numkeys);
+  }
+
+  SbTime start = SbTime::getTimeOfDay();
+  for (int i = 0; i < num; i++) delaysensors[i]->schedule();
+  printf("delay queue: schedule %d sensors:   %8.3f s\n", num, seconds_since(start));
+
+  start = SbTime::getTimeOfDay();
+  for (int i = 0; i < num; i += 2) delaysensors[i]->unschedule();
+  printf("delay queue: unschedule %d sensors: %8.3f s\n", num / 2, seconds_since(start));
+
+  start = SbTime::getTimeOfDay();
+  sm->processDelayQueue(TRUE);
+  printf("delay queue: process %d sensors:    %8.3f s\n", numtriggered, seconds_since(start));
+
+  printf("delay queue: %d triggered, %d out of order\n\n", numtriggered, numoutoforder);
+  for (int i = 0; i < num; i++) delete delaysensors[i];
+  delaysensors.clear();
+
+  numtriggered = numoutoforder = 0;
+  lastkey = -1.0;
+  lastindex = -1;
+
+  // Trigger times are all in the past, so that processTimerQueue()
+  // handles every sensor.
+  const SbTime base = SbTime::getTimeOfDay() - SbTime(double(numkeys + 1));
+  std::vector<SoAlarmSensor *> timersensors(num);
+  for (int i = 0; i < num; i++) {
+    timersensors[i] = new SoAlarmSensor(timer_cb, reinterpret_cast<void *>(static_cast<size_t>(i)));
+    timersensors[i]->setTime(base + SbTime(double((i * 7919) % numkeys)));
+  }
+
+  start = SbTime::getTimeOfDay();
+  for (int i = 0; i < num; i++) timersensors[i]->schedule();
+  printf("timer queue: schedule %d sensors:   %8.3f s\n", num, seconds_since(start));
+
+  start = SbTime::getTimeOfDay();
+  for (int i = 0; i < num; i += 2) timersensors[i]->unschedule();
+  printf("timer queue: unschedule %d sensors: %8.3f s\n", num / 2, seconds_since(start));
+
+  start = SbTime::getTimeOfDay();
+  sm->processTimerQueue();
+  printf("timer queue: process %d sensors:    %8.3f s\n", numtriggered, seconds_since(start));
+
+  printf("timer queue: %d triggered, %d out of order\n", numtriggered, numoutoforder);
+  for (int i = 0; i < num; i++) delete timersensors[i];
+
+  return 0;
+}